@@ -20,6 +20,7 @@
  * along with this program. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _GNU_SOURCE
 #include <gtk/gtk.h>
 #include <vte/vte.h>
 #include <stdlib.h>
@@ -28,7 +29,12 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <sys/utsname.h>
 #include <pango/pango.h>
+#include <zstd.h>
 #if defined(GDK_WINDOWING_X11)
 #include <gdk/gdkx.h>
 #endif
@@ -150,6 +156,17 @@ void on_smartctl_activate(GtkWidget *menuitem, gpointer user_data);
 void on_disk_read_benchmark_activate(GtkWidget *menuitem, gpointer user_data);
 void on_disk_file_write_benchmark_activate(GtkWidget *menuitem, gpointer user_data);
 void on_disk_raw_write_benchmark_activate(GtkWidget *button, gpointer user_data);
+void on_free_space_write_benchmark_clicked(GtkWidget *button, gpointer user_data);
+void on_free_space_workload_clicked(GtkWidget *button, gpointer user_data);
+void on_mixed_workload_activate(GtkWidget *menuitem, gpointer user_data);
+void on_free_space_trace_replay_clicked(GtkWidget *button, gpointer user_data);
+void on_trace_replay_activate(GtkWidget *menuitem, gpointer user_data);
+void on_fs_metadata_benchmark_activate(GtkWidget *menuitem, gpointer user_data);
+void on_commit_latency_benchmark_activate(GtkWidget *menuitem, gpointer user_data);
+void on_read_path_comparison_activate(GtkWidget *menuitem, gpointer user_data);
+void on_queue_tuning_activate(GtkWidget *menuitem, gpointer user_data);
+void on_benchmark_results_activate(GtkWidget *menuitem, gpointer user_data);
+void on_io_budget_activate(GtkWidget *menuitem, gpointer user_data);
 void on_auto_fsck_activate(GtkWidget *menuitem, gpointer user_data);
 void on_e2fsck_activate(GtkWidget *menuitem, gpointer user_data);
 void on_ext_repair_deep_activate(GtkWidget *menuitem, gpointer user_data);
@@ -159,6 +176,7 @@ void on_ntfsresize_activate(GtkWidget *menuitem, gpointer user_data);
 void on_diskscan_activate(GtkWidget *menuitem, gpointer user_data);
 void on_mount_activate(GtkWidget *menuitem, gpointer user_data);
 void on_umount_activate(GtkWidget *menuitem, gpointer user_data);
+void on_mount_profile_compare_activate(GtkWidget *menuitem, gpointer user_data);
 void on_umount_f_activate(GtkWidget *menuitem, gpointer user_data);
 void on_umount_l_activate(GtkWidget *menuitem, gpointer user_data);
 void on_rename_partition_activate(GtkWidget *menuitem, gpointer user_data);
@@ -168,8 +186,15 @@ void on_resize_partition_activate(GtkWidget *menuitem, gpointer user_data);
 void on_grub_uefi_install_activate(GtkWidget *menuitem, gpointer user_data);
 void on_grub_mbr_install_activate(GtkWidget *menuitem, gpointer user_data);
 void on_toggle_boot_flag_activate(GtkWidget *menuitem, gpointer user_data);
+void on_fstrim_activate(GtkWidget *menuitem, gpointer user_data);
 void on_dd_copy_partition_activate(GtkWidget *menuitem, gpointer user_data);
 void on_dd_restore_partition_activate(GtkWidget *menuitem, gpointer user_data);
+void on_resume_image_job_activate(GtkWidget *menuitem, gpointer user_data);
+void on_verify_image_activate(GtkWidget *menuitem, gpointer user_data);
+void on_clone_device_activate(GtkWidget *menuitem, gpointer user_data);
+void on_fanout_restore_activate(GtkWidget *menuitem, gpointer user_data);
+void on_rescue_image_activate(GtkWidget *menuitem, gpointer user_data);
+void on_rescue_map_activate(GtkWidget *menuitem, gpointer user_data);
 void on_delete_partition_table_activate(GtkWidget *menuitem, gpointer user_data);
 void on_delete_partition_activate(GtkWidget *menuitem, gpointer user_data);
 void on_shred_fs_activate(GtkWidget *menuitem, gpointer user_data);
@@ -342,6 +367,7 @@ static gchar *get_base_device(const gchar *dev) {
         gchar *p = g_strrstr(dev, "p");
         if (p && isdigit(*(p+1))) return g_strndup(dev, p - dev);
     }
+    if (g_str_has_prefix(dev, "nvme") || g_str_has_prefix(dev, "mmcblk")) return g_strdup(dev);
     for (const char *p = dev; *p; ++p) {
         if (isdigit(*p)) return g_strndup(dev, p - dev);
     }
@@ -660,6 +686,27 @@ void on_show_disk_areas_activate(GtkWidget *menuitem, gpointer user_data) {
             g_object_set_data(G_OBJECT(create_fs_btn), "disk_areas_window", window);
             g_signal_connect(create_fs_btn, "clicked", G_CALLBACK(on_create_fs_clicked), tree);
 
+            GtkWidget *free_bench_btn = gtk_button_new_with_label("Write Speed Test on Selected Free Space (fio)");
+            gtk_box_pack_start(GTK_BOX(box), free_bench_btn, FALSE, FALSE, 0);
+
+            g_object_set_data(G_OBJECT(free_bench_btn), "disk_path", g_strdup(device_path));
+            g_object_set_data(G_OBJECT(free_bench_btn), "main_tree_view", tree_view);
+            g_signal_connect(free_bench_btn, "clicked", G_CALLBACK(on_free_space_write_benchmark_clicked), tree);
+
+            GtkWidget *free_workload_btn = gtk_button_new_with_label("Mixed Workload Test on Selected Free Space (fio)");
+            gtk_box_pack_start(GTK_BOX(box), free_workload_btn, FALSE, FALSE, 0);
+
+            g_object_set_data(G_OBJECT(free_workload_btn), "disk_path", g_strdup(device_path));
+            g_object_set_data(G_OBJECT(free_workload_btn), "main_tree_view", tree_view);
+            g_signal_connect(free_workload_btn, "clicked", G_CALLBACK(on_free_space_workload_clicked), tree);
+
+            GtkWidget *free_replay_btn = gtk_button_new_with_label("Replay I/O Trace on Selected Free Space (fio)");
+            gtk_box_pack_start(GTK_BOX(box), free_replay_btn, FALSE, FALSE, 0);
+
+            g_object_set_data(G_OBJECT(free_replay_btn), "disk_path", g_strdup(device_path));
+            g_object_set_data(G_OBJECT(free_replay_btn), "main_tree_view", tree_view);
+            g_signal_connect(free_replay_btn, "clicked", G_CALLBACK(on_free_space_trace_replay_clicked), tree);
+
             gtk_widget_show_all(window);
         }
 
@@ -1453,6 +1500,420 @@ static void on_benchmark_gib_changed(GtkEditable *editable, gpointer user_data)
     widgets->updating = FALSE;
 }
 
+typedef struct {
+    gchar *id;
+    gchar *time;
+    gchar *test;
+    gchar *kind;
+    gchar *device;
+    gchar *model;
+    gchar *serial;
+    gchar *firmware;
+    gchar *kernel;
+    gchar *parameters;
+    gboolean complete;
+    double read_mib_s, read_iops, read_lat_us, read_p50_us, read_p99_us, read_p999_us;
+    double write_mib_s, write_iops, write_lat_us, write_p50_us, write_p99_us, write_p999_us;
+    double lat_hist[22];
+    double meta_rate[7];
+} BenchmarkRun;
+
+static const char *benchmark_hist_labels[22] = {
+    "<=2us", "4us", "10us", "20us", "50us", "100us", "250us", "500us", "750us", "1ms",
+    "2ms", "4ms", "10ms", "20ms", "50ms", "100ms", "250ms", "500ms", "750ms", "1s", "2s", ">2s"
+};
+
+/* Operations per second of the metadata benchmark, reported as "meta;<name>;<rate>" lines. */
+static const char *benchmark_meta_names[7] = {
+    "create", "stat", "warm_scan", "cold_scan", "stat_scan", "rename", "unlink"
+};
+
+static const char *benchmark_meta_labels[7] = {
+    "Create files/s", "Stat files/s", "Warm scan entries/s", "Cold scan entries/s",
+    "Scan+stat entries/s", "Rename files/s", "Unlink files/s"
+};
+
+static gchar *get_partition_mountpoint(const gchar *device_path) {
+    gchar *cmd = g_strdup_printf("lsblk -no MOUNTPOINT %s 2>/dev/null | head -1", device_path);
+    FILE *fp = popen(cmd, "r");
+    char buf[1024] = "";
+    gchar *mountpoint = NULL;
+    if (fp && fgets(buf, sizeof(buf), fp)) {
+        buf[strcspn(buf, "\n")] = '\0';
+        if (strlen(buf) > 0 && buf[0] == '/') mountpoint = g_strdup(buf);
+    }
+    if (fp) pclose(fp);
+    g_free(cmd);
+    return mountpoint;
+}
+
+static gchar *read_sysfs_block_attr(const gchar *disk_name, const gchar *attr) {
+    gchar *path = g_strdup_printf("/sys/block/%s/%s", disk_name, attr);
+    gchar *contents = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) {
+        g_free(path);
+        return NULL;
+    }
+    g_free(path);
+    g_strstrip(contents);
+    return contents;
+}
+
+static gchar *get_benchmark_store_dir(void) {
+    gchar *dir = g_build_filename(g_get_user_data_dir(), "DriveAssistify", "benchmarks", NULL);
+    g_mkdir_with_parents(dir, 0700);
+    return dir;
+}
+
+/* Records who/what/where for a benchmark run and returns the file its output must be appended to. */
+static gchar *benchmark_store_begin(const gchar *test, const gchar *kind, const gchar *device_path, const gchar *parameters) {
+    gchar *dev_name = g_path_get_basename(device_path);
+    gchar *disk_name = get_base_device(dev_name);
+
+    gchar *model = read_sysfs_block_attr(disk_name, "device/model");
+    gchar *serial = read_sysfs_block_attr(disk_name, "device/serial");
+    gchar *firmware = read_sysfs_block_attr(disk_name, "device/firmware_rev");
+    if (!firmware) firmware = read_sysfs_block_attr(disk_name, "device/rev");
+    if (!serial) {
+        gchar *serial_cmd = g_strdup_printf("lsblk -dno SERIAL /dev/%s 2>/dev/null", disk_name);
+        FILE *fp = popen(serial_cmd, "r");
+        char buf[128] = "";
+        if (fp && fgets(buf, sizeof(buf), fp) && strlen(g_strstrip(buf)) > 0)
+            serial = g_strdup(buf);
+        if (fp) pclose(fp);
+        g_free(serial_cmd);
+    }
+
+    struct utsname uts;
+    const gchar *kernel = uname(&uts) == 0 ? uts.release : "unknown";
+
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    gchar *time_text = g_date_time_format(now, "%Y-%m-%d %H:%M:%S");
+    g_date_time_unref(now);
+
+    gchar *id = g_strdup_printf("%s-%06d-%s", stamp, (int)(g_get_real_time() % 1000000), dev_name);
+    gchar *dir = get_benchmark_store_dir();
+    gchar *ini_name = g_strdup_printf("%s.ini", id);
+    gchar *out_name = g_strdup_printf("%s.out", id);
+    gchar *ini_path = g_build_filename(dir, ini_name, NULL);
+    gchar *out_path = g_build_filename(dir, out_name, NULL);
+
+    GKeyFile *kf = g_key_file_new();
+    g_key_file_set_string(kf, "Run", "Id", id);
+    g_key_file_set_string(kf, "Run", "Time", time_text);
+    g_key_file_set_string(kf, "Run", "Test", test);
+    g_key_file_set_string(kf, "Run", "Kind", kind);
+    g_key_file_set_string(kf, "Run", "Device", device_path);
+    g_key_file_set_string(kf, "Run", "Model", model ? model : "N/A");
+    g_key_file_set_string(kf, "Run", "Serial", serial ? serial : "N/A");
+    g_key_file_set_string(kf, "Run", "Firmware", firmware ? firmware : "N/A");
+    g_key_file_set_string(kf, "Run", "Kernel", kernel);
+    g_key_file_set_string(kf, "Run", "Parameters", parameters);
+    g_key_file_set_string(kf, "Run", "Output", out_name);
+
+    GError *error = NULL;
+    if (!g_key_file_save_to_file(kf, ini_path, &error)) {
+        g_warning("Failed to save benchmark record: %s", error->message);
+        g_clear_error(&error);
+        g_free(out_path);
+        out_path = NULL;
+    }
+    g_key_file_free(kf);
+
+    g_free(ini_path); g_free(out_name); g_free(ini_name); g_free(dir); g_free(id);
+    g_free(time_text); g_free(stamp);
+    g_free(model); g_free(serial); g_free(firmware);
+    g_free(disk_name); g_free(dev_name);
+    return out_path;
+}
+
+/* Shell suffix that keeps the output of a benchmark command in the store while it is shown in the terminal. */
+static gchar *benchmark_store_tee(const gchar *out_path) {
+    if (!out_path) return g_strdup("");
+    gchar *quoted = g_shell_quote(out_path);
+    gchar *suffix = g_strdup_printf(" 2>&1 | tee -a %s", quoted);
+    g_free(quoted);
+    return suffix;
+}
+
+/* Evicts only the target's cached pages: BLKFLSBUF for a block device, fsync plus POSIX_FADV_DONTNEED for a file. */
+static gchar *build_target_cache_evict_command(const gchar *target, gboolean is_device) {
+    gchar *quoted = g_shell_quote(target);
+    gchar *cmd = is_device
+        ? g_strdup_printf("sudo blockdev --flushbufs %s", quoted)
+        : g_strdup_printf("sudo sync %s && sudo dd if=%s iflag=nocache count=0 status=none", quoted, quoted);
+    g_free(quoted);
+    return cmd;
+}
+
+static void parse_fio_terse_ddir(gchar **fields, int base, double *mib_s, double *iops, double *lat_us,
+                                 double *p50, double *p99, double *p999) {
+    *mib_s = g_ascii_strtod(fields[base + 1], NULL) / 1024.0;
+    *iops = g_ascii_strtod(fields[base + 2], NULL);
+    *lat_us = g_ascii_strtod(fields[base + 34], NULL);
+    for (int i = 0; i < 20; i++) {
+        const gchar *f = fields[base + 12 + i];
+        const gchar *eq = strchr(f, '=');
+        if (!eq) continue;
+        double pct = g_ascii_strtod(f, NULL);
+        double val = g_ascii_strtod(eq + 1, NULL);
+        if (ABS(pct - 50.0) < 0.001) *p50 = val;
+        else if (ABS(pct - 99.0) < 0.001) *p99 = val;
+        else if (ABS(pct - 99.9) < 0.001) *p999 = val;
+    }
+}
+
+/* fio terse v3: 5 header fields, 41 per direction (read, write), 5 CPU, 7 depth, 10 usec + 12 msec buckets. */
+static gboolean parse_fio_terse_line(BenchmarkRun *run, const gchar *line) {
+    gchar **fields = g_strsplit(line, ";", -1);
+    if (g_strv_length(fields) < 121 || g_strcmp0(fields[0], "3") != 0) {
+        g_strfreev(fields);
+        return FALSE;
+    }
+    parse_fio_terse_ddir(fields, 5, &run->read_mib_s, &run->read_iops, &run->read_lat_us,
+                         &run->read_p50_us, &run->read_p99_us, &run->read_p999_us);
+    parse_fio_terse_ddir(fields, 46, &run->write_mib_s, &run->write_iops, &run->write_lat_us,
+                         &run->write_p50_us, &run->write_p99_us, &run->write_p999_us);
+    for (int i = 0; i < 22; i++)
+        run->lat_hist[i] = g_ascii_strtod(fields[99 + i], NULL);
+    g_strfreev(fields);
+    return TRUE;
+}
+
+/* dd summary: "<bytes> bytes (...) copied, <seconds> s, <rate>" (run with LC_ALL=C). */
+static gboolean parse_dd_output(BenchmarkRun *run, const gchar *text) {
+    const gchar *copied = g_strrstr(text, " copied, ");
+    if (!copied) return FALSE;
+    const gchar *line = copied;
+    while (line > text && line[-1] != '\n' && line[-1] != '\r') line--;
+    long long bytes = g_ascii_strtoll(line, NULL, 10);
+    double seconds = g_ascii_strtod(copied + strlen(" copied, "), NULL);
+    if (bytes <= 0 || seconds <= 0) return FALSE;
+    double mib_s = (double)bytes / 1048576.0 / seconds;
+    if (g_strcmp0(run->kind, "dd-write") == 0) run->write_mib_s = mib_s;
+    else run->read_mib_s = mib_s;
+    return TRUE;
+}
+
+/* "meta;<name>;<rate>" from build_rate_report_command. */
+static void parse_meta_rate_line(BenchmarkRun *run, const gchar *line) {
+    gchar **fields = g_strsplit(line, ";", -1);
+    if (g_strv_length(fields) == 3) {
+        for (int i = 0; i < 7; i++) {
+            if (g_strcmp0(fields[1], benchmark_meta_names[i]) == 0)
+                run->meta_rate[i] = g_ascii_strtod(fields[2], NULL);
+        }
+    }
+    g_strfreev(fields);
+}
+
+static void benchmark_run_free(gpointer data) {
+    BenchmarkRun *run = data;
+    g_free(run->id); g_free(run->time); g_free(run->test); g_free(run->kind);
+    g_free(run->device); g_free(run->model); g_free(run->serial);
+    g_free(run->firmware); g_free(run->kernel); g_free(run->parameters);
+    g_free(run);
+}
+
+static BenchmarkRun *benchmark_run_load(const gchar *dir, const gchar *ini_name) {
+    gchar *ini_path = g_build_filename(dir, ini_name, NULL);
+    GKeyFile *kf = g_key_file_new();
+    if (!g_key_file_load_from_file(kf, ini_path, G_KEY_FILE_NONE, NULL)) {
+        g_key_file_free(kf);
+        g_free(ini_path);
+        return NULL;
+    }
+
+    BenchmarkRun *run = g_new0(BenchmarkRun, 1);
+    run->id = g_key_file_get_string(kf, "Run", "Id", NULL);
+    run->time = g_key_file_get_string(kf, "Run", "Time", NULL);
+    run->test = g_key_file_get_string(kf, "Run", "Test", NULL);
+    run->kind = g_key_file_get_string(kf, "Run", "Kind", NULL);
+    run->device = g_key_file_get_string(kf, "Run", "Device", NULL);
+    run->model = g_key_file_get_string(kf, "Run", "Model", NULL);
+    run->serial = g_key_file_get_string(kf, "Run", "Serial", NULL);
+    run->firmware = g_key_file_get_string(kf, "Run", "Firmware", NULL);
+    run->kernel = g_key_file_get_string(kf, "Run", "Kernel", NULL);
+    run->parameters = g_key_file_get_string(kf, "Run", "Parameters", NULL);
+    gchar *out_name = g_key_file_get_string(kf, "Run", "Output", NULL);
+    g_key_file_free(kf);
+
+    if (!run->id) {
+        benchmark_run_free(run);
+        g_free(out_name);
+        g_free(ini_path);
+        return NULL;
+    }
+
+    gchar *out_path = out_name ? g_build_filename(dir, out_name, NULL) : NULL;
+    gchar *output = NULL;
+    if (out_path && g_file_get_contents(out_path, &output, NULL, NULL)) {
+        if (g_str_has_prefix(run->kind, "dd-")) {
+            run->complete = parse_dd_output(run, output);
+        } else {
+            gchar **lines = g_strsplit_set(output, "\r\n", -1);
+            for (int i = 0; lines[i]; i++) {
+                if (!run->complete && g_str_has_prefix(lines[i], "3;"))
+                    run->complete = parse_fio_terse_line(run, lines[i]);
+                else if (g_str_has_prefix(lines[i], "meta;"))
+                    parse_meta_rate_line(run, lines[i]);
+            }
+            g_strfreev(lines);
+        }
+        g_free(output);
+    }
+
+    g_free(out_path);
+    g_free(out_name);
+    g_free(ini_path);
+    return run;
+}
+
+static gint compare_benchmark_runs(gconstpointer a, gconstpointer b) {
+    const BenchmarkRun *ra = *(BenchmarkRun * const *)a;
+    const BenchmarkRun *rb = *(BenchmarkRun * const *)b;
+    return g_strcmp0(ra->id, rb->id);
+}
+
+static GPtrArray *benchmark_store_load_all(void) {
+    GPtrArray *runs = g_ptr_array_new_with_free_func(benchmark_run_free);
+    gchar *dir = get_benchmark_store_dir();
+    GDir *d = g_dir_open(dir, 0, NULL);
+    if (d) {
+        const gchar *name;
+        while ((name = g_dir_read_name(d))) {
+            if (!g_str_has_suffix(name, ".ini")) continue;
+            BenchmarkRun *run = benchmark_run_load(dir, name);
+            if (run) g_ptr_array_add(runs, run);
+        }
+        g_dir_close(d);
+    }
+    g_ptr_array_sort(runs, compare_benchmark_runs);
+    g_free(dir);
+    return runs;
+}
+
+typedef struct {
+    int node;
+    gchar *local_cpus;
+    int remote_node;
+    gchar *remote_cpus;
+    gchar *irqs;
+} DevicePlacement;
+
+static gchar *read_numa_node_cpulist(int node) {
+    gchar *path = g_strdup_printf("/sys/devices/system/node/node%d/cpulist", node);
+    gchar *contents = NULL;
+    if (g_file_get_contents(path, &contents, NULL, NULL)) g_strstrip(contents);
+    g_free(path);
+    return contents;
+}
+
+/* Finds the device's NUMA node, the CPUs of that node and of another node, and the IRQs of its PCI function. */
+static void get_device_placement(const gchar *device_path, DevicePlacement *pl) {
+    pl->node = -1;
+    pl->remote_node = -1;
+    pl->local_cpus = pl->remote_cpus = pl->irqs = NULL;
+
+    gchar *dev_name = g_path_get_basename(device_path);
+    gchar *disk_name = get_base_device(dev_name);
+    gchar *link = g_strdup_printf("/sys/block/%s/device", disk_name);
+    char *resolved = realpath(link, NULL);
+    g_free(link);
+    g_free(disk_name);
+    g_free(dev_name);
+
+    gchar *dir = resolved ? g_strdup(resolved) : NULL;
+    free(resolved);
+    while (dir && g_str_has_prefix(dir, "/sys/devices/") && (pl->node < 0 || !pl->irqs)) {
+        gchar *numa_path = g_build_filename(dir, "numa_node", NULL);
+        gchar *numa_text = NULL;
+        if (pl->node < 0 && g_file_get_contents(numa_path, &numa_text, NULL, NULL))
+            pl->node = atoi(numa_text);
+        g_free(numa_text);
+        g_free(numa_path);
+
+        gchar *msi_path = g_build_filename(dir, "msi_irqs", NULL);
+        GDir *msi_dir = pl->irqs ? NULL : g_dir_open(msi_path, 0, NULL);
+        if (msi_dir) {
+            GString *irqs = g_string_new(" ");
+            const gchar *entry;
+            while ((entry = g_dir_read_name(msi_dir)) != NULL)
+                g_string_append_printf(irqs, "%s ", entry);
+            g_dir_close(msi_dir);
+            pl->irqs = g_string_free(irqs, FALSE);
+        }
+        g_free(msi_path);
+
+        gchar *parent = g_path_get_dirname(dir);
+        g_free(dir);
+        dir = parent;
+    }
+    g_free(dir);
+
+    if (pl->node < 0) return;
+    pl->local_cpus = read_numa_node_cpulist(pl->node);
+    for (int n = 0; n < 64 && pl->remote_node < 0; n++) {
+        if (n == pl->node) continue;
+        gchar *cpus = read_numa_node_cpulist(n);
+        if (cpus && strlen(cpus) > 0) {
+            pl->remote_node = n;
+            pl->remote_cpus = cpus;
+        } else {
+            g_free(cpus);
+        }
+    }
+}
+
+static void free_device_placement(DevicePlacement *pl) {
+    g_free(pl->local_cpus);
+    g_free(pl->remote_cpus);
+    g_free(pl->irqs);
+}
+
+/* Wraps a command so the per-CPU interrupt counts of the device's IRQs during the run are printed afterwards. */
+static gchar *build_irq_report_command(const gchar *inner_cmd, const gchar *irqs, const gchar *tee) {
+    if (!irqs) return g_strdup_printf("%s; echo 'No MSI interrupts found for this device, IRQ placement not reported.'", inner_cmd);
+    gchar *cmd = g_strdup_printf(
+        "irq_dir=$(mktemp -d); cat /proc/interrupts > \"$irq_dir/before\"; %s; "
+        "cat /proc/interrupts > \"$irq_dir/after\"; "
+        "awk -v irqs='%s' 'FNR == 1 { ncpu = NF; next } "
+        "{ irq = $1; sub(\":\", \"\", irq); if (index(irqs, \" \" irq \" \") == 0) next; "
+        "for (i = 2; i <= ncpu + 1; i++) { if (NR == FNR) b[irq, i] = $i; else d[i - 2] += $i - b[irq, i] } } "
+        "END { print \"\"; print \"Device interrupts served per CPU during the run:\"; any = 0; "
+        "for (c = 0; c < ncpu; c++) if (d[c] > 0) { print \"  CPU\" c \": \" d[c]; any = 1 } "
+        "if (!any) print \"  none\" }' \"$irq_dir/before\" \"$irq_dir/after\"%s; rm -rf \"$irq_dir\"",
+        inner_cmd, irqs, tee);
+    return cmd;
+}
+
+enum { PLACEMENT_ANY, PLACEMENT_LOCAL, PLACEMENT_REMOTE, PLACEMENT_AB, PLACEMENT_CUSTOM };
+
+/* One dd read run, optionally pinned with taskset, recorded in the benchmark store and followed by the IRQ report. */
+static gchar *build_placed_read_command(const gchar *device_path, long long test_size_mib,
+                                        const gchar *cpus, const gchar *label, const gchar *irqs) {
+    gchar *params = g_strdup_printf("size=%lld MiB, bs=1M, iflag=direct, cpus=%s", test_size_mib, cpus ? cpus : "any");
+    gchar *test = label ? g_strdup_printf("Sequential Read (dd) [%s]", label) : g_strdup("Sequential Read (dd)");
+    gchar *out_path = benchmark_store_begin(test, "dd-read", device_path, params);
+    gchar *tee = benchmark_store_tee(out_path);
+    gchar *evict = build_target_cache_evict_command(device_path, TRUE);
+    gchar *pin = cpus ? g_strdup_printf("taskset -c %s ", cpus) : g_strdup("");
+    gchar *inner = g_strdup_printf(
+        "%s && echo 'Reading on CPUs: %s' && "
+        "LC_ALL=C %sdd if=%s of=/dev/null bs=1M count=%lld status=progress iflag=direct%s",
+        evict, cpus ? cpus : "any", pin, device_path, test_size_mib, tee);
+    gchar *cmd = build_irq_report_command(inner, irqs, tee);
+    g_free(inner);
+    g_free(pin);
+    g_free(evict);
+    g_free(tee);
+    g_free(out_path);
+    g_free(test);
+    g_free(params);
+    return cmd;
+}
+
 void on_disk_read_benchmark_activate(GtkWidget *menuitem, gpointer user_data) {
     GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
     GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
@@ -1514,6 +1975,37 @@ void on_disk_read_benchmark_activate(GtkWidget *menuitem, gpointer user_data) {
     gtk_box_pack_start(GTK_BOX(content_area), entry_gib, FALSE, FALSE, 2);
     gtk_box_pack_start(GTK_BOX(content_area), label_info, FALSE, FALSE, 5);
 
+    DevicePlacement placement;
+    get_device_placement(device_path, &placement);
+    int placement_kinds[5];
+    int placement_count = 0;
+    GtkWidget *placement_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(placement_combo), "Any CPU (no pinning)");
+    placement_kinds[placement_count++] = PLACEMENT_ANY;
+    if (placement.local_cpus) {
+        gchar *text = g_strdup_printf("Local NUMA node %d (CPUs %s)", placement.node, placement.local_cpus);
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(placement_combo), text);
+        placement_kinds[placement_count++] = PLACEMENT_LOCAL;
+        g_free(text);
+    }
+    if (placement.remote_cpus) {
+        gchar *text = g_strdup_printf("Remote NUMA node %d (CPUs %s)", placement.remote_node, placement.remote_cpus);
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(placement_combo), text);
+        placement_kinds[placement_count++] = PLACEMENT_REMOTE;
+        g_free(text);
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(placement_combo), "A/B: local node, then remote node");
+        placement_kinds[placement_count++] = PLACEMENT_AB;
+    }
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(placement_combo), "Custom CPU list (below)");
+    placement_kinds[placement_count++] = PLACEMENT_CUSTOM;
+    gtk_combo_box_set_active(GTK_COMBO_BOX(placement_combo), placement.local_cpus ? 1 : 0);
+    GtkWidget *cpus_entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(cpus_entry), placement.local_cpus ? placement.local_cpus : "0");
+
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("CPU placement of the reader:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), placement_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), cpus_entry, FALSE, FALSE, 2);
+
     BenchmarkSizeWidgets *widgets = g_new0(BenchmarkSizeWidgets, 1);
     widgets->entry_bytes = entry_bytes;
     widgets->entry_mib = entry_mib;
@@ -1536,11 +2028,24 @@ void on_disk_read_benchmark_activate(GtkWidget *menuitem, gpointer user_data) {
         test_size_mib = atoll(mib_text);
         if (test_size_mib <= 0) test_size_mib = 8192;
     }
+    int placement_index = gtk_combo_box_get_active(GTK_COMBO_BOX(placement_combo));
+    int placement_kind = placement_index >= 0 ? placement_kinds[placement_index] : PLACEMENT_ANY;
+    gchar *custom_cpus = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(cpus_entry))));
 
     g_free(widgets);
     gtk_widget_destroy(size_dialog);
 
+    if (size_response == GTK_RESPONSE_ACCEPT && placement_kind == PLACEMENT_CUSTOM &&
+        !g_regex_match_simple("^[0-9]+(-[0-9]+)?(,[0-9]+(-[0-9]+)?)*$", custom_cpus, 0, 0)) {
+        GtkWidget *err = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
+            GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, "Invalid CPU list: %s\n\nUse a list like 0-7,16-23.", custom_cpus);
+        gtk_dialog_run(GTK_DIALOG(err)); gtk_widget_destroy(err);
+        size_response = GTK_RESPONSE_CANCEL;
+    }
+
     if (size_response != GTK_RESPONSE_ACCEPT) {
+        g_free(custom_cpus);
+        free_device_placement(&placement);
         g_free(device_path);
         g_free(partition_name);
         return;
@@ -1551,9 +2056,10 @@ void on_disk_read_benchmark_activate(GtkWidget *menuitem, gpointer user_data) {
         "Disk Read Benchmark (safe)\n\n"
         "Device: %s\n"
         "Test size: %lld GiB (%lld MiB)\n"
-        "Operation: Sequential read\n\n"
+        "Operation: Sequential read%s\n\n"
         "This test only reads data – safe operation.",
-        device_path, test_size_gib_display, test_size_mib
+        device_path, test_size_gib_display, test_size_mib,
+        placement_kind == PLACEMENT_AB ? " (twice: local NUMA node, then remote)" : ""
     );
 
     GtkWidget *confirm_dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
@@ -1563,15 +2069,38 @@ void on_disk_read_benchmark_activate(GtkWidget *menuitem, gpointer user_data) {
     g_free(confirm_text);
 
     if (response == GTK_RESPONSE_YES) {
-        gchar *cmd = g_strdup_printf(
-            "sudo sh -c \"echo 3 > /proc/sys/vm/drop_caches\" && "
-            "dd if=%s of=/dev/null bs=1M count=%lld status=progress iflag=direct",
-            device_path, test_size_mib
-        );
+        gchar *cmd = NULL;
+        gchar *local_label = g_strdup_printf("local node %d", placement.node);
+        gchar *remote_label = g_strdup_printf("remote node %d", placement.remote_node);
+        if (placement_kind == PLACEMENT_LOCAL) {
+            cmd = build_placed_read_command(device_path, test_size_mib, placement.local_cpus, local_label, placement.irqs);
+        } else if (placement_kind == PLACEMENT_REMOTE) {
+            cmd = build_placed_read_command(device_path, test_size_mib, placement.remote_cpus, remote_label, placement.irqs);
+        } else if (placement_kind == PLACEMENT_AB) {
+            gchar *run_a = build_placed_read_command(device_path, test_size_mib, placement.local_cpus, local_label, placement.irqs);
+            gchar *run_b = build_placed_read_command(device_path, test_size_mib, placement.remote_cpus, remote_label, placement.irqs);
+            cmd = g_strdup_printf(
+                "echo '=== A: %s ==='; %s; echo; echo '=== B: %s ==='; %s; echo; "
+                "echo 'Both runs are saved. Compare them in File > Benchmark Results and Comparison.'",
+                local_label, run_a, remote_label, run_b);
+            g_free(run_b);
+            g_free(run_a);
+        } else if (placement_kind == PLACEMENT_CUSTOM) {
+            gchar *label = g_strdup_printf("CPUs %s", custom_cpus);
+            cmd = build_placed_read_command(device_path, test_size_mib, custom_cpus, label, placement.irqs);
+            g_free(label);
+        } else {
+            cmd = build_placed_read_command(device_path, test_size_mib, NULL, NULL, placement.irqs);
+        }
         run_command_in_terminal(tree_view, cmd);
         g_free(cmd);
+        g_free(remote_label);
+        g_free(local_label);
     }
 
+    g_free(custom_cpus);
+    free_device_placement(&placement);
+
     g_free(device_path);
     g_free(partition_name);
 }
@@ -1633,7 +2162,8 @@ void on_disk_file_write_benchmark_activate(GtkWidget *menuitem, gpointer user_da
         "Operation: Sequential file write (safe)\n"
         "Default test size: 8 GiB\n\n"
         "Enter test size below:\n"
-        "(File will be created in home folder and auto-deleted)",  // ✅ Змінено /tmp → home
+        "(File will be created on the partition if it is mounted,\n"
+        "otherwise in home folder, and auto-deleted)",
         device_path
     );
     gtk_label_set_text(GTK_LABEL(info_label), info_text);
@@ -1685,7 +2215,13 @@ void on_disk_file_write_benchmark_activate(GtkWidget *menuitem, gpointer user_da
         return;
     }
 
-    FILE *space_fp = popen("df --output=avail $HOME | tail -1 | tr -d ' '", "r");
+    gchar *mountpoint = get_partition_mountpoint(device_path);
+    const gchar *test_dir = mountpoint ? mountpoint : g_get_home_dir();
+    gchar *quoted_dir = g_shell_quote(test_dir);
+    gchar *df_cmd = g_strdup_printf("df --output=avail %s | tail -1 | tr -d ' '", quoted_dir);
+    FILE *space_fp = popen(df_cmd, "r");
+    g_free(df_cmd);
+    g_free(quoted_dir);
     gchar space_buf[16] = {0};
     long long free_kb = 0;
     if (space_fp) {
@@ -1699,18 +2235,21 @@ void on_disk_file_write_benchmark_activate(GtkWidget *menuitem, gpointer user_da
     if (free_kb < required_kb) {
         GtkWidget *warn = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
             GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
-            "ERROR: Insufficient space in home folder!\n\n"
+            "ERROR: Insufficient space in %s!\n\n"
             "Required: %.1f GiB\n"
             "Please free up space or use Raw Write test.",
-            (double)test_size_mib / 1024
+            test_dir, (double)test_size_mib / 1024
         );
         gtk_dialog_run(GTK_DIALOG(warn)); gtk_widget_destroy(warn);
+        g_free(mountpoint);
         g_free(device_path);
         g_free(partition_name);
         return;
     }
 
-    gchar *test_file = g_strdup_printf("$HOME/benchmark-%s.dat", partition_name);
+    gchar *test_name = g_strdup_printf("benchmark-%s.dat", partition_name);
+    gchar *test_file = g_build_filename(test_dir, test_name, NULL);
+    g_free(test_name);
     
     long long test_size_gib_display = test_size_mib / 1024;
     gchar *size_display = g_strdup_printf("%lld MiB (%.2f GiB)", test_size_mib, (double)test_size_gib_display);
@@ -1719,10 +2258,10 @@ void on_disk_file_write_benchmark_activate(GtkWidget *menuitem, gpointer user_da
         "Device: %s\n"
         "Test size: %s\n"
         "Test file: %s\n\n"
-        "This test creates temporary file in home folder\n"
+        "This test creates temporary file in %s\n"
         "File will be automatically deleted after test!\n"
         "It's a safe operation.",
-        device_path, size_display, test_file
+        device_path, size_display, test_file, mountpoint ? "the partition's mount point" : "home folder (partition is not mounted)"
     );
 
     GtkWidget *dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
@@ -1731,24 +2270,100 @@ void on_disk_file_write_benchmark_activate(GtkWidget *menuitem, gpointer user_da
     gtk_widget_destroy(dialog);
 
     if (response == GTK_RESPONSE_YES) {
+        gchar *params = g_strdup_printf("size=%lld MiB, bs=1M, oflag=direct, file=%s", test_size_mib, test_file);
+        gchar *out_path = benchmark_store_begin("File Write (dd)", "dd-write", device_path, params);
+        gchar *tee = benchmark_store_tee(out_path);
+        gchar *quoted_file = g_shell_quote(test_file);
+        gchar *quoted_dir = g_shell_quote(test_dir);
+        gchar *evict = build_target_cache_evict_command(test_file, FALSE);
         gchar *cmd = g_strdup_printf(
-            "sudo sh -c \"echo 3 > /proc/sys/vm/drop_caches\" && "
-            "sync && "
-            "dd if=/dev/zero of='%s' bs=1M count=%lld status=progress oflag=direct && "
-            "sync && rm -f '%s'",
-            test_file, test_size_mib, test_file
+            "sync -f %s && "
+            "LC_ALL=C sudo dd if=/dev/zero of=%s bs=1M count=%lld status=progress oflag=direct%s && "
+            "%s && sudo rm -f %s",
+            quoted_dir, quoted_file, test_size_mib, tee, evict, quoted_file
         );
         run_command_in_terminal(tree_view, cmd);
         g_free(cmd);
+        g_free(evict);
+        g_free(quoted_dir);
+        g_free(quoted_file);
+        g_free(tee);
+        g_free(out_path);
+        g_free(params);
     }
 
     g_free(test_file);
     g_free(size_display);
     g_free(warn_text);
+    g_free(mountpoint);
     g_free(device_path);
     g_free(partition_name);
 }
 
+static gboolean check_fio_available(void) {
+    gchar *fio_path = g_find_program_in_path("fio");
+    if (!fio_path) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "fio is not installed.\n\nPlease install the 'fio' package to run this test.");
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        return FALSE;
+    }
+    g_free(fio_path);
+    return TRUE;
+}
+
+/* Sequential incompressible fio write with a per-second bandwidth log, followed by an awk pass that finds the write cliff. */
+static gchar *build_write_cliff_command(const gchar *device_path, long long size_mib, gboolean precondition,
+                                        int idle_seconds, const gchar *tee) {
+    gchar *quoted_dev = g_shell_quote(device_path);
+    gchar *fio_common = g_strdup_printf(
+        "--filename=%s --rw=write --bs=1M --size=%lldM --ioengine=libaio --iodepth=32 --direct=1 "
+        "--refill_buffers --randrepeat=0",
+        quoted_dev, size_mib);
+
+    gchar *precondition_cmd = precondition
+        ? g_strdup_printf("echo '== Preconditioning: filling the test range with incompressible data ==' && "
+                          "sudo fio --name=precondition %s && "
+                          "echo 'Idle for %d s so the drive can drain its write cache...' && sleep %d && ",
+                          fio_common, idle_seconds, idle_seconds)
+        : g_strdup("");
+
+    gchar *evict = build_target_cache_evict_command(device_path, TRUE);
+    gchar *cmd = g_strdup_printf(
+        "cliff_dir=$(mktemp -d) && %s && %s"
+        "echo '== Measured run: per-second throughput ==' && "
+        "sudo fio --name=sustained %s --write_bw_log=\"$cliff_dir/sustained\" --log_avg_msec=1000 --per_job_logs=0 "
+        "--output-format=normal,terse --terse-version=3%s && "
+        "awk -F', *' '{ t[n] = $1 / 1000; v[n] = $2 / 1024; n++ } "
+        "END { "
+        "if (n < 10) { print \"Fewer than 10 samples, run a larger test for write cliff detection.\"; exit } "
+        "w = 5; base = 0; for (i = 0; i < w; i++) base += v[i]; base /= w; cliff = -1; "
+        "for (i = w; i + w <= n; i++) { s = 0; for (j = i; j < i + w; j++) s += v[j]; "
+        "if (s / w < base * 0.6) { cliff = i; break } } "
+        "print \"\"; print \"Per-second write throughput:\"; "
+        "for (i = 0; i < n; i++) print \"  \" int(t[i] + 0.5) \" s: \" int(v[i]) \" MiB/s\" (i == cliff ? \"   <== write cache exhausted\" : \"\"); "
+        "print \"\"; "
+        "if (cliff < 0) { s = 0; for (i = 0; i < n; i++) s += v[i]; "
+        "print \"No write cliff detected: the cache is larger than the test size, or the drive has none.\"; "
+        "print \"Average write rate: \" int(s / n) \" MiB/s\" } "
+        "else { c = 0; for (i = 0; i < cliff; i++) c += v[i]; s = 0; for (i = cliff; i < n; i++) s += v[i]; "
+        "print \"Write cache exhausted after \" int(t[cliff] + 0.5) \" s and about \" int(c / 1024 * 10) / 10 \" GiB\"; "
+        "print \"Cached write rate:    \" int(c / cliff) \" MiB/s\"; "
+        "print \"Sustained write rate: \" int(s / (n - cliff)) \" MiB/s\" } }' \"$cliff_dir/sustained_bw.log\"%s; "
+        "rm -rf \"$cliff_dir\"; %s",
+        evict, precondition_cmd,
+        fio_common, tee,
+        tee, evict);
+
+    g_free(evict);
+    g_free(precondition_cmd);
+    g_free(fio_common);
+    g_free(quoted_dev);
+    return cmd;
+}
+
 void on_disk_raw_write_benchmark_activate(GtkWidget *menuitem, gpointer user_data) {
     GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
     GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
@@ -1807,6 +2422,22 @@ void on_disk_raw_write_benchmark_activate(GtkWidget *menuitem, gpointer user_dat
         gtk_box_pack_start(GTK_BOX(content_area), entry_gib, FALSE, FALSE, 2);
         gtk_box_pack_start(GTK_BOX(content_area), label_info, FALSE, FALSE, 5);
 
+        GtkWidget *mode_combo = gtk_combo_box_text_new();
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(mode_combo), "Quick (dd, zeros, single pass)");
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(mode_combo), "Steady state (fio, incompressible data, write cliff detection)");
+        gtk_combo_box_set_active(GTK_COMBO_BOX(mode_combo), 0);
+        GtkWidget *precondition_check = gtk_check_button_new_with_label(
+            "Precondition: fill the test range once before measuring (steady state only)");
+        gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(precondition_check), TRUE);
+        GtkWidget *idle_spin = gtk_spin_button_new_with_range(0, 3600, 10);
+        gtk_spin_button_set_value(GTK_SPIN_BUTTON(idle_spin), 60);
+
+        gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Test mode (for steady state, use a size larger than the drive's write cache):"), FALSE, FALSE, 2);
+        gtk_box_pack_start(GTK_BOX(content_area), mode_combo, FALSE, FALSE, 2);
+        gtk_box_pack_start(GTK_BOX(content_area), precondition_check, FALSE, FALSE, 2);
+        gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Idle time after preconditioning, lets the cache drain (seconds):"), FALSE, FALSE, 2);
+        gtk_box_pack_start(GTK_BOX(content_area), idle_spin, FALSE, FALSE, 2);
+
         BenchmarkSizeWidgets *widgets = g_new0(BenchmarkSizeWidgets, 1);
         widgets->entry_bytes = entry_bytes;
         widgets->entry_mib = entry_mib;
@@ -1829,11 +2460,14 @@ void on_disk_raw_write_benchmark_activate(GtkWidget *menuitem, gpointer user_dat
             test_size_mib = atoll(mib_text);
             if (test_size_mib <= 0) test_size_mib = 8192;
         }
+        gboolean steady_state = gtk_combo_box_get_active(GTK_COMBO_BOX(mode_combo)) == 1;
+        gboolean precondition = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(precondition_check));
+        int idle_seconds = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(idle_spin));
 
         g_free(widgets);
         gtk_widget_destroy(size_dialog);
 
-        if (size_response != GTK_RESPONSE_ACCEPT) {
+        if (size_response != GTK_RESPONSE_ACCEPT || (steady_state && !check_fio_available())) {
             g_free(device_path);
             g_free(partition_name);
             return;
@@ -1845,10 +2479,12 @@ void on_disk_raw_write_benchmark_activate(GtkWidget *menuitem, gpointer user_dat
             "WARNING: Raw Device Write (destructive)\n\n"
             "Device: %s\n"
             "Test size: %s\n"
-            "Operation: Direct write to raw device\n\n"
+            "Operation: Direct write to raw device%s\n\n"
             "THIS WILL DESTROY ALL DATA in first %lld GiB of selected device!\n\n"
             "Are you sure you want to continue?",
-            device_path, size_display, test_size_gib_display
+            device_path, size_display,
+            steady_state ? (precondition ? " (preconditioned steady state, writes the range twice)" : " (steady state)") : "",
+            test_size_gib_display
         );
 
         GtkWidget *dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
@@ -1856,16 +2492,34 @@ void on_disk_raw_write_benchmark_activate(GtkWidget *menuitem, gpointer user_dat
         gint response = gtk_dialog_run(GTK_DIALOG(dialog));
         gtk_widget_destroy(dialog);
 
-        if (response == GTK_RESPONSE_YES) {
+        if (response == GTK_RESPONSE_YES && steady_state) {
+            gchar *params = g_strdup_printf("size=%lld MiB, bs=1M, iodepth=32, direct=1, incompressible, precondition=%s, idle=%ds",
+                                            test_size_mib, precondition ? "yes" : "no", precondition ? idle_seconds : 0);
+            gchar *out_path = benchmark_store_begin("Raw Device Sustained Write (fio)", "fio", device_path, params);
+            gchar *tee = benchmark_store_tee(out_path);
+            gchar *cmd = build_write_cliff_command(device_path, test_size_mib, precondition, idle_seconds, tee);
+            run_command_in_terminal(tree_view, cmd);
+            g_free(cmd);
+            g_free(tee);
+            g_free(out_path);
+            g_free(params);
+        } else if (response == GTK_RESPONSE_YES) {
+            gchar *params = g_strdup_printf("size=%lld MiB, bs=1M, oflag=direct", test_size_mib);
+            gchar *out_path = benchmark_store_begin("Raw Device Write (dd)", "dd-write", device_path, params);
+            gchar *tee = benchmark_store_tee(out_path);
+            gchar *evict = build_target_cache_evict_command(device_path, TRUE);
             gchar *cmd = g_strdup_printf(
-                "sudo sh -c \"echo 3 > /proc/sys/vm/drop_caches\" && "
-                "sync && "
-                "dd if=/dev/zero of=%s bs=1M count=%lld status=progress oflag=direct && "
-                "sync",
-                device_path, test_size_mib
+                "%s && "
+                "LC_ALL=C dd if=/dev/zero of=%s bs=1M count=%lld status=progress oflag=direct%s && "
+                "%s",
+                evict, device_path, test_size_mib, tee, evict
             );
             run_command_in_terminal(tree_view, cmd);
             g_free(cmd);
+            g_free(evict);
+            g_free(tee);
+            g_free(out_path);
+            g_free(params);
         }
 
         g_free(size_display);
@@ -1875,2155 +2529,9041 @@ void on_disk_raw_write_benchmark_activate(GtkWidget *menuitem, gpointer user_dat
     }
 }
 
-void on_auto_fsck_activate(GtkWidget *menuitem, gpointer user_data) {
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-    GtkTreeModel *model;
+/* Looks up the exact byte range (1 MiB aligned, end exclusive) of the "Free Space" row selected in the disk area view. */
+static gboolean get_selected_free_space_range(GtkTreeView *tree, const gchar *disk_path, long long *first, long long *last) {
+    GtkTreeModel *model = gtk_tree_view_get_model(tree);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree);
     GtkTreeIter iter;
-    gchar *partition_name = NULL;
-    gchar *filesystem = NULL;
 
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter, 
-                          COL_NAME, &partition_name, 
-                          COL_FSTYPE, &filesystem, 
-                          -1);
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "Please select an area in the list.");
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        return FALSE;
+    }
 
-        if (!filesystem) {
-            GtkWidget *warn = gtk_message_dialog_new(
-                NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
-                "ERROR: Could not determine filesystem type for partition %s", 
-                partition_name
-            );
-            gtk_dialog_run(GTK_DIALOG(warn));
-            gtk_widget_destroy(warn);
-            g_free(partition_name);
-            return;
-        }
+    gchar *start = NULL, *end = NULL, *type = NULL;
+    gtk_tree_model_get(model, &iter, 0, &start, 1, &end, 3, &type, -1);
 
-        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
-        gchar *cmd = NULL;
-        gchar *fs_name = NULL;
+    if (!type || g_strcmp0(type, "Free Space") != 0) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "Please select a 'Free Space' area. This test never touches partitions.");
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        g_free(start); g_free(end); g_free(type);
+        return FALSE;
+    }
 
-        if (g_strcmp0(filesystem, "ext4") == 0 || 
-            g_strcmp0(filesystem, "ext3") == 0 || 
-            g_strcmp0(filesystem, "ext2") == 0) {
-            cmd = g_strdup_printf("e2fsck -f -y -v %s", device_path);
-            fs_name = g_strdup("EXT2/3/4");
-        }
-        else if (g_strcmp0(filesystem, "vfat") == 0 || 
-                 g_strcmp0(filesystem, "fat32") == 0) {
-            cmd = g_strdup_printf("dosfsck -a -v %s", device_path);
-            fs_name = g_strdup("FAT32");
-        }
-        else if (g_strcmp0(filesystem, "ntfs") == 0) {
-            cmd = g_strdup_printf("ntfsfix %s", device_path);
-            fs_name = g_strdup("NTFS");
-        }
-        else if (g_strcmp0(filesystem, "xfs") == 0) {
-            cmd = g_strdup_printf("xfs_repair %s", device_path);
-            fs_name = g_strdup("XFS");
-        }
-        else if (g_strcmp0(filesystem, "btrfs") == 0) {
-            cmd = g_strdup_printf("btrfs check --repair %s", device_path);
-            fs_name = g_strdup("Btrfs");
-        }
-        else if (g_strcmp0(filesystem, "f2fs") == 0) {
-            cmd = g_strdup_printf("fsck.f2fs -f %s", device_path);
-            fs_name = g_strdup("F2FS");
-        }
-        else {
-            GtkWidget *warn = gtk_message_dialog_new(
-                NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK,
-                "Filesystem '%s' is not supported for automatic repair.\n\n"
-                "Supported filesystems:\n"
-                "• ext2/ext3/ext4\n"
-                "• FAT32 (vfat)\n"
-                "• NTFS\n"
-                "• XFS\n"
-                "• Btrfs\n"
-                "• F2FS",
-                filesystem
-            );
-            gtk_dialog_run(GTK_DIALOG(warn));
-            gtk_widget_destroy(warn);
-            g_free(device_path);
-            g_free(partition_name);
-            g_free(filesystem);
-            return;
+    double start_mib = g_ascii_strtod(start, NULL);
+    double end_mib = g_ascii_strtod(end, NULL);
+    g_free(start); g_free(end); g_free(type);
+
+    /* The list shows rounded MiB values, so look the gap up again in exact bytes. */
+    long long gap_start = -1, gap_end = -1;
+    double best_diff = -1;
+    gchar *parted_cmd = g_strdup_printf("LC_ALL=C parted -sm %s unit B print free", disk_path);
+    FILE *fp = popen(parted_cmd, "r");
+    char line[512];
+    while (fp && fgets(line, sizeof(line), fp)) {
+        long long s = 0, e = 0, sz = 0;
+        if (!strstr(line, ":free;")) continue;
+        if (sscanf(line, "%*[^:]:%lldB:%lldB:%lldB", &s, &e, &sz) != 3) continue;
+        double diff = ABS((double)s / 1048576.0 - start_mib) + ABS((double)(e + 1) / 1048576.0 - end_mib);
+        if (best_diff < 0 || diff < best_diff) {
+            best_diff = diff;
+            gap_start = s;
+            gap_end = e;
         }
+    }
+    if (fp) pclose(fp);
+    g_free(parted_cmd);
 
-        gchar *confirm_msg = g_strdup_printf(
-            "Auto-detected filesystem: %s (%s)\n"
-            "Partition: %s\n\n"
-            "Command to execute: %s\n\n"
-            "Do you want to proceed with filesystem check?",
-            fs_name, filesystem, device_path, cmd
-        );
+    const long long align = 1048576LL;
+    *first = gap_start >= 0 ? (gap_start + align - 1) / align * align : 0;
+    *last = gap_end >= 0 ? (gap_end + 1) / align * align : 0;
 
-        GtkWidget *confirm = gtk_message_dialog_new(
-            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO,
-            "%s", confirm_msg
-        );
-        
-        gint response = gtk_dialog_run(GTK_DIALOG(confirm));
-        gtk_widget_destroy(confirm);
-        g_free(confirm_msg);
+    if (gap_start < 0 || best_diff > 2.0 || *last - *first < align) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "Cannot determine exact boundaries of the selected free space on %s,\n"
+            "or the area is smaller than 1 MiB after alignment.", disk_path);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        return FALSE;
+    }
+    return TRUE;
+}
 
-        if (response == GTK_RESPONSE_YES) {
-            run_command_in_terminal(tree_view, cmd);
-        }
+/* Runs inner_cmd only if [first, first + size) of the disk is still unallocated when the command starts. */
+static gchar *build_free_space_guarded_command(const gchar *disk_path, long long first, long long size,
+                                               const gchar *inner_cmd) {
+    gchar *quoted_disk = g_shell_quote(disk_path);
+    gchar *cmd = g_strdup_printf(
+        "echo 'Verifying that bytes %lld-%lld of %s are still unallocated...'; "
+        "if ! LC_ALL=C sudo parted -sm %s unit B print free | "
+        "awk -F: -v s=%lld -v e=%lld '$5 ~ /^free/ { sub(\"B\", \"\", $2); sub(\"B\", \"\", $3); "
+        "if ($2 + 0 <= s && $3 + 1 >= e) ok = 1 } END { exit ok ? 0 : 1 }'; then "
+        "echo 'ERROR: The selected range is no longer free space. Test aborted.'; "
+        "else "
+        "%s; "
+        "fi",
+        first, first + size - 1, disk_path,
+        quoted_disk, first, first + size,
+        inner_cmd);
+    g_free(quoted_disk);
+    return cmd;
+}
 
-        g_free(cmd);
-        g_free(fs_name);
-        g_free(device_path);
-        g_free(partition_name);
-        g_free(filesystem);
-    }
+/* fio job confined to [first, first + size) of the disk; refuses to start if that range is no longer unallocated. */
+static gchar *build_free_space_fio_command(const gchar *disk_path, long long first, long long size,
+                                           const gchar *job_name, const gchar *job_args, const gchar *tee) {
+    gchar *quoted_disk = g_shell_quote(disk_path);
+    gchar *fio_cmd = g_strdup_printf(
+        "sudo fio --name=%s --filename=%s --ioengine=libaio --direct=1 "
+        "--offset=%lld --size=%lld %s "
+        "--group_reporting --output-format=normal,terse --terse-version=3%s",
+        job_name, quoted_disk, first, size, job_args, tee);
+    gchar *cmd = build_free_space_guarded_command(disk_path, first, size, fio_cmd);
+    g_free(fio_cmd);
+    g_free(quoted_disk);
+    return cmd;
 }
 
-void on_e2fsck_activate(GtkWidget *menuitem, gpointer user_data) {
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-    GtkTreeModel *model;
-    GtkTreeIter iter;
-    gchar *partition_name = NULL;
-    gchar *filesystem = NULL;
+void on_free_space_write_benchmark_clicked(GtkWidget *button, gpointer user_data) {
+    GtkTreeView *tree = GTK_TREE_VIEW(user_data);
+    const gchar *disk_path = g_object_get_data(G_OBJECT(button), "disk_path");
+    GtkTreeView *main_tree_view = g_object_get_data(G_OBJECT(button), "main_tree_view");
+    long long first = 0, last = 0;
 
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter,
-                           COL_NAME, &partition_name,
-                           COL_FSTYPE, &filesystem,
-                           -1);
+    if (!check_fio_available()) return;
+    if (!get_selected_free_space_range(tree, disk_path, &first, &last)) return;
 
-        if (!filesystem || g_strcmp0(filesystem, "ext4") != 0 &&
-                          g_strcmp0(filesystem, "ext3") != 0 &&
-                          g_strcmp0(filesystem, "ext2") != 0) {
+    const long long align = 1048576LL;
+    long long area_mib = (last - first) / align;
 
-            GtkWidget *warn = gtk_message_dialog_new(
-                NULL,
-                GTK_DIALOG_MODAL,
-                GTK_MESSAGE_ERROR,
-                GTK_BUTTONS_OK,
-                "ERROR: e2fsck can be used **only** on ext2/3/4 partitions!"
-            );
-            gtk_dialog_run(GTK_DIALOG(warn));
-            gtk_widget_destroy(warn);
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "Free Space Write Speed Test",
+        NULL,
+        GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Start Test", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 500, 350);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
 
-            g_free(partition_name);
-            g_free(filesystem);
-            return;
-        }
+    gchar *info_text = g_strdup_printf(
+        "Device: %s\n"
+        "Free space: bytes %lld - %lld (%lld MiB usable, 1 MiB aligned)\n"
+        "Operation: O_DIRECT write into unallocated space only\n\n"
+        "Writes are limited to the boundaries of the selected area.",
+        disk_path, first, last - 1, area_mib);
+    GtkWidget *info_label = gtk_label_new(info_text);
+    gtk_box_pack_start(GTK_BOX(content_area), info_label, FALSE, FALSE, 5);
+    g_free(info_text);
 
-        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
-        gchar *cmd = g_strdup_printf("e2fsck -f -y -v %s", device_path);
+    GtkWidget *entry_mib = gtk_entry_new();
+    char tmp[64];
+    g_snprintf(tmp, sizeof(tmp), "%lld", area_mib < 8192 ? area_mib : 8192);
+    gtk_entry_set_text(GTK_ENTRY(entry_mib), tmp);
 
-        run_command_in_terminal(tree_view, cmd);
+    GtkWidget *bs_combo = gtk_combo_box_text_new();
+    const char *block_sizes[] = {"4k", "64k", "128k", "1M", NULL};
+    for (int i = 0; block_sizes[i]; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(bs_combo), block_sizes[i]);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(bs_combo), 3);
+
+    GtkWidget *qd_combo = gtk_combo_box_text_new();
+    const char *queue_depths[] = {"1", "4", "8", "16", "32", "64", NULL};
+    for (int i = 0; queue_depths[i]; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(qd_combo), queue_depths[i]);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(qd_combo), 2);
+
+    GtkWidget *pattern_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(pattern_combo), "Sequential write");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(pattern_combo), "Random write");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(pattern_combo), 0);
+
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Test size in MiB:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), entry_mib, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Block size:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), bs_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Queue depth (I/Os in flight):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), qd_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Access pattern:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), pattern_combo, FALSE, FALSE, 2);
+
+    gtk_widget_show_all(dialog);
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+
+    long long test_size_mib = atoll(gtk_entry_get_text(GTK_ENTRY(entry_mib)));
+    gchar *bs = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(bs_combo));
+    gchar *qd = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(qd_combo));
+    gboolean random_io = gtk_combo_box_get_active(GTK_COMBO_BOX(pattern_combo)) == 1;
+    gtk_widget_destroy(dialog);
+
+    if (response != GTK_RESPONSE_ACCEPT) {
+        g_free(bs); g_free(qd);
+        return;
+    }
 
+    if (test_size_mib <= 0 || test_size_mib > area_mib) test_size_mib = area_mib;
+    long long test_size = test_size_mib * align;
+
+    GtkWidget *confirm = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
+        GTK_MESSAGE_WARNING, GTK_BUTTONS_YES_NO,
+        "Free Space Write Benchmark\n\n"
+        "Device: %s\n"
+        "Write range: bytes %lld - %lld (%lld MiB)\n"
+        "Block size: %s, queue depth: %s, %s\n\n"
+        "Only the selected unallocated area is overwritten.\n"
+        "The range is checked again right before the test starts.\n\n"
+        "Are you sure you want to continue?",
+        disk_path, first, first + test_size - 1, test_size_mib,
+        bs, qd, random_io ? "random" : "sequential");
+    gint confirm_response = gtk_dialog_run(GTK_DIALOG(confirm));
+    gtk_widget_destroy(confirm);
+
+    if (confirm_response == GTK_RESPONSE_YES) {
+        gchar *params = g_strdup_printf("%s, bs=%s, iodepth=%s, offset=%lld, size=%lld MiB, direct=1",
+                                        random_io ? "randwrite" : "write", bs, qd, first, test_size_mib);
+        gchar *out_path = benchmark_store_begin("Free Space Write (fio)", "fio", disk_path, params);
+        gchar *tee = benchmark_store_tee(out_path);
+        gchar *job_args = g_strdup_printf("--rw=%s --bs=%s --iodepth=%s --randrepeat=0",
+                                          random_io ? "randwrite" : "write", bs, qd);
+        gchar *cmd = build_free_space_fio_command(disk_path, first, test_size, "freespace-write", job_args, tee);
+        run_command_in_terminal(main_tree_view, cmd);
         g_free(cmd);
-        g_free(device_path);
-        g_free(partition_name);
-        g_free(filesystem);
+        g_free(job_args);
+        g_free(tee);
+        g_free(out_path);
+        g_free(params);
     }
+
+    g_free(bs); g_free(qd);
 }
 
-void on_ext_repair_deep_activate(GtkWidget *menuitem, gpointer user_data) {
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-    GtkTreeModel *model;
-    GtkTreeIter iter;
-    gchar *partition_name = NULL;
+/* Asks for a mixed workload profile and returns the matching fio job options, or NULL if cancelled. */
+static gchar *run_workload_profile_dialog(const gchar *target_text, long long max_size_mib,
+                                         long long *size_mib, gchar **summary) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "Mixed Workload Test - Profile",
+        NULL,
+        GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Start Test", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 500, 500);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
 
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
+    gchar *info_text = g_strdup_printf(
+        "%s\n"
+        "Operation: mixed read/write workload (O_DIRECT)\n\n"
+        "Latency is measured under the configured load after a 5 second warm-up.",
+        target_text);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new(info_text), FALSE, FALSE, 5);
+    g_free(info_text);
 
-        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+    GtkWidget *read_spin = gtk_spin_button_new_with_range(0, 100, 5);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(read_spin), 70);
+    GtkWidget *random_spin = gtk_spin_button_new_with_range(0, 100, 5);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(random_spin), 100);
+
+    GtkWidget *bssplit_entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(bssplit_entry), "4k/70:64k/20:1M/10");
+
+    GtkWidget *qd_combo = gtk_combo_box_text_new();
+    const char *queue_depths[] = {"1", "4", "8", "16", "32", "64", NULL};
+    for (int i = 0; queue_depths[i]; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(qd_combo), queue_depths[i]);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(qd_combo), 3);
+
+    GtkWidget *cap_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cap_combo), "No limit");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cap_combo), "IOPS");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cap_combo), "MiB/s");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(cap_combo), 1);
+    GtkWidget *cap_entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(cap_entry), "2000");
+
+    GtkWidget *arrival_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(arrival_combo), "Steady");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(arrival_combo), "Bursty (Poisson arrivals)");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(arrival_combo), 0);
+
+    GtkWidget *duration_spin = gtk_spin_button_new_with_range(10, 86400, 10);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(duration_spin), 60);
+
+    GtkWidget *size_entry = gtk_entry_new();
+    char tmp[64];
+    g_snprintf(tmp, sizeof(tmp), "%lld", max_size_mib < 4096 ? max_size_mib : 4096);
+    gtk_entry_set_text(GTK_ENTRY(size_entry), tmp);
+
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Reads (% of I/Os, rest are writes):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), read_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Random (% of I/Os, rest are sequential):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), random_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Block size distribution (size/percent:...):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), bssplit_entry, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Queue depth (I/Os in flight):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), qd_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Rate limit:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), cap_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), cap_entry, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Arrival pattern (with a rate limit):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), arrival_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Duration (seconds):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), duration_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Working set size in MiB:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), size_entry, FALSE, FALSE, 2);
 
-        gchar *cmd = g_strdup_printf("mke2fs -n %s | grep -oE '[0-9]+' | tr '\\n' ' '", device_path);
-        FILE *fp = popen(cmd, "r");
-        gchar superblocks[1024] = {0};
-        if (fp) {
-            fgets(superblocks, sizeof(superblocks)-1, fp);
-            pclose(fp);
-        }
-        g_free(cmd);
+    gtk_widget_show_all(dialog);
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
 
-        gchar *sb_tokens = g_strdup(superblocks);
-        gchar *saveptr = NULL;
-        gchar *tokens[10] = {0};
-        int count = 0;
-        gchar *token = strtok_r(sb_tokens, " ", &saveptr);
-        while (token && count < 10) {
-            tokens[count++] = token;
-            token = strtok_r(NULL, " ", &saveptr);
-        }
+    int read_pct = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(read_spin));
+    int random_pct = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(random_spin));
+    gchar *bssplit = g_strdup(gtk_entry_get_text(GTK_ENTRY(bssplit_entry)));
+    gchar *qd = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(qd_combo));
+    int cap_type = gtk_combo_box_get_active(GTK_COMBO_BOX(cap_combo));
+    long long cap_value = atoll(gtk_entry_get_text(GTK_ENTRY(cap_entry)));
+    gboolean bursty = gtk_combo_box_get_active(GTK_COMBO_BOX(arrival_combo)) == 1;
+    int duration = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(duration_spin));
+    *size_mib = atoll(gtk_entry_get_text(GTK_ENTRY(size_entry)));
+    gtk_widget_destroy(dialog);
 
-        if (count >= 3) {
-            gchar *message = g_strdup_printf(
-                "WARNING: This operation will attempt advanced recovery of the EXT2/3/4 filesystem using a selected backup superblock.\n\n"
-                "Target: %s\n\n"
-                "Choose a backup superblock to use for recovery:\n"
-                "2) %s\n"
-                "3) %s\n\n"
-                "You should try the 2nd first (usually %s), then the 3rd if needed.\n\n"
-                "Are you sure you want to continue?",
-                device_path, tokens[1], tokens[2], tokens[1]
-            );
-            GtkWidget *dialog = gtk_dialog_new_with_buttons(
-                "Select Backup Superblock",
-                NULL,
-                GTK_DIALOG_MODAL,
-                "_Cancel", GTK_RESPONSE_CANCEL,
-                "_Use 2nd", 2,
-                "_Use 3rd", 3,
-                NULL
-            );
-            GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
-            GtkWidget *label = gtk_label_new(message);
-            gtk_label_set_xalign(GTK_LABEL(label), 0.0);
-            gtk_box_pack_start(GTK_BOX(content_area), label, FALSE, FALSE, 0);
-            gtk_widget_show_all(dialog);
+    if (response != GTK_RESPONSE_ACCEPT) {
+        g_free(bssplit); g_free(qd);
+        return NULL;
+    }
 
-            gint response = gtk_dialog_run(GTK_DIALOG(dialog));
-            gtk_widget_destroy(dialog);
-            g_free(message);
+    g_strstrip(bssplit);
+    if (!g_regex_match_simple("^[0-9]+[kKmM]?/[0-9]+(:[0-9]+[kKmM]?/[0-9]+)*$", bssplit, 0, 0)) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "Invalid block size distribution: %s\n\nExpected a list like 4k/70:64k/20:1M/10.", bssplit);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        g_free(bssplit); g_free(qd);
+        return NULL;
+    }
 
-            gchar *sb_to_use = NULL;
-            if (response == 2) sb_to_use = tokens[1];
-            else if (response == 3) sb_to_use = tokens[2];
+    if (*size_mib <= 0 || *size_mib > max_size_mib) *size_mib = max_size_mib;
+
+    /* fio applies a single rate to reads and writes separately, so the cap is split by the read percentage.
+     * A direction in use gets at least 1, because fio treats 0 as unlimited. */
+    long long cap_units = cap_type == 2 ? cap_value * 1024 : cap_value;
+    long long read_cap = cap_units * read_pct / 100, write_cap = cap_units - read_cap;
+    if (read_pct > 0 && read_cap == 0) read_cap = 1;
+    if (read_pct < 100 && write_cap == 0) write_cap = 1;
+    if (read_pct == 0) read_cap = 0;
+    if (read_pct == 100) write_cap = 0;
+
+    gchar *rate_args;
+    gchar *rate_text;
+    if (cap_type == 1 && cap_value > 0) {
+        rate_args = g_strdup_printf(" --rate_iops=%lld,%lld%s", read_cap, write_cap, bursty ? " --rate_process=poisson" : "");
+        rate_text = g_strdup_printf("%lld IOPS%s", cap_value, bursty ? " (poisson)" : "");
+    } else if (cap_type == 2 && cap_value > 0) {
+        rate_args = g_strdup_printf(" --rate=%lldk,%lldk%s", read_cap, write_cap, bursty ? " --rate_process=poisson" : "");
+        rate_text = g_strdup_printf("%lld MiB/s%s", cap_value, bursty ? " (poisson)" : "");
+    } else {
+        rate_args = g_strdup("");
+        rate_text = g_strdup("unlimited");
+    }
 
-            if (sb_to_use) {
-            gchar *repair_cmd = g_strdup_printf(
-                "e2fsck -b %s -y %s; "
-                "echo ''; echo 'Now running full filesystem check...'; "
-                "e2fsck -f -y -v %s",
-                sb_to_use, device_path, device_path
-            );
-                run_command_in_terminal(tree_view, repair_cmd);
-                g_free(repair_cmd);
-            }
-        } else {
-            GtkWidget *err = gtk_message_dialog_new(
-                NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
-                "Could not find enough backup superblocks for this partition."
-            );
-            gtk_dialog_run(GTK_DIALOG(err));
-            gtk_widget_destroy(err);
-        }
+    gchar *job_args = g_strdup_printf(
+        "--rw=randrw --rwmixread=%d --percentage_random=%d --bssplit=%s --iodepth=%s "
+        "--time_based --runtime=%d --ramp_time=5 --randrepeat=0 "
+        "--percentile_list=50:90:95:99:99.9:99.99%s",
+        read_pct, random_pct, bssplit, qd, duration, rate_args);
+    *summary = g_strdup_printf("read=%d%%, random=%d%%, bssplit=%s, iodepth=%s, rate=%s, runtime=%ds, size=%lld MiB",
+                               read_pct, random_pct, bssplit, qd, rate_text, duration, *size_mib);
+
+    g_free(rate_args); g_free(rate_text);
+    g_free(bssplit); g_free(qd);
+    return job_args;
+}
 
-        g_free(sb_tokens);
-        g_free(device_path);
-        g_free(partition_name);
+void on_free_space_workload_clicked(GtkWidget *button, gpointer user_data) {
+    GtkTreeView *tree = GTK_TREE_VIEW(user_data);
+    const gchar *disk_path = g_object_get_data(G_OBJECT(button), "disk_path");
+    GtkTreeView *main_tree_view = g_object_get_data(G_OBJECT(button), "main_tree_view");
+    long long first = 0, last = 0;
+
+    if (!check_fio_available()) return;
+    if (!get_selected_free_space_range(tree, disk_path, &first, &last)) return;
+
+    long long area_mib = (last - first) / 1048576LL;
+    gchar *target_text = g_strdup_printf("Device: %s\nFree space: bytes %lld - %lld (%lld MiB usable)",
+                                         disk_path, first, last - 1, area_mib);
+    long long size_mib = 0;
+    gchar *summary = NULL;
+    gchar *job_args = run_workload_profile_dialog(target_text, area_mib, &size_mib, &summary);
+    g_free(target_text);
+    if (!job_args) return;
+
+    GtkWidget *confirm = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
+        GTK_MESSAGE_WARNING, GTK_BUTTONS_YES_NO,
+        "Mixed Workload Test on Free Space\n\n"
+        "Device: %s\n"
+        "Range: bytes %lld - %lld\n"
+        "Profile: %s\n\n"
+        "Only the selected unallocated area is written to.\n\n"
+        "Are you sure you want to continue?",
+        disk_path, first, first + size_mib * 1048576LL - 1, summary);
+    gint response = gtk_dialog_run(GTK_DIALOG(confirm));
+    gtk_widget_destroy(confirm);
+
+    if (response == GTK_RESPONSE_YES) {
+        gchar *params = g_strdup_printf("%s, offset=%lld", summary, first);
+        gchar *out_path = benchmark_store_begin("Mixed Workload on Free Space (fio)", "fio", disk_path, params);
+        gchar *tee = benchmark_store_tee(out_path);
+        gchar *cmd = build_free_space_fio_command(disk_path, first, size_mib * 1048576LL, "mixed-workload", job_args, tee);
+        run_command_in_terminal(main_tree_view, cmd);
+        g_free(cmd);
+        g_free(tee);
+        g_free(out_path);
+        g_free(params);
     }
+
+    g_free(summary);
+    g_free(job_args);
 }
 
-void on_fat32fix_activate(GtkWidget *menuitem, gpointer user_data) {
+void on_mixed_workload_activate(GtkWidget *menuitem, gpointer user_data) {
     GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
     GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
     GtkTreeModel *model;
     GtkTreeIter iter;
     gchar *partition_name = NULL;
-    gchar *filesystem = NULL;
 
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter,
-                           COL_NAME, &partition_name,
-                           COL_FSTYPE, &filesystem,
-                           -1);
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    if (!check_fio_available()) return;
 
-        if (!filesystem || g_strcmp0(filesystem, "vfat") != 0) {
-            GtkWidget *warn = gtk_message_dialog_new(
-                NULL,
-                GTK_DIALOG_MODAL,
-                GTK_MESSAGE_ERROR,
-                GTK_BUTTONS_OK,
-                "ERROR: dosfsck can be used **only** on FAT32 (vfat) partitions!"
-            );
-            gtk_dialog_run(GTK_DIALOG(warn));
-            gtk_widget_destroy(warn);
+    gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
+    gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+    gchar *mountpoint = get_partition_mountpoint(device_path);
 
-            g_free(partition_name);
-            g_free(filesystem);
-            return;
-        }
+    if (!mountpoint) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "%s is not mounted.\n\nMount the partition first (the test uses a scratch file on it),\n"
+            "or use 'Show Filesystems and Free Space' to run the test on unallocated space.", device_path);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        g_free(device_path);
+        g_free(partition_name);
+        return;
+    }
 
-        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
-        gchar *cmd = g_strdup_printf("dosfsck -a -v %s", device_path);
+    gchar *quoted_mount = g_shell_quote(mountpoint);
+    gchar *df_cmd = g_strdup_printf("df --output=avail -BM %s | tail -1 | tr -d ' M'", quoted_mount);
+    FILE *space_fp = popen(df_cmd, "r");
+    char space_buf[32] = "";
+    long long free_mib = 0;
+    if (space_fp && fgets(space_buf, sizeof(space_buf), space_fp)) free_mib = atoll(space_buf);
+    if (space_fp) pclose(space_fp);
+    g_free(df_cmd);
+    g_free(quoted_mount);
+
+    /* Leave some room so the scratch file never fills the filesystem. */
+    long long max_size_mib = free_mib - 1024;
+    if (max_size_mib < 64) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "ERROR: Insufficient free space on %s (%lld MiB available).", mountpoint, free_mib);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        g_free(mountpoint);
+        g_free(device_path);
+        g_free(partition_name);
+        return;
+    }
 
+    gchar *scratch_file = g_build_filename(mountpoint, "driveassistify-workload.tmp", NULL);
+    gchar *target_text = g_strdup_printf("Device: %s\nScratch file: %s (auto-deleted)", device_path, scratch_file);
+    long long size_mib = 0;
+    gchar *summary = NULL;
+    gchar *job_args = run_workload_profile_dialog(target_text, max_size_mib, &size_mib, &summary);
+    g_free(target_text);
+
+    if (job_args) {
+        gchar *params = g_strdup_printf("%s, file=%s", summary, scratch_file);
+        gchar *out_path = benchmark_store_begin("Mixed Workload on Scratch File (fio)", "fio", device_path, params);
+        gchar *tee = benchmark_store_tee(out_path);
+        gchar *quoted_file = g_shell_quote(scratch_file);
+        gchar *cmd = g_strdup_printf(
+            "sudo fio --name=mixed-workload --filename=%s --size=%lldM --ioengine=libaio --direct=1 %s "
+            "--group_reporting --output-format=normal,terse --terse-version=3%s; "
+            "sudo rm -f %s",
+            quoted_file, size_mib, job_args, tee, quoted_file);
         run_command_in_terminal(tree_view, cmd);
-
         g_free(cmd);
-        g_free(device_path);
-        g_free(partition_name);
-        g_free(filesystem);
+        g_free(quoted_file);
+        g_free(tee);
+        g_free(out_path);
+        g_free(params);
     }
+
+    g_free(summary);
+    g_free(job_args);
+    g_free(scratch_file);
+    g_free(mountpoint);
+    g_free(device_path);
+    g_free(partition_name);
 }
 
-void on_ntfsfix_activate(GtkWidget *menuitem, gpointer user_data) {
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-    GtkTreeModel *model;
-    GtkTreeIter iter;
-    gchar *partition_name = NULL;
-    gchar *filesystem = NULL;
+typedef struct {
+    guint64 time_ns;
+    guint64 offset;
+    guint32 length;
+    guint32 op;
+} TraceRecord;
 
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter,
-                           COL_NAME, &partition_name,
-                           COL_FSTYPE, &filesystem,
-                           -1);
+enum { TRACE_OP_READ, TRACE_OP_WRITE, TRACE_OP_TRIM };
 
-        if (!filesystem || g_strcmp0(filesystem, "ntfs") != 0) {
-            GtkWidget *warn = gtk_message_dialog_new(
-                NULL,
-                GTK_DIALOG_MODAL,
-                GTK_MESSAGE_ERROR,
-                GTK_BUTTONS_OK,
-                "ERROR: ntfsfix can be used **only** on NTFS partitions!"
-            );
-            gtk_dialog_run(GTK_DIALOG(warn));
-            gtk_widget_destroy(warn);
+static const char *trace_op_names[] = {"read", "write", "trim"};
 
-            g_free(partition_name);
-            g_free(filesystem);
-            return;
-        }
+static gint compare_trace_records(gconstpointer a, gconstpointer b) {
+    const TraceRecord *ra = a, *rb = b;
+    return ra->time_ns < rb->time_ns ? -1 : (ra->time_ns > rb->time_ns ? 1 : 0);
+}
 
-        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
-        gchar *cmd = g_strdup_printf("ntfsfix %s", device_path);
+static int parse_trace_op(const gchar *token) {
+    if (g_ascii_strcasecmp(token, "read") == 0) return TRACE_OP_READ;
+    if (g_ascii_strcasecmp(token, "write") == 0) return TRACE_OP_WRITE;
+    if (g_ascii_strcasecmp(token, "trim") == 0 || g_ascii_strcasecmp(token, "discard") == 0) return TRACE_OP_TRIM;
+    /* blkparse RWBS flags such as R, RA, WS, FWS or D */
+    if (strchr(token, 'D')) return TRACE_OP_TRIM;
+    if (strchr(token, 'W')) return TRACE_OP_WRITE;
+    if (strchr(token, 'R')) return TRACE_OP_READ;
+    return -1;
+}
 
-        run_command_in_terminal(tree_view, cmd);
+/* Text traces: "<seconds> <op> <offset> <length>" per line. Binary traces: little-endian u64 ns, u64 offset, u32 length, u32 op. */
+static GArray *load_io_trace(const gchar *path, gboolean binary, gboolean sectors, guint64 *skipped, gchar **error_text) {
+    gchar *contents = NULL;
+    gsize len = 0;
+    GError *error = NULL;
 
-        g_free(cmd);
-        g_free(device_path);
-        g_free(partition_name);
-        g_free(filesystem);
+    *skipped = 0;
+    if (!g_file_get_contents(path, &contents, &len, &error)) {
+        *error_text = g_strdup(error->message);
+        g_clear_error(&error);
+        return NULL;
     }
-}
 
-void on_ntfsresize_activate(GtkWidget *menuitem, gpointer user_data) {
-    run_command_in_terminal(GTK_TREE_VIEW(user_data), "ntfsresize -P -i -f -v %s");
+    GArray *records = g_array_new(FALSE, FALSE, sizeof(TraceRecord));
+    if (binary) {
+        if (len % 24 != 0) {
+            *error_text = g_strdup_printf("File size (%" G_GSIZE_FORMAT " bytes) is not a multiple of the 24-byte record size.", len);
+            g_array_free(records, TRUE);
+            g_free(contents);
+            return NULL;
+        }
+        for (gsize pos = 0; pos + 24 <= len; pos += 24) {
+            TraceRecord rec;
+            guint64 v64;
+            guint32 v32;
+            memcpy(&v64, contents + pos, 8);
+            rec.time_ns = GUINT64_FROM_LE(v64);
+            memcpy(&v64, contents + pos + 8, 8);
+            rec.offset = GUINT64_FROM_LE(v64);
+            memcpy(&v32, contents + pos + 16, 4);
+            rec.length = GUINT32_FROM_LE(v32);
+            memcpy(&v32, contents + pos + 20, 4);
+            rec.op = GUINT32_FROM_LE(v32);
+            if (rec.op > TRACE_OP_TRIM || rec.length == 0) {
+                (*skipped)++;
+                continue;
+            }
+            if (sectors) rec.offset *= 512;
+            g_array_append_val(records, rec);
+        }
+    } else {
+        gchar *line = contents;
+        while (line && *line) {
+            gchar *next = strchr(line, '\n');
+            if (next) *next++ = '\0';
+            g_strdelimit(line, ",;\t\r", ' ');
+            g_strstrip(line);
+
+            if (line[0] != '\0' && line[0] != '#') {
+                gchar *end = NULL;
+                double seconds = g_ascii_strtod(line, &end);
+                char op_text[32];
+                unsigned long long offset = 0, length = 0;
+                int op = -1;
+                if (end != line && seconds >= 0 &&
+                    sscanf(end, "%31s %llu %llu", op_text, &offset, &length) == 3)
+                    op = parse_trace_op(op_text);
+                if (op >= 0 && length > 0 && length <= G_MAXUINT32) {
+                    TraceRecord rec;
+                    rec.time_ns = (guint64)(seconds * 1e9);
+                    rec.offset = sectors ? offset * 512 : offset;
+                    rec.length = (guint32)length;
+                    rec.op = op;
+                    g_array_append_val(records, rec);
+                } else {
+                    (*skipped)++;
+                }
+            }
+            line = next;
+        }
+    }
+    g_free(contents);
+
+    if (records->len == 0) {
+        *error_text = g_strdup("The trace does not contain any usable read, write or trim records.");
+        g_array_free(records, TRUE);
+        return NULL;
+    }
+    g_array_sort(records, compare_trace_records);
+    return records;
 }
 
-void on_diskscan_activate(GtkWidget *menuitem, gpointer user_data) {
-    run_command_in_terminal(GTK_TREE_VIEW(user_data), "diskscan %s");
+static void get_io_trace_extent(GArray *records, guint64 *min_offset, guint64 *footprint) {
+    guint64 lo = G_MAXUINT64, hi = 0;
+    for (guint i = 0; i < records->len; i++) {
+        TraceRecord *rec = &g_array_index(records, TraceRecord, i);
+        if (rec->offset < lo) lo = rec->offset;
+        if (rec->offset + rec->length > hi) hi = rec->offset + rec->length;
+    }
+    *min_offset = lo;
+    *footprint = hi - lo;
 }
 
-static void on_mount_child_exited(VteTerminal *terminal, gint status, gpointer user_data) {
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    
-    GtkWidget *window = gtk_widget_get_toplevel(GTK_WIDGET(terminal));
-    if (GTK_IS_WINDOW(window)) {
-        gtk_window_set_title(GTK_WINDOW(window), "Command Finished");
+/* Writes a fio v3 iolog that replays the trace inside [region_start, region_start + region_size) of target. */
+/* The iolog is created with a unique name in the temporary directory; *iolog_path receives it on success. */
+static gboolean write_replay_iolog(GArray *records, gchar **iolog_path, const gchar *target,
+                                   long long region_start, long long region_size, long long align,
+                                   gboolean with_trims, double *span_s, gchar **summary, gchar **error_text) {
+    GError *error = NULL;
+    gchar *path = NULL;
+    int fd = g_file_open_tmp("driveassistify-replay-XXXXXX.iolog", &path, &error);
+    if (fd < 0) {
+        *error_text = g_strdup_printf("Cannot create the replay iolog: %s", error->message);
+        g_clear_error(&error);
+        return FALSE;
     }
-    
-    refresh_disk_list_delayed(tree_view);
+    FILE *f = fdopen(fd, "w");
+    if (!f) {
+        *error_text = g_strdup_printf("Cannot write %s: %s", path, g_strerror(errno));
+        close(fd);
+        unlink(path);
+        g_free(path);
+        return FALSE;
+    }
+
+    guint64 min_offset = 0, footprint = 0;
+    get_io_trace_extent(records, &min_offset, &footprint);
+    guint64 t0 = g_array_index(records, TraceRecord, 0).time_ns;
+    guint64 last_ts = 0, counts[3] = {0, 0, 0}, dropped = 0;
+
+    fprintf(f, "fio version 3 iolog\n0 %s add\n0 %s open\n", target, target);
+    for (guint i = 0; i < records->len; i++) {
+        TraceRecord *rec = &g_array_index(records, TraceRecord, i);
+        long long length = ((long long)rec->length + align - 1) / align * align;
+        if (length > region_size || (rec->op == TRACE_OP_TRIM && !with_trims)) {
+            dropped++;
+            continue;
+        }
+        long long rel = (long long)((rec->offset - min_offset) % (guint64)region_size) / align * align;
+        if (rel + length > region_size) rel = (region_size - length) / align * align;
+        last_ts = rec->time_ns - t0;
+        fprintf(f, "%" G_GUINT64_FORMAT " %s %s %lld %lld\n",
+                last_ts, target, trace_op_names[rec->op], region_start + rel, length);
+        counts[rec->op]++;
+    }
+    fprintf(f, "%" G_GUINT64_FORMAT " %s close\n", last_ts, target);
+
+    if (fclose(f) != 0) {
+        *error_text = g_strdup_printf("Cannot write %s: %s", path, g_strerror(errno));
+        unlink(path);
+        g_free(path);
+        return FALSE;
+    }
+
+    *iolog_path = path;
+
+    *span_s = (double)last_ts / 1e9;
+    *summary = g_strdup_printf("%" G_GUINT64_FORMAT " reads, %" G_GUINT64_FORMAT " writes, %" G_GUINT64_FORMAT " trims, "
+                               "%" G_GUINT64_FORMAT " dropped, trace footprint %" G_GUINT64_FORMAT " MiB",
+                               counts[TRACE_OP_READ], counts[TRACE_OP_WRITE], counts[TRACE_OP_TRIM],
+                               dropped, footprint / 1048576);
+    return TRUE;
 }
 
-void on_mount_activate(GtkWidget *menuitem, gpointer user_data) {
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-    GtkTreeModel *model;
-    GtkTreeIter iter;
-    gchar *disk_name;
-    
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter, COL_NAME, &disk_name, -1);
+/* fio replay of an iolog followed by a comparison of the wall-clock completion time with the original trace span. */
+static gchar *build_trace_replay_command(const gchar *iolog_path, gboolean no_stall, int iodepth,
+                                         double span_s, const gchar *tee) {
+    gchar *quoted_log = g_shell_quote(iolog_path);
+    char span_text[G_ASCII_DTOSTR_BUF_SIZE];
+    g_ascii_formatd(span_text, sizeof(span_text), "%.3f", span_s);
+    gchar *cmd = g_strdup_printf(
+        "replay_start=$(cut -d' ' -f1 /proc/uptime); "
+        "sudo fio --name=trace-replay --read_iolog=%s --ioengine=libaio --direct=1 --iodepth=%d%s "
+        "--percentile_list=50:90:95:99:99.9:99.99 "
+        "--group_reporting --output-format=normal,terse --terse-version=3%s; "
+        "replay_end=$(cut -d' ' -f1 /proc/uptime); "
+        "awk -v s=\"$replay_start\" -v e=\"$replay_end\" -v o=%s 'BEGIN { d = e - s; print \"\"; "
+        "print \"Original trace span (s):    \" o; "
+        "print \"Replay completion time (s): \" d; "
+        "print \"Difference (s):             \" d - o; "
+        "if (o > 0) print \"Replay/original ratio:      \" d / o }'%s; "
+        "rm -f %s",
+        quoted_log, iodepth, no_stall ? " --replay_no_stall=1" : "", tee, span_text, tee, quoted_log);
+    g_free(quoted_log);
+    return cmd;
+}
 
-        gchar *device_path = g_strdup_printf("/dev/%s", disk_name);
-        gchar *mount_point = g_strdup_printf("/mnt/%s", disk_name);
-        gchar *quoted_device_path = g_shell_quote(device_path);
-        gchar *quoted_mount_point = g_shell_quote(mount_point);
-        
-        gchar *mkdir_command = g_strdup_printf("sudo mkdir -p %s", quoted_mount_point);
-        system(mkdir_command);
-        g_free(mkdir_command);
-        
-        gchar *command = g_strdup_printf(
-            "if [ -b %s ]; then "
-            "  echo 'Mounting %s to %s...'; "
-            "  timeout 15 sudo mount %s %s && "
-            "  echo 'Mounted successfully' || "
-            "  (sleep 2 && timeout 15 sudo mount %s %s && "
-            "   echo 'Mounted on second attempt' || "
-            "   echo 'ERROR: Mount failed after 2 attempts'); "
-            "else "
-            "  echo 'ERROR: Device %s not found'; "
-            "fi",
-            quoted_device_path,
-            device_path, 
-            mount_point,
-            quoted_device_path, quoted_mount_point,
-            quoted_device_path, quoted_mount_point,
-            device_path
-        );
-        
-        run_command_in_terminal(tree_view, command);
-        
-        g_free(command);
-        g_free(quoted_device_path);
-        g_free(quoted_mount_point);
-        g_free(device_path);
-        g_free(mount_point);
-        g_free(disk_name);
+/* Asks for the trace and replay mode; with ask_target the replay target (scratch file or existing file) is chosen too. */
+static gboolean run_trace_replay_dialog(const gchar *target_text, gboolean ask_target, gboolean scratch_possible,
+                                        gchar **trace_path, gboolean *binary, gboolean *sectors,
+                                        gboolean *no_stall, int *iodepth, gchar **target_file) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "I/O Trace Replay",
+        NULL,
+        GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Start Replay", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 520, 450);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+    gchar *info_text = g_strdup_printf(
+        "%s\n\n"
+        "Offsets from the trace are remapped into the target, so a trace\n"
+        "recorded on a larger disk wraps around inside it. Requires fio 3.31 or newer.",
+        target_text);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new(info_text), FALSE, FALSE, 5);
+    g_free(info_text);
+
+    GtkWidget *trace_chooser = gtk_file_chooser_button_new("Select Trace File", GTK_FILE_CHOOSER_ACTION_OPEN);
+
+    GtkWidget *format_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(format_combo), "Text: <seconds> <op> <offset> <length> per line");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(format_combo), "Binary: 24-byte records (u64 ns, u64 offset, u32 length, u32 op)");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(format_combo), 0);
+
+    GtkWidget *unit_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(unit_combo), "Bytes");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(unit_combo), "512-byte sectors (blkparse)");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(unit_combo), 0);
+
+    GtkWidget *mode_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(mode_combo), "Time-faithful (original inter-arrival times)");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(mode_combo), "As fast as possible");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(mode_combo), 0);
+
+    GtkWidget *qd_combo = gtk_combo_box_text_new();
+    const char *queue_depths[] = {"1", "4", "8", "16", "32", "64", NULL};
+    for (int i = 0; queue_depths[i]; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(qd_combo), queue_depths[i]);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(qd_combo), 4);
+
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Trace file:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), trace_chooser, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Trace format (op: R/W/D flags or read/write/trim):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), format_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Offset unit:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), unit_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Replay timing:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), mode_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Maximum I/Os in flight:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), qd_combo, FALSE, FALSE, 2);
+
+    GtkWidget *target_combo = NULL;
+    GtkWidget *target_chooser = NULL;
+    if (ask_target) {
+        target_combo = gtk_combo_box_text_new();
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(target_combo), "Scratch file on the mounted partition (auto-deleted)");
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(target_combo), "Existing file or disk image (contents are overwritten by trace writes)");
+        gtk_combo_box_set_active(GTK_COMBO_BOX(target_combo), scratch_possible ? 0 : 1);
+        target_chooser = gtk_file_chooser_button_new("Select Target File or Image", GTK_FILE_CHOOSER_ACTION_OPEN);
+        gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Replay target:"), FALSE, FALSE, 2);
+        gtk_box_pack_start(GTK_BOX(content_area), target_combo, FALSE, FALSE, 2);
+        gtk_box_pack_start(GTK_BOX(content_area), target_chooser, FALSE, FALSE, 2);
+    }
+
+    gtk_widget_show_all(dialog);
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+
+    *trace_path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(trace_chooser));
+    *binary = gtk_combo_box_get_active(GTK_COMBO_BOX(format_combo)) == 1;
+    *sectors = gtk_combo_box_get_active(GTK_COMBO_BOX(unit_combo)) == 1;
+    *no_stall = gtk_combo_box_get_active(GTK_COMBO_BOX(mode_combo)) == 1;
+    gchar *qd = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(qd_combo));
+    *iodepth = qd ? atoi(qd) : 32;
+    g_free(qd);
+    *target_file = NULL;
+    gboolean use_file = ask_target && gtk_combo_box_get_active(GTK_COMBO_BOX(target_combo)) == 1;
+    if (use_file) *target_file = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(target_chooser));
+    gtk_widget_destroy(dialog);
+
+    const gchar *problem = NULL;
+    if (response != GTK_RESPONSE_ACCEPT) problem = "";
+    else if (!*trace_path) problem = "Please select a trace file.";
+    else if (use_file && !*target_file) problem = "Please select the target file or image.";
+    else if (ask_target && !use_file && !scratch_possible) problem = "The partition is not mounted, so no scratch file can be created.\nSelect an existing file or image instead.";
+    else if (*target_file && strpbrk(*target_file, " \t\n")) problem = "The target path must not contain whitespace (fio iolog limitation).";
+
+    if (problem) {
+        if (problem[0] != '\0') {
+            GtkWidget *err = gtk_message_dialog_new(
+                NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, "%s", problem);
+            gtk_dialog_run(GTK_DIALOG(err));
+            gtk_widget_destroy(err);
+        }
+        g_free(*trace_path); *trace_path = NULL;
+        g_free(*target_file); *target_file = NULL;
+        return FALSE;
     }
+    return TRUE;
 }
 
-void on_umount_activate(GtkWidget *menuitem, gpointer user_data) {
+static GArray *load_io_trace_or_report(const gchar *trace_path, gboolean binary, gboolean sectors, guint64 *skipped) {
+    gchar *error_text = NULL;
+    GArray *records = load_io_trace(trace_path, binary, sectors, skipped, &error_text);
+    if (!records) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "Cannot load trace %s:\n\n%s", trace_path, error_text);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        g_free(error_text);
+    }
+    return records;
+}
+
+static gboolean write_replay_iolog_or_report(GArray *records, gchar **iolog_path, const gchar *target,
+                                             long long region_start, long long region_size, long long align,
+                                             gboolean with_trims, double *span_s, gchar **summary) {
+    gchar *error_text = NULL;
+    if (!write_replay_iolog(records, iolog_path, target, region_start, region_size, align,
+                            with_trims, span_s, summary, &error_text)) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, "%s", error_text);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        g_free(error_text);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void on_free_space_trace_replay_clicked(GtkWidget *button, gpointer user_data) {
+    GtkTreeView *tree = GTK_TREE_VIEW(user_data);
+    const gchar *disk_path = g_object_get_data(G_OBJECT(button), "disk_path");
+    GtkTreeView *main_tree_view = g_object_get_data(G_OBJECT(button), "main_tree_view");
+    long long first = 0, last = 0;
+
+    if (!check_fio_available()) return;
+    if (!get_selected_free_space_range(tree, disk_path, &first, &last)) return;
+
+    gchar *target_text = g_strdup_printf("Device: %s\nFree space: bytes %lld - %lld (%lld MiB usable)\n"
+                                         "Trace writes and trims go to this unallocated area only.",
+                                         disk_path, first, last - 1, (last - first) / 1048576LL);
+    gchar *trace_path = NULL, *target_file = NULL;
+    gboolean binary = FALSE, sectors = FALSE, no_stall = FALSE;
+    int iodepth = 32;
+    gboolean ok = run_trace_replay_dialog(target_text, FALSE, FALSE, &trace_path, &binary, &sectors,
+                                          &no_stall, &iodepth, &target_file);
+    g_free(target_text);
+    if (!ok) return;
+
+    guint64 skipped = 0;
+    GArray *records = load_io_trace_or_report(trace_path, binary, sectors, &skipped);
+    if (!records) {
+        g_free(trace_path);
+        return;
+    }
+
+    gchar *dev_name = g_path_get_basename(disk_path);
+    gchar *lbs_text = read_sysfs_block_attr(dev_name, "queue/logical_block_size");
+    long long align = lbs_text ? atoll(lbs_text) : 512;
+    if (align < 512) align = 512;
+    g_free(lbs_text);
+    g_free(dev_name);
+
+    gchar *iolog_path = NULL;
+    double span_s = 0;
+    gchar *summary = NULL;
+    if (write_replay_iolog_or_report(records, &iolog_path, disk_path, first, last - first, align,
+                                     TRUE, &span_s, &summary)) {
+        GtkWidget *confirm = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
+            GTK_MESSAGE_WARNING, GTK_BUTTONS_YES_NO,
+            "I/O Trace Replay on Free Space\n\n"
+            "Device: %s\n"
+            "Range: bytes %lld - %lld\n"
+            "Trace: %s\n"
+            "%s (%" G_GUINT64_FORMAT " unparsable lines or records skipped)\n"
+            "Original span: %.3f s, mode: %s\n\n"
+            "Are you sure you want to continue?",
+            disk_path, first, last - 1, trace_path, summary, skipped, span_s,
+            no_stall ? "as fast as possible" : "time-faithful");
+        gint response = gtk_dialog_run(GTK_DIALOG(confirm));
+        gtk_widget_destroy(confirm);
+
+        if (response == GTK_RESPONSE_YES) {
+            gchar *params = g_strdup_printf("trace=%s, %s, mode=%s, iodepth=%d, offset=%lld",
+                                            trace_path, summary, no_stall ? "fast" : "time-faithful", iodepth, first);
+            gchar *out_path = benchmark_store_begin("I/O Trace Replay on Free Space (fio)", "fio", disk_path, params);
+            gchar *tee = benchmark_store_tee(out_path);
+            gchar *replay_cmd = build_trace_replay_command(iolog_path, no_stall, iodepth, span_s, tee);
+            gchar *cmd = build_free_space_guarded_command(disk_path, first, last - first, replay_cmd);
+            run_command_in_terminal(main_tree_view, cmd);
+            g_free(cmd);
+            g_free(replay_cmd);
+            g_free(tee);
+            g_free(out_path);
+            g_free(params);
+        } else {
+            unlink(iolog_path);
+        }
+    }
+
+    g_free(summary);
+    g_free(iolog_path);
+    g_array_free(records, TRUE);
+    g_free(trace_path);
+}
+
+void on_trace_replay_activate(GtkWidget *menuitem, gpointer user_data) {
     GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
     GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
     GtkTreeModel *model;
     GtkTreeIter iter;
-    gchar *disk_name = NULL;
-    
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter, COL_NAME, &disk_name, -1);
+    gchar *partition_name = NULL;
 
-        gchar *device_path = g_strdup_printf("/dev/%s", disk_name);
-        gchar *quoted_device_path = g_shell_quote(device_path);
-        
-        gchar *command = g_strdup_printf(
-            "echo 'Unmounting %s...'; "
-            "if mount | grep -q '^%s '; then "
-                "timeout 15 sudo umount %s && "
-                "echo 'Unmounted successfully' || "
-                "(sleep 2 && timeout 15 sudo umount %s && "
-                "echo 'Unmounted on second attempt' || "
-                "echo 'ERROR: Unmount failed after 2 attempts'); "
-            "else "
-                "echo 'Device %s is not mounted - unmounting not needed'; "
-            "fi",
-            device_path,
-            device_path,
-            quoted_device_path,
-            quoted_device_path,
-            device_path
-        );
-        
-        run_command_in_terminal(tree_view, command);
-        
-        g_free(command);
-        g_free(quoted_device_path);
-        g_free(device_path);
-        g_free(disk_name);
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    if (!check_fio_available()) return;
+
+    gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
+    gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+    gchar *mountpoint = get_partition_mountpoint(device_path);
+
+    gchar *target_text = mountpoint
+        ? g_strdup_printf("Device: %s\nMounted at: %s", device_path, mountpoint)
+        : g_strdup_printf("Device: %s (not mounted)", device_path);
+    gchar *trace_path = NULL, *target_file = NULL;
+    gboolean binary = FALSE, sectors = FALSE, no_stall = FALSE;
+    int iodepth = 32;
+    gboolean ok = run_trace_replay_dialog(target_text, TRUE, mountpoint != NULL, &trace_path, &binary, &sectors,
+                                          &no_stall, &iodepth, &target_file);
+    g_free(target_text);
+
+    GArray *records = NULL;
+    guint64 skipped = 0;
+    if (ok) records = load_io_trace_or_report(trace_path, binary, sectors, &skipped);
+
+    long long region_size = 0;
+    gchar *scratch_file = NULL;
+    if (records && target_file) {
+        struct stat st;
+        if (stat(target_file, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 1048576) {
+            GtkWidget *err = gtk_message_dialog_new(
+                NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                "%s is not a regular file of at least 1 MiB.", target_file);
+            gtk_dialog_run(GTK_DIALOG(err));
+            gtk_widget_destroy(err);
+        } else {
+            region_size = st.st_size / 4096 * 4096;
+        }
+    } else if (records) {
+        gchar *quoted_mount = g_shell_quote(mountpoint);
+        gchar *df_cmd = g_strdup_printf("df --output=avail -BM %s | tail -1 | tr -d ' M'", quoted_mount);
+        FILE *space_fp = popen(df_cmd, "r");
+        char space_buf[32] = "";
+        long long free_mib = 0;
+        if (space_fp && fgets(space_buf, sizeof(space_buf), space_fp)) free_mib = atoll(space_buf);
+        if (space_fp) pclose(space_fp);
+        g_free(df_cmd);
+        g_free(quoted_mount);
+
+        guint64 min_offset = 0, footprint = 0;
+        get_io_trace_extent(records, &min_offset, &footprint);
+        long long size_mib = (long long)((footprint + 1048575) / 1048576);
+        if (size_mib < 64) size_mib = 64;
+        if (size_mib > free_mib - 1024) size_mib = free_mib - 1024;
+
+        if (size_mib < 64) {
+            GtkWidget *err = gtk_message_dialog_new(
+                NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                "ERROR: Insufficient free space on %s (%lld MiB available).", mountpoint, free_mib);
+            gtk_dialog_run(GTK_DIALOG(err));
+            gtk_widget_destroy(err);
+        } else if (strpbrk(mountpoint, " \t\n")) {
+            GtkWidget *err = gtk_message_dialog_new(
+                NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                "The mount point %s contains whitespace, which fio iologs cannot express.\n"
+                "Select an existing file or image instead.", mountpoint);
+            gtk_dialog_run(GTK_DIALOG(err));
+            gtk_widget_destroy(err);
+        } else {
+            region_size = size_mib * 1048576LL;
+            scratch_file = g_build_filename(mountpoint, "driveassistify-replay.tmp", NULL);
+        }
+    }
+
+    const gchar *target = target_file ? target_file : scratch_file;
+    gchar *iolog_path = NULL;
+    double span_s = 0;
+    gchar *summary = NULL;
+    if (region_size > 0 &&
+        write_replay_iolog_or_report(records, &iolog_path, target, 0, region_size, 4096,
+                                     target_file == NULL, &span_s, &summary)) {
+        GtkWidget *confirm = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL,
+            GTK_MESSAGE_WARNING, GTK_BUTTONS_YES_NO,
+            "I/O Trace Replay\n\n"
+            "Target: %s%s\n"
+            "Trace: %s\n"
+            "%s (%" G_GUINT64_FORMAT " unparsable lines or records skipped)\n"
+            "Original span: %.3f s, mode: %s\n\n"
+            "Are you sure you want to continue?",
+            target, target_file ? " (existing contents will be overwritten by trace writes)" : " (auto-deleted)",
+            trace_path, summary, skipped, span_s, no_stall ? "as fast as possible" : "time-faithful");
+        gint response = gtk_dialog_run(GTK_DIALOG(confirm));
+        gtk_widget_destroy(confirm);
+
+        if (response == GTK_RESPONSE_YES) {
+            gchar *params = g_strdup_printf("trace=%s, %s, mode=%s, iodepth=%d, target=%s",
+                                            trace_path, summary, no_stall ? "fast" : "time-faithful", iodepth, target);
+            gchar *out_path = benchmark_store_begin("I/O Trace Replay (fio)", "fio", device_path, params);
+            gchar *tee = benchmark_store_tee(out_path);
+            gchar *replay_cmd = build_trace_replay_command(iolog_path, no_stall, iodepth, span_s, tee);
+            gchar *cmd;
+            if (scratch_file) {
+                gchar *quoted_file = g_shell_quote(scratch_file);
+                cmd = g_strdup_printf(
+                    "echo 'Preparing scratch file...'; "
+                    "sudo fio --name=prefill --filename=%s --size=%lld --rw=write --bs=1M "
+                    "--ioengine=libaio --direct=1 --output=/dev/null && { %s; }; "
+                    "sudo rm -f %s",
+                    quoted_file, region_size, replay_cmd, quoted_file);
+                g_free(quoted_file);
+            } else {
+                cmd = g_strdup(replay_cmd);
+            }
+            run_command_in_terminal(tree_view, cmd);
+            g_free(cmd);
+            g_free(replay_cmd);
+            g_free(tee);
+            g_free(out_path);
+            g_free(params);
+        } else {
+            unlink(iolog_path);
+        }
     }
+
+    g_free(summary);
+    g_free(iolog_path);
+    g_free(scratch_file);
+    if (records) g_array_free(records, TRUE);
+    g_free(target_file);
+    g_free(trace_path);
+    g_free(mountpoint);
+    g_free(device_path);
+    g_free(partition_name);
 }
 
-void on_umount_l_activate(GtkWidget *menuitem, gpointer user_data) {
+/* Prints "<count> <what> in <seconds> s (<rate> per second)" from two /proc/uptime readings,
+ * followed by "meta;<name>;<rate>" for the results store. */
+static gchar *build_rate_report_command(const gchar *count_expr, const gchar *what, const gchar *name) {
+    return g_strdup_printf(
+        "awk -v n=\"%s\" -v s=\"$meta_start\" -v e=\"$meta_end\" "
+        "'BEGIN { d = e - s; if (d <= 0) d = 0.01; print n \" %s in \" d \" s (\" int(n / d) \" per second)\"; "
+        "print \"meta;%s;\" n / d }'",
+        count_expr, what, name);
+}
+
+/* Metadata benchmark on an already mounted file system; everything happens in a temporary directory under mount_dir. */
+static gchar *build_fs_metadata_benchmark_command(const gchar *mount_dir, int threads, int files, int fsync_seconds,
+                                                  gboolean cold_scan) {
+    gchar *bench_dir = g_build_filename(mount_dir, ".driveassistify-metabench", NULL);
+    gchar *quoted_dir = g_shell_quote(bench_dir);
+    gchar *common = g_strdup_printf("--directory=%s --thread --numjobs=%d --nrfiles=%d --filesize=4k "
+                                    "--openfiles=1 --group_reporting",
+                                    quoted_dir, threads, files);
+    gchar *scan_count = g_strdup_printf("$(sudo ls -f %s | wc -l)", quoted_dir);
+    gchar *scan_prefix = cold_scan
+        ? g_strdup_printf("echo && echo '== Directory scan, cold cache ==' && "
+                          "sync -f %s && sudo sh -c 'echo 2 > /proc/sys/vm/drop_caches' && ", quoted_dir)
+        : g_strdup("echo && echo '== Directory scan, warm cache ==' && ");
+    gchar *create_report = build_rate_report_command("$meta_total", "files created", "create");
+    gchar *stat_report = build_rate_report_command("$meta_total", "files stat()ed", "stat");
+    gchar *rename_report = build_rate_report_command("$meta_total", "files renamed", "rename");
+    gchar *unlink_report = build_rate_report_command("$meta_total", "files unlinked", "unlink");
+    gchar *scan_report = build_rate_report_command("$meta_entries", "directory entries listed",
+                                                   cold_scan ? "cold_scan" : "warm_scan");
+    gchar *stat_scan_report = build_rate_report_command("$meta_entries", "directory entries listed and stat()ed",
+                                                        "stat_scan");
+
+    gchar *cmd = g_strdup_printf(
+        "{ meta_total=%d; "
+        "sudo rm -rf %s && sudo mkdir -p %s && "
+        "echo '== Create (empty files, %d threads) ==' && "
+        "meta_start=$(cut -d' ' -f1 /proc/uptime) && "
+        "sudo fio --name=create --ioengine=filecreate --fallocate=none '--filename_format=meta.$jobnum.$filenum' %s && "
+        "meta_end=$(cut -d' ' -f1 /proc/uptime) && %s && "
+        "echo && echo '== Stat ==' && "
+        "meta_start=$(cut -d' ' -f1 /proc/uptime) && "
+        "sudo fio --name=stat --ioengine=filestat '--filename_format=meta.$jobnum.$filenum' %s && "
+        "meta_end=$(cut -d' ' -f1 /proc/uptime) && %s && "
+        "%s"
+        "meta_start=$(cut -d' ' -f1 /proc/uptime) && meta_entries=%s && "
+        "meta_end=$(cut -d' ' -f1 /proc/uptime) && %s && "
+        "echo && echo '== Directory scan with stat, warm cache ==' && "
+        "meta_start=$(cut -d' ' -f1 /proc/uptime) && meta_entries=$(sudo ls -lU %s | wc -l) && "
+        "meta_end=$(cut -d' ' -f1 /proc/uptime) && %s && "
+        "echo && echo '== Rename ==' && "
+        "meta_start=$(cut -d' ' -f1 /proc/uptime) && meta_job=0 && "
+        "while [ $meta_job -lt %d ]; do "
+        "sudo perl -e 'my ($d, $j, $n) = @ARGV; "
+        "for my $i (0 .. $n - 1) { rename(\"$d/meta.$j.$i\", \"$d/meta.$j.$i.r\") or die \"meta.$j.$i: $!\\n\" }' "
+        "%s $meta_job %d & meta_job=$((meta_job + 1)); done; wait; "
+        "meta_end=$(cut -d' ' -f1 /proc/uptime) && %s && "
+        "echo && echo '== Unlink ==' && "
+        "meta_start=$(cut -d' ' -f1 /proc/uptime) && "
+        "sudo fio --name=unlink --ioengine=filedelete '--filename_format=meta.$jobnum.$filenum.r' %s && "
+        "meta_end=$(cut -d' ' -f1 /proc/uptime) && %s && "
+        "echo && echo '== fsync after every 4 KiB write ==' && "
+        "sudo fio --name=fsync-small-writes --directory=%s --thread --numjobs=%d --ioengine=psync "
+        "--rw=randwrite --bs=4k --size=16m --fsync=1 --time_based --runtime=%d --group_reporting "
+        "--output-format=normal,terse --terse-version=3; "
+        "sudo rm -rf %s; }",
+        threads * files,
+        quoted_dir, quoted_dir,
+        threads,
+        common,
+        create_report,
+        common, stat_report,
+        scan_prefix, scan_count, scan_report,
+        quoted_dir, stat_scan_report,
+        threads, quoted_dir, files, rename_report,
+        common, unlink_report,
+        quoted_dir, threads, fsync_seconds,
+        quoted_dir);
+
+    g_free(stat_scan_report);
+    g_free(scan_report);
+    g_free(unlink_report);
+    g_free(rename_report);
+    g_free(stat_report);
+    g_free(create_report);
+    g_free(scan_prefix);
+    g_free(scan_count);
+    g_free(common);
+    g_free(quoted_dir);
+    g_free(bench_dir);
+    return cmd;
+}
+
+void on_fs_metadata_benchmark_activate(GtkWidget *menuitem, gpointer user_data) {
     GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
     GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
     GtkTreeModel *model;
     GtkTreeIter iter;
-    gchar *disk_name = NULL;
-    
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter, COL_NAME, &disk_name, -1);
+    gchar *partition_name = NULL;
 
-        gchar *device_path = g_strdup_printf("/dev/%s", disk_name);
-        gchar *quoted_device_path = g_shell_quote(device_path);
-        
-        gchar *command = g_strdup_printf(
-            "echo 'Lazy unmounting %s...'; "
-            "if mount | grep -q '^%s '; then "
-                "timeout 15 sudo umount -l %s && "
-                "echo 'Lazy unmount successful' || "
-                "(sleep 2 && timeout 15 sudo umount -l %s && "
-                "echo 'Lazy unmount successful on second attempt' || "
-                "echo 'ERROR: Lazy unmount failed'); "
-            "else "
-                "echo 'Device %s is not mounted - lazy unmounting not needed'; "
-            "fi",
-            device_path,
-            device_path,
-            quoted_device_path,
-            quoted_device_path,
-            device_path
-        );
-        
-        run_command_in_terminal(tree_view, command);
-        
-        g_free(command);
-        g_free(quoted_device_path);
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    if (!check_fio_available()) return;
+
+    gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
+    gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+    gchar *mountpoint = get_partition_mountpoint(device_path);
+
+    if (!mountpoint) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "%s is not mounted.\n\nMount the partition first; the test runs on its file system.", device_path);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
         g_free(device_path);
-        g_free(disk_name);
+        g_free(partition_name);
+        return;
+    }
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "Filesystem Metadata Benchmark",
+        NULL,
+        GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Start Test", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 500, 350);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+    gchar *info_text = g_strdup_printf(
+        "Device: %s\n"
+        "Mounted at: %s\n\n"
+        "Measures small file create, stat, rename and unlink rates,\n"
+        "cold and warm scans of one large directory, and fsync-heavy\n"
+        "4 KiB writes. All files are created in a temporary directory\n"
+        "on the partition and deleted afterwards.",
+        device_path, mountpoint);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new(info_text), FALSE, FALSE, 5);
+    g_free(info_text);
+
+    int cpus = g_get_num_processors();
+    GtkWidget *threads_spin = gtk_spin_button_new_with_range(1, 64, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(threads_spin), cpus < 8 ? cpus : 8);
+    GtkWidget *files_spin = gtk_spin_button_new_with_range(100, 1000000, 1000);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(files_spin), 10000);
+    GtkWidget *fsync_spin = gtk_spin_button_new_with_range(5, 600, 5);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(fsync_spin), 30);
+
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Worker threads:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), threads_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Files per thread:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), files_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("fsync write test duration (seconds):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), fsync_spin, FALSE, FALSE, 2);
+    GtkWidget *cold_check = gtk_check_button_new_with_label(
+        "Also scan with a cold cache (drops the dentry/inode cache of the whole system)");
+    gtk_box_pack_start(GTK_BOX(content_area), cold_check, FALSE, FALSE, 2);
+
+    gtk_widget_show_all(dialog);
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    int threads = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(threads_spin));
+    int files = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(files_spin));
+    int fsync_seconds = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(fsync_spin));
+    gboolean cold_scan = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(cold_check));
+    gtk_widget_destroy(dialog);
+
+    if (response == GTK_RESPONSE_ACCEPT) {
+        gchar *bench_dir = g_build_filename(mountpoint, ".driveassistify-metabench", NULL);
+        gchar *params = g_strdup_printf("threads=%d, files/thread=%d, fsync runtime=%ds, dir=%s",
+                                        threads, files, fsync_seconds, bench_dir);
+        gchar *out_path = benchmark_store_begin("Filesystem Metadata (fio)", "fs-meta", device_path, params);
+        gchar *tee = benchmark_store_tee(out_path);
+        gchar *bench = build_fs_metadata_benchmark_command(mountpoint, threads, files, fsync_seconds, cold_scan);
+        gchar *cmd = g_strconcat(bench, tee, NULL);
+        run_command_in_terminal(tree_view, cmd);
+
+        g_free(cmd);
+        g_free(bench);
+        g_free(tee);
+        g_free(out_path);
+        g_free(params);
+        g_free(bench_dir);
     }
+
+    g_free(mountpoint);
+    g_free(device_path);
+    g_free(partition_name);
 }
 
-void on_umount_f_activate(GtkWidget *menuitem, gpointer user_data) {
+void on_commit_latency_benchmark_activate(GtkWidget *menuitem, gpointer user_data) {
     GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
     GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
     GtkTreeModel *model;
     GtkTreeIter iter;
-    gchar *disk_name = NULL;
-    
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter, COL_NAME, &disk_name, -1);
+    gchar *partition_name = NULL;
 
-        gchar *device_path = g_strdup_printf("/dev/%s", disk_name);
-        gchar *quoted_device_path = g_shell_quote(device_path);
-        
-        gchar *command = g_strdup_printf(
-            "echo 'Force unmounting %s...'; "
-            "if mount | grep -q '^%s '; then "
-                "timeout 15 sudo umount -f %s && "
-                "echo 'Forced unmount successful' || "
-                "(sleep 2 && timeout 15 sudo umount -f %s && "
-                "echo 'Forced unmount successful on second attempt' || "
-                "echo 'ERROR: Forced unmount failed'); "
-            "else "
-                "echo 'Device %s is not mounted - force unmounting not needed'; "
-            "fi",
-            device_path,
-            device_path,
-            quoted_device_path,
-            quoted_device_path,
-            device_path
-        );
-        
-        run_command_in_terminal(tree_view, command);
-        
-        g_free(command);
-        g_free(quoted_device_path);
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    if (!check_fio_available()) return;
+
+    gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
+    gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+    gchar *mountpoint = get_partition_mountpoint(device_path);
+
+    if (!mountpoint) {
+        GtkWidget *err = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "%s is not mounted.\n\nMount the partition first; the test writes a log file on it.", device_path);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
         g_free(device_path);
-        g_free(disk_name);
+        g_free(partition_name);
+        return;
     }
-}
 
-void on_rename_partition_activate(GtkWidget *menuitem, gpointer user_data) {
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-    GtkTreeModel *model;
-    GtkTreeIter iter;
-    gchar *partition_name = NULL, *fstype = NULL;
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, COL_FSTYPE, &fstype, -1);
-        gchar *current_label = NULL;
-        gchar *label_cmd = NULL;
-        if (g_strcmp0(fstype, "ext4") == 0 || g_strcmp0(fstype, "ext3") == 0 || g_strcmp0(fstype, "ext2") == 0) {
-            label_cmd = g_strdup_printf(
-                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
-                "label=$( blkid -s LABEL -o value /dev/%s 2>/dev/null ); "
-                "if [ -z \"$label\" ]; then "
-                "  magic=$( sudo dd if=/dev/%s bs=1 skip=1080 count=2 2>/dev/null | od -An -tx1 | tr -d ' \\n' ); "
-                "  if [ \"$magic\" = '53ef' ]; then "
-                "    label=$( sudo dd if=/dev/%s bs=1 skip=1144 count=16 2>/dev/null "
-                "      | tr -d '\\0' | sed 's/[[:space:]]*$//' ); "
-                "  fi; "
-                "fi; "
-                "echo \"$label\"",
-                partition_name, partition_name, partition_name, partition_name
-            );
-        } else if (g_strcmp0(fstype, "ntfs") == 0) {
-            label_cmd = g_strdup_printf(
-                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
-                "blkid -s LABEL -o value /dev/%s 2>/dev/null",
-                partition_name, partition_name
-            );
-        } else if (g_strcmp0(fstype, "exfat") == 0) {
-            label_cmd = g_strdup_printf(
-                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
-                "blkid -s LABEL -o value /dev/%s 2>/dev/null",
-                partition_name, partition_name
-            );
-        } else if (g_strcmp0(fstype, "vfat") == 0 || g_strcmp0(fstype, "fat32") == 0 || g_strcmp0(fstype, "fat") == 0) {
-            label_cmd = g_strdup_printf(
-                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
-                "label=$( sudo dd if=/dev/%s bs=512 count=1 2>/dev/null | "
-                "  dd bs=1 skip=71 count=11 2>/dev/null | tr -d '\\0' | sed 's/[[:space:]]*$//' ); "
-                "if [ -z \"$label\" ] || [ \"$label\" = 'NO NAME' ]; then "
-                "  label=$( sudo dd if=/dev/%s bs=512 count=1 2>/dev/null | "
-                "    dd bs=1 skip=43 count=11 2>/dev/null | tr -d '\\0' | sed 's/[[:space:]]*$//' ); "
-                "fi; "
-                "if [ -z \"$label\" ] || [ \"$label\" = 'NO NAME' ]; then "
-                "  blkid -s LABEL -o value /dev/%s 2>/dev/null; "
-                "else echo \"$label\"; fi",
-                partition_name, partition_name, partition_name, partition_name
-            );
-        } else if (g_strcmp0(fstype, "xfs") == 0) {
-            label_cmd = g_strdup_printf(
-                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
-                "label=$( xfs_admin -l /dev/%s 2>/dev/null | cut -d'\"' -f2 ); "
-                "if [ -z \"$label\" ]; then "
-                "  magic=$( sudo dd if=/dev/%s bs=1 count=4 2>/dev/null | od -An -tx1 | tr -d ' \\n' ); "
-                "  if [ \"$magic\" = '58465342' ]; then "
-                "    label=$( sudo dd if=/dev/%s bs=1 skip=108 count=12 2>/dev/null "
-                "      | tr -d '\\0' | sed 's/[[:space:]]*$//' ); "
-                "  fi; "
-                "fi; "
-                "echo \"$label\"",
-                partition_name, partition_name, partition_name, partition_name
-            );
-        } else if (g_strcmp0(fstype, "btrfs") == 0) {
-            label_cmd = g_strdup_printf(
-                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
-                "label=$( btrfs filesystem label /dev/%s 2>/dev/null ); "
-                "if [ -z \"$label\" ]; then "
-                "  magic=$( sudo dd if=/dev/%s bs=1 skip=65600 count=8 2>/dev/null ); "
-                "  if [ \"$magic\" = '_BHRfS_M' ]; then "
-                "    label=$( sudo dd if=/dev/%s bs=1 skip=65835 count=256 2>/dev/null "
-                "      | tr -d '\\0' | sed 's/[[:space:]]*$//' ); "
-                "  fi; "
-                "fi; "
-                "echo \"$label\"",
-                partition_name, partition_name, partition_name, partition_name
-            );
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "Commit Latency Benchmark",
+        NULL,
+        GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Start Test", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 500, 350);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+    gchar *info_text = g_strdup_printf(
+        "Device: %s\n"
+        "Mounted at: %s\n\n"
+        "Simulates a database write-ahead log: every small write is made\n"
+        "durable before the next one is issued. Drives with slow cache\n"
+        "flushes show high commit latency here.",
+        device_path, mountpoint);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new(info_text), FALSE, FALSE, 5);
+    g_free(info_text);
+
+    /* Synchronous writes rather than fio's --fdatasync/--fsync: fio times those calls separately,
+     * so the write latency it reports would leave out the flush. */
+    GtkWidget *sync_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(sync_combo), "O_DSYNC writes (same as fdatasync after every write)");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(sync_combo), "O_SYNC writes (same as fsync after every write)");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(sync_combo), 0);
+
+    GtkWidget *bs_combo = gtk_combo_box_text_new();
+    const char *block_sizes[] = {"512", "4k", "8k", "16k", "64k", NULL};
+    for (int i = 0; block_sizes[i]; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(bs_combo), block_sizes[i]);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(bs_combo), 1);
+
+    GtkWidget *jobs_spin = gtk_spin_button_new_with_range(1, 64, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(jobs_spin), 1);
+    GtkWidget *duration_spin = gtk_spin_button_new_with_range(10, 3600, 10);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(duration_spin), 60);
+    GtkWidget *append_check = gtk_check_button_new_with_label("Append to a growing file (like a real log) instead of overwriting");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(append_check), TRUE);
+
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Durability method:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), sync_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Write size:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), bs_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Concurrent writers (one log file each):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), jobs_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Duration (seconds):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), duration_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), append_check, FALSE, FALSE, 2);
+
+    gtk_widget_show_all(dialog);
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    int sync_method = gtk_combo_box_get_active(GTK_COMBO_BOX(sync_combo));
+    gchar *bs = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(bs_combo));
+    int jobs = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(jobs_spin));
+    int duration = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(duration_spin));
+    gboolean append = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(append_check));
+    gtk_widget_destroy(dialog);
+
+    if (response == GTK_RESPONSE_ACCEPT) {
+        const char *sync_args[] = {"--sync=dsync", "--sync=sync"};
+        const char *sync_names[] = {"O_DSYNC", "O_SYNC"};
+        if (sync_method < 0 || sync_method > 1) sync_method = 0;
+
+        gchar *test_dir = g_build_filename(mountpoint, ".driveassistify-commit", NULL);
+        gchar *quoted_dir = g_shell_quote(test_dir);
+
+        gchar *params = g_strdup_printf("sync=%s, bs=%s, writers=%d, runtime=%ds, %s, dir=%s",
+                                        sync_names[sync_method], bs, jobs, duration,
+                                        append ? "append" : "overwrite", test_dir);
+        gchar *out_path = benchmark_store_begin("Commit Latency (fio)", "fio", device_path, params);
+        gchar *store_copy = NULL;
+        if (out_path) {
+            gchar *quoted_out = g_shell_quote(out_path);
+            store_copy = g_strdup_printf("; cat \"$commit_tmp/out\" \"$commit_tmp/verdict\" >> %s", quoted_out);
+            g_free(quoted_out);
         } else {
-            label_cmd = g_strdup_printf(
-                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
-                "blkid -s LABEL -o value /dev/%s 2>/dev/null",
-                partition_name, partition_name
-            );
-        }
-        if (label_cmd) {
-            FILE *fp = popen(label_cmd, "r");
-            if (fp) {
-                char label_buf[256] = {0};
-                if (fgets(label_buf, sizeof(label_buf), fp)) {
-                    g_strstrip(label_buf);
-                    if (strlen(label_buf) > 0)
-                        current_label = g_strdup(label_buf);
-                }
-                pclose(fp);
-            }
-            g_free(label_cmd);
-        }
-        GtkWidget *dialog = gtk_dialog_new_with_buttons(
-            "Rename Partition", NULL, GTK_DIALOG_MODAL,
-            "_Cancel", GTK_RESPONSE_CANCEL,
-            "_Rename", GTK_RESPONSE_ACCEPT,
-            NULL
-        );
-        gtk_window_set_default_size(GTK_WINDOW(dialog), 400, 140);
-        GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
-        gchar *info_text;
-        if (current_label && strlen(current_label) > 0)
-            info_text = g_strdup_printf("Partition: %s (%s)\nCurrent label: %s", partition_name, fstype, current_label);
-        else
-            info_text = g_strdup_printf("Partition: %s (%s)\nCurrent label: (empty)", partition_name, fstype);
-        GtkWidget *info_label_w = gtk_label_new(info_text);
-        gtk_label_set_xalign(GTK_LABEL(info_label_w), 0.0);
-        gtk_box_pack_start(GTK_BOX(content_area), info_label_w, FALSE, FALSE, 10);
-        g_free(info_text);
-        GtkWidget *entry = gtk_entry_new();
-        gtk_entry_set_max_length(GTK_ENTRY(entry), 16);
-        gtk_entry_set_width_chars(GTK_ENTRY(entry), 24);
-        if (current_label && strlen(current_label) > 0) {
-            gtk_entry_set_text(GTK_ENTRY(entry), current_label);
-            gtk_editable_select_region(GTK_EDITABLE(entry), 0, -1);
-        }
-        gtk_box_pack_start(GTK_BOX(content_area), entry, FALSE, FALSE, 5);
-        gtk_widget_show_all(dialog);
-        gint response = gtk_dialog_run(GTK_DIALOG(dialog));
-        gchar *new_label = NULL;
-        if (response == GTK_RESPONSE_ACCEPT)
-            new_label = g_strdup(gtk_entry_get_text(GTK_ENTRY(entry)));
-        gtk_widget_destroy(dialog);
-        if (new_label && strlen(new_label) > 0) {
-            gchar *cmd = NULL;
-            if (g_strcmp0(fstype, "ext4") == 0 || g_strcmp0(fstype, "ext3") == 0 || g_strcmp0(fstype, "ext2") == 0) {
-                cmd = g_strdup_printf(
-                    "sudo e2label %%s '%s' && "
-                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null && "
-                    "echo 'Label changed (ext2/3/4)' || echo 'ERROR: Failed to change ext label'",
-                    new_label
-                );
-            } else if (g_strcmp0(fstype, "ntfs") == 0) {
-                cmd = g_strdup_printf(
-                    "sudo ntfslabel --force %%s '%s' >/dev/null 2>&1 && "
-                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null && "
-                    "echo 'Label changed (NTFS)' || echo 'ERROR: Failed to change NTFS label'",
-                    new_label
-                );
-            } else if (g_strcmp0(fstype, "exfat") == 0) {
-                cmd = g_strdup_printf(
-                    "sudo exfatlabel %%s '%s' && "
-                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null && "
-                    "echo 'Label changed (exFAT)' || echo 'ERROR: Failed to change exFAT label'",
-                    new_label
-                );
-            } else if (g_strcmp0(fstype, "vfat") == 0 || g_strcmp0(fstype, "fat32") == 0 || g_strcmp0(fstype, "fat") == 0) {
-                cmd = g_strdup_printf(
-                    "{ sudo dosfslabel %%s '%s' 2>&1 || sudo fatlabel %%s '%s' 2>&1; } | "
-                    "grep -v 'differences\\|Differences\\|offset\\|Not automatically\\|backup'; "
-                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null; "
-                    "echo 'Label changed (FAT)'",
-                    new_label, new_label
-                );
-            } else if (g_strcmp0(fstype, "xfs") == 0) {
-                cmd = g_strdup_printf(
-                    "sudo xfs_admin -L '%s' %%s && "
-                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null && "
-                    "echo 'Label changed (XFS)' || echo 'ERROR: Failed to change XFS label'",
-                    new_label
-                );
-            } else if (g_strcmp0(fstype, "btrfs") == 0) {
-                cmd = g_strdup_printf(
-                    "sudo btrfs filesystem label %%s '%s' && "
-                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null && "
-                    "echo 'Label changed (Btrfs)' || echo 'ERROR: Failed to change Btrfs label'",
-                    new_label
-                );
-            } else {
-                cmd = g_strdup_printf("echo 'Unsupported or unknown filesystem: %s'", fstype ? fstype : "unknown");
-            }
-            run_command_in_terminal(tree_view, cmd);
-            g_free(cmd);
-            g_free(new_label);
+            store_copy = g_strdup("");
         }
-        if (current_label) g_free(current_label);
-        g_free(partition_name);
-        g_free(fstype);
+
+        gchar *cmd = g_strdup_printf(
+            "commit_tmp=$(mktemp -d) && sudo rm -rf %s && sudo mkdir -p %s && "
+            "sudo fio --name=commit --directory=%s '--filename_format=wal.$jobnum' --ioengine=psync "
+            "--rw=write --bs=%s --size=256m %s%s --thread --numjobs=%d --time_based --runtime=%d "
+            "--percentile_list=50:90:99:99.9:99.99 --group_reporting "
+            "--output-format=normal,terse --terse-version=3 2>&1 | tee \"$commit_tmp/out\"; "
+            "awk -F';' -v jobs=%d '/^3;/ { iops = $49; if (iops <= 0) next; lat = jobs / iops * 1000000; "
+            "print \"\"; print \"Commits per second: \" int(iops); "
+            "print \"Mean commit latency per writer: \" int(lat) \" us\"; "
+            "if (lat < 100) print \"Verdict: commits finish in under 0.1 ms. The drive either has power-loss protection \" "
+            "\"or acknowledges flushes before data reaches the media - check its specification.\"; "
+            "else if (lat > 5000) print \"Verdict: slow cache flushes (over 5 ms per commit). \" "
+            "\"Poor fit for databases and other commit-heavy workloads.\"; "
+            "else print \"Verdict: normal flush behaviour for a drive without power-loss protection.\" }' "
+            "\"$commit_tmp/out\" | tee \"$commit_tmp/verdict\"%s; "
+            "sudo rm -rf %s; rm -rf \"$commit_tmp\"",
+            quoted_dir, quoted_dir,
+            quoted_dir, bs, sync_args[sync_method], append ? " --file_append=1" : "", jobs, duration,
+            jobs, store_copy,
+            quoted_dir);
+        run_command_in_terminal(tree_view, cmd);
+
+        g_free(cmd);
+        g_free(store_copy);
+        g_free(out_path);
+        g_free(params);
+        g_free(quoted_dir);
+        g_free(test_dir);
     }
+
+    g_free(bs);
+    g_free(mountpoint);
+    g_free(device_path);
+    g_free(partition_name);
 }
 
-void on_partition_table_activate(GtkWidget *menuitem, gpointer user_data) {
+void on_read_path_comparison_activate(GtkWidget *menuitem, gpointer user_data) {
     GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
     GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
     GtkTreeModel *model;
     GtkTreeIter iter;
-    gchar *disk_name = NULL;
-    gchar *type = NULL;
+    gchar *partition_name = NULL;
 
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter, COL_NAME, &disk_name, COL_TYPE, &type, -1);
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    if (!check_fio_available()) return;
 
-        if (g_strcmp0(type, "disk") != 0) {
+    gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
+    gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "Read Path Comparison",
+        NULL,
+        GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Start Test", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 500, 300);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+    gchar *info_text = g_strdup_printf(
+        "Device: %s\n"
+        "Operation: Sequential read (safe)\n\n"
+        "Reads the same region four times: buffered read(), O_DIRECT,\n"
+        "mmap with MADV_SEQUENTIAL and io_uring with registered buffers,\n"
+        "then reports bandwidth and CPU time per GiB for each path.",
+        device_path);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new(info_text), FALSE, FALSE, 5);
+    g_free(info_text);
+
+    GtkWidget *size_entry = gtk_entry_new();
+    gtk_entry_set_text(GTK_ENTRY(size_entry), "2048");
+    GtkWidget *bs_combo = gtk_combo_box_text_new();
+    const char *block_sizes[] = {"128k", "1M", "4M", NULL};
+    for (int i = 0; block_sizes[i]; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(bs_combo), block_sizes[i]);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(bs_combo), 1);
+    GtkWidget *qd_combo = gtk_combo_box_text_new();
+    const char *queue_depths[] = {"1", "4", "8", "16", "32", "64", NULL};
+    for (int i = 0; queue_depths[i]; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(qd_combo), queue_depths[i]);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(qd_combo), 3);
+
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Region size in MiB (from the start of the device):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), size_entry, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Block size:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), bs_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("io_uring queue depth (the other paths are synchronous):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), qd_combo, FALSE, FALSE, 2);
+
+    gtk_widget_show_all(dialog);
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    long long size_mib = atoll(gtk_entry_get_text(GTK_ENTRY(size_entry)));
+    gchar *bs = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(bs_combo));
+    gchar *qd = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(qd_combo));
+    gtk_widget_destroy(dialog);
+
+    if (response == GTK_RESPONSE_ACCEPT) {
+        if (size_mib <= 0) size_mib = 2048;
+        const char *path_names[] = {"buffered", "direct", "mmap", "io_uring"};
+        const char *path_args[] = {
+            "--ioengine=psync --direct=0",
+            "--ioengine=psync --direct=1",
+            "--ioengine=mmap --fadvise_hint=sequential",
+            NULL
+        };
+        gchar *uring_args = g_strdup_printf("--ioengine=io_uring --direct=1 --fixedbufs --registerfiles --iodepth=%s", qd);
+        gchar *quoted_dev = g_shell_quote(device_path);
+        gchar *evict = build_target_cache_evict_command(device_path, TRUE);
+
+        GString *cmd = g_string_new("readpath_out=$(mktemp)");
+        for (int i = 0; i < 4; i++) {
+            const gchar *args = path_args[i] ? path_args[i] : uring_args;
+            gchar *params = g_strdup_printf("size=%lld MiB, bs=%s, %s", size_mib, bs, args);
+            gchar *test = g_strdup_printf("Read Path: %s (fio)", path_names[i]);
+            gchar *out_path = benchmark_store_begin(test, "fio", device_path, params);
+            gchar *quoted_out = out_path ? g_shell_quote(out_path) : NULL;
+            g_string_append_printf(cmd,
+                "; echo; echo '=== %s ==='; %s && "
+                "sudo fio --name=%s --filename=%s --readonly --rw=read --bs=%s --size=%lldM %s "
+                "--output-format=normal,terse --terse-version=3 2>&1 | tee -a \"$readpath_out\"%s%s",
+                path_names[i], evict,
+                path_names[i], quoted_dev, bs, size_mib, args,
+                quoted_out ? " | tee -a " : "", quoted_out ? quoted_out : "");
+            g_free(quoted_out);
+            g_free(out_path);
+            g_free(test);
+            g_free(params);
+        }
+        g_string_append(cmd,
+            "; echo; echo '=== Summary ==='; "
+            "awk -F';' '/^3;/ { kb = $6 + 0; if (kb <= 0) next; rt = $9 / 1000; gib = kb / 1048576; "
+            "cpu = ($88 + $89) / 100 * rt; "
+            "print \"  \" $3 \": \" int($7 / 1024) \" MiB/s, CPU \" int(cpu / gib * 1000) / 1000 \" s per GiB \" "
+            "\"(CPU usage percent: user \" $88 + 0 \", system \" $89 + 0 \")\" }' \"$readpath_out\"; "
+            "rm -f \"$readpath_out\"");
+        run_command_in_terminal(tree_view, cmd->str);
+
+        g_string_free(cmd, TRUE);
+        g_free(evict);
+        g_free(quoted_dev);
+        g_free(uring_args);
+    }
+
+    g_free(qd);
+    g_free(bs);
+    g_free(device_path);
+    g_free(partition_name);
+}
+
+typedef struct {
+    gchar *scheduler;
+    gchar **schedulers;
+    int read_ahead_kb;
+    int nr_requests;
+    int rq_affinity;
+} QueueSettings;
+
+static void free_queue_settings(QueueSettings *settings) {
+    if (!settings) return;
+    g_free(settings->scheduler);
+    g_strfreev(settings->schedulers);
+    g_free(settings);
+}
+
+static int read_sysfs_block_int(const gchar *disk_name, const gchar *attr) {
+    gchar *value = read_sysfs_block_attr(disk_name, attr);
+    int result = value ? atoi(value) : -1;
+    g_free(value);
+    return result;
+}
+
+/* queue/scheduler lists every available scheduler with the active one in brackets, e.g. "mq-deadline kyber [bfq] none". */
+static QueueSettings *read_queue_settings(const gchar *disk_name) {
+    gchar *scheduler_line = read_sysfs_block_attr(disk_name, "queue/scheduler");
+    if (!scheduler_line) return NULL;
+
+    QueueSettings *settings = g_new0(QueueSettings, 1);
+    GPtrArray *names = g_ptr_array_new();
+    gchar **tokens = g_strsplit_set(scheduler_line, " \t", -1);
+    for (int i = 0; tokens[i]; i++) {
+        gchar *name = tokens[i];
+        if (strlen(name) == 0) continue;
+        if (name[0] == '[') {
+            name = g_strndup(name + 1, strlen(name) - (name[strlen(name) - 1] == ']' ? 2 : 1));
+            settings->scheduler = g_strdup(name);
+        } else {
+            name = g_strdup(name);
+        }
+        g_ptr_array_add(names, name);
+    }
+    g_ptr_array_add(names, NULL);
+    settings->schedulers = (gchar **)g_ptr_array_free(names, FALSE);
+    if (!settings->scheduler) settings->scheduler = g_strdup(settings->schedulers[0] ? settings->schedulers[0] : "none");
+    g_strfreev(tokens);
+    g_free(scheduler_line);
+
+    settings->read_ahead_kb = read_sysfs_block_int(disk_name, "queue/read_ahead_kb");
+    settings->nr_requests = read_sysfs_block_int(disk_name, "queue/nr_requests");
+    settings->rq_affinity = read_sysfs_block_int(disk_name, "queue/rq_affinity");
+    return settings;
+}
+
+/* The scheduler goes first because switching it resets nr_requests to the new scheduler's default. */
+static gchar *build_queue_apply_command(const gchar *disk_name, const QueueSettings *settings) {
+    GString *cmd = g_string_new(NULL);
+    g_string_append_printf(cmd, "q=/sys/block/%s/queue; ", disk_name);
+    g_string_append_printf(cmd, "echo %s | sudo tee $q/scheduler > /dev/null; ", settings->scheduler);
+    if (settings->nr_requests > 0)
+        g_string_append_printf(cmd, "echo %d | sudo tee $q/nr_requests > /dev/null; ", settings->nr_requests);
+    if (settings->read_ahead_kb >= 0)
+        g_string_append_printf(cmd, "echo %d | sudo tee $q/read_ahead_kb > /dev/null; ", settings->read_ahead_kb);
+    if (settings->rq_affinity >= 0)
+        g_string_append_printf(cmd, "echo %d | sudo tee $q/rq_affinity > /dev/null; ", settings->rq_affinity);
+    g_string_append(cmd, "echo; echo 'Queue settings now:'; "
+                         "for f in scheduler nr_requests read_ahead_kb rq_affinity; do echo \"  $f: $(cat $q/$f)\"; done");
+    return g_string_free(cmd, FALSE);
+}
+
+static void set_queue_panel_values(GtkWidget *window, const QueueSettings *settings) {
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(g_object_get_data(G_OBJECT(window), "scheduler_combo")), settings->scheduler);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(window), "read_ahead_spin")), settings->read_ahead_kb);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(window), "nr_requests_spin")), settings->nr_requests);
+    gchar affinity_id[8];
+    g_snprintf(affinity_id, sizeof(affinity_id), "%d", settings->rq_affinity);
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(g_object_get_data(G_OBJECT(window), "rq_affinity_combo")), affinity_id);
+}
+
+static QueueSettings *get_queue_panel_values(GtkWidget *window) {
+    QueueSettings *settings = g_new0(QueueSettings, 1);
+    const gchar *scheduler = gtk_combo_box_get_active_id(GTK_COMBO_BOX(g_object_get_data(G_OBJECT(window), "scheduler_combo")));
+    const gchar *affinity = gtk_combo_box_get_active_id(GTK_COMBO_BOX(g_object_get_data(G_OBJECT(window), "rq_affinity_combo")));
+    settings->scheduler = g_strdup(scheduler ? scheduler : "none");
+    settings->read_ahead_kb = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(window), "read_ahead_spin")));
+    settings->nr_requests = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(window), "nr_requests_spin")));
+    settings->rq_affinity = affinity ? atoi(affinity) : -1;
+    return settings;
+}
+
+static void on_queue_reload_clicked(GtkWidget *button, gpointer user_data) {
+    GtkWidget *window = GTK_WIDGET(user_data);
+    QueueSettings *current = read_queue_settings(g_object_get_data(G_OBJECT(window), "disk_name"));
+    if (!current) return;
+    set_queue_panel_values(window, current);
+    gchar *text = g_strdup_printf("Current: scheduler %s, nr_requests %d, read_ahead_kb %d, rq_affinity %d",
+                                  current->scheduler, current->nr_requests, current->read_ahead_kb, current->rq_affinity);
+    gtk_label_set_text(GTK_LABEL(g_object_get_data(G_OBJECT(window), "current_label")), text);
+    g_free(text);
+    free_queue_settings(current);
+}
+
+static void on_queue_apply_clicked(GtkWidget *button, gpointer user_data) {
+    GtkWidget *window = GTK_WIDGET(user_data);
+    QueueSettings *settings = get_queue_panel_values(window);
+    gchar *cmd = build_queue_apply_command(g_object_get_data(G_OBJECT(window), "disk_name"), settings);
+    run_command_simple(cmd, window, NULL, NULL, NULL);
+    g_free(cmd);
+    free_queue_settings(settings);
+}
+
+static void on_queue_revert_clicked(GtkWidget *button, gpointer user_data) {
+    GtkWidget *window = GTK_WIDGET(user_data);
+    QueueSettings *original = g_object_get_data(G_OBJECT(window), "original");
+    gchar *cmd = build_queue_apply_command(g_object_get_data(G_OBJECT(window), "disk_name"), original);
+    set_queue_panel_values(window, original);
+    run_command_simple(cmd, window, NULL, NULL, NULL);
+    g_free(cmd);
+}
+
+static gchar *get_udev_serial(const gchar *disk_name) {
+    gchar *cmd = g_strdup_printf("udevadm info --query=property --name=/dev/%s 2>/dev/null", disk_name);
+    FILE *fp = popen(cmd, "r");
+    g_free(cmd);
+    gchar *serial = NULL;
+    char line[512];
+    while (fp && fgets(line, sizeof(line), fp)) {
+        if (g_str_has_prefix(line, "ID_SERIAL=")) {
+            serial = g_strstrip(g_strdup(line + strlen("ID_SERIAL=")));
+            break;
+        }
+    }
+    if (fp) pclose(fp);
+    return serial;
+}
+
+/* Matches the disk by its udev serial so the rule survives renumbering; falls back to the kernel name. */
+static void on_queue_export_udev_clicked(GtkWidget *button, gpointer user_data) {
+    GtkWidget *window = GTK_WIDGET(user_data);
+    const gchar *disk_name = g_object_get_data(G_OBJECT(window), "disk_name");
+    QueueSettings *settings = get_queue_panel_values(window);
+    gchar *serial = get_udev_serial(disk_name);
+
+    GString *rule = g_string_new("# Block queue settings exported by DriveAssistify\n");
+    gchar *match = NULL;
+    if (serial && strlen(serial) > 0 && !strchr(serial, '"')) {
+        match = g_strdup_printf("ENV{ID_SERIAL}==\"%s\"", serial);
+    } else {
+        g_string_append(rule, "# No udev serial was found, so the rule matches the kernel name, which can change between boots.\n");
+        match = g_strdup_printf("KERNEL==\"%s\"", disk_name);
+    }
+    g_string_append_printf(rule,
+        "ACTION==\"add|change\", SUBSYSTEM==\"block\", ENV{DEVTYPE}==\"disk\", %s, "
+        "ATTR{queue/scheduler}=\"%s\", ATTR{queue/nr_requests}=\"%d\", ATTR{queue/read_ahead_kb}=\"%d\", ATTR{queue/rq_affinity}=\"%d\"\n",
+        match, settings->scheduler, settings->nr_requests, settings->read_ahead_kb, settings->rq_affinity);
+
+    GtkWidget *chooser = gtk_file_chooser_dialog_new("Export udev Rule", GTK_WINDOW(window), GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                     "_Cancel", GTK_RESPONSE_CANCEL, "_Save", GTK_RESPONSE_ACCEPT, NULL);
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(chooser), TRUE);
+    gchar *default_name = g_strdup_printf("60-driveassistify-queue-%s.rules", disk_name);
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(chooser), default_name);
+    g_free(default_name);
+
+    if (gtk_dialog_run(GTK_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT) {
+        gchar *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+        GError *error = NULL;
+        GtkWidget *msg;
+        if (g_file_set_contents(filename, rule->str, -1, &error)) {
+            msg = gtk_message_dialog_new(GTK_WINDOW(window), GTK_DIALOG_MODAL, GTK_MESSAGE_INFO, GTK_BUTTONS_OK,
+                "Rule saved to %s\n\nTo make it permanent, copy it to /etc/udev/rules.d/ and run:\n"
+                "sudo udevadm control --reload && sudo udevadm trigger --subsystem-match=block", filename);
+        } else {
+            msg = gtk_message_dialog_new(GTK_WINDOW(window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                "Could not save the rule: %s", error->message);
+            g_clear_error(&error);
+        }
+        gtk_dialog_run(GTK_DIALOG(msg));
+        gtk_widget_destroy(msg);
+        g_free(filename);
+    }
+    gtk_widget_destroy(chooser);
+
+    g_free(match);
+    g_string_free(rule, TRUE);
+    g_free(serial);
+    free_queue_settings(settings);
+}
+
+/*
+ * Tunes one setting at a time (scheduler, nr_requests, read_ahead_kb, rq_affinity), keeping the best candidate of each
+ * before moving on to the next. Each candidate is measured with the same read-only fio job after evicting the device's
+ * cached pages. The objective is either read bandwidth (higher wins) or p99 completion latency (lower wins).
+ * fio sorts the percentile list, so with 99:99.9 the p99 is always the first read percentile field ($18).
+ */
+static gchar *build_queue_autotune_command(const gchar *disk_name, const gchar *fio_args, gboolean latency_objective,
+                                           const gchar *const candidates[4], const gchar *baseline_out, const gchar *tuned_out) {
+    gchar *disk_path = g_strdup_printf("/dev/%s", disk_name);
+    gchar *quoted_disk = g_shell_quote(disk_path);
+    gchar *evict = build_target_cache_evict_command(disk_path, TRUE);
+    gchar *quoted_baseline = baseline_out ? g_shell_quote(baseline_out) : g_strdup("''");
+    gchar *quoted_tuned = tuned_out ? g_shell_quote(tuned_out) : g_strdup("''");
+    const gchar *params[] = {"scheduler", "nr_requests", "read_ahead_kb", "rq_affinity"};
+
+    GString *cmd = g_string_new(NULL);
+    g_string_append_printf(cmd,
+        "q=/sys/block/%s/queue; qt_tmp=$(mktemp); "
+        "qt_run() { %s; sudo fio --name=queue-tune --filename=%s --readonly %s --percentile_list=99:99.9 "
+        "--output-format=terse --terse-version=3 "
+        "--group_reporting > \"$qt_tmp\" 2>&1; [ -n \"$1\" ] && cat \"$qt_tmp\" >> \"$1\"; "
+        "awk -F';' -v obj=%s '$1 == \"3\" { if (obj == \"bw\") v = $7; else { v = $18; sub(/.*=/, \"\", v) } print int(v); exit }' \"$qt_tmp\"; }; "
+        "qt_better() { [ -n \"$1\" ] && [ \"$1\" -gt 0 ] && { [ -z \"$2\" ] || [ \"$1\" %s \"$2\" ]; }; }; "
+        "qt_get() { if [ \"$1\" = scheduler ]; then sed 's/.*\\[\\(.*\\)\\].*/\\1/' $q/scheduler; else cat $q/$1; fi; }; "
+        "qt_unit=%s; "
+        "echo 'Measuring the current settings (baseline)...'; qt_base=$(qt_run %s); "
+        "echo \"Baseline: $qt_base $qt_unit\"; ",
+        disk_name, evict, quoted_disk, fio_args,
+        latency_objective ? "lat" : "bw", latency_objective ? "-lt" : "-gt",
+        latency_objective ? "'us p99 latency'" : "'KiB/s'", quoted_baseline);
+
+    for (int i = 0; i < 4; i++) {
+        if (!candidates[i] || strlen(candidates[i]) == 0) continue;
+        g_string_append_printf(cmd,
+            "echo; echo 'Tuning %s: %s'; qt_keep=$(qt_get %s); qt_best=''; qt_best_val=$qt_keep; "
+            "for qt_v in %s; do "
+            "if echo $qt_v | sudo tee $q/%s > /dev/null 2>&1; then qt_r=$(qt_run); echo \"  %s=$qt_v: $qt_r $qt_unit\"; "
+            "if qt_better \"$qt_r\" \"$qt_best\"; then qt_best=$qt_r; qt_best_val=$qt_v; fi; "
+            "else echo \"  %s=$qt_v: rejected by the kernel\"; fi; done; "
+            "echo $qt_best_val | sudo tee $q/%s > /dev/null; echo \"Keeping %s=$qt_best_val\"; ",
+            params[i], candidates[i], params[i], candidates[i], params[i], params[i], params[i], params[i], params[i]);
+    }
+
+    g_string_append_printf(cmd,
+        "echo; echo 'Measuring the tuned settings...'; qt_final=$(qt_run %s); "
+        "echo \"Baseline: $qt_base $qt_unit, tuned: $qt_final $qt_unit\"; "
+        "if qt_better \"$qt_base\" \"$qt_final\"; then echo 'The tuned settings did not beat the baseline; the difference may be noise. "
+        "Use Revert in the tuning panel to go back.'; fi; "
+        "echo; echo 'Queue settings now:'; for f in scheduler nr_requests read_ahead_kb rq_affinity; do echo \"  $f: $(cat $q/$f)\"; done; "
+        "rm -f \"$qt_tmp\"",
+        quoted_tuned);
+
+    g_free(quoted_tuned);
+    g_free(quoted_baseline);
+    g_free(evict);
+    g_free(quoted_disk);
+    g_free(disk_path);
+    return g_string_free(cmd, FALSE);
+}
+
+static void on_queue_autotune_clicked(GtkWidget *button, gpointer user_data) {
+    GtkWidget *window = GTK_WIDGET(user_data);
+    const gchar *disk_name = g_object_get_data(G_OBJECT(window), "disk_name");
+    QueueSettings *original = g_object_get_data(G_OBJECT(window), "original");
+    if (!check_fio_available()) return;
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Queue Auto-Tune", GTK_WINDOW(window), GTK_DIALOG_MODAL,
+                                                    "_Cancel", GTK_RESPONSE_CANCEL, "_Start", GTK_RESPONSE_ACCEPT, NULL);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new(
+        "Each candidate is applied and measured with a read-only fio job.\n"
+        "Settings are tuned one after another, keeping the best value of each.\n"
+        "Leave a candidate list empty to keep that setting as it is."), FALSE, FALSE, 5);
+
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 6);
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 8);
+    gtk_container_set_border_width(GTK_CONTAINER(grid), 5);
+
+    GtkWidget *objective_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(objective_combo), "bw", "Throughput (higher is better)");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(objective_combo), "lat", "p99 latency (lower is better)");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(objective_combo), 0);
+
+    GtkWidget *workload_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(workload_combo), "rand", "Random 4 KiB read, queue depth 32, O_DIRECT");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(workload_combo), "seqdirect", "Sequential 128 KiB read, queue depth 8, O_DIRECT");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(workload_combo), "seqbuffered", "Sequential 1 MiB buffered read (uses read-ahead)");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(workload_combo), 0);
+
+    GtkWidget *runtime_spin = gtk_spin_button_new_with_range(5, 300, 5);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(runtime_spin), 15);
+
+    GString *scheduler_list = g_string_new(NULL);
+    for (int i = 0; original->schedulers[i]; i++)
+        g_string_append_printf(scheduler_list, "%s%s", i ? " " : "", original->schedulers[i]);
+    GtkWidget *entries[4];
+    const char *entry_labels[] = {"Schedulers:", "nr_requests:", "read_ahead_kb:", "rq_affinity:"};
+    const char *entry_defaults[] = {scheduler_list->str, "32 64 128 256", "128 512 2048 8192", "1 2"};
+    for (int i = 0; i < 4; i++) {
+        entries[i] = gtk_entry_new();
+        gtk_entry_set_text(GTK_ENTRY(entries[i]), entry_defaults[i]);
+        gtk_grid_attach(GTK_GRID(grid), gtk_label_new(entry_labels[i]), 0, i + 3, 1, 1);
+        gtk_grid_attach(GTK_GRID(grid), entries[i], 1, i + 3, 1, 1);
+    }
+    g_string_free(scheduler_list, TRUE);
+
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Objective:"), 0, 0, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), objective_combo, 1, 0, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Workload:"), 0, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), workload_combo, 1, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Seconds per candidate:"), 0, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), runtime_spin, 1, 2, 1, 1);
+    gtk_box_pack_start(GTK_BOX(content_area), grid, FALSE, FALSE, 5);
+    gtk_widget_show_all(dialog);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) != GTK_RESPONSE_ACCEPT) {
+        gtk_widget_destroy(dialog);
+        return;
+    }
+
+    const gchar *candidates[4];
+    gchar *candidate_text[4];
+    gboolean valid = TRUE;
+    for (int i = 0; i < 4; i++) {
+        candidate_text[i] = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(entries[i]))));
+        if (!g_regex_match_simple(i == 0 ? "^[a-z0-9_ -]*$" : "^[0-9 ]*$", candidate_text[i], 0, 0)) valid = FALSE;
+        candidates[i] = candidate_text[i];
+    }
+    const gchar *objective = gtk_combo_box_get_active_id(GTK_COMBO_BOX(objective_combo));
+    const gchar *workload = gtk_combo_box_get_active_id(GTK_COMBO_BOX(workload_combo));
+    int runtime = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(runtime_spin));
+    gboolean latency_objective = g_strcmp0(objective, "lat") == 0;
+    gtk_widget_destroy(dialog);
+
+    if (!valid) {
+        GtkWidget *err = gtk_message_dialog_new(GTK_WINDOW(window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "Candidate lists must be space separated scheduler names or numbers.");
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        for (int i = 0; i < 4; i++) g_free(candidate_text[i]);
+        return;
+    }
+
+    /* read_ahead_kb only affects buffered reads, so measuring it with O_DIRECT would just pick noise. */
+    gchar *fio_args;
+    if (g_strcmp0(workload, "seqbuffered") == 0) {
+        fio_args = g_strdup_printf("--rw=read --bs=1M --ioengine=psync --direct=0 --runtime=%d --time_based", runtime);
+    } else {
+        fio_args = g_strcmp0(workload, "seqdirect") == 0
+            ? g_strdup_printf("--rw=read --bs=128k --ioengine=libaio --iodepth=8 --direct=1 --runtime=%d --time_based", runtime)
+            : g_strdup_printf("--rw=randread --bs=4k --ioengine=libaio --iodepth=32 --direct=1 --runtime=%d --time_based", runtime);
+        candidates[2] = NULL;
+    }
+
+    gchar *disk_path = g_strdup_printf("/dev/%s", disk_name);
+    gchar *params = g_strdup_printf("workload=%s objective=%s runtime=%ds", workload, objective, runtime);
+    gchar *baseline_out = benchmark_store_begin("Queue Tuning Baseline (fio)", "fio", disk_path, params);
+    gchar *tuned_out = benchmark_store_begin("Queue Tuning Result (fio)", "fio", disk_path, params);
+    gchar *cmd = build_queue_autotune_command(disk_name, fio_args, latency_objective, candidates, baseline_out, tuned_out);
+    run_command_simple(cmd, window, NULL, NULL, NULL);
+
+    g_free(cmd);
+    g_free(tuned_out);
+    g_free(baseline_out);
+    g_free(params);
+    g_free(disk_path);
+    g_free(fio_args);
+    for (int i = 0; i < 4; i++) g_free(candidate_text[i]);
+}
+
+void on_queue_tuning_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
+    gchar *disk_name = get_base_device(partition_name);
+    g_free(partition_name);
+
+    QueueSettings *original = read_queue_settings(disk_name);
+    if (!original) {
+        GtkWidget *err = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "/sys/block/%s/queue is not available for this device.", disk_name);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        g_free(disk_name);
+        return;
+    }
+
+    GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gchar *title = g_strdup_printf("Block Queue Tuning: /dev/%s", disk_name);
+    gtk_window_set_title(GTK_WINDOW(window), title);
+    g_free(title);
+    gtk_window_set_position(GTK_WINDOW(window), GTK_WIN_POS_CENTER);
+    gtk_container_set_border_width(GTK_CONTAINER(window), 10);
+    g_object_set_data_full(G_OBJECT(window), "disk_name", disk_name, g_free);
+    g_object_set_data_full(G_OBJECT(window), "original", original, (GDestroyNotify)free_queue_settings);
+
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
+    gtk_container_add(GTK_CONTAINER(window), box);
+
+    gchar *original_text = g_strdup_printf("When opened: scheduler %s, nr_requests %d, read_ahead_kb %d, rq_affinity %d\n"
+                                           "Changes are not persistent; export a udev rule to keep them after a reboot.",
+                                           original->scheduler, original->nr_requests, original->read_ahead_kb, original->rq_affinity);
+    gtk_box_pack_start(GTK_BOX(box), gtk_label_new(original_text), FALSE, FALSE, 0);
+    g_free(original_text);
+    GtkWidget *current_label = gtk_label_new("");
+    gtk_box_pack_start(GTK_BOX(box), current_label, FALSE, FALSE, 0);
+
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 6);
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 8);
+
+    GtkWidget *scheduler_combo = gtk_combo_box_text_new();
+    for (int i = 0; original->schedulers[i]; i++)
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(scheduler_combo), original->schedulers[i], original->schedulers[i]);
+    GtkWidget *nr_requests_spin = gtk_spin_button_new_with_range(4, 65536, 4);
+    GtkWidget *read_ahead_spin = gtk_spin_button_new_with_range(0, 65536, 64);
+    GtkWidget *rq_affinity_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(rq_affinity_combo), "0", "0 - complete on any CPU");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(rq_affinity_combo), "1", "1 - complete in the submitter's CPU group");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(rq_affinity_combo), "2", "2 - complete on the submitting CPU");
+
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("I/O scheduler:"), 0, 0, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), scheduler_combo, 1, 0, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("nr_requests:"), 0, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), nr_requests_spin, 1, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("read_ahead_kb:"), 0, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), read_ahead_spin, 1, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("rq_affinity:"), 0, 3, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), rq_affinity_combo, 1, 3, 1, 1);
+    gtk_box_pack_start(GTK_BOX(box), grid, FALSE, FALSE, 0);
+
+    g_object_set_data(G_OBJECT(window), "scheduler_combo", scheduler_combo);
+    g_object_set_data(G_OBJECT(window), "nr_requests_spin", nr_requests_spin);
+    g_object_set_data(G_OBJECT(window), "read_ahead_spin", read_ahead_spin);
+    g_object_set_data(G_OBJECT(window), "rq_affinity_combo", rq_affinity_combo);
+    g_object_set_data(G_OBJECT(window), "current_label", current_label);
+
+    GtkWidget *button_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+    GtkWidget *reload_btn = gtk_button_new_with_label("Reload");
+    GtkWidget *apply_btn = gtk_button_new_with_label("Apply");
+    GtkWidget *autotune_btn = gtk_button_new_with_label("Auto-Tune...");
+    GtkWidget *revert_btn = gtk_button_new_with_label("Revert to Original");
+    GtkWidget *export_btn = gtk_button_new_with_label("Export udev Rule...");
+    g_signal_connect(reload_btn, "clicked", G_CALLBACK(on_queue_reload_clicked), window);
+    g_signal_connect(apply_btn, "clicked", G_CALLBACK(on_queue_apply_clicked), window);
+    g_signal_connect(autotune_btn, "clicked", G_CALLBACK(on_queue_autotune_clicked), window);
+    g_signal_connect(revert_btn, "clicked", G_CALLBACK(on_queue_revert_clicked), window);
+    g_signal_connect(export_btn, "clicked", G_CALLBACK(on_queue_export_udev_clicked), window);
+    gtk_box_pack_start(GTK_BOX(button_box), reload_btn, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(button_box), apply_btn, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(button_box), autotune_btn, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(button_box), revert_btn, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(button_box), export_btn, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), button_box, FALSE, FALSE, 0);
+
+    on_queue_reload_clicked(NULL, window);
+    gtk_widget_show_all(window);
+}
+
+enum {
+    BR_COL_TIME,
+    BR_COL_TEST,
+    BR_COL_DEVICE,
+    BR_COL_MODEL,
+    BR_COL_FIRMWARE,
+    BR_COL_KERNEL,
+    BR_COL_READ,
+    BR_COL_WRITE,
+    BR_COL_READ_P99,
+    BR_COL_WRITE_P99,
+    BR_COL_INDEX,
+    BR_NUM_COLS
+};
+
+static GPtrArray *get_selected_benchmark_runs(GtkWidget *window, gboolean all_if_none) {
+    GtkTreeView *tree = g_object_get_data(G_OBJECT(window), "runs_tree");
+    GPtrArray *runs = g_object_get_data(G_OBJECT(window), "runs");
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree);
+    GtkTreeModel *model;
+    GPtrArray *selected = g_ptr_array_new();
+
+    GList *rows = gtk_tree_selection_get_selected_rows(selection, &model);
+    for (GList *l = rows; l; l = l->next) {
+        GtkTreeIter iter;
+        gint index = -1;
+        if (gtk_tree_model_get_iter(model, &iter, l->data)) {
+            gtk_tree_model_get(model, &iter, BR_COL_INDEX, &index, -1);
+            if (index >= 0 && index < (gint)runs->len)
+                g_ptr_array_add(selected, g_ptr_array_index(runs, index));
+        }
+    }
+    g_list_free_full(rows, (GDestroyNotify)gtk_tree_path_free);
+
+    if (selected->len == 0 && all_if_none) {
+        for (guint i = 0; i < runs->len; i++)
+            g_ptr_array_add(selected, g_ptr_array_index(runs, i));
+    }
+    return selected;
+}
+
+static void append_benchmark_delta(GString *report, const gchar *name, double base, double value,
+                                   gboolean higher_is_better, double threshold) {
+    if (base <= 0 && value <= 0) return;
+    g_string_append_printf(report, "  %-22s %14.2f %14.2f", name, base, value);
+    if (base > 0) {
+        double delta = (value - base) * 100.0 / base;
+        gboolean regression = higher_is_better ? delta < -threshold : delta > threshold;
+        g_string_append_printf(report, "   %+8.1f%%%s", delta, regression ? "   <== REGRESSION" : "");
+    }
+    g_string_append(report, "\n");
+}
+
+static void on_benchmark_compare_clicked(GtkWidget *button, gpointer user_data) {
+    GtkWidget *window = GTK_WIDGET(user_data);
+    GtkWidget *threshold_spin = g_object_get_data(G_OBJECT(window), "threshold_spin");
+    double threshold = gtk_spin_button_get_value(GTK_SPIN_BUTTON(threshold_spin));
+    GPtrArray *selected = get_selected_benchmark_runs(window, FALSE);
+
+    if (selected->len < 2) {
+        GtkWidget *err = gtk_message_dialog_new(
+            GTK_WINDOW(window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "Please select at least two runs (Ctrl+Click).\nThe oldest selected run is used as the baseline.");
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        g_ptr_array_free(selected, TRUE);
+        return;
+    }
+
+    g_ptr_array_sort(selected, compare_benchmark_runs);
+    BenchmarkRun *base = g_ptr_array_index(selected, 0);
+    GString *report = g_string_new(NULL);
+
+    for (guint i = 0; i < selected->len; i++) {
+        BenchmarkRun *r = g_ptr_array_index(selected, i);
+        g_string_append_printf(report, "%s #%u: %s  %s  %s\n    Model: %s  Serial: %s  Firmware: %s  Kernel: %s\n    Parameters: %s%s\n",
+            i == 0 ? "Baseline" : "Run", i, r->time, r->test, r->device,
+            r->model, r->serial, r->firmware, r->kernel, r->parameters,
+            r->complete ? "" : "\n    (no result recorded - run was interrupted)");
+    }
+
+    for (guint i = 1; i < selected->len; i++) {
+        BenchmarkRun *r = g_ptr_array_index(selected, i);
+        g_string_append_printf(report, "\n=== Run #%u against baseline (regression threshold %.0f%%) ===\n", i, threshold);
+        g_string_append_printf(report, "  %-22s %14s %14s   %9s\n", "Metric", "Baseline", "Run", "Delta");
+        append_benchmark_delta(report, "Read MiB/s", base->read_mib_s, r->read_mib_s, TRUE, threshold);
+        append_benchmark_delta(report, "Read IOPS", base->read_iops, r->read_iops, TRUE, threshold);
+        append_benchmark_delta(report, "Read mean latency us", base->read_lat_us, r->read_lat_us, FALSE, threshold);
+        append_benchmark_delta(report, "Read p50 latency us", base->read_p50_us, r->read_p50_us, FALSE, threshold);
+        append_benchmark_delta(report, "Read p99 latency us", base->read_p99_us, r->read_p99_us, FALSE, threshold);
+        append_benchmark_delta(report, "Read p99.9 latency us", base->read_p999_us, r->read_p999_us, FALSE, threshold);
+        append_benchmark_delta(report, "Write MiB/s", base->write_mib_s, r->write_mib_s, TRUE, threshold);
+        append_benchmark_delta(report, "Write IOPS", base->write_iops, r->write_iops, TRUE, threshold);
+        append_benchmark_delta(report, "Write mean latency us", base->write_lat_us, r->write_lat_us, FALSE, threshold);
+        append_benchmark_delta(report, "Write p50 latency us", base->write_p50_us, r->write_p50_us, FALSE, threshold);
+        append_benchmark_delta(report, "Write p99 latency us", base->write_p99_us, r->write_p99_us, FALSE, threshold);
+        append_benchmark_delta(report, "Write p99.9 latency us", base->write_p999_us, r->write_p999_us, FALSE, threshold);
+        for (int m = 0; m < 7; m++)
+            append_benchmark_delta(report, benchmark_meta_labels[m], base->meta_rate[m], r->meta_rate[m], TRUE, threshold);
+    }
+
+    g_string_append(report, "\n=== Latency histogram overlay (% of I/Os per bucket) ===\n");
+    g_string_append_printf(report, "  %-8s", "Bucket");
+    for (guint i = 0; i < selected->len; i++) {
+        char col[16];
+        g_snprintf(col, sizeof(col), i == 0 ? "Base" : "#%u", i);
+        g_string_append_printf(report, " %8s", col);
+    }
+    g_string_append(report, "\n");
+    for (int b = 0; b < 22; b++) {
+        gboolean any = FALSE;
+        for (guint i = 0; i < selected->len; i++)
+            if (((BenchmarkRun *)g_ptr_array_index(selected, i))->lat_hist[b] > 0) any = TRUE;
+        if (!any) continue;
+        g_string_append_printf(report, "  %-8s", benchmark_hist_labels[b]);
+        for (guint i = 0; i < selected->len; i++)
+            g_string_append_printf(report, " %7.2f%%", ((BenchmarkRun *)g_ptr_array_index(selected, i))->lat_hist[b]);
+        g_string_append(report, "\n");
+    }
+
+    show_large_text_dialog(GTK_WINDOW(window), "Benchmark Comparison", report->str);
+    g_string_free(report, TRUE);
+    g_ptr_array_free(selected, TRUE);
+}
+
+static void append_csv_field(GString *out, const gchar *value, gboolean last) {
+    gchar **parts = g_strsplit(value ? value : "", "\"", -1);
+    gchar *escaped = g_strjoinv("\"\"", parts);
+    g_string_append_printf(out, "\"%s\"%s", escaped, last ? "\n" : ",");
+    g_free(escaped);
+    g_strfreev(parts);
+}
+
+static void append_json_string(GString *out, const gchar *key, const gchar *value) {
+    g_string_append_printf(out, "    \"%s\": \"", key);
+    for (const gchar *p = value ? value : ""; *p; p++) {
+        if (*p == '"' || *p == '\\') g_string_append_printf(out, "\\%c", *p);
+        else if ((guchar)*p < 0x20) g_string_append_printf(out, "\\u%04x", (guchar)*p);
+        else g_string_append_c(out, *p);
+    }
+    g_string_append(out, "\",\n");
+}
+
+static void on_benchmark_export_clicked(GtkWidget *button, gpointer user_data) {
+    GtkWidget *window = GTK_WIDGET(user_data);
+    gboolean as_json = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(button), "as_json"));
+    GPtrArray *selected = get_selected_benchmark_runs(window, TRUE);
+
+    GtkWidget *dialog = gtk_file_chooser_dialog_new(
+        as_json ? "Export Benchmark Results as JSON" : "Export Benchmark Results as CSV",
+        GTK_WINDOW(window),
+        GTK_FILE_CHOOSER_ACTION_SAVE,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Save", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), as_json ? "benchmarks.json" : "benchmarks.csv");
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), TRUE);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        GString *out = g_string_new(NULL);
+
+        if (as_json) g_string_append(out, "[\n");
+        else {
+            g_string_append(out, "id,time,test,device,model,serial,firmware,kernel,parameters,complete,"
+                                 "read_mib_s,read_iops,read_lat_us,read_p50_us,read_p99_us,read_p999_us,"
+                                 "write_mib_s,write_iops,write_lat_us,write_p50_us,write_p99_us,write_p999_us");
+            for (int m = 0; m < 7; m++) g_string_append_printf(out, ",%s_per_s", benchmark_meta_names[m]);
+            for (int b = 0; b < 22; b++) g_string_append_printf(out, ",lat_%s", benchmark_hist_labels[b]);
+            g_string_append(out, "\n");
+        }
+
+        for (guint i = 0; i < selected->len; i++) {
+            BenchmarkRun *r = g_ptr_array_index(selected, i);
+            double metrics[12] = {
+                r->read_mib_s, r->read_iops, r->read_lat_us, r->read_p50_us, r->read_p99_us, r->read_p999_us,
+                r->write_mib_s, r->write_iops, r->write_lat_us, r->write_p50_us, r->write_p99_us, r->write_p999_us
+            };
+            const char *metric_names[12] = {
+                "read_mib_s", "read_iops", "read_lat_us", "read_p50_us", "read_p99_us", "read_p999_us",
+                "write_mib_s", "write_iops", "write_lat_us", "write_p50_us", "write_p99_us", "write_p999_us"
+            };
+            char num[G_ASCII_DTOSTR_BUF_SIZE];
+
+            if (as_json) {
+                g_string_append(out, "  {\n");
+                append_json_string(out, "id", r->id);
+                append_json_string(out, "time", r->time);
+                append_json_string(out, "test", r->test);
+                append_json_string(out, "device", r->device);
+                append_json_string(out, "model", r->model);
+                append_json_string(out, "serial", r->serial);
+                append_json_string(out, "firmware", r->firmware);
+                append_json_string(out, "kernel", r->kernel);
+                append_json_string(out, "parameters", r->parameters);
+                g_string_append_printf(out, "    \"complete\": %s,\n", r->complete ? "true" : "false");
+                for (int m = 0; m < 12; m++)
+                    g_string_append_printf(out, "    \"%s\": %s,\n", metric_names[m], g_ascii_dtostr(num, sizeof(num), metrics[m]));
+                for (int m = 0; m < 7; m++)
+                    g_string_append_printf(out, "    \"%s_per_s\": %s,\n", benchmark_meta_names[m],
+                                           g_ascii_dtostr(num, sizeof(num), r->meta_rate[m]));
+                g_string_append(out, "    \"latency_histogram_pct\": {");
+                for (int b = 0; b < 22; b++)
+                    g_string_append_printf(out, "%s\"%s\": %s", b ? ", " : "", benchmark_hist_labels[b],
+                                           g_ascii_dtostr(num, sizeof(num), r->lat_hist[b]));
+                g_string_append_printf(out, "}\n  }%s\n", i + 1 < selected->len ? "," : "");
+            } else {
+                append_csv_field(out, r->id, FALSE);
+                append_csv_field(out, r->time, FALSE);
+                append_csv_field(out, r->test, FALSE);
+                append_csv_field(out, r->device, FALSE);
+                append_csv_field(out, r->model, FALSE);
+                append_csv_field(out, r->serial, FALSE);
+                append_csv_field(out, r->firmware, FALSE);
+                append_csv_field(out, r->kernel, FALSE);
+                append_csv_field(out, r->parameters, FALSE);
+                g_string_append(out, r->complete ? "1" : "0");
+                for (int m = 0; m < 12; m++)
+                    g_string_append_printf(out, ",%s", g_ascii_dtostr(num, sizeof(num), metrics[m]));
+                for (int m = 0; m < 7; m++)
+                    g_string_append_printf(out, ",%s", g_ascii_dtostr(num, sizeof(num), r->meta_rate[m]));
+                for (int b = 0; b < 22; b++)
+                    g_string_append_printf(out, ",%s", g_ascii_dtostr(num, sizeof(num), r->lat_hist[b]));
+                g_string_append(out, "\n");
+            }
+        }
+        if (as_json) g_string_append(out, "]\n");
+
+        GError *error = NULL;
+        if (!g_file_set_contents(filename, out->str, out->len, &error)) {
             GtkWidget *err = gtk_message_dialog_new(
+                GTK_WINDOW(window), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                "Failed to export results: %s", error->message);
+            gtk_dialog_run(GTK_DIALOG(err));
+            gtk_widget_destroy(err);
+            g_clear_error(&error);
+        }
+
+        g_string_free(out, TRUE);
+        g_free(filename);
+    }
+
+    gtk_widget_destroy(dialog);
+    g_ptr_array_free(selected, TRUE);
+}
+
+void on_benchmark_results_activate(GtkWidget *menuitem, gpointer user_data) {
+    GPtrArray *runs = benchmark_store_load_all();
+
+    GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(window), "Benchmark Results");
+    gtk_window_set_default_size(GTK_WINDOW(window), 1100, 500);
+    gtk_window_set_position(GTK_WINDOW(window), GTK_WIN_POS_CENTER);
+    gtk_container_set_border_width(GTK_CONTAINER(window), 10);
+    g_object_set_data_full(G_OBJECT(window), "runs", runs, (GDestroyNotify)g_ptr_array_unref);
+
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
+    gtk_container_add(GTK_CONTAINER(window), box);
+
+    gchar *store_dir = get_benchmark_store_dir();
+    gchar *header = g_strdup_printf("%u saved runs in %s\nSelect two or more runs to compare them; the oldest one is the baseline.",
+                                    runs->len, store_dir);
+    gtk_box_pack_start(GTK_BOX(box), gtk_label_new(header), FALSE, FALSE, 0);
+    g_free(header);
+    g_free(store_dir);
+
+    GtkListStore *store = gtk_list_store_new(BR_NUM_COLS,
+        G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+        G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT);
+
+    for (guint i = 0; i < runs->len; i++) {
+        BenchmarkRun *r = g_ptr_array_index(runs, i);
+        gchar *read = r->complete && r->read_mib_s > 0 ? g_strdup_printf("%.1f MiB/s", r->read_mib_s) : g_strdup(r->complete ? "-" : "no result");
+        gchar *write = r->complete && r->write_mib_s > 0 ? g_strdup_printf("%.1f MiB/s", r->write_mib_s) : g_strdup(r->complete ? "-" : "no result");
+        gchar *read_p99 = r->read_p99_us > 0 ? g_strdup_printf("%.0f us", r->read_p99_us) : g_strdup("-");
+        gchar *write_p99 = r->write_p99_us > 0 ? g_strdup_printf("%.0f us", r->write_p99_us) : g_strdup("-");
+
+        GtkTreeIter iter;
+        gtk_list_store_append(store, &iter);
+        gtk_list_store_set(store, &iter,
+            BR_COL_TIME, r->time, BR_COL_TEST, r->test, BR_COL_DEVICE, r->device,
+            BR_COL_MODEL, r->model, BR_COL_FIRMWARE, r->firmware, BR_COL_KERNEL, r->kernel,
+            BR_COL_READ, read, BR_COL_WRITE, write,
+            BR_COL_READ_P99, read_p99, BR_COL_WRITE_P99, write_p99,
+            BR_COL_INDEX, (gint)i, -1);
+
+        g_free(read); g_free(write); g_free(read_p99); g_free(write_p99);
+    }
+
+    GtkWidget *tree = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
+    g_object_unref(store);
+    gtk_tree_selection_set_mode(gtk_tree_view_get_selection(GTK_TREE_VIEW(tree)), GTK_SELECTION_MULTIPLE);
+
+    const char *titles[] = {"Time", "Test", "Device", "Model", "Firmware", "Kernel", "Read", "Write", "Read p99", "Write p99"};
+    for (int i = 0; i < BR_COL_INDEX; ++i) {
+        GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+        GtkTreeViewColumn *col = gtk_tree_view_column_new_with_attributes(titles[i], renderer, "text", i, NULL);
+        gtk_tree_view_column_set_resizable(col, TRUE);
+        gtk_tree_view_append_column(GTK_TREE_VIEW(tree), col);
+    }
+
+    GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+    gtk_container_add(GTK_CONTAINER(scrolled), tree);
+    gtk_box_pack_start(GTK_BOX(box), scrolled, TRUE, TRUE, 0);
+    g_object_set_data(G_OBJECT(window), "runs_tree", tree);
+
+    GtkWidget *button_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+    gtk_box_pack_start(GTK_BOX(box), button_box, FALSE, FALSE, 0);
+
+    gtk_box_pack_start(GTK_BOX(button_box), gtk_label_new("Regression threshold (%):"), FALSE, FALSE, 0);
+    GtkWidget *threshold_spin = gtk_spin_button_new_with_range(1, 100, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(threshold_spin), 10);
+    gtk_box_pack_start(GTK_BOX(button_box), threshold_spin, FALSE, FALSE, 0);
+    g_object_set_data(G_OBJECT(window), "threshold_spin", threshold_spin);
+
+    GtkWidget *compare_btn = gtk_button_new_with_label("Compare Selected");
+    g_signal_connect(compare_btn, "clicked", G_CALLBACK(on_benchmark_compare_clicked), window);
+    gtk_box_pack_start(GTK_BOX(button_box), compare_btn, FALSE, FALSE, 0);
+
+    GtkWidget *csv_btn = gtk_button_new_with_label("Export CSV");
+    g_object_set_data(G_OBJECT(csv_btn), "as_json", GINT_TO_POINTER(FALSE));
+    g_signal_connect(csv_btn, "clicked", G_CALLBACK(on_benchmark_export_clicked), window);
+    gtk_box_pack_end(GTK_BOX(button_box), csv_btn, FALSE, FALSE, 0);
+
+    GtkWidget *json_btn = gtk_button_new_with_label("Export JSON");
+    g_object_set_data(G_OBJECT(json_btn), "as_json", GINT_TO_POINTER(TRUE));
+    g_signal_connect(json_btn, "clicked", G_CALLBACK(on_benchmark_export_clicked), window);
+    gtk_box_pack_end(GTK_BOX(button_box), json_btn, FALSE, FALSE, 0);
+
+    gtk_widget_show_all(window);
+}
+
+void on_auto_fsck_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL;
+    gchar *filesystem = NULL;
+
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, 
+                          COL_NAME, &partition_name, 
+                          COL_FSTYPE, &filesystem, 
+                          -1);
+
+        if (!filesystem) {
+            GtkWidget *warn = gtk_message_dialog_new(
                 NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
-                    "This function is intended only for entire disks (e.g., /dev/sdb), not for partitions (e.g., /dev/sdb1). Please select a whole disk (not a partition)."
+                "ERROR: Could not determine filesystem type for partition %s", 
+                partition_name
+            );
+            gtk_dialog_run(GTK_DIALOG(warn));
+            gtk_widget_destroy(warn);
+            g_free(partition_name);
+            return;
+        }
+
+        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+        gchar *cmd = NULL;
+        gchar *fs_name = NULL;
+
+        if (g_strcmp0(filesystem, "ext4") == 0 || 
+            g_strcmp0(filesystem, "ext3") == 0 || 
+            g_strcmp0(filesystem, "ext2") == 0) {
+            cmd = g_strdup_printf("e2fsck -f -y -v %s", device_path);
+            fs_name = g_strdup("EXT2/3/4");
+        }
+        else if (g_strcmp0(filesystem, "vfat") == 0 || 
+                 g_strcmp0(filesystem, "fat32") == 0) {
+            cmd = g_strdup_printf("dosfsck -a -v %s", device_path);
+            fs_name = g_strdup("FAT32");
+        }
+        else if (g_strcmp0(filesystem, "ntfs") == 0) {
+            cmd = g_strdup_printf("ntfsfix %s", device_path);
+            fs_name = g_strdup("NTFS");
+        }
+        else if (g_strcmp0(filesystem, "xfs") == 0) {
+            cmd = g_strdup_printf("xfs_repair %s", device_path);
+            fs_name = g_strdup("XFS");
+        }
+        else if (g_strcmp0(filesystem, "btrfs") == 0) {
+            cmd = g_strdup_printf("btrfs check --repair %s", device_path);
+            fs_name = g_strdup("Btrfs");
+        }
+        else if (g_strcmp0(filesystem, "f2fs") == 0) {
+            cmd = g_strdup_printf("fsck.f2fs -f %s", device_path);
+            fs_name = g_strdup("F2FS");
+        }
+        else {
+            GtkWidget *warn = gtk_message_dialog_new(
+                NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK,
+                "Filesystem '%s' is not supported for automatic repair.\n\n"
+                "Supported filesystems:\n"
+                "• ext2/ext3/ext4\n"
+                "• FAT32 (vfat)\n"
+                "• NTFS\n"
+                "• XFS\n"
+                "• Btrfs\n"
+                "• F2FS",
+                filesystem
+            );
+            gtk_dialog_run(GTK_DIALOG(warn));
+            gtk_widget_destroy(warn);
+            g_free(device_path);
+            g_free(partition_name);
+            g_free(filesystem);
+            return;
+        }
+
+        gchar *confirm_msg = g_strdup_printf(
+            "Auto-detected filesystem: %s (%s)\n"
+            "Partition: %s\n\n"
+            "Command to execute: %s\n\n"
+            "Do you want to proceed with filesystem check?",
+            fs_name, filesystem, device_path, cmd
+        );
+
+        GtkWidget *confirm = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO,
+            "%s", confirm_msg
+        );
+        
+        gint response = gtk_dialog_run(GTK_DIALOG(confirm));
+        gtk_widget_destroy(confirm);
+        g_free(confirm_msg);
+
+        if (response == GTK_RESPONSE_YES) {
+            run_command_in_terminal(tree_view, cmd);
+        }
+
+        g_free(cmd);
+        g_free(fs_name);
+        g_free(device_path);
+        g_free(partition_name);
+        g_free(filesystem);
+    }
+}
+
+void on_e2fsck_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL;
+    gchar *filesystem = NULL;
+
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter,
+                           COL_NAME, &partition_name,
+                           COL_FSTYPE, &filesystem,
+                           -1);
+
+        if (!filesystem || g_strcmp0(filesystem, "ext4") != 0 &&
+                          g_strcmp0(filesystem, "ext3") != 0 &&
+                          g_strcmp0(filesystem, "ext2") != 0) {
+
+            GtkWidget *warn = gtk_message_dialog_new(
+                NULL,
+                GTK_DIALOG_MODAL,
+                GTK_MESSAGE_ERROR,
+                GTK_BUTTONS_OK,
+                "ERROR: e2fsck can be used **only** on ext2/3/4 partitions!"
+            );
+            gtk_dialog_run(GTK_DIALOG(warn));
+            gtk_widget_destroy(warn);
+
+            g_free(partition_name);
+            g_free(filesystem);
+            return;
+        }
+
+        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+        gchar *cmd = g_strdup_printf("e2fsck -f -y -v %s", device_path);
+
+        run_command_in_terminal(tree_view, cmd);
+
+        g_free(cmd);
+        g_free(device_path);
+        g_free(partition_name);
+        g_free(filesystem);
+    }
+}
+
+void on_ext_repair_deep_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL;
+
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
+
+        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+
+        gchar *cmd = g_strdup_printf("mke2fs -n %s | grep -oE '[0-9]+' | tr '\\n' ' '", device_path);
+        FILE *fp = popen(cmd, "r");
+        gchar superblocks[1024] = {0};
+        if (fp) {
+            fgets(superblocks, sizeof(superblocks)-1, fp);
+            pclose(fp);
+        }
+        g_free(cmd);
+
+        gchar *sb_tokens = g_strdup(superblocks);
+        gchar *saveptr = NULL;
+        gchar *tokens[10] = {0};
+        int count = 0;
+        gchar *token = strtok_r(sb_tokens, " ", &saveptr);
+        while (token && count < 10) {
+            tokens[count++] = token;
+            token = strtok_r(NULL, " ", &saveptr);
+        }
+
+        if (count >= 3) {
+            gchar *message = g_strdup_printf(
+                "WARNING: This operation will attempt advanced recovery of the EXT2/3/4 filesystem using a selected backup superblock.\n\n"
+                "Target: %s\n\n"
+                "Choose a backup superblock to use for recovery:\n"
+                "2) %s\n"
+                "3) %s\n\n"
+                "You should try the 2nd first (usually %s), then the 3rd if needed.\n\n"
+                "Are you sure you want to continue?",
+                device_path, tokens[1], tokens[2], tokens[1]
+            );
+            GtkWidget *dialog = gtk_dialog_new_with_buttons(
+                "Select Backup Superblock",
+                NULL,
+                GTK_DIALOG_MODAL,
+                "_Cancel", GTK_RESPONSE_CANCEL,
+                "_Use 2nd", 2,
+                "_Use 3rd", 3,
+                NULL
+            );
+            GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+            GtkWidget *label = gtk_label_new(message);
+            gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+            gtk_box_pack_start(GTK_BOX(content_area), label, FALSE, FALSE, 0);
+            gtk_widget_show_all(dialog);
+
+            gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+            gtk_widget_destroy(dialog);
+            g_free(message);
+
+            gchar *sb_to_use = NULL;
+            if (response == 2) sb_to_use = tokens[1];
+            else if (response == 3) sb_to_use = tokens[2];
+
+            if (sb_to_use) {
+            gchar *repair_cmd = g_strdup_printf(
+                "e2fsck -b %s -y %s; "
+                "echo ''; echo 'Now running full filesystem check...'; "
+                "e2fsck -f -y -v %s",
+                sb_to_use, device_path, device_path
+            );
+                run_command_in_terminal(tree_view, repair_cmd);
+                g_free(repair_cmd);
+            }
+        } else {
+            GtkWidget *err = gtk_message_dialog_new(
+                NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                "Could not find enough backup superblocks for this partition."
+            );
+            gtk_dialog_run(GTK_DIALOG(err));
+            gtk_widget_destroy(err);
+        }
+
+        g_free(sb_tokens);
+        g_free(device_path);
+        g_free(partition_name);
+    }
+}
+
+void on_fat32fix_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL;
+    gchar *filesystem = NULL;
+
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter,
+                           COL_NAME, &partition_name,
+                           COL_FSTYPE, &filesystem,
+                           -1);
+
+        if (!filesystem || g_strcmp0(filesystem, "vfat") != 0) {
+            GtkWidget *warn = gtk_message_dialog_new(
+                NULL,
+                GTK_DIALOG_MODAL,
+                GTK_MESSAGE_ERROR,
+                GTK_BUTTONS_OK,
+                "ERROR: dosfsck can be used **only** on FAT32 (vfat) partitions!"
+            );
+            gtk_dialog_run(GTK_DIALOG(warn));
+            gtk_widget_destroy(warn);
+
+            g_free(partition_name);
+            g_free(filesystem);
+            return;
+        }
+
+        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+        gchar *cmd = g_strdup_printf("dosfsck -a -v %s", device_path);
+
+        run_command_in_terminal(tree_view, cmd);
+
+        g_free(cmd);
+        g_free(device_path);
+        g_free(partition_name);
+        g_free(filesystem);
+    }
+}
+
+void on_ntfsfix_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL;
+    gchar *filesystem = NULL;
+
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter,
+                           COL_NAME, &partition_name,
+                           COL_FSTYPE, &filesystem,
+                           -1);
+
+        if (!filesystem || g_strcmp0(filesystem, "ntfs") != 0) {
+            GtkWidget *warn = gtk_message_dialog_new(
+                NULL,
+                GTK_DIALOG_MODAL,
+                GTK_MESSAGE_ERROR,
+                GTK_BUTTONS_OK,
+                "ERROR: ntfsfix can be used **only** on NTFS partitions!"
+            );
+            gtk_dialog_run(GTK_DIALOG(warn));
+            gtk_widget_destroy(warn);
+
+            g_free(partition_name);
+            g_free(filesystem);
+            return;
+        }
+
+        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+        gchar *cmd = g_strdup_printf("ntfsfix %s", device_path);
+
+        run_command_in_terminal(tree_view, cmd);
+
+        g_free(cmd);
+        g_free(device_path);
+        g_free(partition_name);
+        g_free(filesystem);
+    }
+}
+
+void on_ntfsresize_activate(GtkWidget *menuitem, gpointer user_data) {
+    run_command_in_terminal(GTK_TREE_VIEW(user_data), "ntfsresize -P -i -f -v %s");
+}
+
+void on_diskscan_activate(GtkWidget *menuitem, gpointer user_data) {
+    run_command_in_terminal(GTK_TREE_VIEW(user_data), "diskscan %s");
+}
+
+static void on_mount_child_exited(VteTerminal *terminal, gint status, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    
+    GtkWidget *window = gtk_widget_get_toplevel(GTK_WIDGET(terminal));
+    if (GTK_IS_WINDOW(window)) {
+        gtk_window_set_title(GTK_WINDOW(window), "Command Finished");
+    }
+    
+    refresh_disk_list_delayed(tree_view);
+}
+
+static gchar *get_trim_schedule_path(void) {
+    gchar *dir = g_build_filename(g_get_user_data_dir(), "DriveAssistify", NULL);
+    g_mkdir_with_parents(dir, 0700);
+    gchar *path = g_build_filename(dir, "trim-schedule.ini", NULL);
+    g_free(dir);
+    return path;
+}
+
+static gchar *get_trim_log_path(void) {
+    gchar *dir = g_build_filename(g_get_user_data_dir(), "DriveAssistify", NULL);
+    g_mkdir_with_parents(dir, 0700);
+    gchar *path = g_build_filename(dir, "trim-log.txt", NULL);
+    g_free(dir);
+    return path;
+}
+
+/*
+ * Trims the file system mounted from source (a device path or UUID=...) with FITRIM in chunk_gib ranges. The minimum
+ * extent is the device's discard granularity, so no time is spent on extents the device would ignore. After each chunk
+ * the job sleeps long enough that trimming takes at most duty_percent of the wall time. Appends one line per run to
+ * the trim log: time, source, mount point, bytes trimmed, seconds, result, mode.
+ */
+static gchar *build_paced_trim_command(const gchar *source, int chunk_gib, int duty_percent, gboolean scheduled) {
+    gchar *quoted_source = g_shell_quote(source);
+    gchar *log_path = get_trim_log_path();
+    gchar *quoted_log = g_shell_quote(log_path);
+    const gchar *sudo = scheduled ? "sudo -n" : "sudo";
+
+    gchar *cmd = g_strdup_printf(
+        "{ tr_src=%s; tr_log=%s; tr_mode=%s; tr_result=failed; tr_total=0; tr_secs=0; "
+        "tr_mp=$(findmnt -rn -o TARGET -S \"$tr_src\" | head -n 1); tr_dev=$(findmnt -rn -o SOURCE -S \"$tr_src\" | head -n 1); "
+        "if [ -z \"$tr_mp\" ]; then echo \"$tr_src is not mounted, nothing to trim.\"; tr_mp=-; "
+        "else set -- $(lsblk -ndbo DISC-GRAN,DISC-MAX \"$tr_dev\"); tr_gran=${1:-0}; "
+        "if [ \"${2:-0}\" -eq 0 ]; then echo \"$tr_dev does not support discard (discard_max_bytes is 0).\"; "
+        "else tr_size=$(df -B1 --output=size \"$tr_mp\" | tail -n 1 | tr -d ' '); tr_chunk=$((%d * 1073741824)); "
+        "tr_off=0; tr_result=ok; tr_start=$(cut -d' ' -f1 /proc/uptime); "
+        "echo \"Trimming $tr_mp ($tr_dev) in $((tr_chunk / 1073741824)) GiB ranges, minimum extent $tr_gran bytes, at most %d percent of the time busy\"; "
+        "while [ $tr_off -lt $tr_size ]; do "
+        "tr_t0=$(cut -d' ' -f1 /proc/uptime); "
+        "if ! tr_out=$(%s fstrim -v -o $tr_off -l $tr_chunk -m $tr_gran \"$tr_mp\" 2>&1); then echo \"$tr_out\"; tr_result=failed; break; fi; "
+        "tr_bytes=$(echo \"$tr_out\" | awk '{ for (i = 2; i <= NF; i++) if ($i ~ /^bytes/) { v = $(i - 1); gsub(/[^0-9]/, \"\", v); print v + 0; exit } }'); "
+        "tr_total=$((tr_total + ${tr_bytes:-0})); tr_off=$((tr_off + tr_chunk)); tr_t1=$(cut -d' ' -f1 /proc/uptime); "
+        "tr_pause=$(awk -v a=$tr_t0 -v b=$tr_t1 -v d=%d 'BEGIN { p = (b - a) * (100 - d) / d; print (p > 0 ? int(p * 1000) / 1000 : 0) }'); "
+        "echo \"  up to $((tr_off / 1073741824)) GiB: $(( ${tr_bytes:-0} / 1048576 )) MiB trimmed, pausing $tr_pause s\"; "
+        "sleep $tr_pause; done; "
+        "tr_secs=$(awk -v a=$tr_start -v b=$(cut -d' ' -f1 /proc/uptime) 'BEGIN { print int((b - a) * 10) / 10 }'); "
+        "echo \"Trimmed $tr_total bytes ($((tr_total / 1048576)) MiB) in $tr_secs s, result: $tr_result\"; fi; fi; "
+        "echo \"$(date -Iseconds)\t$tr_src\t$tr_mp\t$tr_total\t$tr_secs\t$tr_result\t$tr_mode\" >> \"$tr_log\"; "
+        "[ \"$tr_result\" = ok ]; }",
+        quoted_source, quoted_log, scheduled ? "scheduled" : "manual",
+        chunk_gib, duty_percent, sudo, duty_percent);
+
+    g_free(quoted_log);
+    g_free(log_path);
+    g_free(quoted_source);
+    return cmd;
+}
+
+/* Starts every scheduled trim that is due. With wait set (headless mode) they run one after another in the foreground. */
+static int run_due_trims(gboolean wait) {
+    gchar *path = get_trim_schedule_path();
+    GKeyFile *kf = g_key_file_new();
+    int failures = 0;
+    if (!g_key_file_load_from_file(kf, path, G_KEY_FILE_NONE, NULL)) {
+        if (wait) g_print("No trim schedule in %s\n", path);
+        g_key_file_free(kf);
+        g_free(path);
+        return 0;
+    }
+
+    gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+    gchar **groups = g_key_file_get_groups(kf, NULL);
+    gboolean changed = FALSE;
+    for (int i = 0; groups[i]; i++) {
+        int interval_hours = g_key_file_get_integer(kf, groups[i], "IntervalHours", NULL);
+        gint64 last_run = g_key_file_get_int64(kf, groups[i], "LastRun", NULL);
+        if (interval_hours <= 0 || now - last_run < (gint64)interval_hours * 3600) continue;
+
+        int chunk_gib = g_key_file_get_integer(kf, groups[i], "ChunkGiB", NULL);
+        int duty_percent = g_key_file_get_integer(kf, groups[i], "DutyPercent", NULL);
+        gchar *cmd = build_paced_trim_command(groups[i], chunk_gib > 0 ? chunk_gib : 16,
+                                              CLAMP(duty_percent, 5, 100), TRUE);
+        gchar *argv[] = {"/bin/sh", "-c", cmd, NULL};
+        GError *error = NULL;
+        gint status = 0;
+        gboolean started;
+        if (wait)
+            started = g_spawn_sync(NULL, argv, NULL, G_SPAWN_CHILD_INHERITS_STDIN, NULL, NULL, NULL, NULL, &status, &error);
+        else
+            started = g_spawn_async(NULL, argv, NULL, G_SPAWN_STDOUT_TO_DEV_NULL | G_SPAWN_STDERR_TO_DEV_NULL,
+                                    NULL, NULL, NULL, &error);
+        if (!started) {
+            g_warning("Scheduled trim of %s could not be started: %s", groups[i], error->message);
+            g_clear_error(&error);
+            failures++;
+        } else if (wait && status != 0) {
+            failures++;
+        }
+        g_key_file_set_int64(kf, groups[i], "LastRun", now);
+        changed = TRUE;
+        g_free(cmd);
+    }
+
+    if (changed) g_key_file_save_to_file(kf, path, NULL);
+    g_strfreev(groups);
+    g_key_file_free(kf);
+    g_free(path);
+    return failures > 0 ? 1 : 0;
+}
+
+static gboolean on_trim_schedule_timer(gpointer user_data) {
+    run_due_trims(FALSE);
+    return G_SOURCE_CONTINUE;
+}
+
+static gchar *get_recent_trim_log(int max_lines) {
+    gchar *path = get_trim_log_path();
+    gchar *contents = NULL;
+    GString *text = g_string_new(NULL);
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        gchar **lines = g_strsplit(g_strstrip(contents), "\n", -1);
+        int count = g_strv_length(lines);
+        for (int i = MAX(0, count - max_lines); i < count; i++) {
+            gchar **f = g_strsplit(lines[i], "\t", -1);
+            if (g_strv_length(f) >= 7)
+                g_string_append_printf(text, "%s  %s  %s: %lld MiB in %s s, %s (%s)\n", f[0], f[1], f[2],
+                                       (long long)(g_ascii_strtoll(f[3], NULL, 10) / 1048576), f[4], f[5], f[6]);
+            g_strfreev(f);
+        }
+        g_strfreev(lines);
+    }
+    g_free(contents);
+    g_free(path);
+    if (text->len == 0) g_string_append(text, "No trims recorded yet.\n");
+    return g_string_free(text, FALSE);
+}
+
+void on_fstrim_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL, *uuid = NULL;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, COL_UUID, &uuid, -1);
+    gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+    gchar *mountpoint = get_partition_mountpoint(device_path);
+    gchar *disk_name = get_base_device(partition_name);
+    gchar *discard_max = read_sysfs_block_attr(disk_name, "queue/discard_max_bytes");
+    gchar *discard_granularity = read_sysfs_block_attr(disk_name, "queue/discard_granularity");
+
+    const gchar *problem = NULL;
+    if (!mountpoint) problem = "is not mounted. FITRIM works on a mounted file system; mount it first.";
+    else if (!discard_max || g_ascii_strtoll(discard_max, NULL, 10) == 0) problem = "is on a device that does not support discard.";
+    if (problem) {
+        GtkWidget *err = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                                                "%s %s", device_path, problem);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        goto out;
+    }
+
+    gboolean has_uuid = uuid && strlen(uuid) > 0 && strcmp(uuid, "N/A") != 0 && strcmp(uuid, "-") != 0;
+    gchar *schedule_key = has_uuid ? g_strdup_printf("UUID=%s", uuid) : NULL;
+    gchar *schedule_path = get_trim_schedule_path();
+    GKeyFile *kf = g_key_file_new();
+    g_key_file_load_from_file(kf, schedule_path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+    int current_interval = schedule_key ? g_key_file_get_integer(kf, schedule_key, "IntervalHours", NULL) : 0;
+    int current_chunk = schedule_key ? g_key_file_get_integer(kf, schedule_key, "ChunkGiB", NULL) : 0;
+    int current_duty = schedule_key ? g_key_file_get_integer(kf, schedule_key, "DutyPercent", NULL) : 0;
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "TRIM Free Space",
+        NULL,
+        GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "Save _Schedule Only", GTK_RESPONSE_APPLY,
+        "_Trim Now", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 600, 400);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+    gchar *info_text = g_strdup_printf(
+        "Device: %s\nMounted at: %s\nDiscard granularity: %s bytes, max discard: %s bytes\n\n"
+        "Tells the SSD which blocks are free (FITRIM) in ranges, pausing between\n"
+        "ranges so that other I/O on the device is not stalled.",
+        device_path, mountpoint, discard_granularity ? discard_granularity : "?", discard_max);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new(info_text), FALSE, FALSE, 5);
+    g_free(info_text);
+
+    GtkWidget *chunk_spin = gtk_spin_button_new_with_range(1, 1024, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(chunk_spin), current_chunk > 0 ? current_chunk : 16);
+    GtkWidget *duty_spin = gtk_spin_button_new_with_range(5, 100, 5);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(duty_spin), current_duty > 0 ? current_duty : 50);
+    GtkWidget *schedule_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(schedule_combo), "0", "No schedule");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(schedule_combo), "24", "Daily");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(schedule_combo), "168", "Weekly");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(schedule_combo), "720", "Every 30 days");
+    gchar interval_id[16];
+    g_snprintf(interval_id, sizeof(interval_id), "%d", current_interval);
+    if (!gtk_combo_box_set_active_id(GTK_COMBO_BOX(schedule_combo), interval_id))
+        gtk_combo_box_set_active(GTK_COMBO_BOX(schedule_combo), 0);
+    gtk_widget_set_sensitive(schedule_combo, has_uuid);
+
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Range size per FITRIM call (GiB):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), chunk_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Maximum share of time spent trimming (%):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), duty_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new(has_uuid
+        ? "Recurring schedule (runs while DriveAssistify is open, or with --run-scheduled-trims from cron or a systemd timer):"
+        : "Recurring schedule (not available: the file system has no UUID):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), schedule_combo, FALSE, FALSE, 2);
+
+    gchar *history = get_recent_trim_log(8);
+    gchar *history_text = g_strdup_printf("Recent trims:\n%s", history);
+    GtkWidget *history_label = gtk_label_new(history_text);
+    gtk_label_set_selectable(GTK_LABEL(history_label), TRUE);
+    gtk_box_pack_start(GTK_BOX(content_area), history_label, FALSE, FALSE, 5);
+    g_free(history_text);
+    g_free(history);
+
+    gtk_widget_show_all(dialog);
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    int chunk_gib = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(chunk_spin));
+    int duty_percent = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(duty_spin));
+    const gchar *interval_text = gtk_combo_box_get_active_id(GTK_COMBO_BOX(schedule_combo));
+    int interval_hours = interval_text ? atoi(interval_text) : 0;
+    gtk_widget_destroy(dialog);
+
+    if ((response == GTK_RESPONSE_ACCEPT || response == GTK_RESPONSE_APPLY) && schedule_key) {
+        if (interval_hours > 0) {
+            g_key_file_set_string(kf, schedule_key, "Device", device_path);
+            g_key_file_set_integer(kf, schedule_key, "IntervalHours", interval_hours);
+            g_key_file_set_integer(kf, schedule_key, "ChunkGiB", chunk_gib);
+            g_key_file_set_integer(kf, schedule_key, "DutyPercent", duty_percent);
+            /* A manual trim now counts as the first scheduled run. */
+            if (response == GTK_RESPONSE_ACCEPT || !g_key_file_has_key(kf, schedule_key, "LastRun", NULL))
+                g_key_file_set_int64(kf, schedule_key, "LastRun",
+                                     response == GTK_RESPONSE_ACCEPT ? g_get_real_time() / G_USEC_PER_SEC : 0);
+        } else {
+            g_key_file_remove_group(kf, schedule_key, NULL);
+        }
+        GError *error = NULL;
+        if (!g_key_file_save_to_file(kf, schedule_path, &error)) {
+            g_warning("Failed to save trim schedule: %s", error->message);
+            g_clear_error(&error);
+        }
+    }
+
+    if (response == GTK_RESPONSE_ACCEPT) {
+        gchar *cmd = build_paced_trim_command(device_path, chunk_gib, duty_percent, FALSE);
+        run_command_in_terminal(tree_view, cmd);
+        g_free(cmd);
+    }
+
+    g_key_file_free(kf);
+    g_free(schedule_path);
+    g_free(schedule_key);
+
+out:
+    g_free(discard_granularity);
+    g_free(discard_max);
+    g_free(disk_name);
+    g_free(mountpoint);
+    g_free(device_path);
+    g_free(uuid);
+    g_free(partition_name);
+}
+
+typedef struct {
+    const char *fstype;
+    const char *name;
+    const char *driver;
+    const char *options;
+} MountProfile;
+
+/* "*" profiles apply to every file system; driver NULL lets mount pick the driver for the detected type. */
+static const MountProfile mount_profiles[] = {
+    {"*", "Defaults", NULL, ""},
+    {"*", "noatime", NULL, "noatime"},
+    {"*", "lazytime", NULL, "lazytime"},
+    {"ext4", "noatime, journal commit every 60 s", NULL, "noatime,commit=60"},
+    {"ext4", "noatime, lazytime, online discard", NULL, "noatime,lazytime,discard"},
+    {"ext4", "noatime, no write barriers (unsafe on power loss)", NULL, "noatime,barrier=0"},
+    {"ext3", "noatime, journal commit every 60 s", NULL, "noatime,commit=60"},
+    {"btrfs", "noatime, zstd:1 compression", NULL, "noatime,compress=zstd:1"},
+    {"btrfs", "noatime, asynchronous discard", NULL, "noatime,discard=async"},
+    {"btrfs", "noatime, commit every 60 s", NULL, "noatime,commit=60"},
+    {"xfs", "noatime, large log buffers", NULL, "noatime,logbufs=8,logbsize=256k"},
+    {"xfs", "noatime, online discard", NULL, "noatime,discard"},
+    {"f2fs", "noatime, asynchronous discard", NULL, "noatime,discard"},
+    {"ntfs", "ntfs3 kernel driver", "ntfs3", ""},
+    {"ntfs", "ntfs3, noatime, preallocation", "ntfs3", "noatime,prealloc"},
+    {"ntfs", "ntfs-3g (FUSE)", "ntfs-3g", ""},
+    {"ntfs", "ntfs-3g, noatime, big_writes", "ntfs-3g", "noatime,big_writes"},
+    {"vfat", "noatime, flush early", NULL, "noatime,flush"},
+    {"exfat", "noatime, discard", NULL, "noatime,discard"},
+    {NULL, NULL, NULL, NULL}
+};
+
+static gboolean mount_profile_matches(const MountProfile *profile, const gchar *fstype) {
+    return strcmp(profile->fstype, "*") == 0 || g_strcmp0(profile->fstype, fstype) == 0;
+}
+
+static gboolean is_valid_mount_option_text(const gchar *text) {
+    return g_regex_match_simple("^[A-Za-z0-9_=:,./-]*$", text, 0, 0);
+}
+
+/* "-t driver -o options " with either part left out when empty, ready to put in front of the device. */
+static gchar *build_mount_profile_args(const gchar *driver, const gchar *options) {
+    GString *args = g_string_new(NULL);
+    if (driver && strlen(driver) > 0) g_string_append_printf(args, "-t %s ", driver);
+    if (options && strlen(options) > 0) g_string_append_printf(args, "-o %s ", options);
+    return g_string_free(args, FALSE);
+}
+
+static void on_mount_profile_changed(GtkComboBox *combo, gpointer user_data) {
+    const gchar *id = gtk_combo_box_get_active_id(combo);
+    if (!id) return;
+    const MountProfile *profile = &mount_profiles[atoi(id)];
+    gtk_entry_set_text(GTK_ENTRY(g_object_get_data(G_OBJECT(combo), "driver_entry")), profile->driver ? profile->driver : "");
+    gtk_entry_set_text(GTK_ENTRY(g_object_get_data(G_OBJECT(combo), "options_entry")), profile->options);
+}
+
+/* Asks for the mount profile; returns FALSE on cancel or invalid input, otherwise the chosen driver and options. */
+static gboolean run_mount_profile_dialog(const gchar *device_path, const gchar *fstype, gchar **driver, gchar **options) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "Mount Partition",
+        NULL,
+        GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Mount", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    gchar *info_text = g_strdup_printf("Device: %s\nFile system: %s", device_path, fstype && strlen(fstype) > 0 ? fstype : "unknown");
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new(info_text), FALSE, FALSE, 5);
+    g_free(info_text);
+
+    GtkWidget *profile_combo = gtk_combo_box_text_new();
+    for (int i = 0; mount_profiles[i].fstype; i++) {
+        if (!mount_profile_matches(&mount_profiles[i], fstype)) continue;
+        gchar id[16];
+        g_snprintf(id, sizeof(id), "%d", i);
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(profile_combo), id, mount_profiles[i].name);
+    }
+    GtkWidget *driver_entry = gtk_entry_new();
+    GtkWidget *options_entry = gtk_entry_new();
+    g_object_set_data(G_OBJECT(profile_combo), "driver_entry", driver_entry);
+    g_object_set_data(G_OBJECT(profile_combo), "options_entry", options_entry);
+    g_signal_connect(profile_combo, "changed", G_CALLBACK(on_mount_profile_changed), NULL);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(profile_combo), 0);
+
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Mount profile:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), profile_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Driver (-t, empty = detect):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), driver_entry, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Options (-o):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), options_entry, FALSE, FALSE, 2);
+
+    gtk_widget_show_all(dialog);
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    *driver = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(driver_entry))));
+    *options = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(options_entry))));
+    gtk_widget_destroy(dialog);
+
+    if (response == GTK_RESPONSE_ACCEPT && is_valid_mount_option_text(*driver) && is_valid_mount_option_text(*options))
+        return TRUE;
+    if (response == GTK_RESPONSE_ACCEPT) {
+        GtkWidget *err = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "The driver and options may only contain letters, digits and _ = : , . / -");
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+    }
+    g_free(*driver);
+    g_free(*options);
+    *driver = NULL;
+    *options = NULL;
+    return FALSE;
+}
+
+void on_mount_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *disk_name;
+    gchar *fstype = NULL;
+    
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, COL_NAME, &disk_name, COL_FSTYPE, &fstype, -1);
+
+        gchar *device_path = g_strdup_printf("/dev/%s", disk_name);
+        gchar *driver = NULL, *options = NULL;
+        if (!run_mount_profile_dialog(device_path, fstype, &driver, &options)) {
+            g_free(device_path);
+            g_free(fstype);
+            g_free(disk_name);
+            return;
+        }
+        gchar *mount_args = build_mount_profile_args(driver, options);
+        gchar *mount_point = g_strdup_printf("/mnt/%s", disk_name);
+        gchar *quoted_device_path = g_shell_quote(device_path);
+        gchar *quoted_mount_point = g_shell_quote(mount_point);
+        
+        gchar *mkdir_command = g_strdup_printf("sudo mkdir -p %s", quoted_mount_point);
+        system(mkdir_command);
+        g_free(mkdir_command);
+        
+        gchar *command = g_strdup_printf(
+            "if [ -b %s ]; then "
+            "  echo 'Mounting %s to %s %s...'; "
+            "  timeout 15 sudo mount %s%s %s && "
+            "  echo 'Mounted successfully' || "
+            "  (sleep 2 && timeout 15 sudo mount %s%s %s && "
+            "   echo 'Mounted on second attempt' || "
+            "   echo 'ERROR: Mount failed after 2 attempts'); "
+            "else "
+            "  echo 'ERROR: Device %s not found'; "
+            "fi",
+            quoted_device_path,
+            device_path, 
+            mount_point, mount_args,
+            mount_args, quoted_device_path, quoted_mount_point,
+            mount_args, quoted_device_path, quoted_mount_point,
+            device_path
+        );
+        
+        run_command_in_terminal(tree_view, command);
+        
+        g_free(command);
+        g_free(mount_args);
+        g_free(options);
+        g_free(driver);
+        g_free(fstype);
+        g_free(quoted_device_path);
+        g_free(quoted_mount_point);
+        g_free(device_path);
+        g_free(mount_point);
+        g_free(disk_name);
+    }
+}
+
+/*
+ * Mounts a scratch partition with each selected profile in turn, runs the metadata benchmark on it and unmounts it
+ * again, then prints one line per profile so options can be chosen from measurements.
+ */
+void on_mount_profile_compare_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL, *fstype = NULL;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    if (!check_fio_available()) return;
+
+    gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, COL_FSTYPE, &fstype, -1);
+    gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+
+    if (!fstype || strlen(fstype) == 0 || strcmp(fstype, "N/A") == 0 || strcmp(fstype, "-") == 0) {
+        GtkWidget *err = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+            "%s has no file system.\n\nFormat a scratch partition first.", device_path);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        g_free(device_path);
+        g_free(fstype);
+        g_free(partition_name);
+        return;
+    }
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "Compare Mount Option Profiles",
+        NULL,
+        GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Start Test", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 500, 400);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+    gchar *info_text = g_strdup_printf(
+        "Device: %s\n"
+        "File system: %s\n\n"
+        "The partition is unmounted, then mounted with each selected profile\n"
+        "and measured with the filesystem metadata benchmark. Test files are\n"
+        "created in a temporary directory and deleted afterwards.\n"
+        "Use a scratch partition: it stays unmounted when the test ends.",
+        device_path, fstype);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new(info_text), FALSE, FALSE, 5);
+    g_free(info_text);
+
+    GPtrArray *checks = g_ptr_array_new();
+    for (int i = 0; mount_profiles[i].fstype; i++) {
+        if (!mount_profile_matches(&mount_profiles[i], fstype)) continue;
+        gchar *label = g_strdup_printf("%s%s%s", mount_profiles[i].name,
+                                       strlen(mount_profiles[i].options) > 0 ? "  -o " : "", mount_profiles[i].options);
+        GtkWidget *check = gtk_check_button_new_with_label(label);
+        g_free(label);
+        gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check), TRUE);
+        g_object_set_data(G_OBJECT(check), "profile_index", GINT_TO_POINTER(i));
+        gtk_box_pack_start(GTK_BOX(content_area), check, FALSE, FALSE, 1);
+        g_ptr_array_add(checks, check);
+    }
+
+    int cpus = g_get_num_processors();
+    GtkWidget *threads_spin = gtk_spin_button_new_with_range(1, 64, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(threads_spin), cpus < 4 ? cpus : 4);
+    GtkWidget *files_spin = gtk_spin_button_new_with_range(100, 1000000, 1000);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(files_spin), 2000);
+    GtkWidget *fsync_spin = gtk_spin_button_new_with_range(5, 600, 5);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(fsync_spin), 10);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Worker threads:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), threads_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Files per thread:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), files_spin, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("fsync write test duration per profile (seconds):"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), fsync_spin, FALSE, FALSE, 2);
+
+    gtk_widget_show_all(dialog);
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    int threads = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(threads_spin));
+    int files = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(files_spin));
+    int fsync_seconds = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(fsync_spin));
+    GArray *selected = g_array_new(FALSE, FALSE, sizeof(int));
+    for (guint i = 0; i < checks->len; i++) {
+        GtkWidget *check = g_ptr_array_index(checks, i);
+        if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(check))) {
+            int index = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(check), "profile_index"));
+            g_array_append_val(selected, index);
+        }
+    }
+    g_ptr_array_free(checks, TRUE);
+    gtk_widget_destroy(dialog);
+
+    if (response == GTK_RESPONSE_ACCEPT && selected->len > 0) {
+        gchar *mount_dir = g_strdup_printf("/mnt/driveassistify-compare-%s", partition_name);
+        gchar *quoted_mount_dir = g_shell_quote(mount_dir);
+        gchar *quoted_device = g_shell_quote(device_path);
+        gchar *bench = build_fs_metadata_benchmark_command(mount_dir, threads, files, fsync_seconds, FALSE);
+
+        GString *cmd = g_string_new(NULL);
+        g_string_append_printf(cmd,
+            "cmp_dir=$(mktemp -d); cmp_mp=%s; sudo mkdir -p \"$cmp_mp\"; "
+            "if findmnt -rn -S %s > /dev/null && ! sudo umount %s; then "
+            "echo 'ERROR: %s is in use and could not be unmounted'; else ",
+            quoted_mount_dir, quoted_device, quoted_device, device_path);
+
+        for (guint i = 0; i < selected->len; i++) {
+            const MountProfile *profile = &mount_profiles[g_array_index(selected, int, i)];
+            gchar *args = build_mount_profile_args(profile->driver, profile->options);
+            gchar *params = g_strdup_printf("mount profile=%s, options=%s, threads=%d, files/thread=%d, fsync runtime=%ds",
+                                            profile->name, args, threads, files, fsync_seconds);
+            gchar *test_name = g_strdup_printf("Filesystem Metadata (fio), mount: %s", profile->name);
+            gchar *out_path = benchmark_store_begin(test_name, "fs-meta", device_path, params);
+            gchar *quoted_out = out_path ? g_shell_quote(out_path) : g_strdup("");
+            gchar *drop_record = g_strdup("");
+            if (out_path && g_str_has_suffix(out_path, ".out")) {
+                /* A profile that cannot be mounted has no result; keep it out of the results store. */
+                gchar *ini_path = g_strndup(out_path, strlen(out_path) - strlen(".out"));
+                gchar *ini_file = g_strconcat(ini_path, ".ini", NULL);
+                gchar *quoted_ini = g_shell_quote(ini_file);
+                g_free(drop_record);
+                drop_record = g_strdup_printf("; rm -f %s %s", quoted_ini, quoted_out);
+                g_free(quoted_ini);
+                g_free(ini_file);
+                g_free(ini_path);
+            }
+            gchar *quoted_name = g_shell_quote(profile->name);
+
+            g_string_append_printf(cmd,
+                "echo %s > \"$cmp_dir/%u.name\"; echo; echo '##### Profile: %s (mount %s) #####'; "
+                "if sudo mount %s%s \"$cmp_mp\"; then "
+                "{ %s; } 2>&1 | tee -a \"$cmp_dir/%u\" %s; sudo umount \"$cmp_mp\"; "
+                "else echo 'Mount failed, the driver or an option is not supported here.' | tee \"$cmp_dir/%u\"%s; fi; ",
+                quoted_name, i, profile->name, args,
+                args, quoted_device,
+                bench, i, quoted_out,
+                i, drop_record);
+
+            g_free(quoted_name);
+            g_free(drop_record);
+            g_free(quoted_out);
+            g_free(out_path);
+            g_free(test_name);
+            g_free(params);
+            g_free(args);
+        }
+
+        g_string_append_printf(cmd,
+            "echo; echo '##### Summary (operations per second; fsync = 4 KiB write IOPS) #####'; "
+            "echo 'create\tstat\tlist\tlist+stat\trename\tunlink\tfsync\tprofile'; "
+            "cmp_i=0; while [ $cmp_i -lt %u ]; do "
+            "awk -F';' -v name=\"$(cat \"$cmp_dir/$cmp_i.name\")\" '"
+            "/^meta;/ { v[$2] = int($3) } "
+            "/^3;/ { v[\"fsync\"] = $49 } "
+            "END { n = split(\"create stat warm_scan stat_scan rename unlink fsync\", k, \" \"); "
+            "for (i = 1; i <= n; i++) row = row (k[i] in v ? v[k[i]] : \"-\") \"\\t\"; print row name }' "
+            "\"$cmp_dir/$cmp_i\"; cmp_i=$((cmp_i + 1)); done; "
+            "echo; echo '%s was left unmounted.'; fi; rm -rf \"$cmp_dir\"",
+            selected->len, device_path);
+
+        run_command_in_terminal(tree_view, cmd->str);
+
+        g_string_free(cmd, TRUE);
+        g_free(bench);
+        g_free(quoted_device);
+        g_free(quoted_mount_dir);
+        g_free(mount_dir);
+    }
+
+    g_array_free(selected, TRUE);
+    g_free(device_path);
+    g_free(fstype);
+    g_free(partition_name);
+}
+
+void on_umount_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *disk_name = NULL;
+    
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, COL_NAME, &disk_name, -1);
+
+        gchar *device_path = g_strdup_printf("/dev/%s", disk_name);
+        gchar *quoted_device_path = g_shell_quote(device_path);
+        
+        gchar *command = g_strdup_printf(
+            "echo 'Unmounting %s...'; "
+            "if mount | grep -q '^%s '; then "
+                "timeout 15 sudo umount %s && "
+                "echo 'Unmounted successfully' || "
+                "(sleep 2 && timeout 15 sudo umount %s && "
+                "echo 'Unmounted on second attempt' || "
+                "echo 'ERROR: Unmount failed after 2 attempts'); "
+            "else "
+                "echo 'Device %s is not mounted - unmounting not needed'; "
+            "fi",
+            device_path,
+            device_path,
+            quoted_device_path,
+            quoted_device_path,
+            device_path
+        );
+        
+        run_command_in_terminal(tree_view, command);
+        
+        g_free(command);
+        g_free(quoted_device_path);
+        g_free(device_path);
+        g_free(disk_name);
+    }
+}
+
+void on_umount_l_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *disk_name = NULL;
+    
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, COL_NAME, &disk_name, -1);
+
+        gchar *device_path = g_strdup_printf("/dev/%s", disk_name);
+        gchar *quoted_device_path = g_shell_quote(device_path);
+        
+        gchar *command = g_strdup_printf(
+            "echo 'Lazy unmounting %s...'; "
+            "if mount | grep -q '^%s '; then "
+                "timeout 15 sudo umount -l %s && "
+                "echo 'Lazy unmount successful' || "
+                "(sleep 2 && timeout 15 sudo umount -l %s && "
+                "echo 'Lazy unmount successful on second attempt' || "
+                "echo 'ERROR: Lazy unmount failed'); "
+            "else "
+                "echo 'Device %s is not mounted - lazy unmounting not needed'; "
+            "fi",
+            device_path,
+            device_path,
+            quoted_device_path,
+            quoted_device_path,
+            device_path
+        );
+        
+        run_command_in_terminal(tree_view, command);
+        
+        g_free(command);
+        g_free(quoted_device_path);
+        g_free(device_path);
+        g_free(disk_name);
+    }
+}
+
+void on_umount_f_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *disk_name = NULL;
+    
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, COL_NAME, &disk_name, -1);
+
+        gchar *device_path = g_strdup_printf("/dev/%s", disk_name);
+        gchar *quoted_device_path = g_shell_quote(device_path);
+        
+        gchar *command = g_strdup_printf(
+            "echo 'Force unmounting %s...'; "
+            "if mount | grep -q '^%s '; then "
+                "timeout 15 sudo umount -f %s && "
+                "echo 'Forced unmount successful' || "
+                "(sleep 2 && timeout 15 sudo umount -f %s && "
+                "echo 'Forced unmount successful on second attempt' || "
+                "echo 'ERROR: Forced unmount failed'); "
+            "else "
+                "echo 'Device %s is not mounted - force unmounting not needed'; "
+            "fi",
+            device_path,
+            device_path,
+            quoted_device_path,
+            quoted_device_path,
+            device_path
+        );
+        
+        run_command_in_terminal(tree_view, command);
+        
+        g_free(command);
+        g_free(quoted_device_path);
+        g_free(device_path);
+        g_free(disk_name);
+    }
+}
+
+void on_rename_partition_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL, *fstype = NULL;
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, COL_FSTYPE, &fstype, -1);
+        gchar *current_label = NULL;
+        gchar *label_cmd = NULL;
+        if (g_strcmp0(fstype, "ext4") == 0 || g_strcmp0(fstype, "ext3") == 0 || g_strcmp0(fstype, "ext2") == 0) {
+            label_cmd = g_strdup_printf(
+                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
+                "label=$( blkid -s LABEL -o value /dev/%s 2>/dev/null ); "
+                "if [ -z \"$label\" ]; then "
+                "  magic=$( sudo dd if=/dev/%s bs=1 skip=1080 count=2 2>/dev/null | od -An -tx1 | tr -d ' \\n' ); "
+                "  if [ \"$magic\" = '53ef' ]; then "
+                "    label=$( sudo dd if=/dev/%s bs=1 skip=1144 count=16 2>/dev/null "
+                "      | tr -d '\\0' | sed 's/[[:space:]]*$//' ); "
+                "  fi; "
+                "fi; "
+                "echo \"$label\"",
+                partition_name, partition_name, partition_name, partition_name
+            );
+        } else if (g_strcmp0(fstype, "ntfs") == 0) {
+            label_cmd = g_strdup_printf(
+                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
+                "blkid -s LABEL -o value /dev/%s 2>/dev/null",
+                partition_name, partition_name
+            );
+        } else if (g_strcmp0(fstype, "exfat") == 0) {
+            label_cmd = g_strdup_printf(
+                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
+                "blkid -s LABEL -o value /dev/%s 2>/dev/null",
+                partition_name, partition_name
+            );
+        } else if (g_strcmp0(fstype, "vfat") == 0 || g_strcmp0(fstype, "fat32") == 0 || g_strcmp0(fstype, "fat") == 0) {
+            label_cmd = g_strdup_printf(
+                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
+                "label=$( sudo dd if=/dev/%s bs=512 count=1 2>/dev/null | "
+                "  dd bs=1 skip=71 count=11 2>/dev/null | tr -d '\\0' | sed 's/[[:space:]]*$//' ); "
+                "if [ -z \"$label\" ] || [ \"$label\" = 'NO NAME' ]; then "
+                "  label=$( sudo dd if=/dev/%s bs=512 count=1 2>/dev/null | "
+                "    dd bs=1 skip=43 count=11 2>/dev/null | tr -d '\\0' | sed 's/[[:space:]]*$//' ); "
+                "fi; "
+                "if [ -z \"$label\" ] || [ \"$label\" = 'NO NAME' ]; then "
+                "  blkid -s LABEL -o value /dev/%s 2>/dev/null; "
+                "else echo \"$label\"; fi",
+                partition_name, partition_name, partition_name, partition_name
+            );
+        } else if (g_strcmp0(fstype, "xfs") == 0) {
+            label_cmd = g_strdup_printf(
+                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
+                "label=$( xfs_admin -l /dev/%s 2>/dev/null | cut -d'\"' -f2 ); "
+                "if [ -z \"$label\" ]; then "
+                "  magic=$( sudo dd if=/dev/%s bs=1 count=4 2>/dev/null | od -An -tx1 | tr -d ' \\n' ); "
+                "  if [ \"$magic\" = '58465342' ]; then "
+                "    label=$( sudo dd if=/dev/%s bs=1 skip=108 count=12 2>/dev/null "
+                "      | tr -d '\\0' | sed 's/[[:space:]]*$//' ); "
+                "  fi; "
+                "fi; "
+                "echo \"$label\"",
+                partition_name, partition_name, partition_name, partition_name
+            );
+        } else if (g_strcmp0(fstype, "btrfs") == 0) {
+            label_cmd = g_strdup_printf(
+                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
+                "label=$( btrfs filesystem label /dev/%s 2>/dev/null ); "
+                "if [ -z \"$label\" ]; then "
+                "  magic=$( sudo dd if=/dev/%s bs=1 skip=65600 count=8 2>/dev/null ); "
+                "  if [ \"$magic\" = '_BHRfS_M' ]; then "
+                "    label=$( sudo dd if=/dev/%s bs=1 skip=65835 count=256 2>/dev/null "
+                "      | tr -d '\\0' | sed 's/[[:space:]]*$//' ); "
+                "  fi; "
+                "fi; "
+                "echo \"$label\"",
+                partition_name, partition_name, partition_name, partition_name
+            );
+        } else {
+            label_cmd = g_strdup_printf(
+                "sudo blockdev --flushbufs /dev/%s 2>/dev/null; "
+                "blkid -s LABEL -o value /dev/%s 2>/dev/null",
+                partition_name, partition_name
+            );
+        }
+        if (label_cmd) {
+            FILE *fp = popen(label_cmd, "r");
+            if (fp) {
+                char label_buf[256] = {0};
+                if (fgets(label_buf, sizeof(label_buf), fp)) {
+                    g_strstrip(label_buf);
+                    if (strlen(label_buf) > 0)
+                        current_label = g_strdup(label_buf);
+                }
+                pclose(fp);
+            }
+            g_free(label_cmd);
+        }
+        GtkWidget *dialog = gtk_dialog_new_with_buttons(
+            "Rename Partition", NULL, GTK_DIALOG_MODAL,
+            "_Cancel", GTK_RESPONSE_CANCEL,
+            "_Rename", GTK_RESPONSE_ACCEPT,
+            NULL
+        );
+        gtk_window_set_default_size(GTK_WINDOW(dialog), 400, 140);
+        GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+        gchar *info_text;
+        if (current_label && strlen(current_label) > 0)
+            info_text = g_strdup_printf("Partition: %s (%s)\nCurrent label: %s", partition_name, fstype, current_label);
+        else
+            info_text = g_strdup_printf("Partition: %s (%s)\nCurrent label: (empty)", partition_name, fstype);
+        GtkWidget *info_label_w = gtk_label_new(info_text);
+        gtk_label_set_xalign(GTK_LABEL(info_label_w), 0.0);
+        gtk_box_pack_start(GTK_BOX(content_area), info_label_w, FALSE, FALSE, 10);
+        g_free(info_text);
+        GtkWidget *entry = gtk_entry_new();
+        gtk_entry_set_max_length(GTK_ENTRY(entry), 16);
+        gtk_entry_set_width_chars(GTK_ENTRY(entry), 24);
+        if (current_label && strlen(current_label) > 0) {
+            gtk_entry_set_text(GTK_ENTRY(entry), current_label);
+            gtk_editable_select_region(GTK_EDITABLE(entry), 0, -1);
+        }
+        gtk_box_pack_start(GTK_BOX(content_area), entry, FALSE, FALSE, 5);
+        gtk_widget_show_all(dialog);
+        gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+        gchar *new_label = NULL;
+        if (response == GTK_RESPONSE_ACCEPT)
+            new_label = g_strdup(gtk_entry_get_text(GTK_ENTRY(entry)));
+        gtk_widget_destroy(dialog);
+        if (new_label && strlen(new_label) > 0) {
+            gchar *cmd = NULL;
+            if (g_strcmp0(fstype, "ext4") == 0 || g_strcmp0(fstype, "ext3") == 0 || g_strcmp0(fstype, "ext2") == 0) {
+                cmd = g_strdup_printf(
+                    "sudo e2label %%s '%s' && "
+                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null && "
+                    "echo 'Label changed (ext2/3/4)' || echo 'ERROR: Failed to change ext label'",
+                    new_label
+                );
+            } else if (g_strcmp0(fstype, "ntfs") == 0) {
+                cmd = g_strdup_printf(
+                    "sudo ntfslabel --force %%s '%s' >/dev/null 2>&1 && "
+                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null && "
+                    "echo 'Label changed (NTFS)' || echo 'ERROR: Failed to change NTFS label'",
+                    new_label
+                );
+            } else if (g_strcmp0(fstype, "exfat") == 0) {
+                cmd = g_strdup_printf(
+                    "sudo exfatlabel %%s '%s' && "
+                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null && "
+                    "echo 'Label changed (exFAT)' || echo 'ERROR: Failed to change exFAT label'",
+                    new_label
+                );
+            } else if (g_strcmp0(fstype, "vfat") == 0 || g_strcmp0(fstype, "fat32") == 0 || g_strcmp0(fstype, "fat") == 0) {
+                cmd = g_strdup_printf(
+                    "{ sudo dosfslabel %%s '%s' 2>&1 || sudo fatlabel %%s '%s' 2>&1; } | "
+                    "grep -v 'differences\\|Differences\\|offset\\|Not automatically\\|backup'; "
+                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null; "
+                    "echo 'Label changed (FAT)'",
+                    new_label, new_label
+                );
+            } else if (g_strcmp0(fstype, "xfs") == 0) {
+                cmd = g_strdup_printf(
+                    "sudo xfs_admin -L '%s' %%s && "
+                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null && "
+                    "echo 'Label changed (XFS)' || echo 'ERROR: Failed to change XFS label'",
+                    new_label
+                );
+            } else if (g_strcmp0(fstype, "btrfs") == 0) {
+                cmd = g_strdup_printf(
+                    "sudo btrfs filesystem label %%s '%s' && "
+                    "sudo blockdev --flushbufs /dev/%%s 2>/dev/null && "
+                    "echo 'Label changed (Btrfs)' || echo 'ERROR: Failed to change Btrfs label'",
+                    new_label
+                );
+            } else {
+                cmd = g_strdup_printf("echo 'Unsupported or unknown filesystem: %s'", fstype ? fstype : "unknown");
+            }
+            run_command_in_terminal(tree_view, cmd);
+            g_free(cmd);
+            g_free(new_label);
+        }
+        if (current_label) g_free(current_label);
+        g_free(partition_name);
+        g_free(fstype);
+    }
+}
+
+void on_partition_table_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *disk_name = NULL;
+    gchar *type = NULL;
+
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, COL_NAME, &disk_name, COL_TYPE, &type, -1);
+
+        if (g_strcmp0(type, "disk") != 0) {
+            GtkWidget *err = gtk_message_dialog_new(
+                NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                    "This function is intended only for entire disks (e.g., /dev/sdb), not for partitions (e.g., /dev/sdb1). Please select a whole disk (not a partition)."
+            );
+            gtk_dialog_run(GTK_DIALOG(err));
+            gtk_widget_destroy(err);
+            g_free(type);
+            g_free(disk_name);
+            return;
+        }
+        g_free(type);
+
+        GtkWidget *dialog = gtk_dialog_new_with_buttons(
+            "Choose Partition Table Type",
+            NULL,
+            GTK_DIALOG_MODAL,
+            "_Cancel", GTK_RESPONSE_CANCEL,
+            "_Create", GTK_RESPONSE_OK,
+            NULL
+        );
+        gtk_window_set_default_size(GTK_WINDOW(dialog), 350, 70);
+
+        GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+        GtkWidget *combo = gtk_combo_box_text_new();
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "MBR (msdos)");
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "GPT");
+        gtk_combo_box_set_active(GTK_COMBO_BOX(combo), 0);
+        gtk_container_add(GTK_CONTAINER(content_area), combo);
+        gtk_widget_show_all(dialog);
+
+        gint result = gtk_dialog_run(GTK_DIALOG(dialog));
+        int table_type = gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
+        gtk_widget_destroy(dialog);
+
+        if (result == GTK_RESPONSE_OK) {
+            gchar *device_path = g_strdup_printf("/dev/%s", disk_name);
+            gchar *quoted_device = g_shell_quote(device_path);
+
+            GtkWidget *warn = gtk_message_dialog_new(
+                NULL,
+                GTK_DIALOG_MODAL,
+                GTK_MESSAGE_WARNING,
+                GTK_BUTTONS_OK_CANCEL,
+                "WARNING: Creating a new partition table will destroy all data on %s!\n\nContinue?",
+                device_path
+            );
+            gint resp = gtk_dialog_run(GTK_DIALOG(warn));
+            gtk_widget_destroy(warn);
+
+            if (resp == GTK_RESPONSE_OK) {
+                const char *table = (table_type == 0) ? "msdos" : "gpt";
+                gchar *fdisk_cmd = (table_type == 0)
+                    ? g_strdup_printf("echo -e 'o\\nw\\n' | sudo fdisk %s", quoted_device)
+                    : g_strdup_printf("echo -e 'g\\nw\\n' | sudo fdisk %s", quoted_device);
+
+                gchar *command = g_strdup_printf(
+                    "for part in $(lsblk -ln -o NAME %s | grep -v ^$(basename %s)$); do umount /dev/$part 2>/dev/null; done; "
+                    "(sudo parted -s %s mklabel \"%s\" || %s) && "
+                    "sudo partprobe %s || sudo blockdev --rereadpt %s && "
+                    "sudo parted -s %s print | grep -q '^Number  Start' && "
+                    "[ -z \"$(sudo parted -s %s print | grep '^ [0-9]')\" ] && "
+                    "echo 'Partition table (%s) created successfully.' || "
+                    "echo 'Failed: partition table (%s) not created.'",
+                    quoted_device, quoted_device, quoted_device, table, fdisk_cmd, 
+                    quoted_device, quoted_device, quoted_device, quoted_device, table, table
+                );
+                run_command_in_terminal(tree_view, command);
+                g_free(fdisk_cmd);
+                g_free(command);
+            }
+            g_free(quoted_device);
+            g_free(device_path);
+        }
+        g_free(disk_name);
+    }
+}
+
+void on_mkfs_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL;
+    gchar *mountpoint = NULL;
+    gchar *type = NULL;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter))
+        return;
+
+    gtk_tree_model_get(model, &iter,
+        COL_NAME, &partition_name,
+        COL_MOUNTPOINT, &mountpoint,
+        COL_TYPE, &type,
+        -1);
+
+    if (g_strcmp0(type, "disk") == 0) {
+        GtkWidget *warn_dialog = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_YES_NO,
+            "WARNING: You are about to create a filesystem directly on the disk (%s) without creating a partition table!\n\n"
+            "This is NOT recommended. Use 'Show Filesystems and Free Space' to create a partition with a filesystem instead.\n\n"
+            "Do you really want to continue?", partition_name
+        );
+        gint warn_resp = gtk_dialog_run(GTK_DIALOG(warn_dialog));
+        gtk_widget_destroy(warn_dialog);
+        if (warn_resp != GTK_RESPONSE_YES) {
+            g_free(partition_name);
+            g_free(type);
+            if (mountpoint) g_free(mountpoint);
+            return;
+        }
+    }
+
+    gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "Format Filesystem", NULL, GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL, "_Create", GTK_RESPONSE_ACCEPT, NULL
+    );
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 420, 180);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+    GtkWidget *combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "ext4");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "ext3");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "ext2");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "ntfs (quick format)");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "ntfs (full zeroing)");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "exfat");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "fat32");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo), 0);
+
+    GtkWidget *cluster_label = gtk_label_new("Cluster / Block size:");
+    GtkWidget *cluster_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cluster_combo), "default");
+    const int cluster_options[] = {512,1024,2048,4096,8192,16384,32768,65536};
+    for (int i = 0; i < 8; i++) {
+        gchar tmp[16];
+        g_snprintf(tmp, sizeof(tmp), "%d", cluster_options[i]);
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cluster_combo), tmp);
+    }
+    gtk_combo_box_set_active(GTK_COMBO_BOX(cluster_combo), 0);
+
+    GtkWidget *sector_label = gtk_label_new("Logical sector size (bytes):");
+    GtkWidget *sector_combo = gtk_combo_box_text_new();
+    const int sector_options[] = {512,1024,2048,4096,8192,16384};
+    int default_sector = 512;
+    for (int i = 0; i < 6; i++) {
+        gchar tmp[32];
+        g_snprintf(tmp, sizeof(tmp), "%d%s", sector_options[i],
+                   sector_options[i]==default_sector ? " (default)" : "");
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(sector_combo), tmp);
+    }
+    gtk_combo_box_set_active(GTK_COMBO_BOX(sector_combo), 0);
+
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Select filesystem type:"), FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), sector_label, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), sector_combo, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), cluster_label, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(content_area), cluster_combo, FALSE, FALSE, 2);
+
+    GtkWidget *spacer = gtk_label_new("");
+    gtk_widget_set_size_request(spacer, -1, 15);
+    gtk_box_pack_start(GTK_BOX(content_area), spacer, FALSE, FALSE, 0);
+
+    gtk_widget_show_all(dialog);
+
+    ClusterUpdateData cud;
+    cud.cluster_label = cluster_label;
+    cud.cluster_combo = cluster_combo;
+    g_signal_connect(combo, "changed", G_CALLBACK(update_cluster_options_cb), &cud);
+    update_cluster_options_cb(GTK_COMBO_BOX_TEXT(combo), &cud);
+
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    if (response == GTK_RESPONSE_ACCEPT) {
+        const gchar *fs_display = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(combo));
+        const gchar *cluster_sel = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(cluster_combo));
+        const gchar *sector_sel_str = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(sector_combo));
+
+        gboolean is_ntfs_quick = g_strcmp0(fs_display, "ntfs (quick format)") == 0;
+        gboolean is_ntfs_full = g_strcmp0(fs_display, "ntfs (full zeroing)") == 0;
+        const gchar *fs_type = is_ntfs_quick || is_ntfs_full ? "ntfs" : fs_display;
+
+        int chosen_sector = 512;
+        if (sector_sel_str) {
+            char *clean = g_strdup(sector_sel_str);
+            char *p = strstr(clean, " (default)");
+            if (p) *p = 0;
+            chosen_sector = atoi(clean);
+            g_free(clean);
+        }
+
+        int cluster_val = 0;
+        if (cluster_sel && g_strcmp0(cluster_sel,"default")!=0) {
+            cluster_val = atoi(cluster_sel);
+        } else {
+            if (g_strcmp0(fs_type,"ext4")==0 || g_strcmp0(fs_type,"ext3")==0) cluster_val = 4096;
+            else if (g_strcmp0(fs_type,"ext2")==0) cluster_val = 1024;
+            else if (g_strcmp0(fs_type,"exfat")==0) cluster_val = 8;
+            else if (g_strcmp0(fs_type,"fat32")==0) cluster_val = 1;
+        }
+
+        gchar *mkfs_cmd = NULL;
+        if (g_strcmp0(fs_type,"ext4")==0)
+            mkfs_cmd = g_strdup_printf("mkfs.ext4 -F -b %d '%s'", cluster_val, device_path);
+        else if (g_strcmp0(fs_type,"ext3")==0)
+            mkfs_cmd = g_strdup_printf("mkfs.ext3 -F -b %d '%s'", cluster_val, device_path);
+        else if (g_strcmp0(fs_type,"ext2")==0)
+            mkfs_cmd = g_strdup_printf("mkfs.ext2 -F -b %d '%s'", cluster_val, device_path);
+        else if (is_ntfs_quick) {
+            if (cluster_val > 0)
+                mkfs_cmd = g_strdup_printf("mkfs.ntfs -f -c %d -Q '%s'", cluster_val, device_path);
+            else
+                mkfs_cmd = g_strdup_printf("mkfs.ntfs -f -Q '%s'", device_path);
+        }
+        else if (is_ntfs_full) {
+            if (cluster_val > 0)
+                mkfs_cmd = g_strdup_printf("mkfs.ntfs -F -c %d '%s'", cluster_val, device_path);
+            else
+                mkfs_cmd = g_strdup_printf("mkfs.ntfs -F '%s'", device_path);
+        }
+        else if (g_strcmp0(fs_type,"exfat")==0)
+            mkfs_cmd = g_strdup_printf("mkfs.exfat -s %d '%s'", cluster_val, device_path);
+        else if (g_strcmp0(fs_type,"fat32")==0)
+            mkfs_cmd = g_strdup_printf("mkfs.vfat -F 32 -s %d '%s'", cluster_val, device_path);
+
+        GtkWidget *warn = gtk_message_dialog_new(
+            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK_CANCEL,
+            "WARNING: This will destroy all data on %s!\n\nFilesystem type: %s\nCluster/Block: %d\nSector: %d\n\nAre you sure?",
+            device_path, fs_display, cluster_val, chosen_sector
+        );
+        gint warn_response = gtk_dialog_run(GTK_DIALOG(warn));
+        gtk_widget_destroy(warn);
+
+        if (warn_response == GTK_RESPONSE_OK) {
+            gboolean requires_reread = (g_strcmp0(fs_type,"exfat")!=0 && g_strcmp0(fs_type,"fat32")!=0);
+            gchar *command = NULL;
+
+            if (mountpoint && strlen(mountpoint)>0 && strcmp(mountpoint,"N/A")!=0 && strcmp(mountpoint,"-")!=0) {
+                if (requires_reread) {
+                    command = g_strdup_printf(
+                        "echo 'Unmounting %s...'; umount '%s' 2>/dev/null; "
+                        "echo 'Formatting %s as %s...'; sudo %s; "
+                        "sudo udevadm settle && "
+                        "(sudo partprobe '%s' || sudo blockdev --rereadpt '%s'); "
+                        "echo 'Filesystem created and partition table re-read.'",
+                        device_path, device_path, device_path, fs_display, mkfs_cmd, device_path, device_path
+                    );
+                } else {
+                    command = g_strdup_printf(
+                        "echo 'Unmounting %s...'; umount '%s' 2>/dev/null; "
+                        "echo 'Formatting %s as %s...'; sudo %s; "
+                        "sudo udevadm settle && "
+                        "echo 'Filesystem created.'",
+                        device_path, device_path, device_path, fs_display, mkfs_cmd
+                    );
+                }
+            } else {
+                if (requires_reread) {
+                    command = g_strdup_printf(
+                        "echo 'Formatting %s as %s...'; sudo %s; "
+                        "sudo udevadm settle && "
+                        "(sudo partprobe '%s' || sudo blockdev --rereadpt '%s'); "
+                        "echo 'Filesystem created and partition table re-read.'",
+                        device_path, fs_display, mkfs_cmd, device_path, device_path
+                    );
+                } else {
+                    command = g_strdup_printf(
+                        "echo 'Formatting %s as %s...'; sudo %s; "
+                        "sudo udevadm settle && "
+                        "echo 'Filesystem created.'",
+                        device_path, fs_display, mkfs_cmd
+                    );
+                }
+            }
+            run_command_in_terminal(tree_view, command);
+            g_free(command);
+            
+            show_disk_list(NULL, tree_view);
+            if (g_strcmp0(fs_type, "ext2") == 0 || 
+                g_strcmp0(fs_type, "ext3") == 0 || 
+                is_ntfs_full) {
+                g_timeout_add(12000, refresh_disk_list_delayed, g_object_ref(tree_view));
+            } else {
+                g_timeout_add(3850, refresh_disk_list_delayed, g_object_ref(tree_view));
+            }
+        }
+        g_free(mkfs_cmd);
+    }
+
+    gtk_widget_destroy(dialog);
+    g_free(device_path);
+    g_free(partition_name);
+    g_free(type);
+    if (mountpoint) g_free(mountpoint);
+}
+
+typedef struct {
+    GtkWidget *label_free;
+    long long orig_free;
+    long long orig_size;
+    int sector_size;
+
+    GtkWidget *entry_start;
+    GtkWidget *entry_end;
+    GtkWidget *entry_mib;
+
+    GtkWidget *entry_bytes;
+    GtkWidget *entry_gib;
+    GtkWidget *entry_sectors;
+    gboolean updating;
+} ResizeWidgets;
+
+static gboolean is_updating = FALSE;
+
+static void on_resize_dialog_response(GtkDialog *dialog, gint response_id, gpointer user_data);
+static void on_resize_dialog_destroy(GtkWidget *dialog, gpointer user_data);
+static void on_entry_bytes_changed(GtkEditable *editable, gpointer user_data);
+static void on_entry_mib_changed(GtkEditable *editable, gpointer user_data);
+static void on_entry_gib_changed(GtkEditable *editable, gpointer user_data);
+static void on_entry_sectors_changed(GtkEditable *editable, gpointer user_data);
+
+static void on_entry_start_changed(GtkEditable *editable, gpointer user_data) {
+    if (is_updating) return;
+    is_updating = TRUE;
+
+    ResizeWidgets *widgets = (ResizeWidgets*)user_data;
+    const gchar *start_text = gtk_entry_get_text(GTK_ENTRY(widgets->entry_start));
+    const gchar *mib_text = gtk_entry_get_text(GTK_ENTRY(widgets->entry_mib));
+    int start = atoi(start_text);
+    int input = atoi(mib_text);
+
+    if (input > 0 && widgets->sector_size > 0) {
+        int sectors = (input * 1024 * 1024) / widgets->sector_size;
+        int end = start + sectors - 1;
+        if (start >= 0 && sectors > 0 && end >= start) {
+            gchar end_str[32];
+            g_snprintf(end_str, sizeof(end_str), "%d", end);
+            gtk_entry_set_text(GTK_ENTRY(widgets->entry_end), end_str);
+        } else {
+            gtk_entry_set_text(GTK_ENTRY(widgets->entry_end), "");
+        }
+    } else {
+        gtk_entry_set_text(GTK_ENTRY(widgets->entry_end), "");
+    }
+
+    is_updating = FALSE;
+}
+
+static void on_entry_end_changed(GtkEditable *editable, gpointer user_data) {
+    if (is_updating) return;
+    is_updating = TRUE;
+
+    ResizeWidgets *widgets = (ResizeWidgets*)user_data;
+    const gchar *start_text = gtk_entry_get_text(GTK_ENTRY(widgets->entry_start));
+    const gchar *end_text = gtk_entry_get_text(GTK_ENTRY(widgets->entry_end));
+    int start = atoi(start_text);
+    int end = atoi(end_text);
+    if (end > start && widgets->sector_size > 0) {
+        int sectors = end - start + 1;
+        int mib = (sectors * widgets->sector_size) / (1024 * 1024);
+        gchar mib_str[32];
+        g_snprintf(mib_str, sizeof(mib_str), "%d", mib);
+        gtk_entry_set_text(GTK_ENTRY(widgets->entry_mib), mib_str);
+    }
+
+    is_updating = FALSE;
+}
+
+static void on_entry_bytes_changed(GtkEditable *editable, gpointer user_data) {
+    ResizeWidgets *w = (ResizeWidgets*)user_data;
+    const char *text = gtk_entry_get_text(GTK_ENTRY(editable));
+    if (!text || strlen(text) == 0) return;
+
+    long long bytes = atoll(text);
+    long long mib = bytes / (1024*1024);
+    long long gib = bytes / (1024*1024*1024);
+    long long sectors = (bytes + w->sector_size - 1) / w->sector_size;
+
+    g_signal_handlers_block_by_func(w->entry_mib,   G_CALLBACK(on_entry_mib_changed), w);
+    g_signal_handlers_block_by_func(w->entry_gib,   G_CALLBACK(on_entry_gib_changed), w);
+    g_signal_handlers_block_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
+
+    char tmp[64];
+    g_snprintf(tmp, sizeof(tmp), "%lld", mib);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_mib), tmp);
+    g_snprintf(tmp, sizeof(tmp), "%lld", gib);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_gib), tmp);
+    g_snprintf(tmp, sizeof(tmp), "%lld", sectors);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_sectors), tmp);
+
+    g_signal_handlers_unblock_by_func(w->entry_mib,   G_CALLBACK(on_entry_mib_changed), w);
+    g_signal_handlers_unblock_by_func(w->entry_gib,   G_CALLBACK(on_entry_gib_changed), w);
+    g_signal_handlers_unblock_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
+}
+
+static void on_entry_mib_changed(GtkEditable *editable, gpointer user_data) {
+    if (is_updating) return;
+    is_updating = 1;
+
+    ResizeWidgets *w = (ResizeWidgets*)user_data;
+    const char *text = gtk_entry_get_text(GTK_ENTRY(editable));
+    if (!text || strlen(text) == 0) { is_updating = 0; return; }
+
+    long long input_mib = atoll(text);
+    if (input_mib < 0) input_mib = 0;
+
+    long long bytes = input_mib * 1024LL * 1024LL;
+    double gib = (double)input_mib / 1024.0;
+    long long sectors = (bytes + w->sector_size - 1) / w->sector_size;
+
+    g_signal_handlers_block_by_func(w->entry_bytes,   G_CALLBACK(on_entry_bytes_changed), w);
+    g_signal_handlers_block_by_func(w->entry_gib,     G_CALLBACK(on_entry_gib_changed), w);
+    g_signal_handlers_block_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
+
+    char tmp[64];
+    g_snprintf(tmp, sizeof(tmp), "%lld", bytes);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_bytes), tmp);
+
+    g_snprintf(tmp, sizeof(tmp), "%lld", input_mib);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_mib), tmp);
+
+    g_snprintf(tmp, sizeof(tmp), "%.2f", gib);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_gib), tmp);
+
+    g_snprintf(tmp, sizeof(tmp), "%lld", sectors);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_sectors), tmp);
+
+    const char *start_text = gtk_entry_get_text(GTK_ENTRY(w->entry_start));
+    if (start_text && strlen(start_text) > 0) {
+        long long start = atoll(start_text);
+        if (start >= 0 && sectors > 0) {
+            long long end = start + sectors - 1;
+            g_snprintf(tmp, sizeof(tmp), "%lld", end);
+            g_signal_handlers_block_by_func(w->entry_end, G_CALLBACK(on_entry_end_changed), w);
+            gtk_entry_set_text(GTK_ENTRY(w->entry_end), tmp);
+            g_signal_handlers_unblock_by_func(w->entry_end, G_CALLBACK(on_entry_end_changed), w);
+        }
+    }
+
+    if (w->label_free) {
+        long long left = (w->orig_size + w->orig_free) - input_mib;
+        if (left < 0) left = 0;
+        char lbl[128];
+        g_snprintf(lbl, sizeof(lbl), "Free space after resize: %lld MiB", left);
+        gtk_label_set_text(GTK_LABEL(w->label_free), lbl);
+    }
+
+    g_signal_handlers_unblock_by_func(w->entry_bytes,   G_CALLBACK(on_entry_bytes_changed), w);
+    g_signal_handlers_unblock_by_func(w->entry_gib,     G_CALLBACK(on_entry_gib_changed), w);
+    g_signal_handlers_unblock_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
+
+    is_updating = 0;
+}
+
+static void on_entry_gib_changed(GtkEditable *editable, gpointer user_data) {
+    CreateFSWidgets *w = (CreateFSWidgets*)user_data;
+    if (w->updating) return;
+    w->updating = TRUE;
+
+    const char *text = gtk_entry_get_text(GTK_ENTRY(editable));
+    if (!text || strlen(text) == 0) { w->updating = FALSE; return; }
+
+    double gib = atof(text);
+    long long bytes = (long long)(gib * 1024.0 * 1024.0 * 1024.0);
+    long long mib = bytes / (1024 * 1024);
+    long long sectors = (bytes + w->sector_size - 1) / w->sector_size;
+
+    g_signal_handlers_block_by_func(w->entry_bytes, G_CALLBACK(on_create_entry_bytes_changed), w);
+    g_signal_handlers_block_by_func(w->entry_mib, G_CALLBACK(on_create_entry_mib_changed), w);
+    g_signal_handlers_block_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
+
+    char tmp[64];
+    g_snprintf(tmp, sizeof(tmp), "%lld", bytes);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_bytes), tmp);
+    g_snprintf(tmp, sizeof(tmp), "%lld", mib);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_mib), tmp);
+    g_snprintf(tmp, sizeof(tmp), "%lld", sectors);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_sectors), tmp);
+
+    g_signal_handlers_unblock_by_func(w->entry_bytes, G_CALLBACK(on_create_entry_bytes_changed), w);
+    g_signal_handlers_unblock_by_func(w->entry_mib, G_CALLBACK(on_create_entry_mib_changed), w);
+    g_signal_handlers_unblock_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
+
+    if (w->label_free) {
+        long long mib = (long long)(gib * 1024.0);
+        long long left = w->orig_free - mib;
+        if (left < 0) left = 0;
+        char lbl[128];
+        g_snprintf(lbl, sizeof(lbl), "Free space after creation: %lld MiB (%.2f GiB)", 
+                   left, (double)left / 1024.0);
+        gtk_label_set_text(GTK_LABEL(w->label_free), lbl);
+}
+
+    w->updating = FALSE;
+}
+
+static void on_entry_sectors_changed(GtkEditable *editable, gpointer user_data) {
+    CreateFSWidgets *w = (CreateFSWidgets*)user_data;
+    if (w->updating) return;
+    w->updating = TRUE;
+
+    const char *text = gtk_entry_get_text(GTK_ENTRY(editable));
+    if (!text || strlen(text) == 0) { w->updating = FALSE; return; }
+
+    long long sectors = atoll(text);
+    long long bytes = sectors * w->sector_size;
+    long long mib = bytes / (1024 * 1024);
+    double gib = (double)bytes / (1024.0 * 1024.0 * 1024.0);
+
+    g_signal_handlers_block_by_func(w->entry_bytes, G_CALLBACK(on_create_entry_bytes_changed), w);
+    g_signal_handlers_block_by_func(w->entry_mib, G_CALLBACK(on_create_entry_mib_changed), w);
+    g_signal_handlers_block_by_func(w->entry_gib, G_CALLBACK(on_entry_gib_changed), w);
+
+    char tmp[64];
+    g_snprintf(tmp, sizeof(tmp), "%lld", bytes);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_bytes), tmp);
+    g_snprintf(tmp, sizeof(tmp), "%lld", mib);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_mib), tmp);
+    g_snprintf(tmp, sizeof(tmp), "%.2f", gib);
+    gtk_entry_set_text(GTK_ENTRY(w->entry_gib), tmp);
+
+    g_signal_handlers_unblock_by_func(w->entry_bytes, G_CALLBACK(on_create_entry_bytes_changed), w);
+    g_signal_handlers_unblock_by_func(w->entry_mib, G_CALLBACK(on_create_entry_mib_changed), w);
+    g_signal_handlers_unblock_by_func(w->entry_gib, G_CALLBACK(on_entry_gib_changed), w);
+
+    if (w->label_free) {
+        long long mib = bytes / (1024 * 1024);
+        long long left = w->orig_free - mib;
+        if (left < 0) left = 0;
+        char lbl[128];
+        g_snprintf(lbl, sizeof(lbl), "Free space after creation: %lld MiB (%.2f GiB)", 
+                   left, (double)left / 1024.0);
+        gtk_label_set_text(GTK_LABEL(w->label_free), lbl);
+}
+
+    w->updating = FALSE;
+}
+
+void on_resize_partition_activate(GtkWidget *menuitem, gpointer user_data) {
+
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL, *fstype = NULL, *size = NULL;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter))
+        return;
+
+    gtk_tree_model_get(model, &iter,
+                       COL_NAME, &partition_name,
+                       COL_FSTYPE, &fstype,
+                       COL_SIZE, &size,
+                       -1);
+
+    gchar *disk_name = get_disk_from_partition(partition_name);
+    if (!disk_name) return;
+
+    gchar *device_disk = g_strdup_printf("/dev/%s", disk_name);
+
+    gchar *part_num = NULL;
+
+    if (g_str_has_prefix(partition_name, "nvme") ||
+        g_str_has_prefix(partition_name, "mmcblk"))
+    {
+        gchar *p = g_strrstr(partition_name, "p");
+        if (p && isdigit(*(p+1)))
+            part_num = g_strdup(p + 1);
+    }
+    else {
+        const gchar *p = partition_name;
+        while (*p && !isdigit(*p)) p++;
+        if (*p) part_num = g_strdup(p);
+    }
+
+    int sector_size = 512;
+    {
+        gchar *ss_cmd = g_strdup_printf("blockdev --getss %s", device_disk);
+        FILE *ss_fp = popen(ss_cmd, "r");
+        if (ss_fp) {
+            if (fscanf(ss_fp, "%d", &sector_size) != 1)
+                sector_size = 512;
+            pclose(ss_fp);
+        }
+        g_free(ss_cmd);
+    }
+
+    long long start_mib = 0, end_mib = 0, orig_size_mib = 0;
+    long long start_sector = 0, end_sector = 0;
+
+    if (part_num) {
+        gchar *cmd = g_strdup_printf(
+            "LC_ALL=C parted -m %s unit MiB print "
+            "| awk -F: -v N=\"%s\" '$1==N {gsub(/MiB$/, \"\", $2); "
+            "gsub(/MiB$/, \"\", $3); print $2 \" \" $3}'",
+            device_disk, part_num);
+
+        FILE *fp = popen(cmd, "r");
+        if (fp) {
+            char buf[256] = {0};
+            if (fgets(buf, sizeof(buf), fp)) {
+                char *tok = strtok(buf, " \t\n");
+                if (tok) start_mib = atoll(tok);
+
+                tok = strtok(NULL, " \t\n");
+                if (tok) end_mib = atoll(tok);
+
+                start_sector = (start_mib * 1024LL * 1024LL) / sector_size;
+                end_sector   = (end_mib   * 1024LL * 1024LL) / sector_size;
+
+                orig_size_mib = end_mib - start_mib;
+            }
+            pclose(fp);
+        }
+        g_free(cmd);
+    }
+
+    long long max_free = 0;
+    {
+        gchar *command = g_strdup_printf(
+            "LC_ALL=C parted -m %s unit MiB print free", device_disk);
+
+        FILE *fp = popen(command, "r");
+        if (fp) {
+            char line[512];
+            gboolean in_table = FALSE;
+            long long prev_end = 0;
+            gboolean found_partition = FALSE;
+
+            while (fgets(line, sizeof(line), fp)) {
+                if (strstr(line, "Number") && strstr(line, "File system")) {
+                    in_table = TRUE;
+                    continue;
+                }
+                if (!in_table) continue;
+
+                gchar *trim = g_strstrip(line);
+                if (!trim[0]) continue;
+
+                char num[32], st[64], en[64], size_s[64], type[64];
+                int p = sscanf(trim, "%31[^:]:%63[^:]:%63[^:]:%63[^:]:%63[^\n]",
+                               num, st, en, size_s, type);
+
+                if (p >= 4) {
+                    long long block_start = atoll(st);
+                    long long block_end   = atoll(en);
+                    gchar *block_type = type;
+
+                    if (found_partition && g_str_has_prefix(block_type, "Free Space")) {
+                        max_free = block_end - block_start;
+                        break;
+                    }
+
+                    if (num && part_num && g_strcmp0(num, part_num) == 0) {
+                        found_partition = TRUE;
+                        prev_end = block_end;
+                    }
+                }
+            }
+            pclose(fp);
+        }
+        if (max_free < 0) max_free = 0;
+        g_free(command);
+    }
+
+    GtkWidget *main_window = GTK_WIDGET(
+        gtk_widget_get_toplevel(GTK_WIDGET(tree_view)));
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(
+        "Resize Partition",
+        GTK_IS_WINDOW(main_window) ? GTK_WINDOW(main_window) : NULL,
+        GTK_DIALOG_MODAL,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Resize", GTK_RESPONSE_ACCEPT,
+        NULL);
+
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 540, 420);
+    GtkWidget *area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+
+    GtkWidget *label1 = gtk_label_new(
+        "Resize Partition (Bytes / MiB / GiB / Sectors):");
+
+    GtkWidget *entry_bytes   = gtk_entry_new();
+    GtkWidget *entry_mib     = gtk_entry_new();
+    GtkWidget *entry_gib     = gtk_entry_new();
+    GtkWidget *entry_sectors = gtk_entry_new();
+
+    GtkWidget *label_free = gtk_label_new(NULL);
+
+    GtkWidget *label2 = gtk_label_new("Or specify first and last sector:");
+
+    GtkWidget *entry_start = gtk_entry_new();
+    GtkWidget *entry_end   = gtk_entry_new();
+
+    GtkWidget *reminder = gtk_label_new(
+        "Note: When shrinking a partition, the console will ask 'Yes/No'. "
+        "Type 'Yes' and press Enter to confirm.");
+    gtk_widget_set_halign(reminder, GTK_ALIGN_START);
+
+    GtkWidget *alignment_info = gtk_label_new(
+        "For best compatibility and performance, the start sector should be 2048 or a multiple of 2048 (1 MiB\n"
+        "alignment). This ensures proper partition alignment on modern storage devices.");
+    gtk_widget_set_halign(alignment_info, GTK_ALIGN_START);
+
+    {
+        char tmp[128];
+
+        g_snprintf(tmp, sizeof(tmp), "%lld",
+                   orig_size_mib * 1024LL * 1024LL);
+        gtk_entry_set_text(GTK_ENTRY(entry_bytes), tmp);
+
+        g_snprintf(tmp, sizeof(tmp), "%lld", orig_size_mib);
+        gtk_entry_set_text(GTK_ENTRY(entry_mib), tmp);
+
+        double gib = (double)orig_size_mib / 1024.0;
+        g_snprintf(tmp, sizeof(tmp), "%.2f", gib);
+        gtk_entry_set_text(GTK_ENTRY(entry_gib), tmp);
+
+        long long sectors = (end_sector - start_sector);
+        g_snprintf(tmp, sizeof(tmp), "%lld", sectors);
+        gtk_entry_set_text(GTK_ENTRY(entry_sectors), tmp);
+
+        g_snprintf(tmp, sizeof(tmp), "%lld", start_sector);
+        gtk_entry_set_text(GTK_ENTRY(entry_start), tmp);
+
+        g_snprintf(tmp, sizeof(tmp), "%lld", end_sector);
+        gtk_entry_set_text(GTK_ENTRY(entry_end), tmp);
+
+        if (max_free > 0) {
+            g_snprintf(tmp, sizeof(tmp),
+                       "Free space: %lld MiB", max_free);
+            gtk_label_set_text(GTK_LABEL(label_free), tmp);
+        } else {
+            gtk_label_set_text(GTK_LABEL(label_free),
+                               "Free space: unknown");
+        }
+    }
+
+    gtk_box_pack_start(GTK_BOX(area), label1, FALSE, FALSE, 4);
+    gtk_box_pack_start(GTK_BOX(area), entry_bytes,   FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(area), entry_mib,     FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(area), entry_gib,     FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(area), entry_sectors, FALSE, FALSE, 2);
+
+    gtk_box_pack_start(GTK_BOX(area), label_free, FALSE, FALSE, 6);
+    gtk_box_pack_start(GTK_BOX(area), label2, FALSE, FALSE, 4);
+    gtk_box_pack_start(GTK_BOX(area), entry_start, FALSE, FALSE, 2);
+    gtk_box_pack_start(GTK_BOX(area), entry_end,   FALSE, FALSE, 2);
+
+    gtk_box_pack_start(GTK_BOX(area), alignment_info, FALSE, FALSE, 8);
+    gtk_box_pack_start(GTK_BOX(area), reminder, FALSE, FALSE, 8);
+
+    ResizeWidgets *widgets = g_new0(ResizeWidgets, 1);
+
+    widgets->label_free   = label_free;
+    widgets->orig_free    = max_free;
+    widgets->orig_size    = orig_size_mib;
+    widgets->sector_size  = sector_size;
+
+    widgets->entry_bytes   = entry_bytes;
+    widgets->entry_mib     = entry_mib;
+    widgets->entry_gib     = entry_gib;
+    widgets->entry_sectors = entry_sectors;
+    widgets->entry_start   = entry_start;
+    widgets->entry_end     = entry_end;
+
+    g_signal_connect(entry_bytes,   "changed",
+                     G_CALLBACK(on_entry_bytes_changed),   widgets);
+    g_signal_connect(entry_mib,     "changed",
+                     G_CALLBACK(on_entry_mib_changed),     widgets);
+    g_signal_connect(entry_gib,     "changed",
+                     G_CALLBACK(on_entry_gib_changed),     widgets);
+    g_signal_connect(entry_sectors, "changed",
+                     G_CALLBACK(on_entry_sectors_changed), widgets);
+    g_signal_connect(entry_start,   "changed",
+                     G_CALLBACK(on_entry_start_changed),   widgets);
+    g_signal_connect(entry_end,     "changed",
+                     G_CALLBACK(on_entry_end_changed),     widgets);
+
+    on_entry_mib_changed(GTK_EDITABLE(entry_mib), widgets);
+
+    gtk_widget_show_all(dialog);
+
+    g_object_set_data(G_OBJECT(dialog), "widgets", widgets);
+    g_object_set_data(G_OBJECT(dialog), "tree_view", tree_view);
+    g_object_set_data(G_OBJECT(dialog), "partition_name", partition_name);
+    g_object_set_data(G_OBJECT(dialog), "fstype", fstype);
+    g_object_set_data(G_OBJECT(dialog), "size", size);
+
+    g_object_set_data(G_OBJECT(dialog), "device_disk", device_disk);
+    g_object_set_data(G_OBJECT(dialog), "entry_bytes", entry_bytes);
+    g_object_set_data(G_OBJECT(dialog), "entry_mib", entry_mib);
+    g_object_set_data(G_OBJECT(dialog), "entry_gib", entry_gib);
+    g_object_set_data(G_OBJECT(dialog), "entry_sectors", entry_sectors);
+    g_object_set_data(G_OBJECT(dialog), "entry_start", entry_start);
+    g_object_set_data(G_OBJECT(dialog), "entry_end", entry_end);
+
+    g_signal_connect(dialog, "response",
+                     G_CALLBACK(on_resize_dialog_response), NULL);
+    g_signal_connect(dialog, "destroy",
+                     G_CALLBACK(on_resize_dialog_destroy), NULL);
+
+    if (part_num) g_free(part_num);
+    g_free(disk_name);
+}
+
+static void on_resize_dialog_response(GtkDialog *dialog, gint response_id, gpointer user_data) {
+    ResizeWidgets *widgets = g_object_get_data(G_OBJECT(dialog), "widgets");
+    GtkTreeView *tree_view = g_object_get_data(G_OBJECT(dialog), "tree_view");
+    gchar *partition_name = g_object_get_data(G_OBJECT(dialog), "partition_name");
+    gchar *fstype = g_object_get_data(G_OBJECT(dialog), "fstype");
+    GtkWidget *entry_mib = g_object_get_data(G_OBJECT(dialog), "entry_mib");
+
+    if (response_id != GTK_RESPONSE_ACCEPT) {
+        gtk_widget_destroy(GTK_WIDGET(dialog));
+        return;
+    }
+
+    const gchar *size_str = gtk_entry_get_text(GTK_ENTRY(entry_mib));
+    if (!size_str || strlen(size_str) == 0) goto cleanup_and_close_dialog;
+
+    gchar *disk_name = get_disk_from_partition(partition_name);
+    if (!disk_name) goto cleanup_and_close_dialog;
+    gchar *disk_path = g_strdup_printf("/dev/%s", disk_name);
+
+    gchar *part_num = NULL;
+    if (g_str_has_prefix(partition_name, "nvme") || g_str_has_prefix(partition_name, "mmcblk")) {
+        gchar *p = g_strrstr(partition_name, "p");
+        if (p && isdigit(*(p+1))) part_num = g_strdup(p+1);
+    } else {
+        const gchar *p = partition_name;
+        while (*p && !isdigit(*p)) p++;
+        if (*p) part_num = g_strdup(p);
+    }
+    if (!part_num) goto cleanup_and_close_dialog;
+
+    gchar *cmd_sectors = g_strdup_printf(
+        "parted -m %s unit s print | grep '^%s:' | cut -d: -f2,3 | tr -d 's'",
+        disk_path, part_num
+    );
+    FILE *fp = popen(cmd_sectors, "r");
+    g_free(cmd_sectors);
+
+    long long start_sector = 0, current_end_sector = 0;
+    if (fp && fscanf(fp, "%lld:%lld", &start_sector, &current_end_sector) != 2) {
+        start_sector = current_end_sector = 0;
+    }
+    if (fp) pclose(fp);
+
+    gchar *tmp = g_strdup(size_str);
+    gchar *t = g_strstrip(tmp);
+    while (strlen(t) > 0 && strchr("BbIiMm ", t[strlen(t)-1])) t[strlen(t)-1] = '\0';
+    long long target_mib = atoll(t);
+    g_free(tmp);
+    if (target_mib <= 0) goto cleanup_and_close_dialog;
+
+    long long sector_size = widgets && widgets->sector_size > 0 ? widgets->sector_size : 512;
+    long long target_sectors = (target_mib * 1024LL * 1024LL + sector_size - 1) / sector_size;
+    long long final_end_sector = start_sector + target_sectors - 1;
+
+    gchar *cmd_disk_size = g_strdup_printf("blockdev --getsz %s", disk_path);
+    FILE *fd = popen(cmd_disk_size, "r");
+    g_free(cmd_disk_size);
+    long long disk_sectors = 0;
+    if (fd && fscanf(fd, "%lld", &disk_sectors) != 1) disk_sectors = 0;
+    if (fd) pclose(fd);
+
+    if (disk_sectors > 0 && final_end_sector >= disk_sectors)
+        final_end_sector = disk_sectors - 1;
+
+    gchar *part_path = NULL;
+    if (g_str_has_prefix(disk_name, "nvme") || g_str_has_prefix(disk_name, "mmcblk"))
+        part_path = g_strdup_printf("/dev/%sp%s", disk_name, part_num);
+    else
+        part_path = g_strdup_printf("/dev/%s%s", disk_name, part_num);
+
+    gboolean shrinking = final_end_sector < current_end_sector;
+
+    GString *script = g_string_new(NULL);
+    g_string_append_printf(script,
+        "#!/bin/bash\nset -e\n\n"
+        "before_start=%lld\n"
+        "before_end=%lld\n"
+        "before_size=$((before_end - before_start + 1))\n"
+        "before_mib=$((before_size*%lld/1024/1024))\n"
+        "before_gib=$((before_mib/1024))\n\n"
+        "echo \"======================================\"\n"
+        "echo \" BEFORE\"\n"
+        "echo \" Start sector : $before_start\"\n"
+        "echo \" End sector   : $before_end\"\n"
+        "echo \" Size (sect)  : $before_size  ($before_mib MiB / ~$before_gib GiB)\"\n"
+        "echo \"======================================\"\n\n",
+        start_sector, current_end_sector, sector_size
+    );
+
+    g_string_append_printf(script, "umount %s 2>/dev/null || true\n\n", part_path);
+
+    if (shrinking && g_str_has_prefix(fstype, "ext")) {
+        g_string_append_printf(script,
+            "echo 'Running e2fsck...'\n"
+            "e2fsck -fy %s\n"
+            "echo 'Shrinking filesystem...'\n"
+            "resize2fs %s %lldM\n\n",
+            part_path, part_path, target_mib
+        );
+
+        g_string_append_printf(script,
+            "blk_cnt=$(dumpe2fs -h %s | awk '/Block count:/ {print $3}')\n"
+            "blk_sz=$(dumpe2fs -h %s | awk '/Block size:/ {print $3}')\n"
+            "fs_sectors=$(( (blk_cnt * blk_sz + %lld - 1)/%lld ))\n"
+            "new_end=$(( %lld + fs_sectors - 1 ))\n"
+            "echo \"Filesystem end sector: $new_end\"\n\n",
+            part_path, part_path, sector_size, sector_size, start_sector
+        );
+
+        g_string_append_printf(script,
+            "echo 'Resizing partition (shrink)...'\n"
+            "parted %s resizepart %s ${new_end}s\n"
+            "echo 'Partition shrink completed.'\n\n",
+            disk_path, part_num
+        );
+    }
+
+    if (!shrinking) {
+        g_string_append_printf(script,
+            "echo 'Extending partition...'\n"
+            "parted --script %s resizepart %s %llds\n"
+            "echo 'Partition extend completed.'\n\n",
+            disk_path, part_num, final_end_sector
+        );
+
+        if (g_str_has_prefix(fstype, "ext")) {
+            g_string_append_printf(script,
+                "echo 'Updating filesystem...'\n"
+                "e2fsck -fy %s || true\n"
+                "resize2fs %s || true\n\n",
+                part_path, part_path
             );
-            gtk_dialog_run(GTK_DIALOG(err));
-            gtk_widget_destroy(err);
-            g_free(type);
-            g_free(disk_name);
-            return;
         }
-        g_free(type);
+    }
 
-        GtkWidget *dialog = gtk_dialog_new_with_buttons(
-            "Choose Partition Table Type",
-            NULL,
-            GTK_DIALOG_MODAL,
-            "_Cancel", GTK_RESPONSE_CANCEL,
-            "_Create", GTK_RESPONSE_OK,
-            NULL
-        );
-        gtk_window_set_default_size(GTK_WINDOW(dialog), 350, 70);
+    g_string_append_printf(script,
+        "udevadm settle && partprobe %s || blockdev --rereadpt %s\\n"
+        "after_start=$(parted -m %s unit s print | grep '^%s:' | cut -d: -f2 | tr -d 's')\n"
+        "after_end=$(parted -m %s unit s print | grep '^%s:' | cut -d: -f3 | tr -d 's')\n"
+        "after_size=$((after_end - after_start + 1))\n"
+        "after_mib=$((after_size*%lld/1024/1024))\n"
+        "after_gib=$((after_mib/1024))\n\n"
+        "echo \"======================================\"\n"
+        "echo \" AFTER\"\n"
+        "echo \" Start sector : $after_start\"\n"
+        "echo \" End sector   : $after_end\"\n"
+        "echo \" Size (sect)  : $after_size  ($after_mib MiB / ~$after_gib GiB)\"\n"
+        "echo \"======================================\"\n"
+        "echo \"Operation completed.\"\n"
+        "rm -f \"$0\"\n",
+        disk_path, disk_path, part_num, disk_path, part_num, sector_size
+    );
 
-        GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
-        GtkWidget *combo = gtk_combo_box_text_new();
-        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "MBR (msdos)");
-        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "GPT");
-        gtk_combo_box_set_active(GTK_COMBO_BOX(combo), 0);
-        gtk_container_add(GTK_CONTAINER(content_area), combo);
-        gtk_widget_show_all(dialog);
+    gchar *tmp_path = g_strdup_printf("/tmp/driveassistify_resize_%ld.sh", (long)getpid());
+    g_file_set_contents(tmp_path, script->str, -1, NULL);
+    chmod(tmp_path, 0755);
 
-        gint result = gtk_dialog_run(GTK_DIALOG(dialog));
-        int table_type = gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
-        gtk_widget_destroy(dialog);
+    run_command_in_terminal(tree_view, tmp_path);
 
-        if (result == GTK_RESPONSE_OK) {
-            gchar *device_path = g_strdup_printf("/dev/%s", disk_name);
-            gchar *quoted_device = g_shell_quote(device_path);
+    g_string_free(script, TRUE);
+    g_free(tmp_path);
+    g_free(part_path);
+    g_free(part_num);
+    g_free(disk_name);
+    g_free(disk_path);
 
-            GtkWidget *warn = gtk_message_dialog_new(
-                NULL,
-                GTK_DIALOG_MODAL,
-                GTK_MESSAGE_WARNING,
-                GTK_BUTTONS_OK_CANCEL,
-                "WARNING: Creating a new partition table will destroy all data on %s!\n\nContinue?",
-                device_path
-            );
-            gint resp = gtk_dialog_run(GTK_DIALOG(warn));
-            gtk_widget_destroy(warn);
+cleanup_and_close_dialog:
+    gtk_widget_destroy(GTK_WIDGET(dialog));
+}
 
-            if (resp == GTK_RESPONSE_OK) {
-                const char *table = (table_type == 0) ? "msdos" : "gpt";
-                gchar *fdisk_cmd = (table_type == 0)
-                    ? g_strdup_printf("echo -e 'o\\nw\\n' | sudo fdisk %s", quoted_device)
-                    : g_strdup_printf("echo -e 'g\\nw\\n' | sudo fdisk %s", quoted_device);
+static void on_resize_dialog_destroy(GtkWidget *dialog, gpointer user_data) {
+    ResizeWidgets *widgets = g_object_get_data(G_OBJECT(dialog), "widgets");
+    gchar *partition_name = g_object_get_data(G_OBJECT(dialog), "partition_name");
+    gchar *fstype = g_object_get_data(G_OBJECT(dialog), "fstype");
+    gchar *size = g_object_get_data(G_OBJECT(dialog), "size");
+    gchar *device_path = g_object_get_data(G_OBJECT(dialog), "device_path");
+    if (widgets) g_free(widgets);
+    if (partition_name) g_free(partition_name);
+    if (fstype) g_free(fstype);
+    if (size) g_free(size);
+    if (device_path) g_free(device_path);
+}
 
-                gchar *command = g_strdup_printf(
-                    "for part in $(lsblk -ln -o NAME %s | grep -v ^$(basename %s)$); do umount /dev/$part 2>/dev/null; done; "
-                    "(sudo parted -s %s mklabel \"%s\" || %s) && "
-                    "sudo partprobe %s || sudo blockdev --rereadpt %s && "
-                    "sudo parted -s %s print | grep -q '^Number  Start' && "
-                    "[ -z \"$(sudo parted -s %s print | grep '^ [0-9]')\" ] && "
-                    "echo 'Partition table (%s) created successfully.' || "
-                    "echo 'Failed: partition table (%s) not created.'",
-                    quoted_device, quoted_device, quoted_device, table, fdisk_cmd, 
-                    quoted_device, quoted_device, quoted_device, quoted_device, table, table
-                );
-                run_command_in_terminal(tree_view, command);
-                g_free(fdisk_cmd);
-                g_free(command);
-            }
-            g_free(quoted_device);
-            g_free(device_path);
-        }
-        g_free(disk_name);
-    }
+static void on_grub_terminal_exited(VteTerminal *terminal, gint status, gpointer user_data) {
+    GtkWidget *window = GTK_WIDGET(user_data);
+    gtk_window_set_title(GTK_WINDOW(window), "Command Finished - You can close this window");
 }
 
-void on_mkfs_activate(GtkWidget *menuitem, gpointer user_data) {
+void on_grub_uefi_install_activate(GtkWidget *menuitem, gpointer user_data) {
     GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
     GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
     GtkTreeModel *model;
     GtkTreeIter iter;
-    gchar *partition_name = NULL;
-    gchar *mountpoint = NULL;
-    gchar *type = NULL;
-
-    if (!gtk_tree_selection_get_selected(selection, &model, &iter))
-        return;
+    gchar *partition_name = NULL, *mountpoint = NULL;
 
-    gtk_tree_model_get(model, &iter,
-        COL_NAME, &partition_name,
-        COL_MOUNTPOINT, &mountpoint,
-        COL_TYPE, &type,
-        -1);
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
 
-    if (g_strcmp0(type, "disk") == 0) {
-        GtkWidget *warn_dialog = gtk_message_dialog_new(
-            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_YES_NO,
-            "WARNING: You are about to create a filesystem directly on the disk (%s) without creating a partition table!\n\n"
-            "This is NOT recommended. Use 'Show Filesystems and Free Space' to create a partition with a filesystem instead.\n\n"
-            "Do you really want to continue?", partition_name
-        );
-        gint warn_resp = gtk_dialog_run(GTK_DIALOG(warn_dialog));
-        gtk_widget_destroy(warn_dialog);
-        if (warn_resp != GTK_RESPONSE_YES) {
-            g_free(partition_name);
-            g_free(type);
-            if (mountpoint) g_free(mountpoint);
-            return;
-        }
-    }
+        gtk_tree_model_get(model, &iter,
+                           COL_NAME, &partition_name,
+                           COL_MOUNTPOINT, &mountpoint,
+                           -1);
 
-    gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+        gchar *device_path        = g_strdup_printf("/dev/%s", partition_name);
+        gchar *mount_dir          = g_strdup("/mnt/driveassistify_grub");
+        gchar *quoted_device_path = g_shell_quote(device_path);
+        gchar *quoted_mountpoint  = mountpoint ? g_shell_quote(mountpoint) : g_strdup("''");
 
-    GtkWidget *dialog = gtk_dialog_new_with_buttons(
-        "Format Filesystem", NULL, GTK_DIALOG_MODAL,
-        "_Cancel", GTK_RESPONSE_CANCEL, "_Create", GTK_RESPONSE_ACCEPT, NULL
-    );
-    gtk_window_set_default_size(GTK_WINDOW(dialog), 420, 180);
-    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+        GtkWidget *warn = gtk_message_dialog_new(
+            NULL,
+            GTK_DIALOG_MODAL,
+            GTK_MESSAGE_WARNING,
+            GTK_BUTTONS_OK_CANCEL,
+            "WARNING: This is a potentially destructive operation!\n\n"
+            "Installing GRUB2 to a UEFI partition.\n"
+            "If you select the wrong partition, your system may become unbootable.\n\n"
+            "Target partition: %s\n\n"
+            "Are you sure you want to continue?",
+            device_path
+        );
 
-    GtkWidget *combo = gtk_combo_box_text_new();
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "ext4");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "ext3");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "ext2");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "ntfs (quick format)");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "ntfs (full zeroing)");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "exfat");
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), "fat32");
-    gtk_combo_box_set_active(GTK_COMBO_BOX(combo), 0);
+        gint response = gtk_dialog_run(GTK_DIALOG(warn));
+        gtk_widget_destroy(warn);
 
-    GtkWidget *cluster_label = gtk_label_new("Cluster / Block size:");
-    GtkWidget *cluster_combo = gtk_combo_box_text_new();
-    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cluster_combo), "default");
-    const int cluster_options[] = {512,1024,2048,4096,8192,16384,32768,65536};
-    for (int i = 0; i < 8; i++) {
-        gchar tmp[16];
-        g_snprintf(tmp, sizeof(tmp), "%d", cluster_options[i]);
-        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(cluster_combo), tmp);
-    }
-    gtk_combo_box_set_active(GTK_COMBO_BOX(cluster_combo), 0);
+        if (response == GTK_RESPONSE_OK) {
 
-    GtkWidget *sector_label = gtk_label_new("Logical sector size (bytes):");
-    GtkWidget *sector_combo = gtk_combo_box_text_new();
-    const int sector_options[] = {512,1024,2048,4096,8192,16384};
-    int default_sector = 512;
-    for (int i = 0; i < 6; i++) {
-        gchar tmp[32];
-        g_snprintf(tmp, sizeof(tmp), "%d%s", sector_options[i],
-                   sector_options[i]==default_sector ? " (default)" : "");
-        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(sector_combo), tmp);
-    }
-    gtk_combo_box_set_active(GTK_COMBO_BOX(sector_combo), 0);
+            gchar *command = g_strdup_printf(
+                "echo '========================================='; "
+                "echo 'Starting UEFI GRUB installation'; "
+                "echo 'Target device: %s'; "
+                "echo 'Mount directory: %s'; "
+                "echo '-----------------------------------------'; "
 
-    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Select filesystem type:"), FALSE, FALSE, 2);
-    gtk_box_pack_start(GTK_BOX(content_area), combo, FALSE, FALSE, 2);
-    gtk_box_pack_start(GTK_BOX(content_area), sector_label, FALSE, FALSE, 2);
-    gtk_box_pack_start(GTK_BOX(content_area), sector_combo, FALSE, FALSE, 2);
-    gtk_box_pack_start(GTK_BOX(content_area), cluster_label, FALSE, FALSE, 2);
-    gtk_box_pack_start(GTK_BOX(content_area), cluster_combo, FALSE, FALSE, 2);
+                "echo 'Unmounting previous mount (if any)...'; "
 
-    GtkWidget *spacer = gtk_label_new("");
-    gtk_widget_set_size_request(spacer, -1, 15);
-    gtk_box_pack_start(GTK_BOX(content_area), spacer, FALSE, FALSE, 0);
+                "if mount | grep -q '%s '; then "
+                "  echo 'Trying normal umount with timeout...'; "
+                "  for i in 1 2; do "
+                "    timeout 15 umount %s && break || { "
+                "      echo 'Attempt $i failed, retrying in 2s...'; "
+                "      sleep 2; "
+                "    }; "
+                "  done; "
+                "  if mount | grep -q '%s '; then "
+                "    echo 'ERROR: Could not unmount the device.'; "
+                "    echo 'You may need to unmount manually using:'; "
+                "    echo '   umount %s'; "
+                "    echo '   umount -l %s   (lazy)'; "
+                "    echo '   umount -f %s   (force)'; "
+                "    echo 'Aborting.'; "
+                "    echo; "
+                "    echo 'This window can now be closed.'; "
+                "    read -p 'Press Enter to close...'; "
+                "    exit 1; "
+                "  fi; "
+                "else "
+                "  echo 'Device not mounted — OK'; "
+                "fi; "
 
-    gtk_widget_show_all(dialog);
+                "echo 'Creating temporary mount directory...'; "
+                "mkdir -p %s; "
 
-    ClusterUpdateData cud;
-    cud.cluster_label = cluster_label;
-    cud.cluster_combo = cluster_combo;
-    g_signal_connect(combo, "changed", G_CALLBACK(update_cluster_options_cb), &cud);
-    update_cluster_options_cb(GTK_COMBO_BOX_TEXT(combo), &cud);
+                "echo 'Mounting target partition (vfat)...'; "
+                "mount -t vfat %s %s || { "
+                "  echo 'ERROR: Failed to mount partition! Aborting.'; "
+                "  echo; "
+                "  echo 'This window can now be closed.'; "
+                "  read -p 'Press Enter to close...'; "
+                "  exit 1; "
+                "}; "
 
-    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
-    if (response == GTK_RESPONSE_ACCEPT) {
-        const gchar *fs_display = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(combo));
-        const gchar *cluster_sel = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(cluster_combo));
-        const gchar *sector_sel_str = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(sector_combo));
+                "echo 'Ensuring boot directory exists...'; "
+                "mkdir -p %s/boot; "
 
-        gboolean is_ntfs_quick = g_strcmp0(fs_display, "ntfs (quick format)") == 0;
-        gboolean is_ntfs_full = g_strcmp0(fs_display, "ntfs (full zeroing)") == 0;
-        const gchar *fs_type = is_ntfs_quick || is_ntfs_full ? "ntfs" : fs_display;
+                "echo 'Running grub-install...'; "
+                "grub-install --target=x86_64-efi "
+                "             --efi-directory=%s "
+                "             --boot-directory=%s/boot "
+                "             --removable --no-nvram || { "
+                "    echo 'ERROR: grub-install failed! Unmounting...'; "
+                "    timeout 15 umount %s 2>/dev/null; "
+                "    echo; "
+                "    echo 'This window can now be closed.'; "
+                "    read -p 'Press Enter to close...'; "
+                "    exit 1; "
+                "}; "
 
-        int chosen_sector = 512;
-        if (sector_sel_str) {
-            char *clean = g_strdup(sector_sel_str);
-            char *p = strstr(clean, " (default)");
-            if (p) *p = 0;
-            chosen_sector = atoi(clean);
-            g_free(clean);
-        }
+                "echo 'Unmounting...'; "
+                "timeout 15 umount %s; "
 
-        int cluster_val = 0;
-        if (cluster_sel && g_strcmp0(cluster_sel,"default")!=0) {
-            cluster_val = atoi(cluster_sel);
-        } else {
-            if (g_strcmp0(fs_type,"ext4")==0 || g_strcmp0(fs_type,"ext3")==0) cluster_val = 4096;
-            else if (g_strcmp0(fs_type,"ext2")==0) cluster_val = 1024;
-            else if (g_strcmp0(fs_type,"exfat")==0) cluster_val = 8;
-            else if (g_strcmp0(fs_type,"fat32")==0) cluster_val = 1;
-        }
+                "echo 'Removing temporary directory...'; "
+                "rmdir %s; "
 
-        gchar *mkfs_cmd = NULL;
-        if (g_strcmp0(fs_type,"ext4")==0)
-            mkfs_cmd = g_strdup_printf("mkfs.ext4 -F -b %d '%s'", cluster_val, device_path);
-        else if (g_strcmp0(fs_type,"ext3")==0)
-            mkfs_cmd = g_strdup_printf("mkfs.ext3 -F -b %d '%s'", cluster_val, device_path);
-        else if (g_strcmp0(fs_type,"ext2")==0)
-            mkfs_cmd = g_strdup_printf("mkfs.ext2 -F -b %d '%s'", cluster_val, device_path);
-        else if (is_ntfs_quick) {
-            if (cluster_val > 0)
-                mkfs_cmd = g_strdup_printf("mkfs.ntfs -f -c %d -Q '%s'", cluster_val, device_path);
-            else
-                mkfs_cmd = g_strdup_printf("mkfs.ntfs -f -Q '%s'", device_path);
-        }
-        else if (is_ntfs_full) {
-            if (cluster_val > 0)
-                mkfs_cmd = g_strdup_printf("mkfs.ntfs -F -c %d '%s'", cluster_val, device_path);
-            else
-                mkfs_cmd = g_strdup_printf("mkfs.ntfs -F '%s'", device_path);
-        }
-        else if (g_strcmp0(fs_type,"exfat")==0)
-            mkfs_cmd = g_strdup_printf("mkfs.exfat -s %d '%s'", cluster_val, device_path);
-        else if (g_strcmp0(fs_type,"fat32")==0)
-            mkfs_cmd = g_strdup_printf("mkfs.vfat -F 32 -s %d '%s'", cluster_val, device_path);
+                "echo '-----------------------------------------'; "
+                "echo 'UEFI GRUB installation finished successfully.'; "
+                "echo '========================================='; "
+                "echo; "
+                "read -p 'Press Enter to close...';",
 
-        GtkWidget *warn = gtk_message_dialog_new(
-            NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK_CANCEL,
-            "WARNING: This will destroy all data on %s!\n\nFilesystem type: %s\nCluster/Block: %d\nSector: %d\n\nAre you sure?",
-            device_path, fs_display, cluster_val, chosen_sector
-        );
-        gint warn_response = gtk_dialog_run(GTK_DIALOG(warn));
-        gtk_widget_destroy(warn);
+                device_path,
+                mount_dir,
 
-        if (warn_response == GTK_RESPONSE_OK) {
-            gboolean requires_reread = (g_strcmp0(fs_type,"exfat")!=0 && g_strcmp0(fs_type,"fat32")!=0);
-            gchar *command = NULL;
+                device_path,
+                device_path,
+                device_path,
+                device_path,
+                device_path,
+                device_path,
 
-            if (mountpoint && strlen(mountpoint)>0 && strcmp(mountpoint,"N/A")!=0 && strcmp(mountpoint,"-")!=0) {
-                if (requires_reread) {
-                    command = g_strdup_printf(
-                        "echo 'Unmounting %s...'; umount '%s' 2>/dev/null; "
-                        "echo 'Formatting %s as %s...'; sudo %s; "
-                        "sudo udevadm settle && "
-                        "(sudo partprobe '%s' || sudo blockdev --rereadpt '%s'); "
-                        "echo 'Filesystem created and partition table re-read.'",
-                        device_path, device_path, device_path, fs_display, mkfs_cmd, device_path, device_path
-                    );
-                } else {
-                    command = g_strdup_printf(
-                        "echo 'Unmounting %s...'; umount '%s' 2>/dev/null; "
-                        "echo 'Formatting %s as %s...'; sudo %s; "
-                        "sudo udevadm settle && "
-                        "echo 'Filesystem created.'",
-                        device_path, device_path, device_path, fs_display, mkfs_cmd
-                    );
-                }
-            } else {
-                if (requires_reread) {
-                    command = g_strdup_printf(
-                        "echo 'Formatting %s as %s...'; sudo %s; "
-                        "sudo udevadm settle && "
-                        "(sudo partprobe '%s' || sudo blockdev --rereadpt '%s'); "
-                        "echo 'Filesystem created and partition table re-read.'",
-                        device_path, fs_display, mkfs_cmd, device_path, device_path
-                    );
-                } else {
-                    command = g_strdup_printf(
-                        "echo 'Formatting %s as %s...'; sudo %s; "
-                        "sudo udevadm settle && "
-                        "echo 'Filesystem created.'",
-                        device_path, fs_display, mkfs_cmd
-                    );
-                }
-            }
-            run_command_in_terminal(tree_view, command);
-            g_free(command);
+                mount_dir,
+                quoted_device_path,
+                mount_dir,
+                mount_dir,
+                mount_dir,
+                mount_dir,
+                mount_dir,
+                mount_dir,
+                mount_dir
+            );
+
+            pid_t pid = fork();
             
-            show_disk_list(NULL, tree_view);
-            if (g_strcmp0(fs_type, "ext2") == 0 || 
-                g_strcmp0(fs_type, "ext3") == 0 || 
-                is_ntfs_full) {
-                g_timeout_add(12000, refresh_disk_list_delayed, g_object_ref(tree_view));
+            if (pid == 0) {
+                const gchar *terminals[] = {"gnome-terminal", "konsole", "xfce4-terminal", 
+                                           "mate-terminal", "lxterminal", "xterm", NULL};
+                
+                for (int i = 0; terminals[i]; i++) {
+                    gchar *term_bin = g_find_program_in_path(terminals[i]);
+                    if (term_bin) {
+                        if (g_strcmp0(terminals[i], "gnome-terminal") == 0) {
+                            execlp(term_bin, term_bin, "--", "bash", "-c", command, NULL);
+                        } else {
+                            execlp(term_bin, term_bin, "-e", "bash", "-c", command, NULL);
+                        }
+                        g_free(term_bin);
+                    }
+                }
+                
+                exit(1);
+            } else if (pid > 0) {
+                g_free(command);
             } else {
-                g_timeout_add(3850, refresh_disk_list_delayed, g_object_ref(tree_view));
+                g_warning("Failed to fork process");
+                GtkWidget *err = gtk_message_dialog_new(
+                    GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(tree_view))),
+                    GTK_DIALOG_MODAL,
+                    GTK_MESSAGE_ERROR,
+                    GTK_BUTTONS_OK,
+                    "Failed to create new process."
+                );
+                gtk_dialog_run(GTK_DIALOG(err));
+                gtk_widget_destroy(err);
+                g_free(command);
             }
         }
-        g_free(mkfs_cmd);
-    }
 
-    gtk_widget_destroy(dialog);
-    g_free(device_path);
-    g_free(partition_name);
-    g_free(type);
-    if (mountpoint) g_free(mountpoint);
+        g_free(quoted_device_path);
+        g_free(quoted_mountpoint);
+        g_free(mount_dir);
+        g_free(device_path);
+        g_free(partition_name);
+        g_free(mountpoint);
+    }
 }
 
-typedef struct {
-    GtkWidget *label_free;
-    long long orig_free;
-    long long orig_size;
-    int sector_size;
+void on_grub_mbr_install_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL, *mountpoint = NULL;
 
-    GtkWidget *entry_start;
-    GtkWidget *entry_end;
-    GtkWidget *entry_mib;
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, COL_MOUNTPOINT, &mountpoint, -1);
 
-    GtkWidget *entry_bytes;
-    GtkWidget *entry_gib;
-    GtkWidget *entry_sectors;
-    gboolean updating;
-} ResizeWidgets;
+        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
 
-static gboolean is_updating = FALSE;
+        gchar *disk_path = NULL;
+        if (g_str_has_prefix(partition_name, "nvme") && strchr(partition_name, 'p')) {
+            char *p = strrchr(device_path, 'p');
+            if (p) {
+                disk_path = g_strndup(device_path, p - device_path);
+            }
+        } else {
+            char *p = device_path + strlen(device_path) - 1;
+            while (p > device_path && g_ascii_isdigit(*p)) p--;
+            p++;
+            disk_path = g_strndup(device_path, p - device_path);
+        }
 
-static void on_resize_dialog_response(GtkDialog *dialog, gint response_id, gpointer user_data);
-static void on_resize_dialog_destroy(GtkWidget *dialog, gpointer user_data);
-static void on_entry_bytes_changed(GtkEditable *editable, gpointer user_data);
-static void on_entry_mib_changed(GtkEditable *editable, gpointer user_data);
-static void on_entry_gib_changed(GtkEditable *editable, gpointer user_data);
-static void on_entry_sectors_changed(GtkEditable *editable, gpointer user_data);
+        gchar *mount_dir = g_strdup("/mnt/driveassistify_grub");
+        gchar *quoted_mount_dir = g_shell_quote(mount_dir);
+        gchar *quoted_device_path = g_shell_quote(device_path);
+        gchar *quoted_disk_path = g_shell_quote(disk_path);
+        gchar *quoted_mountpoint = mountpoint ? g_shell_quote(mountpoint) : g_strdup("''");
 
-static void on_entry_start_changed(GtkEditable *editable, gpointer user_data) {
-    if (is_updating) return;
-    is_updating = TRUE;
+        GtkWidget *warn = gtk_message_dialog_new(
+            NULL,
+            GTK_DIALOG_MODAL,
+            GTK_MESSAGE_WARNING,
+            GTK_BUTTONS_OK_CANCEL,
+            "WARNING: This is a potentially destructive operation!\n\n"
+            "Installing GRUB2 to the MBR rewrites boot code on the disk.\n"
+            "If you select the wrong partition or disk, the system may become unbootable.\n\n"
+            "Target partition: %s\n\n"
+            "Are you sure you want to continue?",
+            device_path
+        );
+        gint response = gtk_dialog_run(GTK_DIALOG(warn));
+        gtk_widget_destroy(warn);
+
+        if (response == GTK_RESPONSE_OK) {
 
-    ResizeWidgets *widgets = (ResizeWidgets*)user_data;
-    const gchar *start_text = gtk_entry_get_text(GTK_ENTRY(widgets->entry_start));
-    const gchar *mib_text = gtk_entry_get_text(GTK_ENTRY(widgets->entry_mib));
-    int start = atoi(start_text);
-    int input = atoi(mib_text);
+            gchar *command = g_strdup_printf(
+                "echo '========================================='; "
+                "echo 'Starting GRUB2 MBR installation'; "
+                "echo 'Target partition: %s'; "
+                "echo 'Target disk: %s'; "
+                "echo 'Mount directory: %s'; "
+                "echo '-----------------------------------------'; "
 
-    if (input > 0 && widgets->sector_size > 0) {
-        int sectors = (input * 1024 * 1024) / widgets->sector_size;
-        int end = start + sectors - 1;
-        if (start >= 0 && sectors > 0 && end >= start) {
-            gchar end_str[32];
-            g_snprintf(end_str, sizeof(end_str), "%d", end);
-            gtk_entry_set_text(GTK_ENTRY(widgets->entry_end), end_str);
-        } else {
-            gtk_entry_set_text(GTK_ENTRY(widgets->entry_end), "");
-        }
-    } else {
-        gtk_entry_set_text(GTK_ENTRY(widgets->entry_end), "");
-    }
+                "echo 'Unmounting previous mount (if any)...'; "
 
-    is_updating = FALSE;
-}
+                "if mount | grep -q '%s '; then "
+                "  echo 'Trying normal umount with timeout...'; "
+                "  for i in 1 2; do "
+                "    timeout 15 umount %s && break || { "
+                "      echo 'Attempt $i failed, retrying in 2s...'; "
+                "      sleep 2; "
+                "    }; "
+                "  done; "
+                "  if mount | grep -q '%s '; then "
+                "    echo 'ERROR: Could not unmount the device.'; "
+                "    echo 'You may need to unmount manually using:'; "
+                "    echo '   umount %s'; "
+                "    echo '   umount -l %s   (lazy)'; "
+                "    echo '   umount -f %s   (force)'; "
+                "    echo 'Aborting.'; "
+                "    echo; "
+                "    echo 'This window can now be closed.'; "
+                "    read -p 'Press Enter to close...'; "
+                "    exit 1; "
+                "  fi; "
+                "else "
+                "  echo 'Device not mounted — OK'; "
+                "fi; "
 
-static void on_entry_end_changed(GtkEditable *editable, gpointer user_data) {
-    if (is_updating) return;
-    is_updating = TRUE;
+                "echo 'Creating temporary mount directory...'; "
+                "mkdir -p %s; "
 
-    ResizeWidgets *widgets = (ResizeWidgets*)user_data;
-    const gchar *start_text = gtk_entry_get_text(GTK_ENTRY(widgets->entry_start));
-    const gchar *end_text = gtk_entry_get_text(GTK_ENTRY(widgets->entry_end));
-    int start = atoi(start_text);
-    int end = atoi(end_text);
-    if (end > start && widgets->sector_size > 0) {
-        int sectors = end - start + 1;
-        int mib = (sectors * widgets->sector_size) / (1024 * 1024);
-        gchar mib_str[32];
-        g_snprintf(mib_str, sizeof(mib_str), "%d", mib);
-        gtk_entry_set_text(GTK_ENTRY(widgets->entry_mib), mib_str);
-    }
+                "echo 'Mounting target partition...'; "
+                "mount %s %s || { "
+                "  echo 'ERROR: Failed to mount partition! Aborting.'; "
+                "  echo; "
+                "  echo 'This window can now be closed.'; "
+                "  read -p 'Press Enter to close...'; "
+                "  exit 1; "
+                "}; "
 
-    is_updating = FALSE;
-}
+                "echo 'Running grub-install (i386-pc)...'; "
+                "grub-install --target=i386-pc --boot-directory=%s/boot %s || { "
+                "    echo 'ERROR: grub-install failed! Unmounting...'; "
+                "    timeout 15 umount %s; "
+                "    echo; "
+                "    echo 'This window can now be closed.'; "
+                "    read -p 'Press Enter to close...'; "
+                "    exit 1; "
+                "}; "
 
-static void on_entry_bytes_changed(GtkEditable *editable, gpointer user_data) {
-    ResizeWidgets *w = (ResizeWidgets*)user_data;
-    const char *text = gtk_entry_get_text(GTK_ENTRY(editable));
-    if (!text || strlen(text) == 0) return;
+                "echo 'Unmounting...'; "
+                "timeout 15 umount %s; "
 
-    long long bytes = atoll(text);
-    long long mib = bytes / (1024*1024);
-    long long gib = bytes / (1024*1024*1024);
-    long long sectors = (bytes + w->sector_size - 1) / w->sector_size;
+                "echo 'Removing temporary directory...'; "
+                "rmdir %s; "
 
-    g_signal_handlers_block_by_func(w->entry_mib,   G_CALLBACK(on_entry_mib_changed), w);
-    g_signal_handlers_block_by_func(w->entry_gib,   G_CALLBACK(on_entry_gib_changed), w);
-    g_signal_handlers_block_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
+                "echo '-----------------------------------------'; "
+                "echo 'GRUB2 MBR installation finished successfully.'; "
+                "echo '========================================='; "
+                "echo; "
+                "read -p 'Press Enter to close...';",
+                
+                device_path,
+                disk_path,
+                mount_dir,
 
-    char tmp[64];
-    g_snprintf(tmp, sizeof(tmp), "%lld", mib);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_mib), tmp);
-    g_snprintf(tmp, sizeof(tmp), "%lld", gib);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_gib), tmp);
-    g_snprintf(tmp, sizeof(tmp), "%lld", sectors);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_sectors), tmp);
+                device_path,
+                device_path,
+                device_path,
+                device_path,
+                device_path,
+                device_path,
 
-    g_signal_handlers_unblock_by_func(w->entry_mib,   G_CALLBACK(on_entry_mib_changed), w);
-    g_signal_handlers_unblock_by_func(w->entry_gib,   G_CALLBACK(on_entry_gib_changed), w);
-    g_signal_handlers_unblock_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
-}
+                quoted_mount_dir,
+                quoted_device_path,
+                quoted_mount_dir,
+                mount_dir,
+                quoted_disk_path,
+                quoted_mount_dir,
+                quoted_mount_dir,
+                quoted_mount_dir
+            );
 
-static void on_entry_mib_changed(GtkEditable *editable, gpointer user_data) {
-    if (is_updating) return;
-    is_updating = 1;
+            pid_t pid = fork();
+            
+            if (pid == 0) {
+                const gchar *terminals[] = {"gnome-terminal", "konsole", "xfce4-terminal", 
+                                           "mate-terminal", "lxterminal", "xterm", NULL};
+                
+                for (int i = 0; terminals[i]; i++) {
+                    gchar *term_bin = g_find_program_in_path(terminals[i]);
+                    if (term_bin) {
+                        if (g_strcmp0(terminals[i], "gnome-terminal") == 0) {
+                            execlp(term_bin, term_bin, "--", "bash", "-c", command, NULL);
+                        } else {
+                            execlp(term_bin, term_bin, "-e", "bash", "-c", command, NULL);
+                        }
+                        g_free(term_bin);
+                    }
+                }
+                
+                exit(1);
+            } else if (pid > 0) {
+                g_free(command);
+            } else {
+                g_warning("Failed to fork process");
+                GtkWidget *err = gtk_message_dialog_new(
+                    GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(tree_view))),
+                    GTK_DIALOG_MODAL,
+                    GTK_MESSAGE_ERROR,
+                    GTK_BUTTONS_OK,
+                    "Failed to create new process."
+                );
+                gtk_dialog_run(GTK_DIALOG(err));
+                gtk_widget_destroy(err);
+                g_free(command);
+            }
+        }
 
-    ResizeWidgets *w = (ResizeWidgets*)user_data;
-    const char *text = gtk_entry_get_text(GTK_ENTRY(editable));
-    if (!text || strlen(text) == 0) { is_updating = 0; return; }
+        g_free(quoted_device_path);
+        g_free(quoted_disk_path);
+        g_free(quoted_mountpoint);
+        g_free(mount_dir);
+        g_free(quoted_mount_dir);
+        g_free(device_path);
+        g_free(disk_path);
+        g_free(partition_name);
+        g_free(mountpoint);
+    }
+}
 
-    long long input_mib = atoll(text);
-    if (input_mib < 0) input_mib = 0;
+void on_toggle_boot_flag_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL;
 
-    long long bytes = input_mib * 1024LL * 1024LL;
-    double gib = (double)input_mib / 1024.0;
-    long long sectors = (bytes + w->sector_size - 1) / w->sector_size;
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
 
-    g_signal_handlers_block_by_func(w->entry_bytes,   G_CALLBACK(on_entry_bytes_changed), w);
-    g_signal_handlers_block_by_func(w->entry_gib,     G_CALLBACK(on_entry_gib_changed), w);
-    g_signal_handlers_block_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
+        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
 
-    char tmp[64];
-    g_snprintf(tmp, sizeof(tmp), "%lld", bytes);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_bytes), tmp);
+        gchar *disk_path = NULL;
+        gchar *part_num = NULL;
+        if (g_str_has_prefix(partition_name, "nvme") && strchr(partition_name, 'p')) {
+            char *p = strrchr(device_path, 'p');
+            if (p) {
+                disk_path = g_strndup(device_path, p - device_path);
+                part_num = g_strdup(p + 1);
+            }
+        } else {
+            char *p = device_path + strlen(device_path) - 1;
+            while (p > device_path && g_ascii_isdigit(*p)) p--;
+            p++;
+            disk_path = g_strndup(device_path, p - device_path);
+            part_num = g_strdup(p);
+        }
 
-    g_snprintf(tmp, sizeof(tmp), "%lld", input_mib);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_mib), tmp);
+        if (g_find_program_in_path("parted")) {
+            gchar *check_cmd = g_strdup_printf(
+                "parted -s %s print | grep -E '^ %s ' | grep boot",
+                disk_path, part_num
+            );
+            int has_boot = (system(check_cmd) == 0);
+            g_free(check_cmd);
 
-    g_snprintf(tmp, sizeof(tmp), "%.2f", gib);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_gib), tmp);
+            gchar *parted_cmd = NULL;
+            if (has_boot) {
+                parted_cmd = g_strdup_printf(
+                    "parted -s %s set %s boot off && echo 'Boot flag removed.' || echo 'Failed to remove boot flag.'",
+                    disk_path, part_num
+                );
+            } else {
+                parted_cmd = g_strdup_printf(
+                    "parted -s %s set %s boot on && echo 'Boot flag set.' || echo 'Failed to set boot flag.'",
+                    disk_path, part_num
+                );
+            }
 
-    g_snprintf(tmp, sizeof(tmp), "%lld", sectors);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_sectors), tmp);
+            run_command_in_terminal(tree_view, parted_cmd);
+            g_free(parted_cmd);
+        } else {
+            gchar *boot_flag_hint = g_strdup_printf(
+                "To manually set the boot flag for a partition using fdisk:\n\n"
+                "1. Open a terminal and run:\n"
+                "   sudo fdisk %s\n\n"
+                "2. In fdisk, enter the following commands in order:\n"
+                "   a    (press 'a' and Enter)\n"
+                "   %s  (enter the partition number and press Enter)\n"
+                "   w    (press 'w' and Enter)\n\n"
+                "After this, the boot flag will be set. Check the result with:\n"
+                "   sudo fdisk -l %s\n",
+                disk_path, part_num, disk_path
+            );
 
-    const char *start_text = gtk_entry_get_text(GTK_ENTRY(w->entry_start));
-    if (start_text && strlen(start_text) > 0) {
-        long long start = atoll(start_text);
-        if (start >= 0 && sectors > 0) {
-            long long end = start + sectors - 1;
-            g_snprintf(tmp, sizeof(tmp), "%lld", end);
-            g_signal_handlers_block_by_func(w->entry_end, G_CALLBACK(on_entry_end_changed), w);
-            gtk_entry_set_text(GTK_ENTRY(w->entry_end), tmp);
-            g_signal_handlers_unblock_by_func(w->entry_end, G_CALLBACK(on_entry_end_changed), w);
+            show_large_text_dialog(
+                GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(tree_view))),
+                "Manual Boot Flag Setup",
+                boot_flag_hint
+            );
+            g_free(boot_flag_hint);
         }
-    }
 
-    if (w->label_free) {
-        long long left = (w->orig_size + w->orig_free) - input_mib;
-        if (left < 0) left = 0;
-        char lbl[128];
-        g_snprintf(lbl, sizeof(lbl), "Free space after resize: %lld MiB", left);
-        gtk_label_set_text(GTK_LABEL(w->label_free), lbl);
+        g_free(device_path);
+        g_free(disk_path);
+        g_free(part_num);
+        g_free(partition_name);
     }
-
-    g_signal_handlers_unblock_by_func(w->entry_bytes,   G_CALLBACK(on_entry_bytes_changed), w);
-    g_signal_handlers_unblock_by_func(w->entry_gib,     G_CALLBACK(on_entry_gib_changed), w);
-    g_signal_handlers_unblock_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
-
-    is_updating = 0;
 }
 
-static void on_entry_gib_changed(GtkEditable *editable, gpointer user_data) {
-    CreateFSWidgets *w = (CreateFSWidgets*)user_data;
-    if (w->updating) return;
-    w->updating = TRUE;
-
-    const char *text = gtk_entry_get_text(GTK_ENTRY(editable));
-    if (!text || strlen(text) == 0) { w->updating = FALSE; return; }
-
-    double gib = atof(text);
-    long long bytes = (long long)(gib * 1024.0 * 1024.0 * 1024.0);
-    long long mib = bytes / (1024 * 1024);
-    long long sectors = (bytes + w->sector_size - 1) / w->sector_size;
+typedef struct {
+    int mbps;
+    int iops;
+    int io_class;
+    int io_level;
+} IoBudget;
+
+static gchar *get_io_budget_dir(void) {
+    gchar *dir = g_build_filename(g_get_user_data_dir(), "DriveAssistify", "jobs", NULL);
+    g_mkdir_with_parents(dir, 0700);
+    return dir;
+}
 
-    g_signal_handlers_block_by_func(w->entry_bytes, G_CALLBACK(on_create_entry_bytes_changed), w);
-    g_signal_handlers_block_by_func(w->entry_mib, G_CALLBACK(on_create_entry_mib_changed), w);
-    g_signal_handlers_block_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
+static gchar *get_io_budget_defaults_path(void) {
+    return g_build_filename(g_get_user_data_dir(), "DriveAssistify", "io-limits.txt", NULL);
+}
 
-    char tmp[64];
-    g_snprintf(tmp, sizeof(tmp), "%lld", bytes);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_bytes), tmp);
-    g_snprintf(tmp, sizeof(tmp), "%lld", mib);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_mib), tmp);
-    g_snprintf(tmp, sizeof(tmp), "%lld", sectors);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_sectors), tmp);
+/* Budget files are plain key=value lines so the running job can re-read them with awk; 0 means unlimited or unchanged. */
+static gboolean load_io_budget(const gchar *path, IoBudget *budget, gchar **label, int *pid) {
+    gchar *contents = NULL;
+    memset(budget, 0, sizeof(*budget));
+    if (label) *label = NULL;
+    if (pid) *pid = 0;
+    if (!g_file_get_contents(path, &contents, NULL, NULL)) return FALSE;
+
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (int i = 0; lines[i]; i++) {
+        gchar *eq = strchr(lines[i], '=');
+        if (!eq) continue;
+        *eq = '\0';
+        const gchar *value = eq + 1;
+        if (strcmp(lines[i], "mbps") == 0) budget->mbps = MAX(0, atoi(value));
+        else if (strcmp(lines[i], "iops") == 0) budget->iops = MAX(0, atoi(value));
+        else if (strcmp(lines[i], "class") == 0) budget->io_class = CLAMP(atoi(value), 0, 3);
+        else if (strcmp(lines[i], "level") == 0) budget->io_level = CLAMP(atoi(value), 0, 7);
+        else if (strcmp(lines[i], "label") == 0 && label) { g_free(*label); *label = g_strdup(value); }
+        else if (strcmp(lines[i], "pid") == 0 && pid) *pid = atoi(value);
+    }
+    g_strfreev(lines);
+    g_free(contents);
+    return TRUE;
+}
 
-    g_signal_handlers_unblock_by_func(w->entry_bytes, G_CALLBACK(on_create_entry_bytes_changed), w);
-    g_signal_handlers_unblock_by_func(w->entry_mib, G_CALLBACK(on_create_entry_mib_changed), w);
-    g_signal_handlers_unblock_by_func(w->entry_sectors, G_CALLBACK(on_entry_sectors_changed), w);
+static gboolean save_io_budget(const gchar *path, const IoBudget *budget, const gchar *label, int pid) {
+    GString *text = g_string_new(NULL);
+    g_string_append_printf(text, "mbps=%d\niops=%d\nclass=%d\nlevel=%d\n",
+                           budget->mbps, budget->iops, budget->io_class, budget->io_level);
+    if (label) g_string_append_printf(text, "label=%s\n", label);
+    if (pid > 0) g_string_append_printf(text, "pid=%d\n", pid);
+    gboolean ok = g_file_set_contents(path, text->str, -1, NULL);
+    g_string_free(text, TRUE);
+    return ok;
+}
 
-    if (w->label_free) {
-        long long mib = (long long)(gib * 1024.0);
-        long long left = w->orig_free - mib;
-        if (left < 0) left = 0;
-        char lbl[128];
-        g_snprintf(lbl, sizeof(lbl), "Free space after creation: %lld MiB (%.2f GiB)", 
-                   left, (double)left / 1024.0);
-        gtk_label_set_text(GTK_LABEL(w->label_free), lbl);
+static gchar *describe_io_budget(const IoBudget *budget) {
+    const char *classes[] = {"unchanged", "realtime", "best-effort", "idle"};
+    gchar *mbps = budget->mbps > 0 ? g_strdup_printf("%d MiB/s", budget->mbps) : g_strdup("unlimited");
+    gchar *iops = budget->iops > 0 ? g_strdup_printf("%d IOPS", budget->iops) : g_strdup("unlimited IOPS");
+    gchar *text = g_strdup_printf("%s, %s, I/O priority %s%s", mbps, iops, classes[budget->io_class],
+                                  budget->io_class == 1 || budget->io_class == 2 ? (budget->io_level < 4 ? " (high)" : " (low)") : "");
+    g_free(iops);
+    g_free(mbps);
+    return text;
 }
 
-    w->updating = FALSE;
+static gboolean io_budget_is_limited(void) {
+    gchar *path = get_io_budget_defaults_path();
+    IoBudget budget;
+    load_io_budget(path, &budget, NULL, NULL);
+    g_free(path);
+    return budget.mbps > 0 || budget.iops > 0;
 }
 
-static void on_entry_sectors_changed(GtkEditable *editable, gpointer user_data) {
-    CreateFSWidgets *w = (CreateFSWidgets*)user_data;
-    if (w->updating) return;
-    w->updating = TRUE;
+/* Starts a helper mode as root; IO_PACE_FILE is passed through env because sudo drops the environment. */
+#define IO_HELPER_SUDO "sudo env IO_PACE_FILE=\"$IO_PACE_FILE\""
 
-    const char *text = gtk_entry_get_text(GTK_ENTRY(editable));
-    if (!text || strlen(text) == 0) { w->updating = FALSE; return; }
+/*
+ * Runs inner_cmd under a per-job I/O budget that starts from the saved defaults and is re-read every second,
+ * so it can be changed while the job runs. device_paths lists the devices of the job, separated by spaces.
+ * With the cgroup v2 io controller the whole job is moved into its own cgroup and io.max limits the disk of
+ * each device; otherwise IO_PACE_FILE tells build_tuned_dd_command() and the helper modes (io_pace()) to pace
+ * themselves. Helper modes must be started with IO_HELPER_SUDO so the variable survives sudo.
+ */
+static gchar *build_io_budget_command(const gchar *label, const gchar *device_paths, const gchar *inner_cmd) {
+    gchar *defaults_path = get_io_budget_defaults_path();
+    IoBudget budget;
+    load_io_budget(defaults_path, &budget, NULL, NULL);
+    g_free(defaults_path);
+
+    gchar *dir = get_io_budget_dir();
+    gchar *job_id = g_strdup_printf("job-%lld", (long long)g_get_real_time());
+    gchar *job_name = g_strdup_printf("%s.limits", job_id);
+    gchar *job_path = g_build_filename(dir, job_name, NULL);
+    gchar *job_label = device_paths && *device_paths ? g_strdup_printf("%s (%s)", label, device_paths) : g_strdup(label);
+    g_strdelimit(job_label, "\n=", ' ');
+    save_io_budget(job_path, &budget, job_label, 0);
+
+    GString *quoted_disks = g_string_new(NULL);
+    gchar **devices = g_strsplit(device_paths ? device_paths : "", " ", -1);
+    for (int i = 0; devices[i]; i++) {
+        if (!devices[i][0]) continue;
+        gchar *dev_name = g_path_get_basename(devices[i]);
+        gchar *disk_name = get_base_device(dev_name);
+        gchar *disk_path = g_strdup_printf("/dev/%s", disk_name);
+        gchar *quoted_disk = g_shell_quote(disk_path);
+        g_string_append_printf(quoted_disks, " %s", quoted_disk);
+        g_free(quoted_disk);
+        g_free(disk_path);
+        g_free(disk_name);
+        g_free(dev_name);
+    }
+    g_strfreev(devices);
+    /* Without a device (for example when only an image file is read) io.max has nothing to limit. */
+    gchar *io_devs = quoted_disks->len > 0 ? g_strdup_printf("$(lsblk -ndo MAJ:MIN%s 2>/dev/null | tr -d ' ' | sort -u)", quoted_disks->str)
+                                           : g_strdup("''");
+    gchar *quoted_job = g_shell_quote(job_path);
+    gchar *description = describe_io_budget(&budget);
+
+    gchar *cmd = g_strdup_printf(
+        "{ io_job=%s; echo \"pid=$$\" >> \"$io_job\"; "
+        "io_get() { awk -F= -v k=\"$1\" '$1 == k { v = $2 } END { print v + 0 }' \"$io_job\"; }; "
+        "io_devs=%s; io_cg=''; io_last=''; IO_PACE_FILE=''; "
+        "if grep -qw io /sys/fs/cgroup/cgroup.controllers 2>/dev/null && [ -n \"$io_devs\" ]; then "
+        "io_orig=/sys/fs/cgroup$(awk -F: '$1 == \"0\" { print $3 }' /proc/$$/cgroup); io_cg=/sys/fs/cgroup/driveassistify-%s; "
+        "grep -qw io /sys/fs/cgroup/cgroup.subtree_control || echo +io | sudo tee /sys/fs/cgroup/cgroup.subtree_control > /dev/null; "
+        "if sudo mkdir -p \"$io_cg\" && echo $$ | sudo tee \"$io_cg/cgroup.procs\" > /dev/null; then "
+        "echo \"I/O budget is enforced with cgroup v2 io.max in $io_cg\"; else io_cg=''; fi; fi; "
+        "if [ -z \"$io_cg\" ]; then IO_PACE_FILE=$io_job; echo 'cgroup v2 io.max cannot be used for this job, it is paced in chunks instead.'; fi; "
+        "io_apply() { "
+        "io_m=$(io_get mbps); io_i=$(io_get iops); io_c=$(io_get class); io_n=$(io_get level); "
+        "[ \"$io_m $io_i $io_c $io_n\" = \"$io_last\" ] && return 0; io_last=\"$io_m $io_i $io_c $io_n\"; "
+        "echo \"I/O budget: ${io_m} MiB/s, ${io_i} IOPS, ionice class ${io_c} level ${io_n} (0 = unlimited/unchanged)\"; "
+        "[ -n \"$io_cg\" ] || return 0; "
+        "io_bps=max; [ \"$io_m\" -gt 0 ] && io_bps=$((io_m * 1048576)); io_ops=max; [ \"$io_i\" -gt 0 ] && io_ops=$io_i; "
+        "for io_dev in $io_devs; do echo \"$io_dev rbps=$io_bps wbps=$io_bps riops=$io_ops wiops=$io_ops\" | sudo tee \"$io_cg/io.max\" > /dev/null; done; "
+        "if [ \"$io_c\" -gt 0 ]; then for io_p in $(cat \"$io_cg/cgroup.procs\"); do sudo ionice -c \"$io_c\" -n \"$io_n\" -p \"$io_p\" 2>/dev/null; done; fi; }; "
+        "echo 'Starting I/O budget: %s. Change it live in File > Bulk Job I/O Limits.'; "
+        "io_apply; ( while kill -0 $$ 2>/dev/null; do sleep 1; io_apply; done ) & io_watch=$!; "
+        "{ %s; }; io_rc=$?; "
+        "kill $io_watch 2>/dev/null; "
+        "if [ -n \"$io_cg\" ]; then echo $$ | sudo tee \"$io_orig/cgroup.procs\" > /dev/null 2>&1 || echo $$ | sudo tee /sys/fs/cgroup/cgroup.procs > /dev/null; "
+        "sudo rmdir \"$io_cg\" 2>/dev/null; fi; "
+        "rm -f \"$io_job\"; [ $io_rc -eq 0 ]; }",
+        quoted_job, io_devs, job_id, description, inner_cmd);
+
+    g_free(io_devs);
+    g_free(description);
+    g_free(quoted_job);
+    g_string_free(quoted_disks, TRUE);
+    g_free(job_label);
+    g_free(job_path);
+    g_free(job_name);
+    g_free(job_id);
+    g_free(dir);
+    return cmd;
+}
 
-    long long sectors = atoll(text);
-    long long bytes = sectors * w->sector_size;
-    long long mib = bytes / (1024 * 1024);
-    double gib = (double)bytes / (1024.0 * 1024.0 * 1024.0);
+static void set_io_budget_controls(GtkWidget *grid, const IoBudget *budget) {
+    gchar class_id[8];
+    g_snprintf(class_id, sizeof(class_id), "%d", budget->io_class);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(grid), "mbps_spin")), budget->mbps);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(grid), "iops_spin")), budget->iops);
+    gtk_combo_box_set_active_id(GTK_COMBO_BOX(g_object_get_data(G_OBJECT(grid), "class_combo")), class_id);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(grid), "level_spin")), budget->io_level);
+}
 
-    g_signal_handlers_block_by_func(w->entry_bytes, G_CALLBACK(on_create_entry_bytes_changed), w);
-    g_signal_handlers_block_by_func(w->entry_mib, G_CALLBACK(on_create_entry_mib_changed), w);
-    g_signal_handlers_block_by_func(w->entry_gib, G_CALLBACK(on_entry_gib_changed), w);
+static void get_io_budget_controls(GtkWidget *grid, IoBudget *budget) {
+    const gchar *class_id = gtk_combo_box_get_active_id(GTK_COMBO_BOX(g_object_get_data(G_OBJECT(grid), "class_combo")));
+    budget->mbps = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(grid), "mbps_spin")));
+    budget->iops = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(grid), "iops_spin")));
+    budget->io_class = class_id ? atoi(class_id) : 0;
+    budget->io_level = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(grid), "level_spin")));
+}
 
-    char tmp[64];
-    g_snprintf(tmp, sizeof(tmp), "%lld", bytes);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_bytes), tmp);
-    g_snprintf(tmp, sizeof(tmp), "%lld", mib);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_mib), tmp);
-    g_snprintf(tmp, sizeof(tmp), "%.2f", gib);
-    gtk_entry_set_text(GTK_ENTRY(w->entry_gib), tmp);
+static GtkWidget *create_io_budget_controls(const IoBudget *budget) {
+    GtkWidget *grid = gtk_grid_new();
+    gtk_grid_set_row_spacing(GTK_GRID(grid), 6);
+    gtk_grid_set_column_spacing(GTK_GRID(grid), 8);
+
+    GtkWidget *mbps_spin = gtk_spin_button_new_with_range(0, 100000, 10);
+    GtkWidget *iops_spin = gtk_spin_button_new_with_range(0, 10000000, 100);
+    GtkWidget *class_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(class_combo), "0", "Unchanged");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(class_combo), "3", "Idle (only when the disk is otherwise unused)");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(class_combo), "2", "Best effort");
+    gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(class_combo), "1", "Realtime");
+    GtkWidget *level_spin = gtk_spin_button_new_with_range(0, 7, 1);
+
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Bandwidth cap (MiB/s, 0 = unlimited):"), 0, 0, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), mbps_spin, 1, 0, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("IOPS cap (0 = unlimited):"), 0, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), iops_spin, 1, 1, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("I/O priority class (ionice):"), 0, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), class_combo, 1, 2, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Priority level (0 = highest, 7 = lowest):"), 0, 3, 1, 1);
+    gtk_grid_attach(GTK_GRID(grid), level_spin, 1, 3, 1, 1);
+
+    g_object_set_data(G_OBJECT(grid), "mbps_spin", mbps_spin);
+    g_object_set_data(G_OBJECT(grid), "iops_spin", iops_spin);
+    g_object_set_data(G_OBJECT(grid), "class_combo", class_combo);
+    g_object_set_data(G_OBJECT(grid), "level_spin", level_spin);
+
+    IoBudget unlimited = {0, 0, 0, 4};
+    set_io_budget_controls(grid, budget ? budget : &unlimited);
+    return grid;
+}
 
-    g_signal_handlers_unblock_by_func(w->entry_bytes, G_CALLBACK(on_create_entry_bytes_changed), w);
-    g_signal_handlers_unblock_by_func(w->entry_mib, G_CALLBACK(on_create_entry_mib_changed), w);
-    g_signal_handlers_unblock_by_func(w->entry_gib, G_CALLBACK(on_entry_gib_changed), w);
+/* Lists job budget files whose shell is still alive; files of dead jobs, or of jobs that never started, are removed. */
+static void refresh_io_budget_jobs(GtkWidget *window) {
+    GtkWidget *jobs_combo = g_object_get_data(G_OBJECT(window), "jobs_combo");
+    gtk_combo_box_text_remove_all(GTK_COMBO_BOX_TEXT(jobs_combo));
+
+    gchar *dir_path = get_io_budget_dir();
+    GDir *dir = g_dir_open(dir_path, 0, NULL);
+    int count = 0;
+    if (dir) {
+        const gchar *name;
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            if (!g_str_has_suffix(name, ".limits")) continue;
+            gchar *path = g_build_filename(dir_path, name, NULL);
+            IoBudget budget;
+            gchar *label = NULL;
+            int pid = 0;
+            load_io_budget(path, &budget, &label, &pid);
+            gchar *proc_path = g_strdup_printf("/proc/%d", pid);
+            if (pid > 0 && g_file_test(proc_path, G_FILE_TEST_IS_DIR)) {
+                gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(jobs_combo), path, label ? label : name);
+                count++;
+            } else {
+                struct stat st;
+                if (pid > 0 || (stat(path, &st) == 0 && time(NULL) - st.st_mtime > 600)) unlink(path);
+            }
+            g_free(proc_path);
+            g_free(label);
+            g_free(path);
+        }
+        g_dir_close(dir);
+    }
+    g_free(dir_path);
 
-    if (w->label_free) {
-        long long mib = bytes / (1024 * 1024);
-        long long left = w->orig_free - mib;
-        if (left < 0) left = 0;
-        char lbl[128];
-        g_snprintf(lbl, sizeof(lbl), "Free space after creation: %lld MiB (%.2f GiB)", 
-                   left, (double)left / 1024.0);
-        gtk_label_set_text(GTK_LABEL(w->label_free), lbl);
+    if (count > 0) gtk_combo_box_set_active(GTK_COMBO_BOX(jobs_combo), 0);
+    gtk_widget_set_sensitive(g_object_get_data(G_OBJECT(window), "job_box"), count > 0);
 }
 
-    w->updating = FALSE;
+static void on_io_budget_job_changed(GtkComboBox *combo, gpointer user_data) {
+    const gchar *path = gtk_combo_box_get_active_id(combo);
+    if (!path) return;
+    IoBudget budget;
+    if (load_io_budget(path, &budget, NULL, NULL))
+        set_io_budget_controls(g_object_get_data(G_OBJECT(user_data), "job_controls"), &budget);
 }
 
-void on_resize_partition_activate(GtkWidget *menuitem, gpointer user_data) {
+static void on_io_budget_refresh_clicked(GtkWidget *button, gpointer user_data) {
+    refresh_io_budget_jobs(GTK_WIDGET(user_data));
+}
 
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-    GtkTreeModel *model;
-    GtkTreeIter iter;
-    gchar *partition_name = NULL, *fstype = NULL, *size = NULL;
+static void on_io_budget_save_defaults_clicked(GtkWidget *button, gpointer user_data) {
+    IoBudget budget;
+    get_io_budget_controls(g_object_get_data(G_OBJECT(user_data), "default_controls"), &budget);
+    gchar *path = get_io_budget_defaults_path();
+    gchar *dir = g_path_get_dirname(path);
+    g_mkdir_with_parents(dir, 0700);
+    if (!save_io_budget(path, &budget, NULL, 0)) {
+        GtkWidget *err = gtk_message_dialog_new(GTK_WINDOW(user_data), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                                                "Could not save %s", path);
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+    }
+    g_free(dir);
+    g_free(path);
+}
 
-    if (!gtk_tree_selection_get_selected(selection, &model, &iter))
+/* The job re-reads its file every second (every chunk when pacing), so rewriting it is all a live change needs. */
+static void on_io_budget_apply_job_clicked(GtkWidget *button, gpointer user_data) {
+    GtkWidget *jobs_combo = g_object_get_data(G_OBJECT(user_data), "jobs_combo");
+    const gchar *path = gtk_combo_box_get_active_id(GTK_COMBO_BOX(jobs_combo));
+    if (!path) return;
+
+    IoBudget old_budget, budget;
+    gchar *label = NULL;
+    int pid = 0;
+    if (!load_io_budget(path, &old_budget, &label, &pid) || pid <= 0) {
+        GtkWidget *err = gtk_message_dialog_new(GTK_WINDOW(user_data), GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                                                "The selected job has already finished.");
+        gtk_dialog_run(GTK_DIALOG(err));
+        gtk_widget_destroy(err);
+        g_free(label);
+        refresh_io_budget_jobs(GTK_WIDGET(user_data));
         return;
+    }
+    get_io_budget_controls(g_object_get_data(G_OBJECT(user_data), "job_controls"), &budget);
+    save_io_budget(path, &budget, label, pid);
+    g_free(label);
+}
 
-    gtk_tree_model_get(model, &iter,
-                       COL_NAME, &partition_name,
-                       COL_FSTYPE, &fstype,
-                       COL_SIZE, &size,
-                       -1);
-
-    gchar *disk_name = get_disk_from_partition(partition_name);
-    if (!disk_name) return;
+void on_io_budget_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(window), "Bulk Job I/O Limits");
+    gtk_window_set_position(GTK_WINDOW(window), GTK_WIN_POS_CENTER);
+    gtk_container_set_border_width(GTK_CONTAINER(window), 10);
 
-    gchar *device_disk = g_strdup_printf("/dev/%s", disk_name);
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
+    gtk_container_add(GTK_CONTAINER(window), box);
+    gtk_box_pack_start(GTK_BOX(box), gtk_label_new(
+        "Partition copy, partition restore and disk erase run under an I/O budget so that other\n"
+        "volumes on the same controller keep responding. The budget is enforced with cgroup v2 io.max\n"
+        "when available, otherwise dd and the image helpers are paced in chunks. ionice only has an effect with the BFQ scheduler."), FALSE, FALSE, 0);
+
+    gchar *defaults_path = get_io_budget_defaults_path();
+    IoBudget defaults;
+    load_io_budget(defaults_path, &defaults, NULL, NULL);
+    g_free(defaults_path);
+
+    GtkWidget *defaults_frame = gtk_frame_new("Budget for new jobs");
+    GtkWidget *defaults_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_container_set_border_width(GTK_CONTAINER(defaults_box), 8);
+    gtk_container_add(GTK_CONTAINER(defaults_frame), defaults_box);
+    GtkWidget *default_controls = create_io_budget_controls(&defaults);
+    gtk_box_pack_start(GTK_BOX(defaults_box), default_controls, FALSE, FALSE, 0);
+    GtkWidget *save_btn = gtk_button_new_with_label("Save");
+    gtk_box_pack_start(GTK_BOX(defaults_box), save_btn, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), defaults_frame, FALSE, FALSE, 0);
+
+    GtkWidget *job_frame = gtk_frame_new("Running jobs");
+    GtkWidget *job_outer = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    gtk_container_set_border_width(GTK_CONTAINER(job_outer), 8);
+    gtk_container_add(GTK_CONTAINER(job_frame), job_outer);
+    GtkWidget *jobs_row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+    GtkWidget *jobs_combo = gtk_combo_box_text_new();
+    GtkWidget *refresh_btn = gtk_button_new_with_label("Refresh");
+    gtk_box_pack_start(GTK_BOX(jobs_row), jobs_combo, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(jobs_row), refresh_btn, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(job_outer), jobs_row, FALSE, FALSE, 0);
+    GtkWidget *job_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+    GtkWidget *job_controls = create_io_budget_controls(NULL);
+    GtkWidget *apply_btn = gtk_button_new_with_label("Apply to Running Job");
+    gtk_box_pack_start(GTK_BOX(job_box), job_controls, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(job_box), apply_btn, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(job_outer), job_box, FALSE, FALSE, 0);
+    gtk_box_pack_start(GTK_BOX(box), job_frame, FALSE, FALSE, 0);
+
+    g_object_set_data(G_OBJECT(window), "default_controls", default_controls);
+    g_object_set_data(G_OBJECT(window), "job_controls", job_controls);
+    g_object_set_data(G_OBJECT(window), "jobs_combo", jobs_combo);
+    g_object_set_data(G_OBJECT(window), "job_box", job_box);
+
+    g_signal_connect(jobs_combo, "changed", G_CALLBACK(on_io_budget_job_changed), window);
+    g_signal_connect(refresh_btn, "clicked", G_CALLBACK(on_io_budget_refresh_clicked), window);
+    g_signal_connect(save_btn, "clicked", G_CALLBACK(on_io_budget_save_defaults_clicked), window);
+    g_signal_connect(apply_btn, "clicked", G_CALLBACK(on_io_budget_apply_job_clicked), window);
+
+    refresh_io_budget_jobs(window);
+    gtk_widget_show_all(window);
+}
 
-    gchar *part_num = NULL;
+static gchar *get_transfer_tuning_path(void) {
+    gchar *dir = g_build_filename(g_get_user_data_dir(), "DriveAssistify", NULL);
+    g_mkdir_with_parents(dir, 0700);
+    gchar *path = g_build_filename(dir, "transfer-tuning.txt", NULL);
+    g_free(dir);
+    return path;
+}
 
-    if (g_str_has_prefix(partition_name, "nvme") ||
-        g_str_has_prefix(partition_name, "mmcblk"))
-    {
-        gchar *p = g_strrstr(partition_name, "p");
-        if (p && isdigit(*(p+1)))
-            part_num = g_strdup(p + 1);
-    }
-    else {
-        const gchar *p = partition_name;
-        while (*p && !isdigit(*p)) p++;
-        if (*p) part_num = g_strdup(p);
+/* "<operation>:<model>" with the model reduced to characters that are safe in the cache file and in shell quotes. */
+static gchar *get_transfer_tuning_key(const gchar *operation, const gchar *device_path) {
+    gchar *dev_name = g_path_get_basename(device_path);
+    gchar *disk_name = get_base_device(dev_name);
+    gchar *model = read_sysfs_block_attr(disk_name, "device/model");
+    gchar *key = NULL;
+    if (model && strlen(model) > 0) {
+        g_strcanon(model, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789._-", '_');
+        key = g_strdup_printf("%s:%s", operation, model);
     }
+    g_free(model);
+    g_free(disk_name);
+    g_free(dev_name);
+    return key;
+}
 
-    int sector_size = 512;
-    {
-        gchar *ss_cmd = g_strdup_printf("blockdev --getss %s", device_disk);
-        FILE *ss_fp = popen(ss_cmd, "r");
-        if (ss_fp) {
-            if (fscanf(ss_fp, "%d", &sector_size) != 1)
-                sector_size = 512;
-            pclose(ss_fp);
+static gboolean lookup_transfer_tuning(const gchar *key, gchar **bs, int *streams) {
+    gchar *path = get_transfer_tuning_path();
+    gchar *contents = NULL;
+    gboolean found = FALSE;
+    if (key && g_file_get_contents(path, &contents, NULL, NULL)) {
+        gchar **lines = g_strsplit(contents, "\n", -1);
+        for (int i = 0; lines[i]; i++) {
+            gchar **fields = g_strsplit(lines[i], "\t", -1);
+            if (g_strv_length(fields) >= 3 && g_strcmp0(fields[0], key) == 0 &&
+                g_regex_match_simple("^[0-9]+[KM]$", fields[1], 0, 0) && atoi(fields[2]) > 0) {
+                g_free(*bs);
+                *bs = g_strdup(fields[1]);
+                *streams = atoi(fields[2]);
+                found = TRUE;
+            }
+            g_strfreev(fields);
         }
-        g_free(ss_cmd);
+        g_strfreev(lines);
     }
+    g_free(contents);
+    g_free(path);
+    return found;
+}
 
-    long long start_mib = 0, end_mib = 0, orig_size_mib = 0;
-    long long start_sector = 0, end_sector = 0;
+/* dd flags shared by the probe and the bulk transfer; stream sources (/dev/urandom, /dev/zero) are never skipped into. */
+static gchar *build_tuned_dd_args(gboolean src_stream, gboolean src_direct, gboolean dst_seek, gboolean dst_direct, gboolean bulk) {
+    GString *args = g_string_new("iflag=");
+    g_string_append(args, src_stream ? "fullblock" : "skip_bytes");
+    if (src_direct) g_string_append(args, ",direct");
+    if (bulk) g_string_append(args, ",count_bytes");
+    if (dst_seek || dst_direct) {
+        g_string_append(args, " oflag=");
+        g_string_append(args, dst_seek ? "seek_bytes" : "");
+        if (dst_direct) g_string_append(args, dst_seek ? ",direct" : "direct");
+    }
+    if (dst_seek && bulk) g_string_append(args, " conv=notrunc");
+    if (!src_stream) g_string_append(args, " skip=$tune_off");
+    if (dst_seek) g_string_append(args, " seek=$tune_off");
+    return g_string_free(args, FALSE);
+}
 
-    if (part_num) {
+/* Sets TUNE_BS and TUNE_STREAMS: from the per-model cache if present, otherwise by timing each block size and stream count for 2 s. */
+static gchar *build_transfer_tuning_command(const gchar *key, const gchar *probe_src, const gchar *probe_dst,
+                                            gboolean src_stream, gboolean src_direct, gboolean dst_seek, gboolean dst_direct) {
+    gchar *cached_bs = NULL;
+    int cached_streams = 0;
+    if (lookup_transfer_tuning(key, &cached_bs, &cached_streams)) {
         gchar *cmd = g_strdup_printf(
-            "LC_ALL=C parted -m %s unit MiB print "
-            "| awk -F: -v N=\"%s\" '$1==N {gsub(/MiB$/, \"\", $2); "
-            "gsub(/MiB$/, \"\", $3); print $2 \" \" $3}'",
-            device_disk, part_num);
-
-        FILE *fp = popen(cmd, "r");
-        if (fp) {
-            char buf[256] = {0};
-            if (fgets(buf, sizeof(buf), fp)) {
-                char *tok = strtok(buf, " \t\n");
-                if (tok) start_mib = atoll(tok);
-
-                tok = strtok(NULL, " \t\n");
-                if (tok) end_mib = atoll(tok);
-
-                start_sector = (start_mib * 1024LL * 1024LL) / sector_size;
-                end_sector   = (end_mib   * 1024LL * 1024LL) / sector_size;
-
-                orig_size_mib = end_mib - start_mib;
-            }
-            pclose(fp);
-        }
-        g_free(cmd);
+            "TUNE_BS=%s; TUNE_STREAMS=%d; "
+            "echo 'Using cached transfer parameters for %s: bs=%s, %d parallel stream(s)'",
+            cached_bs, cached_streams, key, cached_bs, cached_streams);
+        g_free(cached_bs);
+        return cmd;
     }
+    /* A probe under a bandwidth cap would only measure the cap, and running it unthrottled would defeat the cap. */
+    if (io_budget_is_limited())
+        return g_strdup("TUNE_BS=4M; TUNE_STREAMS=1; "
+                        "echo 'An I/O budget is set, so the transfer probe is skipped: bs=4M, 1 stream'");
+
+    gchar *quoted_src = g_shell_quote(probe_src);
+    gchar *quoted_dst = g_shell_quote(probe_dst);
+    gchar *dd_args = build_tuned_dd_args(src_stream, src_direct, dst_seek, dst_direct, FALSE);
+    gchar *tuning_path = get_transfer_tuning_path();
+    gchar *quoted_tuning = g_shell_quote(tuning_path);
+    gchar *tuning_log = g_strdup_printf("%s.log", tuning_path);
+    gchar *quoted_log = g_shell_quote(tuning_log);
+    gchar *save_cmd = key
+        ? g_strdup_printf("echo \"%s\t$TUNE_BS\t$TUNE_STREAMS\" >> %s; ", key, quoted_tuning)
+        : g_strdup("");
+
+    gchar *cmd = g_strdup_printf(
+        "echo 'Probing block size and parallel streams (2 s per combination)...'; "
+        "tune_best=0; TUNE_BS=1M; TUNE_STREAMS=1; tune_dir=$(mktemp -d); "
+        "for tune_bs in 256K 1M 4M 16M; do for tune_st in 1 2 4; do "
+        "tune_i=0; while [ $tune_i -lt $tune_st ]; do tune_off=$((tune_i * 1073741824)); "
+        "LC_ALL=C sudo timeout -s INT 2 dd if=%s of=%s bs=$tune_bs %s 2> \"$tune_dir/probe.$tune_i\" & "
+        "tune_i=$((tune_i + 1)); done; wait; "
+        "tune_rate=$(cat \"$tune_dir\"/probe.* | awk '/ copied, / { t = 0; for (i = 1; i <= NF; i++) if ($i == \"s,\") t = $(i - 1); "
+        "if (t > 0) r += $1 / t } END { print int(r / 1048576) }'); rm -f \"$tune_dir\"/probe.*; "
+        "echo \"  bs=$tune_bs, $tune_st stream(s): $tune_rate MiB/s\"; "
+        "if [ \"$tune_rate\" -gt \"$tune_best\" ]; then tune_best=$tune_rate; TUNE_BS=$tune_bs; TUNE_STREAMS=$tune_st; fi; "
+        "done; done; rm -rf \"$tune_dir\"; "
+        "echo \"Chosen: bs=$TUNE_BS, $TUNE_STREAMS parallel stream(s), $tune_best MiB/s during the probe\"; "
+        "%s"
+        "echo \"$(date) %s bs=$TUNE_BS streams=$TUNE_STREAMS probe=${tune_best}MiB/s\" >> %s",
+        quoted_src, quoted_dst, dd_args,
+        save_cmd,
+        key ? key : probe_src, quoted_log);
+
+    g_free(save_cmd);
+    g_free(quoted_log);
+    g_free(tuning_log);
+    g_free(quoted_tuning);
+    g_free(tuning_path);
+    g_free(dd_args);
+    g_free(quoted_dst);
+    g_free(quoted_src);
+    return cmd;
+}
 
-    long long max_free = 0;
-    {
-        gchar *command = g_strdup_printf(
-            "LC_ALL=C parted -m %s unit MiB print free", device_disk);
-
-        FILE *fp = popen(command, "r");
-        if (fp) {
-            char line[512];
-            gboolean in_table = FALSE;
-            long long prev_end = 0;
-            gboolean found_partition = FALSE;
-
-            while (fgets(line, sizeof(line), fp)) {
-                if (strstr(line, "Number") && strstr(line, "File system")) {
-                    in_table = TRUE;
-                    continue;
-                }
-                if (!in_table) continue;
-
-                gchar *trim = g_strstrip(line);
-                if (!trim[0]) continue;
-
-                char num[32], st[64], en[64], size_s[64], type[64];
-                int p = sscanf(trim, "%31[^:]:%63[^:]:%63[^:]:%63[^:]:%63[^\n]",
-                               num, st, en, size_s, type);
+/*
+ * Copies size_expr bytes from src to dst as TUNE_STREAMS dd processes over disjoint ranges; fails if any stream fails.
+ * When IO_PACE_FILE is set by build_io_budget_command(), each stream copies 64 MiB chunks and sleeps between them
+ * to stay within its share of the current budget. With dst_sparse, zero blocks are skipped and left as holes in dst.
+ */
+static gchar *build_tuned_dd_command(const gchar *src, const gchar *dst, const gchar *size_expr,
+                                     gboolean src_stream, gboolean src_direct, gboolean dst_direct, gboolean dst_sparse) {
+    gchar *quoted_src = g_shell_quote(src);
+    gchar *quoted_dst = g_shell_quote(dst);
+    gchar *dd_args = build_tuned_dd_args(src_stream, src_direct, TRUE, dst_direct, TRUE);
+    if (dst_sparse) {
+        gchar *sparse_args = g_strdup_printf("%s conv=sparse", dd_args);
+        g_free(dd_args);
+        dd_args = sparse_args;
+    }
+    gchar *cmd = g_strdup_printf(
+        "{ tune_paced() { tp_start=$1; tp_end=$(($1 + $2)); tp_off=$1; "
+        "while [ $tp_off -lt $tp_end ]; do "
+        "tp_m=$(io_get mbps); tp_i=$(io_get iops); tp_c=$(io_get class); tp_n=$(io_get level); "
+        "tune_off=$tp_off; tune_len=$((tp_end - tp_off)); [ $tune_len -gt 67108864 ] && tune_len=67108864; "
+        "tp_nice=''; [ \"$tp_c\" -eq 3 ] && tp_nice='ionice -c 3'; [ \"$tp_c\" -eq 1 -o \"$tp_c\" -eq 2 ] && tp_nice=\"ionice -c $tp_c -n $tp_n\"; "
+        "tp_t0=$(cut -d' ' -f1 /proc/uptime); "
+        "sudo $tp_nice dd if=%s of=%s bs=$TUNE_BS %s count=$tune_len status=none || return 1; "
+        "tp_off=$((tp_off + tune_len)); "
+        "[ \"$3\" = progress ] && echo \"  stream 1: $(( (tp_off - tp_start) / 1048576 )) of $(( $2 / 1048576 )) MiB\"; "
+        "tp_wait=$(awk -v t0=$tp_t0 -v t1=$(cut -d' ' -f1 /proc/uptime) -v b=$tune_len -v m=$tp_m -v i=$tp_i -v bs=$TUNE_BS -v n=$TUNE_STREAMS "
+        "'BEGIN { s = bs + 0; if (bs ~ /K$/) s *= 1024; if (bs ~ /M$/) s *= 1048576; w = 0; "
+        "if (m > 0) w = b * n / (m * 1048576); if (i > 0 && b / s * n / i > w) w = b / s * n / i; "
+        "w -= t1 - t0; print (w > 0 ? int(w * 1000) / 1000 : 0) }'); "
+        "sleep $tp_wait; done; }; "
+        "tune_total=%s; tune_chunk=$(( (tune_total / TUNE_STREAMS + 1048575) / 1048576 * 1048576 )); "
+        "tune_pids=''; tune_fail=0; tune_i=0; "
+        "if [ $TUNE_STREAMS -gt 1 ]; then echo \"Progress is shown for stream 1 of $TUNE_STREAMS.\"; fi; "
+        "while [ $tune_i -lt $TUNE_STREAMS ]; do "
+        "tune_off=$((tune_i * tune_chunk)); tune_len=$((tune_total - tune_off)); "
+        "if [ $tune_len -gt $tune_chunk ]; then tune_len=$tune_chunk; fi; "
+        "if [ $tune_i -eq 0 ]; then tune_status=progress; else tune_status=none; fi; "
+        "if [ $tune_len -gt 0 ]; then "
+        "if [ -n \"$IO_PACE_FILE\" ]; then tune_paced $tune_off $tune_len $tune_status & "
+        "else sudo dd if=%s of=%s bs=$TUNE_BS %s count=$tune_len status=$tune_status & fi; tune_pids=\"$tune_pids $!\"; "
+        "fi; tune_i=$((tune_i + 1)); done; "
+        "for tune_pid in $tune_pids; do wait $tune_pid || tune_fail=1; done; "
+        "[ $tune_fail -eq 0 ]; }",
+        quoted_src, quoted_dst, dd_args, size_expr, quoted_src, quoted_dst, dd_args);
+
+    g_free(dd_args);
+    g_free(quoted_dst);
+    g_free(quoted_src);
+    return cmd;
+}
 
-                if (p >= 4) {
-                    long long block_start = atoll(st);
-                    long long block_end   = atoll(en);
-                    gchar *block_type = type;
+typedef struct {
+    guint64 offset;
+    guint64 length;
+} ImageExtent;
+
+static guint16 le16(const guchar *p) { return (guint16)(p[0] | (p[1] << 8)); }
+static guint32 le32(const guchar *p) { return (guint32)p[0] | ((guint32)p[1] << 8) | ((guint32)p[2] << 16) | ((guint32)p[3] << 24); }
+static guint64 le64(const guchar *p) { return (guint64)le32(p) | ((guint64)le32(p + 4) << 32); }
+
+static gboolean read_exact_at(int fd, void *buf, gsize len, guint64 offset) {
+    gsize done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (char *)buf + done, len - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return FALSE;
+        done += (gsize)n;
+    }
+    return TRUE;
+}
 
-                    if (found_partition && g_str_has_prefix(block_type, "Free Space")) {
-                        max_free = block_end - block_start;
-                        break;
-                    }
+static gboolean write_all(int fd, const void *buf, gsize len) {
+    gsize done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, (const char *)buf + done, len - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return FALSE;
+        done += (gsize)n;
+    }
+    return TRUE;
+}
 
-                    if (num && part_num && g_strcmp0(num, part_num) == 0) {
-                        found_partition = TRUE;
-                        prev_end = block_end;
-                    }
-                }
-            }
-            pclose(fp);
+/*
+ * I/O budget for the helper modes when build_io_budget_command() cannot use cgroup v2 io.max: IO_PACE_FILE then
+ * names the job's limits file, and every chunk read from or written to the device calls io_pace(), which sleeps
+ * long enough to keep the job within the MiB/s and IOPS limits. The file is re-read every second for live changes.
+ */
+static void io_pace(gsize bytes) {
+    static GMutex lock;
+    static IoBudget budget;
+    static gint64 started, checked;
+    static guint64 paced_bytes, paced_ops;
+    const gchar *path = g_getenv("IO_PACE_FILE");
+    if (!path || !*path) return;
+
+    g_mutex_lock(&lock);
+    gint64 now = g_get_monotonic_time();
+    if (now - checked >= G_USEC_PER_SEC) {
+        IoBudget current;
+        checked = now;
+        if (load_io_budget(path, &current, NULL, NULL) && (started == 0 || current.mbps != budget.mbps || current.iops != budget.iops)) {
+            budget = current;
+            started = now;
+            paced_bytes = paced_ops = 0;
         }
-        if (max_free < 0) max_free = 0;
-        g_free(command);
     }
+    paced_bytes += bytes;
+    paced_ops++;
+    gint64 due = now;
+    if (budget.mbps > 0) due = MAX(due, started + (gint64)(paced_bytes * G_USEC_PER_SEC / ((guint64)budget.mbps << 20)));
+    if (budget.iops > 0) due = MAX(due, started + (gint64)(paced_ops * G_USEC_PER_SEC / (guint64)budget.iops));
+    g_mutex_unlock(&lock);
+    if (due > now) g_usleep((gulong)(due - now));
+}
 
-    GtkWidget *main_window = GTK_WIDGET(
-        gtk_widget_get_toplevel(GTK_WIDGET(tree_view)));
+/* A block is zero when its first 16 bytes are zero and the block equals itself shifted by 16 bytes;
+ * memcmp() is vectorized in libc, so this runs at memory bandwidth. */
+static gboolean is_zero_block(const guchar *buf, gsize len) {
+    static const guchar zeros[16] = {0};
+    if (len <= 16) return memcmp(buf, zeros, len) == 0;
+    return memcmp(buf, zeros, 16) == 0 && memcmp(buf, buf + 16, len - 16) == 0;
+}
 
-    GtkWidget *dialog = gtk_dialog_new_with_buttons(
-        "Resize Partition",
-        GTK_IS_WINDOW(main_window) ? GTK_WINDOW(main_window) : NULL,
-        GTK_DIALOG_MODAL,
-        "_Cancel", GTK_RESPONSE_CANCEL,
-        "_Resize", GTK_RESPONSE_ACCEPT,
-        NULL);
+/* Restore target that turns zero blocks into BLKZEROOUT (block devices) or punched holes (files),
+ * or skips them entirely when the target is known to be zeroed. Adjacent zero ranges are merged. */
+typedef struct {
+    int fd;
+    gboolean is_block;
+    gboolean target_zeroed;
+    guint64 zero_start;
+    guint64 zero_length;
+    guint64 zeroed_bytes;
+} ZeroAwareTarget;
+
+static void zero_aware_target_init(ZeroAwareTarget *t, int fd, gboolean target_zeroed) {
+    struct stat st;
+    memset(t, 0, sizeof(*t));
+    t->fd = fd;
+    t->is_block = fstat(fd, &st) == 0 && S_ISBLK(st.st_mode);
+    t->target_zeroed = target_zeroed;
+}
 
-    gtk_window_set_default_size(GTK_WINDOW(dialog), 540, 420);
-    GtkWidget *area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+static gboolean flush_zero_range(ZeroAwareTarget *t) {
+    guint64 offset = t->zero_start, length = t->zero_length;
+    t->zero_length = 0;
+    if (length == 0 || t->target_zeroed) return TRUE;
+    if (t->is_block) {
+        guint64 range[2] = {offset, length};
+        if ((offset | length) % 512 == 0 && ioctl(t->fd, BLKZEROOUT, range) == 0) return TRUE;
+    } else if (fallocate(t->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)offset, (off_t)length) == 0) {
+        return TRUE;
+    }
+    /* No offload available: write the zeros. */
+    gsize piece = 1 << 20;
+    guchar *zeros = g_malloc0(piece);
+    gboolean ok = TRUE;
+    for (guint64 pos = 0; ok && pos < length; pos += piece) {
+        gsize n = (gsize)MIN((guint64)piece, length - pos);
+        ok = pwrite(t->fd, zeros, n, (off_t)(offset + pos)) == (ssize_t)n;
+    }
+    g_free(zeros);
+    return ok;
+}
 
-    GtkWidget *label1 = gtk_label_new(
-        "Resize Partition (Bytes / MiB / GiB / Sectors):");
+static gboolean zero_aware_zero(ZeroAwareTarget *t, guint64 offset, guint64 length) {
+    t->zeroed_bytes += length;
+    if (t->zero_length > 0 && t->zero_start + t->zero_length == offset) {
+        t->zero_length += length;
+        return TRUE;
+    }
+    gboolean ok = flush_zero_range(t);
+    t->zero_start = offset;
+    t->zero_length = length;
+    return ok;
+}
 
-    GtkWidget *entry_bytes   = gtk_entry_new();
-    GtkWidget *entry_mib     = gtk_entry_new();
-    GtkWidget *entry_gib     = gtk_entry_new();
-    GtkWidget *entry_sectors = gtk_entry_new();
+static gboolean zero_aware_write(ZeroAwareTarget *t, const guchar *buf, gsize length, guint64 offset) {
+    if (is_zero_block(buf, length)) return zero_aware_zero(t, offset, length);
+    return flush_zero_range(t) && pwrite(t->fd, buf, length, (off_t)offset) == (ssize_t)length;
+}
 
-    GtkWidget *label_free = gtk_label_new(NULL);
+static gboolean zero_aware_finish(ZeroAwareTarget *t) {
+    return flush_zero_range(t) && fsync(t->fd) == 0;
+}
 
-    GtkWidget *label2 = gtk_label_new("Or specify first and last sector:");
+static void add_used_extent(GArray *extents, guint64 offset, guint64 length) {
+    if (length == 0) return;
+    if (extents->len > 0) {
+        ImageExtent *last = &g_array_index(extents, ImageExtent, extents->len - 1);
+        if (last->offset + last->length == offset) {
+            last->length += length;
+            return;
+        }
+    }
+    ImageExtent extent = {offset, length};
+    g_array_append_val(extents, extent);
+}
 
-    GtkWidget *entry_start = gtk_entry_new();
-    GtkWidget *entry_end   = gtk_entry_new();
+/* Adds one extent per run of set bits; bit i stands for the unit at first_offset + i * unit_size. */
+static void add_bitmap_extents(GArray *extents, const guchar *bitmap, guint64 bits, guint64 first_offset, guint64 unit_size) {
+    guint64 i = 0;
+    while (i < bits) {
+        if ((i & 7) == 0 && i + 8 <= bits && bitmap[i >> 3] == 0) {
+            i += 8;
+            continue;
+        }
+        if (bitmap[i >> 3] & (1 << (i & 7))) {
+            guint64 start = i;
+            while (i < bits && (bitmap[i >> 3] & (1 << (i & 7)))) {
+                if ((i & 7) == 0 && i + 8 <= bits && bitmap[i >> 3] == 0xFF) i += 8;
+                else i++;
+            }
+            add_used_extent(extents, first_offset + start * unit_size, (i - start) * unit_size);
+        } else {
+            i++;
+        }
+    }
+}
 
-    GtkWidget *reminder = gtk_label_new(
-        "Note: When shrinking a partition, the console will ask 'Yes/No'. "
-        "Type 'Yes' and press Enter to confirm.");
-    gtk_widget_set_halign(reminder, GTK_ALIGN_START);
+static gint compare_image_extents(gconstpointer a, gconstpointer b) {
+    const ImageExtent *x = a, *y = b;
+    return x->offset < y->offset ? -1 : (x->offset > y->offset ? 1 : 0);
+}
 
-    GtkWidget *alignment_info = gtk_label_new(
-        "For best compatibility and performance, the start sector should be 2048 or a multiple of 2048 (1 MiB\n"
-        "alignment). This ensures proper partition alignment on modern storage devices.");
-    gtk_widget_set_halign(alignment_info, GTK_ALIGN_START);
+/* Sorts, clips to the device and merges overlapping or touching extents. */
+static void normalize_extents(GArray *extents, guint64 device_size) {
+    g_array_sort(extents, compare_image_extents);
+    guint out = 0;
+    for (guint i = 0; i < extents->len; i++) {
+        ImageExtent e = g_array_index(extents, ImageExtent, i);
+        if (e.offset >= device_size) continue;
+        if (e.offset + e.length > device_size) e.length = device_size - e.offset;
+        if (out > 0) {
+            ImageExtent *prev = &g_array_index(extents, ImageExtent, out - 1);
+            if (e.offset <= prev->offset + prev->length) {
+                guint64 end = MAX(prev->offset + prev->length, e.offset + e.length);
+                prev->length = end - prev->offset;
+                continue;
+            }
+        }
+        g_array_index(extents, ImageExtent, out++) = e;
+    }
+    g_array_set_size(extents, out);
+}
 
-    {
-        char tmp[128];
+static gboolean ext_group_has_super(guint64 group, guint32 ro_compat, guint32 compat, const guchar *sb) {
+    if (group == 0) return TRUE;
+    if (compat & 0x200) return group == le32(sb + 0x24C) || group == le32(sb + 0x250);
+    if (!(ro_compat & 0x1) || group == 1) return TRUE;
+    for (guint64 base = 3; base <= 7; base += 2) {
+        guint64 p = base;
+        while (p < group) p *= base;
+        if (p == group) return TRUE;
+    }
+    return FALSE;
+}
 
-        g_snprintf(tmp, sizeof(tmp), "%lld",
-                   orig_size_mib * 1024LL * 1024LL);
-        gtk_entry_set_text(GTK_ENTRY(entry_bytes), tmp);
+/* ext2/3/4: walks the group descriptors and reads each group's block bitmap. */
+static gboolean ext_used_extents(int fd, guint64 device_size, GArray *extents, guint32 *unit) {
+    guchar sb[1024];
+    if (!read_exact_at(fd, sb, sizeof(sb), 1024) || le16(sb + 0x38) != 0xEF53) return FALSE;
+
+    guint32 log_block = le32(sb + 0x18);
+    if (log_block > 6) return FALSE;
+    guint64 bs = 1024ULL << log_block;
+    guint32 incompat = le32(sb + 0x60), ro_compat = le32(sb + 0x64), compat = le32(sb + 0x5C);
+    gboolean is64 = (incompat & 0x80) != 0;
+    if (incompat & 0x10) {
+        g_printerr("ext: meta_bg layout is not supported, using a raw copy\n");
+        return FALSE;
+    }
+    guint64 blocks = le32(sb + 0x04) | (is64 ? (guint64)le32(sb + 0x150) << 32 : 0);
+    guint32 first_data_block = le32(sb + 0x14);
+    guint32 blocks_per_group = le32(sb + 0x20);
+    guint32 inodes_per_group = le32(sb + 0x28);
+    guint32 inode_size = le32(sb + 0x4C) >= 1 ? le16(sb + 0x58) : 128;
+    guint32 desc_size = is64 ? le16(sb + 0xFE) : 32;
+    guint32 reserved_gdt = le16(sb + 0xCE);
+    if (blocks_per_group == 0 || blocks_per_group > bs * 8 || desc_size < 32 || blocks <= first_data_block) return FALSE;
+
+    guint64 groups = (blocks - first_data_block + blocks_per_group - 1) / blocks_per_group;
+    guint64 gdt_blocks = (groups * desc_size + bs - 1) / bs;
+    guint64 inode_table_blocks = ((guint64)inodes_per_group * inode_size + bs - 1) / bs;
+    guchar *gdt = g_malloc(gdt_blocks * bs);
+    guchar *bitmap = g_malloc(bs);
+    gboolean ok = read_exact_at(fd, gdt, gdt_blocks * bs, (first_data_block + 1) * bs);
+
+    /* Boot sector and primary superblock, which are outside every group when the block size is 1 KiB. */
+    add_used_extent(extents, 0, 2048);
+    for (guint64 g = 0; ok && g < groups; g++) {
+        const guchar *d = gdt + g * desc_size;
+        guint64 group_start = first_data_block + g * blocks_per_group;
+        guint64 group_blocks = MIN((guint64)blocks_per_group, blocks - group_start);
+        guint64 block_bitmap = le32(d) | (is64 && desc_size >= 64 ? (guint64)le32(d + 0x20) << 32 : 0);
+        guint64 inode_bitmap = le32(d + 4) | (is64 && desc_size >= 64 ? (guint64)le32(d + 0x24) << 32 : 0);
+        guint64 inode_table = le32(d + 8) | (is64 && desc_size >= 64 ? (guint64)le32(d + 0x28) << 32 : 0);
+
+        if (le16(d + 0x12) & 0x2) {
+            /* BLOCK_UNINIT: the bitmap was never written; only the group's own metadata is in use. */
+            if (ext_group_has_super(g, ro_compat, compat, sb))
+                add_used_extent(extents, group_start * bs, (1 + gdt_blocks + reserved_gdt) * bs);
+            guint64 group_end = group_start + group_blocks;
+            if (block_bitmap >= group_start && block_bitmap < group_end) add_used_extent(extents, block_bitmap * bs, bs);
+            if (inode_bitmap >= group_start && inode_bitmap < group_end) add_used_extent(extents, inode_bitmap * bs, bs);
+            if (inode_table >= group_start && inode_table < group_end)
+                add_used_extent(extents, inode_table * bs, MIN(inode_table_blocks, group_end - inode_table) * bs);
+            continue;
+        }
+        if (block_bitmap == 0 || block_bitmap >= blocks || !read_exact_at(fd, bitmap, bs, block_bitmap * bs)) {
+            ok = FALSE;
+            break;
+        }
+        add_bitmap_extents(extents, bitmap, group_blocks, group_start * bs, bs);
+    }
 
-        g_snprintf(tmp, sizeof(tmp), "%lld", orig_size_mib);
-        gtk_entry_set_text(GTK_ENTRY(entry_mib), tmp);
+    g_free(bitmap);
+    g_free(gdt);
+    *unit = (guint32)bs;
+    return ok;
+}
 
-        double gib = (double)orig_size_mib / 1024.0;
-        g_snprintf(tmp, sizeof(tmp), "%.2f", gib);
-        gtk_entry_set_text(GTK_ENTRY(entry_gib), tmp);
+/* NTFS: reads the $DATA runs of $Bitmap (MFT record 6), one bit per cluster. */
+static gboolean ntfs_used_extents(int fd, guint64 device_size, GArray *extents, guint32 *unit) {
+    guchar boot[512];
+    if (!read_exact_at(fd, boot, sizeof(boot), 0) || memcmp(boot + 3, "NTFS    ", 8) != 0) return FALSE;
+
+    guint64 bps = le16(boot + 0x0B);
+    guint32 spc_raw = boot[0x0D];
+    guint64 spc = spc_raw > 0x80 ? (1ULL << (256 - spc_raw)) : spc_raw;
+    guint64 cluster = bps * spc;
+    guint64 total_sectors = le64(boot + 0x28);
+    guint64 mft_lcn = le64(boot + 0x30);
+    gint cpm = (signed char)boot[0x40];
+    guint64 record_size = cpm > 0 ? (guint64)cpm * cluster : (1ULL << (-cpm));
+    if (bps < 512 || cluster == 0 || record_size < 512 || record_size > 65536) return FALSE;
+    guint64 clusters = total_sectors / spc;
+
+    guchar *record = g_malloc(record_size);
+    gboolean ok = read_exact_at(fd, record, record_size, mft_lcn * cluster + 6 * record_size) && memcmp(record, "FILE", 4) == 0;
+    guint16 usa_offset = ok ? le16(record + 4) : 0, usa_count = ok ? le16(record + 6) : 0;
+    if (ok && (usa_count == 0 || usa_offset + 2 * (guint64)usa_count > record_size || (usa_count - 1) * 512ULL > record_size)) ok = FALSE;
+    for (guint i = 1; ok && i < usa_count; i++)
+        memcpy(record + i * 512 - 2, record + usa_offset + 2 * i, 2);
+
+    guchar *bitmap = NULL;
+    guint64 bitmap_size = 0;
+    guint32 pos = ok ? le16(record + 0x14) : 0;
+    while (ok && pos + 16 <= record_size) {
+        guint32 type = le32(record + pos), len = le32(record + pos + 4);
+        if (type == 0xFFFFFFFF || len == 0 || pos + len > record_size) break;
+        if (type == 0x80 && record[pos + 8] == 1 && record[pos + 9] == 0) {
+            bitmap_size = le64(record + pos + 0x30);
+            if (bitmap_size == 0 || bitmap_size > (clusters + 7) / 8 + cluster) { ok = FALSE; break; }
+            bitmap = g_malloc0(bitmap_size + cluster);
+            const guchar *run = record + pos + le16(record + pos + 0x20);
+            const guchar *end = record + pos + len;
+            guint64 vcn = 0;
+            gint64 lcn = 0;
+            while (ok && run < end && *run) {
+                guint len_size = *run & 0x0F, off_size = *run >> 4;
+                if (len_size == 0 || len_size > 8 || off_size > 8 || run + 1 + len_size + off_size > end) { ok = FALSE; break; }
+                guint64 count = 0;
+                for (guint b = 0; b < len_size; b++) count |= (guint64)run[1 + b] << (8 * b);
+                gint64 delta = 0;
+                for (guint b = 0; b < off_size; b++) delta |= (gint64)run[1 + len_size + b] << (8 * b);
+                if (off_size > 0 && off_size < 8 && (run[len_size + off_size] & 0x80)) delta -= (gint64)1 << (8 * off_size);
+                run += 1 + len_size + off_size;
+                if (off_size == 0) { vcn += count; continue; }
+                lcn += delta;
+                guint64 bytes = MIN(count * cluster, vcn * cluster < bitmap_size ? bitmap_size - vcn * cluster : 0);
+                if (bytes > 0 && !read_exact_at(fd, bitmap + vcn * cluster, bytes, (guint64)lcn * cluster)) ok = FALSE;
+                vcn += count;
+            }
+            break;
+        }
+        pos += len;
+    }
+    if (!bitmap) ok = FALSE;
 
-        long long sectors = (end_sector - start_sector);
-        g_snprintf(tmp, sizeof(tmp), "%lld", sectors);
-        gtk_entry_set_text(GTK_ENTRY(entry_sectors), tmp);
+    if (ok) {
+        add_bitmap_extents(extents, bitmap, MIN(clusters, bitmap_size * 8), 0, cluster);
+        /* The backup boot sector sits right after the last sector the volume claims. */
+        add_used_extent(extents, total_sectors * bps, bps);
+    }
+    g_free(bitmap);
+    g_free(record);
+    *unit = (guint32)cluster;
+    return ok;
+}
 
-        g_snprintf(tmp, sizeof(tmp), "%lld", start_sector);
-        gtk_entry_set_text(GTK_ENTRY(entry_start), tmp);
+/* exFAT: finds the allocation bitmap entry in the root directory and reads the bitmap through the FAT chain. */
+static gboolean exfat_used_extents(int fd, guint64 device_size, GArray *extents, guint32 *unit) {
+    guchar boot[512];
+    if (!read_exact_at(fd, boot, sizeof(boot), 0) || memcmp(boot + 3, "EXFAT   ", 8) != 0) return FALSE;
+
+    guint32 bps_shift = boot[108], spc_shift = boot[109];
+    if (bps_shift < 9 || bps_shift > 12 || bps_shift + spc_shift > 25) return FALSE;
+    guint64 bps = 1ULL << bps_shift, cluster = bps << spc_shift;
+    guint64 fat_offset = le32(boot + 80) * bps;
+    guint64 heap_offset = le32(boot + 88) * bps;
+    guint32 cluster_count = le32(boot + 92);
+    guint32 root_cluster = le32(boot + 96);
+
+    guchar *buf = g_malloc(cluster);
+    guint32 bitmap_cluster = 0;
+    guint64 bitmap_size = 0;
+    guint32 c = root_cluster;
+    for (int steps = 0; c >= 2 && c < cluster_count + 2 && steps < 4096 && !bitmap_cluster; steps++) {
+        if (!read_exact_at(fd, buf, cluster, heap_offset + (guint64)(c - 2) * cluster)) break;
+        gboolean end_of_dir = FALSE;
+        for (guint64 e = 0; e < cluster; e += 32) {
+            if (buf[e] == 0x00) { end_of_dir = TRUE; break; }
+            if (buf[e] == 0x81) {
+                bitmap_cluster = le32(buf + e + 20);
+                bitmap_size = le64(buf + e + 24);
+                break;
+            }
+        }
+        if (end_of_dir) break;
+        guchar next[4];
+        if (!read_exact_at(fd, next, 4, fat_offset + 4ULL * c)) break;
+        c = le32(next);
+    }
 
-        g_snprintf(tmp, sizeof(tmp), "%lld", end_sector);
-        gtk_entry_set_text(GTK_ENTRY(entry_end), tmp);
+    gboolean ok = bitmap_cluster >= 2 && bitmap_size > 0 && bitmap_size <= (cluster_count + 7) / 8 + cluster;
+    guchar *bitmap = ok ? g_malloc0(bitmap_size + cluster) : NULL;
+    guint64 filled = 0;
+    c = bitmap_cluster;
+    while (ok && filled < bitmap_size) {
+        if (c < 2 || c >= cluster_count + 2 || !read_exact_at(fd, bitmap + filled, cluster, heap_offset + (guint64)(c - 2) * cluster)) {
+            ok = FALSE;
+            break;
+        }
+        filled += cluster;
+        guchar next[4];
+        if (!read_exact_at(fd, next, 4, fat_offset + 4ULL * c)) { ok = FALSE; break; }
+        /* A bitmap without a FAT chain (entry 0) is contiguous. */
+        guint32 following = le32(next);
+        c = following == 0 ? c + 1 : following;
+    }
 
-        if (max_free > 0) {
-            g_snprintf(tmp, sizeof(tmp),
-                       "Free space: %lld MiB", max_free);
-            gtk_label_set_text(GTK_LABEL(label_free), tmp);
-        } else {
-            gtk_label_set_text(GTK_LABEL(label_free),
-                               "Free space: unknown");
+    if (ok) {
+        add_used_extent(extents, 0, heap_offset);
+        add_bitmap_extents(extents, bitmap, MIN((guint64)cluster_count, bitmap_size * 8), heap_offset, cluster);
+    }
+    g_free(bitmap);
+    g_free(buf);
+    *unit = (guint32)cluster;
+    return ok;
+}
+
+/* FAT12/16/32: a cluster is in use when its entry in the first FAT is not zero. */
+static gboolean fat_used_extents(int fd, guint64 device_size, GArray *extents, guint32 *unit) {
+    guchar boot[512];
+    if (!read_exact_at(fd, boot, sizeof(boot), 0) || boot[510] != 0x55 || boot[511] != 0xAA) return FALSE;
+
+    guint64 bps = le16(boot + 11), spc = boot[13], reserved = le16(boot + 14), fats = boot[16];
+    guint64 root_entries = le16(boot + 17);
+    guint64 total = le16(boot + 19) ? le16(boot + 19) : le32(boot + 32);
+    guint64 fat_sectors = le16(boot + 22) ? le16(boot + 22) : le32(boot + 36);
+    if (bps < 512 || bps > 4096 || (bps & (bps - 1)) || spc == 0 || (spc & (spc - 1)) || reserved == 0 ||
+        fats == 0 || fats > 4 || fat_sectors == 0 || total == 0)
+        return FALSE;
+    if (memcmp(boot + 54, "FAT", 3) != 0 && memcmp(boot + 82, "FAT", 3) != 0) return FALSE;
+
+    guint64 root_sectors = (root_entries * 32 + bps - 1) / bps;
+    guint64 first_data = reserved + fats * fat_sectors + root_sectors;
+    if (first_data >= total) return FALSE;
+    guint64 clusters = (total - first_data) / spc;
+    int bits = clusters < 4085 ? 12 : (clusters < 65525 ? 16 : 32);
+    guint64 cluster = bps * spc;
+
+    add_used_extent(extents, 0, first_data * bps);
+    gboolean ok = TRUE;
+    if (bits == 12) {
+        guint64 fat_bytes = fat_sectors * bps;
+        guchar *fat = g_malloc(fat_bytes);
+        ok = read_exact_at(fd, fat, fat_bytes, reserved * bps);
+        for (guint64 n = 2; ok && n < clusters + 2 && n * 3 / 2 + 1 < fat_bytes; n++) {
+            guint16 v = le16(fat + n * 3 / 2);
+            v = (n & 1) ? v >> 4 : v & 0x0FFF;
+            if (v) add_used_extent(extents, (first_data + (n - 2) * spc) * bps, cluster);
+        }
+        g_free(fat);
+    } else {
+        /* FAT16/32 tables can be hundreds of MiB, so they are read in 1 MiB pieces. */
+        guint64 entry_size = bits / 8, piece = 1 << 20;
+        guchar *fat = g_malloc(piece);
+        for (guint64 first = 0; ok && first < clusters + 2; first += piece / entry_size) {
+            guint64 count = MIN(piece / entry_size, clusters + 2 - first);
+            if (!read_exact_at(fd, fat, count * entry_size, reserved * bps + first * entry_size)) { ok = FALSE; break; }
+            for (guint64 k = 0; k < count; k++) {
+                guint64 n = first + k;
+                guint32 v = bits == 16 ? le16(fat + k * 2) : (le32(fat + k * 4) & 0x0FFFFFFF);
+                if (n >= 2 && v) add_used_extent(extents, (first_data + (n - 2) * spc) * bps, cluster);
+            }
         }
+        g_free(fat);
     }
+    *unit = (guint32)cluster;
+    return ok;
+}
 
-    gtk_box_pack_start(GTK_BOX(area), label1, FALSE, FALSE, 4);
-    gtk_box_pack_start(GTK_BOX(area), entry_bytes,   FALSE, FALSE, 2);
-    gtk_box_pack_start(GTK_BOX(area), entry_mib,     FALSE, FALSE, 2);
-    gtk_box_pack_start(GTK_BOX(area), entry_gib,     FALSE, FALSE, 2);
-    gtk_box_pack_start(GTK_BOX(area), entry_sectors, FALSE, FALSE, 2);
+/* Returns the byte ranges in use on the device, or a single extent covering everything if the file system is unknown. */
+static GArray *get_used_extents(int fd, guint64 device_size, const gchar **fs_name, guint32 *unit) {
+    struct {
+        const gchar *name;
+        gboolean (*scan)(int, guint64, GArray *, guint32 *);
+    } scanners[] = {
+        {"ext", ext_used_extents}, {"ntfs", ntfs_used_extents}, {"exfat", exfat_used_extents}, {"fat", fat_used_extents},
+    };
+    GArray *extents = g_array_new(FALSE, FALSE, sizeof(ImageExtent));
+    for (guint i = 0; i < G_N_ELEMENTS(scanners); i++) {
+        *unit = 0;
+        if (scanners[i].scan(fd, device_size, extents, unit)) {
+            *fs_name = scanners[i].name;
+            normalize_extents(extents, device_size);
+            return extents;
+        }
+        g_array_set_size(extents, 0);
+    }
+    *fs_name = "raw";
+    *unit = 512;
+    add_used_extent(extents, 0, device_size);
+    return extents;
+}
 
-    gtk_box_pack_start(GTK_BOX(area), label_free, FALSE, FALSE, 6);
-    gtk_box_pack_start(GTK_BOX(area), label2, FALSE, FALSE, 4);
-    gtk_box_pack_start(GTK_BOX(area), entry_start, FALSE, FALSE, 2);
-    gtk_box_pack_start(GTK_BOX(area), entry_end,   FALSE, FALSE, 2);
+static void print_transfer_progress(const gchar *verb, guint64 done, guint64 total, gint64 started, gboolean final) {
+    gint64 now = g_get_monotonic_time();
+    double seconds = (now - started) / 1e6;
+    g_printerr("\r%s %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " MiB (%.1f MiB/s)%s", verb,
+               done >> 20, total >> 20, seconds > 0 ? (done / 1048576.0) / seconds : 0.0, final ? "\n" : "   ");
+}
 
-    gtk_box_pack_start(GTK_BOX(area), alignment_info, FALSE, FALSE, 8);
-    gtk_box_pack_start(GTK_BOX(area), reminder, FALSE, FALSE, 8);
+/* Native image container (.daimg): a 64-byte header, zstd-compressed chunks in device order, then a chunk index.
+ * Header: "DAIMAGE1", codec, chunk size, device size, chunk count, index offset, level, unit, index CRC, file system name,
+ * image flags. Index entry (32 bytes): device offset, stored offset, stored length, raw length, flags, CRC32C of the raw data.
+ * All-zero chunks are flagged DAIMG_CHUNK_ZERO and take no space in the file.
+ * Optional trailer after the index, covered by the index CRC: a SHA-256 per chunk (DAIMG_IMAGE_HASHES), then for
+ * differential images (DAIMG_IMAGE_DIFF) the index CRC of the base image and the base image path. Chunks flagged
+ * DAIMG_CHUNK_BASE are unchanged since the base and are read from the chunk at the same offset in the base chain. */
+#define DAIMG_MAGIC "DAIMAGE1"
+#define DAIMG_HEADER_SIZE 64
+#define DAIMG_ENTRY_SIZE 32
+#define DAIMG_DIGEST_SIZE 32
+#define DAIMG_CODEC_ZSTD 1
+#define DAIMG_CHUNK_STORED 0x1
+#define DAIMG_CHUNK_ZERO 0x2
+#define DAIMG_CHUNK_BASE 0x4
+#define DAIMG_IMAGE_HASHES 0x1
+#define DAIMG_IMAGE_DIFF 0x2
+#define DAIMG_DEFAULT_CHUNK (4 << 20)
+#define DAIMG_MAX_CHAIN 64
 
-    ResizeWidgets *widgets = g_new0(ResizeWidgets, 1);
+typedef struct {
+    guint32 codec;
+    guint32 chunk_size;
+    guint64 device_size;
+    guint64 chunk_count;
+    guint64 index_offset;
+    guint32 level;
+    guint32 unit;
+    guint32 index_crc;
+    gchar fs_name[9];
+    guint32 flags;
+} ImageHeader;
 
-    widgets->label_free   = label_free;
-    widgets->orig_free    = max_free;
-    widgets->orig_size    = orig_size_mib;
-    widgets->sector_size  = sector_size;
+typedef struct {
+    guint64 device_offset;
+    guint64 stored_offset;
+    guint32 stored_length;
+    guint32 raw_length;
+    guint32 flags;
+    guint32 crc;
+} ImageIndexEntry;
+
+static void put_le32(guchar *p, guint32 v) { for (int i = 0; i < 4; i++) p[i] = (guchar)(v >> (8 * i)); }
+static void put_le64(guchar *p, guint64 v) { for (int i = 0; i < 8; i++) p[i] = (guchar)(v >> (8 * i)); }
+
+static guint32 crc32c_table[8][256];
+
+static void crc32c_init(void) {
+    if (crc32c_table[0][1]) return;
+    for (guint32 i = 0; i < 256; i++) {
+        guint32 c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+        crc32c_table[0][i] = c;
+    }
+    for (guint32 i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][i] & 0xFF];
+}
 
-    widgets->entry_bytes   = entry_bytes;
-    widgets->entry_mib     = entry_mib;
-    widgets->entry_gib     = entry_gib;
-    widgets->entry_sectors = entry_sectors;
-    widgets->entry_start   = entry_start;
-    widgets->entry_end     = entry_end;
+/* CRC32C (Castagnoli), slicing by 8; crc32c_init() must have run before worker threads start. */
+static guint32 crc32c(guint32 crc, const guchar *p, gsize len) {
+    crc = ~crc;
+    while (len >= 8) {
+        guint32 lo = crc ^ le32(p), hi = le32(p + 4);
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^ crc32c_table[5][(lo >> 16) & 0xFF] ^
+              crc32c_table[4][lo >> 24] ^ crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+    return ~crc;
+}
 
-    g_signal_connect(entry_bytes,   "changed",
-                     G_CALLBACK(on_entry_bytes_changed),   widgets);
-    g_signal_connect(entry_mib,     "changed",
-                     G_CALLBACK(on_entry_mib_changed),     widgets);
-    g_signal_connect(entry_gib,     "changed",
-                     G_CALLBACK(on_entry_gib_changed),     widgets);
-    g_signal_connect(entry_sectors, "changed",
-                     G_CALLBACK(on_entry_sectors_changed), widgets);
-    g_signal_connect(entry_start,   "changed",
-                     G_CALLBACK(on_entry_start_changed),   widgets);
-    g_signal_connect(entry_end,     "changed",
-                     G_CALLBACK(on_entry_end_changed),     widgets);
+static void encode_image_header(const ImageHeader *h, guchar *buf) {
+    memset(buf, 0, DAIMG_HEADER_SIZE);
+    memcpy(buf, DAIMG_MAGIC, 8);
+    put_le32(buf + 8, h->codec);
+    put_le32(buf + 12, h->chunk_size);
+    put_le64(buf + 16, h->device_size);
+    put_le64(buf + 24, h->chunk_count);
+    put_le64(buf + 32, h->index_offset);
+    put_le32(buf + 40, h->level);
+    put_le32(buf + 44, h->unit);
+    put_le32(buf + 48, h->index_crc);
+    memcpy(buf + 52, h->fs_name, MIN(strlen(h->fs_name), 8));
+    put_le32(buf + 60, h->flags);
+}
 
-    on_entry_mib_changed(GTK_EDITABLE(entry_mib), widgets);
+/* Length of the trailer that follows the chunk index, or G_MAXSIZE if it cannot be read. */
+static gsize image_trailer_length(int fd, const ImageHeader *h) {
+    gsize length = (h->flags & DAIMG_IMAGE_HASHES) ? (gsize)h->chunk_count * DAIMG_DIGEST_SIZE : 0;
+    if (h->flags & DAIMG_IMAGE_DIFF) {
+        guchar base[8];
+        if (!read_exact_at(fd, base, sizeof(base), h->index_offset + h->chunk_count * DAIMG_ENTRY_SIZE + length) ||
+            le32(base + 4) == 0 || le32(base + 4) > 4096)
+            return G_MAXSIZE;
+        length += sizeof(base) + le32(base + 4);
+    }
+    return length;
+}
 
-    gtk_widget_show_all(dialog);
+/* Reads the header and chunk index of a .daimg file; returns NULL if the file is not a valid image. */
+static GArray *load_image_index(int fd, ImageHeader *h) {
+    guchar buf[DAIMG_HEADER_SIZE];
+    if (!read_exact_at(fd, buf, sizeof(buf), 0) || memcmp(buf, DAIMG_MAGIC, 8) != 0) return NULL;
+    memset(h, 0, sizeof(*h));
+    h->codec = le32(buf + 8);
+    h->chunk_size = le32(buf + 12);
+    h->device_size = le64(buf + 16);
+    h->chunk_count = le64(buf + 24);
+    h->index_offset = le64(buf + 32);
+    h->level = le32(buf + 40);
+    h->unit = le32(buf + 44);
+    h->index_crc = le32(buf + 48);
+    memcpy(h->fs_name, buf + 52, 8);
+    h->flags = le32(buf + 60);
+    /* Chunks never overlap and hold whole sectors, so a valid image has no more chunks than the device has sectors. */
+    if (h->index_offset == 0 || h->chunk_size == 0 || h->chunk_count > (G_GUINT64_CONSTANT(1) << 32) ||
+        h->chunk_count > (h->device_size + 511) / 512)
+        return NULL;
+
+    /* Everything is checked against the file size before allocating, so a corrupt header cannot ask for gigabytes. */
+    guint64 file_size = (guint64)lseek(fd, 0, SEEK_END);
+    gsize index_bytes = (gsize)h->chunk_count * DAIMG_ENTRY_SIZE, trailer = image_trailer_length(fd, h);
+    if (trailer == G_MAXSIZE || h->index_offset > file_size || index_bytes + trailer > file_size - h->index_offset) return NULL;
+    guchar *raw = g_try_malloc(index_bytes + trailer + 1);
+    if (!raw) return NULL;
+    crc32c_init();
+    if (!read_exact_at(fd, raw, index_bytes + trailer, h->index_offset) || crc32c(0, raw, index_bytes + trailer) != h->index_crc) {
+        g_free(raw);
+        return NULL;
+    }
+    GArray *index = g_array_sized_new(FALSE, FALSE, sizeof(ImageIndexEntry), (guint)h->chunk_count);
+    for (guint64 i = 0; i < h->chunk_count; i++) {
+        const guchar *p = raw + i * DAIMG_ENTRY_SIZE;
+        ImageIndexEntry e = {le64(p), le64(p + 8), le32(p + 16), le32(p + 20), le32(p + 24), le32(p + 28)};
+        g_array_append_val(index, e);
+    }
+    g_free(raw);
+    return index;
+}
 
-    g_object_set_data(G_OBJECT(dialog), "widgets", widgets);
-    g_object_set_data(G_OBJECT(dialog), "tree_view", tree_view);
-    g_object_set_data(G_OBJECT(dialog), "partition_name", partition_name);
-    g_object_set_data(G_OBJECT(dialog), "fstype", fstype);
-    g_object_set_data(G_OBJECT(dialog), "size", size);
+/* Returns the SHA-256 of every chunk (DAIMG_DIGEST_SIZE bytes each), or NULL if the image has none. */
+static guchar *load_image_digests(int fd, const ImageHeader *h) {
+    if (!(h->flags & DAIMG_IMAGE_HASHES)) return NULL;
+    gsize length = (gsize)h->chunk_count * DAIMG_DIGEST_SIZE;
+    guchar *digests = g_malloc(length + 1);
+    if (!read_exact_at(fd, digests, length, h->index_offset + h->chunk_count * DAIMG_ENTRY_SIZE)) {
+        g_free(digests);
+        return NULL;
+    }
+    return digests;
+}
 
-    g_object_set_data(G_OBJECT(dialog), "device_disk", device_disk);
-    g_object_set_data(G_OBJECT(dialog), "entry_bytes", entry_bytes);
-    g_object_set_data(G_OBJECT(dialog), "entry_mib", entry_mib);
-    g_object_set_data(G_OBJECT(dialog), "entry_gib", entry_gib);
-    g_object_set_data(G_OBJECT(dialog), "entry_sectors", entry_sectors);
-    g_object_set_data(G_OBJECT(dialog), "entry_start", entry_start);
-    g_object_set_data(G_OBJECT(dialog), "entry_end", entry_end);
+/* Returns the base image path recorded in a differential image and the index CRC the base had when it was used. */
+static gchar *load_image_base(int fd, const ImageHeader *h, guint32 *base_index_crc) {
+    if (!(h->flags & DAIMG_IMAGE_DIFF)) return NULL;
+    guint64 offset = h->index_offset + h->chunk_count * DAIMG_ENTRY_SIZE;
+    if (h->flags & DAIMG_IMAGE_HASHES) offset += h->chunk_count * DAIMG_DIGEST_SIZE;
+    guchar base[8];
+    if (!read_exact_at(fd, base, sizeof(base), offset) || le32(base + 4) == 0 || le32(base + 4) > 4096) return NULL;
+    gchar *path = g_malloc0(le32(base + 4) + 1);
+    if (!read_exact_at(fd, path, le32(base + 4), offset + sizeof(base))) {
+        g_free(path);
+        return NULL;
+    }
+    *base_index_crc = le32(base);
+    return path;
+}
 
-    g_signal_connect(dialog, "response",
-                     G_CALLBACK(on_resize_dialog_response), NULL);
-    g_signal_connect(dialog, "destroy",
-                     G_CALLBACK(on_resize_dialog_destroy), NULL);
+static void image_chunk_digest(const guchar *data, gsize length, guchar *digest) {
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    gsize digest_length = DAIMG_DIGEST_SIZE;
+    g_checksum_update(checksum, data, (gssize)length);
+    g_checksum_get_digest(checksum, digest, &digest_length);
+    g_checksum_free(checksum);
+}
 
-    if (part_num) g_free(part_num);
-    g_free(disk_name);
+/* Parses a 64-digit SHA-256; anything else ("zero" included) gives the all-zero hash and FALSE. */
+static gboolean digest_from_hex(const gchar *hex, guchar *digest) {
+    memset(digest, 0, DAIMG_DIGEST_SIZE);
+    if (strlen(hex) != DAIMG_DIGEST_SIZE * 2) return FALSE;
+    for (int i = 0; i < DAIMG_DIGEST_SIZE; i++) {
+        int hi = g_ascii_xdigit_value(hex[2 * i]), lo = g_ascii_xdigit_value(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return FALSE;
+        digest[i] = (guchar)(hi << 4 | lo);
+    }
+    return TRUE;
 }
 
-static void on_resize_dialog_response(GtkDialog *dialog, gint response_id, gpointer user_data) {
-    ResizeWidgets *widgets = g_object_get_data(G_OBJECT(dialog), "widgets");
-    GtkTreeView *tree_view = g_object_get_data(G_OBJECT(dialog), "tree_view");
-    gchar *partition_name = g_object_get_data(G_OBJECT(dialog), "partition_name");
-    gchar *fstype = g_object_get_data(G_OBJECT(dialog), "fstype");
-    GtkWidget *entry_mib = g_object_get_data(G_OBJECT(dialog), "entry_mib");
+/* Tree hash of an image: SHA-256 over the device offset, length and SHA-256 of every chunk in device order, with an
+ * all-zero chunk hash for all-zero chunks. Two images with the same tree hash hold the same data at the same offsets. */
+static gchar *image_tree_hash(GArray *entries, const guchar *digests) {
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    for (guint i = 0; i < entries->len; i++) {
+        ImageIndexEntry *e = &g_array_index(entries, ImageIndexEntry, i);
+        guchar leaf[12];
+        put_le64(leaf, e->device_offset);
+        put_le32(leaf + 8, e->raw_length);
+        g_checksum_update(checksum, leaf, sizeof(leaf));
+        g_checksum_update(checksum, digests + (gsize)i * DAIMG_DIGEST_SIZE, DAIMG_DIGEST_SIZE);
+    }
+    gchar *hex = g_strdup(g_checksum_get_string(checksum));
+    g_checksum_free(checksum);
+    return hex;
+}
 
-    if (response_id != GTK_RESPONSE_ACCEPT) {
-        gtk_widget_destroy(GTK_WIDGET(dialog));
-        return;
+/* Index of the chunk that covers exactly [device_offset, device_offset + raw_length), or -1. */
+static gint find_image_chunk(GArray *index, guint64 device_offset, guint32 raw_length) {
+    guint lo = 0, hi = index->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        if (g_array_index(index, ImageIndexEntry, mid).device_offset < device_offset) lo = mid + 1;
+        else hi = mid;
     }
+    if (lo < index->len && g_array_index(index, ImageIndexEntry, lo).device_offset == device_offset &&
+        g_array_index(index, ImageIndexEntry, lo).raw_length == raw_length)
+        return (gint)lo;
+    return -1;
+}
 
-    const gchar *size_str = gtk_entry_get_text(GTK_ENTRY(entry_mib));
-    if (!size_str || strlen(size_str) == 0) goto cleanup_and_close_dialog;
+/* A differential image and the base images below it, newest first. */
+typedef struct {
+    guint depth;
+    int fds[DAIMG_MAX_CHAIN];
+    ImageHeader headers[DAIMG_MAX_CHAIN];
+    GArray *indexes[DAIMG_MAX_CHAIN];
+} ImageChain;
+
+static void image_chain_close(ImageChain *chain) {
+    for (guint i = 0; i < chain->depth; i++) {
+        close(chain->fds[i]);
+        g_array_free(chain->indexes[i], TRUE);
+    }
+    chain->depth = 0;
+}
 
-    gchar *disk_name = get_disk_from_partition(partition_name);
-    if (!disk_name) goto cleanup_and_close_dialog;
-    gchar *disk_path = g_strdup_printf("/dev/%s", disk_name);
+/* Opens an image and, for differential images, its bases. A base that was moved is looked for beside the image
+ * that refers to it; a base whose index changed since the differential image was taken is rejected. */
+static gboolean image_chain_open(ImageChain *chain, const gchar *image_path) {
+    memset(chain, 0, sizeof(*chain));
+    gchar *path = g_strdup(image_path);
+    guint32 expected_crc = 0;
+    gboolean ok = TRUE;
+    while (ok && path) {
+        int fd = open(path, O_RDONLY);
+        ImageHeader h;
+        GArray *index = fd >= 0 ? load_image_index(fd, &h) : NULL;
+        if (!index) {
+            g_printerr("%s is not a DriveAssistify image or its chunk index is damaged\n", path);
+            if (fd >= 0) close(fd);
+            ok = FALSE;
+            break;
+        }
+        chain->fds[chain->depth] = fd;
+        chain->headers[chain->depth] = h;
+        chain->indexes[chain->depth] = index;
+        chain->depth++;
+        if (chain->depth > 1 && h.index_crc != expected_crc) {
+            g_printerr("Base image %s has changed since the differential image above it was taken\n", path);
+            ok = FALSE;
+            break;
+        }
+        if (chain->depth > 1 && h.device_size != chain->headers[0].device_size) {
+            g_printerr("Base image %s is of a different partition size\n", path);
+            ok = FALSE;
+            break;
+        }
+        gchar *base = load_image_base(fd, &h, &expected_crc);
+        if (!base && (h.flags & DAIMG_IMAGE_DIFF)) {
+            g_printerr("%s refers to a base image, but the reference is damaged\n", path);
+            ok = FALSE;
+        } else if (base && chain->depth == DAIMG_MAX_CHAIN) {
+            g_printerr("The chain of differential images starting at %s is longer than %d images\n", image_path, DAIMG_MAX_CHAIN);
+            g_free(base);
+            base = NULL;
+            ok = FALSE;
+        } else if (base && !g_file_test(base, G_FILE_TEST_EXISTS)) {
+            gchar *dir = g_path_get_dirname(path), *name = g_path_get_basename(base);
+            gchar *beside = g_build_filename(dir, name, NULL);
+            g_free(base);
+            base = beside;
+            g_free(name);
+            g_free(dir);
+        }
+        g_free(path);
+        path = base;
+    }
+    g_free(path);
+    if (!ok) image_chain_close(chain);
+    return ok;
+}
 
-    gchar *part_num = NULL;
-    if (g_str_has_prefix(partition_name, "nvme") || g_str_has_prefix(partition_name, "mmcblk")) {
-        gchar *p = g_strrstr(partition_name, "p");
-        if (p && isdigit(*(p+1))) part_num = g_strdup(p+1);
-    } else {
-        const gchar *p = partition_name;
-        while (*p && !isdigit(*p)) p++;
-        if (*p) part_num = g_strdup(p);
+/* Follows a chunk flagged DAIMG_CHUNK_BASE down the chain; returns the entry that holds its data and its level. */
+static const ImageIndexEntry *image_chain_resolve(ImageChain *chain, const ImageIndexEntry *e, guint *level) {
+    *level = 0;
+    while (e && (e->flags & DAIMG_CHUNK_BASE)) {
+        gint i = ++*level < chain->depth ? find_image_chunk(chain->indexes[*level], e->device_offset, e->raw_length) : -1;
+        e = i >= 0 ? &g_array_index(chain->indexes[*level], ImageIndexEntry, i) : NULL;
     }
-    if (!part_num) goto cleanup_and_close_dialog;
+    return e;
+}
 
-    gchar *cmd_sectors = g_strdup_printf(
-        "parted -m %s unit s print | grep '^%s:' | cut -d: -f2,3 | tr -d 's'",
-        disk_path, part_num
-    );
-    FILE *fp = popen(cmd_sectors, "r");
-    g_free(cmd_sectors);
+/* Decodes one .daimg chunk into raw (raw_length bytes) and checks its CRC32C. Base chunks must be resolved first. */
+static gboolean decode_image_chunk(ZSTD_DCtx *dctx, int fd, const ImageIndexEntry *e, guchar *raw) {
+    if (e->flags & DAIMG_CHUNK_BASE) return FALSE;
+    if (e->flags & DAIMG_CHUNK_ZERO) {
+        memset(raw, 0, e->raw_length);
+        return e->stored_length == 0;
+    }
+    if (e->flags & DAIMG_CHUNK_STORED) {
+        if (e->stored_length != e->raw_length || !read_exact_at(fd, raw, e->raw_length, e->stored_offset)) return FALSE;
+    } else {
+        guchar *stored = g_malloc(e->stored_length + 1);
+        gboolean ok = read_exact_at(fd, stored, e->stored_length, e->stored_offset);
+        if (ok) {
+            size_t n = ZSTD_decompressDCtx(dctx, raw, e->raw_length, stored, e->stored_length);
+            ok = !ZSTD_isError(n) && n == e->raw_length;
+        }
+        g_free(stored);
+        if (!ok) return FALSE;
+    }
+    return crc32c(0, raw, e->raw_length) == e->crc;
+}
 
-    long long start_sector = 0, current_end_sector = 0;
-    if (fp && fscanf(fp, "%lld:%lld", &start_sector, &current_end_sector) != 2) {
-        start_sector = current_end_sector = 0;
+/* Splits extents into chunks that never span two extents or a multiple of chunk_size on the device; *used receives
+ * the total length. Cutting on a fixed device grid keeps the chunks of unchanged regions identical between images. */
+static GArray *split_extents_into_chunks(GArray *extents, guint32 chunk_size, guint64 *used) {
+    GArray *chunks = g_array_new(FALSE, TRUE, sizeof(ImageIndexEntry));
+    *used = 0;
+    for (guint i = 0; i < extents->len; i++) {
+        ImageExtent e = g_array_index(extents, ImageExtent, i);
+        for (guint64 pos = e.offset; pos < e.offset + e.length;) {
+            guint64 end = MIN(e.offset + e.length, (pos / chunk_size + 1) * chunk_size);
+            ImageIndexEntry c = {0};
+            c.device_offset = pos;
+            c.raw_length = (guint32)(end - pos);
+            g_array_append_val(chunks, c);
+            pos = end;
+        }
+        *used += e.length;
     }
-    if (fp) pclose(fp);
+    return chunks;
+}
+
+/*
+ * Imaging and restore jobs keep an append-only journal in IMAGE_JOURNAL_DIR: a header with the job parameters,
+ * one "u" line per finished chunk (CRC32C, plus stored offset, length and flags for .daimg output) and a
+ * "commit N" line every few seconds, written only after the destination has been flushed. On resume, chunks
+ * after the last commit line are redone. The header also holds a SHA-256 of the chunk layout (device offset
+ * and length of every chunk), because the journal entries are applied to the chunk list by index.
+ */
+#define IMAGE_JOURNAL_DIR "/var/lib/DriveAssistify/journals"
+#define IMAGE_JOURNAL_MAGIC "# DriveAssistify journal 2"
+#define IMAGE_JOURNAL_INTERVAL 5
+
+typedef struct {
+    gchar *path;
+    FILE *file;
+    GArray *units;
+    guint64 written;
+    gint64 last_commit;
+} ImageJournal;
+
+static gchar *get_image_journal_path(const gchar *op, const gchar *source, const gchar *destination) {
+    gchar *key = g_strdup_printf("%s\n%s\n%s", op, source, destination);
+    gchar *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+    gchar *base = g_path_get_basename(destination);
+    gchar *name = g_strdup_printf("%s-%s-%.12s.journal", op, base, hash);
+    gchar *path = g_build_filename(IMAGE_JOURNAL_DIR, name, NULL);
+    g_free(name);
+    g_free(base);
+    g_free(hash);
+    g_free(key);
+    return path;
+}
 
-    gchar *tmp = g_strdup(size_str);
-    gchar *t = g_strstrip(tmp);
-    while (strlen(t) > 0 && strchr("BbIiMm ", t[strlen(t)-1])) t[strlen(t)-1] = '\0';
-    long long target_mib = atoll(t);
-    g_free(tmp);
-    if (target_mib <= 0) goto cleanup_and_close_dialog;
+/* SHA-256 over the device offset and length of every chunk, or "-" for jobs whose chunks are fixed by the size. */
+static gchar *get_image_layout_digest(GArray *chunks) {
+    if (!chunks) return g_strdup("-");
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    for (guint i = 0; i < chunks->len; i++) {
+        ImageIndexEntry *c = &g_array_index(chunks, ImageIndexEntry, i);
+        guchar raw[12];
+        put_le64(raw, c->device_offset);
+        put_le32(raw + 8, c->raw_length);
+        g_checksum_update(checksum, raw, sizeof(raw));
+    }
+    gchar *hex = g_strdup(g_checksum_get_string(checksum));
+    g_checksum_free(checksum);
+    return hex;
+}
 
-    long long sector_size = widgets && widgets->sector_size > 0 ? widgets->sector_size : 512;
-    long long target_sectors = (target_mib * 1024LL * 1024LL + sector_size - 1) / sector_size;
-    long long final_end_sector = start_sector + target_sectors - 1;
+/*
+ * Opens the journal of a job. A new job starts an empty journal; if that is not possible the job runs without one.
+ * With resume, the existing journal must describe exactly the same job and chunk layout, otherwise *failed is set.
+ * layout is the chunk list of the job, or NULL when unit_count fixed-size chunks cover the source.
+ */
+static ImageJournal *image_journal_open(const gchar *op, const gchar *source, const gchar *destination, const gchar *params,
+                                        guint64 source_size, GArray *layout, guint unit_count, gboolean resume, gboolean *failed) {
+    gchar *path = get_image_journal_path(op, source, destination);
+    gchar *digest = get_image_layout_digest(layout);
+    gchar *job = g_strdup_printf("%s\nop %s\nsource %s\ndestination %s\nparams %s\nsource_size %" G_GUINT64_FORMAT "\n",
+                                 IMAGE_JOURNAL_MAGIC, op, source, destination, params, source_size);
+    gchar *header = g_strdup_printf("%sunits %u\nlayout %s\n", job, layout ? layout->len : unit_count, digest);
+    GString *contents = g_string_new(header);
+    GArray *units = g_array_new(FALSE, TRUE, sizeof(ImageIndexEntry));
+    *failed = FALSE;
+
+    if (resume) {
+        gchar *old = NULL;
+        if (!g_file_get_contents(path, &old, NULL, NULL) || !g_str_has_prefix(old, job)) {
+            g_printerr("%s does not match this job (the source, destination or parameters changed); start a new job instead\n", path);
+            *failed = TRUE;
+        } else if (!g_str_has_prefix(old, header)) {
+            g_printerr("%s does not match this job: the %s chunk layout changed since it started "
+                       "(for example the file system was mounted or repaired); start a new job instead\n",
+                       path, g_str_has_prefix(op, "image") ? "file system" : "image");
+            *failed = TRUE;
+        } else {
+            /* Keep only the chunks covered by the last commit line. */
+            GArray *seen = g_array_new(FALSE, TRUE, sizeof(ImageIndexEntry));
+            gchar **lines = g_strsplit(old + strlen(header), "\n", -1);
+            for (int i = 0; lines[i]; i++) {
+                if (g_str_has_prefix(lines[i], "u ")) {
+                    ImageIndexEntry e = {0};
+                    gchar *end = NULL;
+                    e.crc = (guint32)g_ascii_strtoull(lines[i] + 2, &end, 16);
+                    e.stored_offset = g_ascii_strtoull(end, &end, 10);
+                    e.stored_length = (guint32)g_ascii_strtoull(end, &end, 10);
+                    e.flags = (guint32)g_ascii_strtoull(end, NULL, 10);
+                    g_array_append_val(seen, e);
+                } else if (g_str_has_prefix(lines[i], "commit ")) {
+                    guint64 n = g_ascii_strtoull(lines[i] + 7, NULL, 10);
+                    if (n <= seen->len) {
+                        g_array_set_size(units, 0);
+                        g_array_append_vals(units, seen->data, (guint)n);
+                    }
+                }
+            }
+            g_strfreev(lines);
+            g_array_free(seen, TRUE);
+            for (guint i = 0; i < units->len; i++) {
+                ImageIndexEntry *e = &g_array_index(units, ImageIndexEntry, i);
+                g_string_append_printf(contents, "u %08x %" G_GUINT64_FORMAT " %u %u\n", e->crc, e->stored_offset, e->stored_length, e->flags);
+            }
+            g_string_append_printf(contents, "commit %u\n", units->len);
+        }
+        g_free(old);
+    }
 
-    gchar *cmd_disk_size = g_strdup_printf("blockdev --getsz %s", disk_path);
-    FILE *fd = popen(cmd_disk_size, "r");
-    g_free(cmd_disk_size);
-    long long disk_sectors = 0;
-    if (fd && fscanf(fd, "%lld", &disk_sectors) != 1) disk_sectors = 0;
-    if (fd) pclose(fd);
+    ImageJournal *journal = NULL;
+    if (!*failed) {
+        FILE *file = NULL;
+        if (g_mkdir_with_parents(IMAGE_JOURNAL_DIR, 0755) == 0 && g_file_set_contents(path, contents->str, -1, NULL))
+            file = fopen(path, "a");
+        if (file) {
+            journal = g_new0(ImageJournal, 1);
+            journal->path = path;
+            journal->file = file;
+            journal->units = units;
+            journal->written = units->len;
+            journal->last_commit = g_get_monotonic_time();
+            path = NULL;
+            units = NULL;
+        } else if (resume) {
+            g_printerr("Cannot update %s: %s\n", path, g_strerror(errno));
+            *failed = TRUE;
+        } else {
+            g_printerr("Cannot create a journal in %s; this job cannot be resumed if it is interrupted\n", IMAGE_JOURNAL_DIR);
+        }
+    }
+    if (units) g_array_free(units, TRUE);
+    g_string_free(contents, TRUE);
+    g_free(header);
+    g_free(job);
+    g_free(digest);
+    g_free(path);
+    return journal;
+}
 
-    if (disk_sectors > 0 && final_end_sector >= disk_sectors)
-        final_end_sector = disk_sectors - 1;
+static guint image_journal_committed(ImageJournal *journal) {
+    return journal ? journal->units->len : 0;
+}
 
-    gchar *part_path = NULL;
-    if (g_str_has_prefix(disk_name, "nvme") || g_str_has_prefix(disk_name, "mmcblk"))
-        part_path = g_strdup_printf("/dev/%sp%s", disk_name, part_num);
-    else
-        part_path = g_strdup_printf("/dev/%s%s", disk_name, part_num);
+static void image_journal_add(ImageJournal *journal, const ImageIndexEntry *e) {
+    if (!journal) return;
+    fprintf(journal->file, "u %08x %" G_GUINT64_FORMAT " %u %u\n", e->crc, e->stored_offset, e->stored_length, e->flags);
+    journal->written++;
+}
 
-    gboolean shrinking = final_end_sector < current_end_sector;
+static gboolean image_journal_due(ImageJournal *journal) {
+    return journal && g_get_monotonic_time() - journal->last_commit >= IMAGE_JOURNAL_INTERVAL * G_USEC_PER_SEC;
+}
 
-    GString *script = g_string_new(NULL);
-    g_string_append_printf(script,
-        "#!/bin/bash\nset -e\n\n"
-        "before_start=%lld\n"
-        "before_end=%lld\n"
-        "before_size=$((before_end - before_start + 1))\n"
-        "before_mib=$((before_size*%lld/1024/1024))\n"
-        "before_gib=$((before_mib/1024))\n\n"
-        "echo \"======================================\"\n"
-        "echo \" BEFORE\"\n"
-        "echo \" Start sector : $before_start\"\n"
-        "echo \" End sector   : $before_end\"\n"
-        "echo \" Size (sect)  : $before_size  ($before_mib MiB / ~$before_gib GiB)\"\n"
-        "echo \"======================================\"\n\n",
-        start_sector, current_end_sector, sector_size
-    );
+/* Flushes the destination first, so a commit line never covers data that is still only in the page cache. */
+static gboolean image_journal_commit(ImageJournal *journal, int dst_fd) {
+    if (!journal) return TRUE;
+    journal->last_commit = g_get_monotonic_time();
+    if (fdatasync(dst_fd) != 0) return FALSE;
+    fprintf(journal->file, "commit %" G_GUINT64_FORMAT "\n", journal->written);
+    return fflush(journal->file) == 0 && fdatasync(fileno(journal->file)) == 0;
+}
 
-    g_string_append_printf(script, "umount %s 2>/dev/null || true\n\n", part_path);
+/* A finished job deletes its journal; an interrupted one leaves it for "DriveAssistify --resume-job". */
+static void image_journal_close(ImageJournal *journal, gboolean success) {
+    if (!journal) return;
+    fclose(journal->file);
+    if (success) unlink(journal->path);
+    else g_printerr("Progress is saved in %s. Resume it from \"Resume Interrupted Image Job\" or with: sudo DriveAssistify --resume-job '%s'\n",
+                    journal->path, journal->path);
+    g_array_free(journal->units, TRUE);
+    g_free(journal->path);
+    g_free(journal);
+}
 
-    if (shrinking && g_str_has_prefix(fstype, "ext")) {
-        g_string_append_printf(script,
-            "echo 'Running e2fsck...'\n"
-            "e2fsck -fy %s\n"
-            "echo 'Shrinking filesystem...'\n"
-            "resize2fs %s %lldM\n\n",
-            part_path, part_path, target_mib
-        );
+/* True if the range at offset still has the content recorded for a journal unit. */
+static gboolean range_matches_unit(int fd, guint64 offset, const ImageIndexEntry *e) {
+    guchar *buf = g_malloc(e->raw_length + 1);
+    gboolean match = read_exact_at(fd, buf, e->raw_length, offset) &&
+                     ((e->flags & DAIMG_CHUNK_ZERO) ? is_zero_block(buf, e->raw_length) : crc32c(0, buf, e->raw_length) == e->crc);
+    g_free(buf);
+    return match;
+}
 
-        g_string_append_printf(script,
-            "blk_cnt=$(dumpe2fs -h %s | awk '/Block count:/ {print $3}')\n"
-            "blk_sz=$(dumpe2fs -h %s | awk '/Block size:/ {print $3}')\n"
-            "fs_sectors=$(( (blk_cnt * blk_sz + %lld - 1)/%lld ))\n"
-            "new_end=$(( %lld + fs_sectors - 1 ))\n"
-            "echo \"Filesystem end sector: $new_end\"\n\n",
-            part_path, part_path, sector_size, sector_size, start_sector
-        );
+static void report_resume(guint committed, guint total) {
+    if (committed > 0) g_printerr("Resuming after chunk %u of %u; the last committed chunk matches on both sides\n", committed, total);
+}
+typedef struct {
+    guint64 seq;
+    ImageIndexEntry entry;
+    guchar *raw;
+    guchar *stored;
+    gboolean failed;
+    gboolean is_new;
+    gchar hash[65];
+    gboolean has_base;
+    guchar digest[DAIMG_DIGEST_SIZE];
+    guchar base_digest[DAIMG_DIGEST_SIZE];
+} ImageChunkJob;
+
+typedef enum {
+    IMAGE_WORK_COMPRESS,
+    IMAGE_WORK_DECOMPRESS,
+    IMAGE_WORK_REPO_STORE,
+    IMAGE_WORK_REPO_LOAD,
+    IMAGE_WORK_HASH
+} ImageWorkMode;
 
-        g_string_append_printf(script,
-            "echo 'Resizing partition (shrink)...'\n"
-            "parted %s resizepart %s ${new_end}s\n"
-            "echo 'Partition shrink completed.'\n\n",
-            disk_path, part_num
-        );
+typedef struct {
+    GAsyncQueue *jobs;
+    GAsyncQueue *done;
+    int level;
+    ImageWorkMode mode;
+    gchar *chunk_dir;
+    GThread **threads;
+    guint thread_count;
+} ImageWorkerPool;
+
+static ImageChunkJob image_worker_stop;
+
+static void repo_store_chunk(ImageWorkerPool *pool, ZSTD_CCtx *cctx, ImageChunkJob *job);
+static void repo_load_chunk(ImageWorkerPool *pool, ZSTD_DCtx *dctx, ImageChunkJob *job);
+
+/* Turns the stored bytes of a .daimg chunk into raw data and checks its CRC32C; zero chunks stay without data. */
+static void decode_chunk_job(ZSTD_DCtx *dctx, ImageChunkJob *job) {
+    ImageIndexEntry *e = &job->entry;
+    if (e->flags & DAIMG_CHUNK_ZERO) {
+        job->failed = e->stored_length != 0;
+        return;
+    }
+    if (e->flags & DAIMG_CHUNK_STORED) {
+        job->raw = job->stored;
+        job->stored = NULL;
+        job->failed = e->stored_length != e->raw_length;
+    } else {
+        job->raw = g_malloc(e->raw_length);
+        size_t n = ZSTD_decompressDCtx(dctx, job->raw, e->raw_length, job->stored, e->stored_length);
+        job->failed = ZSTD_isError(n) || n != e->raw_length;
     }
+    if (!job->failed && crc32c(0, job->raw, e->raw_length) != e->crc) job->failed = TRUE;
+}
 
-    if (!shrinking) {
-        g_string_append_printf(script,
-            "echo 'Extending partition...'\n"
-            "parted --script %s resizepart %s %llds\n"
-            "echo 'Partition extend completed.'\n\n",
-            disk_path, part_num, final_end_sector
-        );
+/* Fills in the CRC32C, the zero flag and the SHA-256 of a chunk (all zero for all-zero chunks),
+ * loading it from the repository or decoding it first if it is not raw data yet. */
+static void hash_chunk_job(ImageWorkerPool *pool, ZSTD_DCtx *dctx, ImageChunkJob *job) {
+    ImageIndexEntry *e = &job->entry;
+    if (pool->chunk_dir && !(e->flags & DAIMG_CHUNK_ZERO)) {
+        /* Repository chunks are checked against their hash while loading. */
+        repo_load_chunk(pool, dctx, job);
+        if (!job->failed) digest_from_hex(job->hash, job->digest);
+        return;
+    }
+    if (job->stored) decode_chunk_job(dctx, job);
+    if (job->failed) return;
+    if (!job->raw || is_zero_block(job->raw, e->raw_length)) {
+        e->flags |= DAIMG_CHUNK_ZERO;
+        e->crc = job->raw ? crc32c(0, job->raw, e->raw_length) : e->crc;
+        memset(job->digest, 0, DAIMG_DIGEST_SIZE);
+        return;
+    }
+    e->crc = crc32c(0, job->raw, e->raw_length);
+    image_chunk_digest(job->raw, e->raw_length, job->digest);
+}
 
-        if (g_str_has_prefix(fstype, "ext")) {
-            g_string_append_printf(script,
-                "echo 'Updating filesystem...'\n"
-                "e2fsck -fy %s || true\n"
-                "resize2fs %s || true\n\n",
-                part_path, part_path
-            );
+/* Processes chunks until the stop marker arrives; each worker keeps its own zstd contexts. */
+static gpointer image_worker_thread(gpointer data) {
+    ImageWorkerPool *pool = data;
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    for (;;) {
+        ImageChunkJob *job = g_async_queue_pop(pool->jobs);
+        if (job == &image_worker_stop) break;
+        ImageIndexEntry *e = &job->entry;
+        if (pool->mode == IMAGE_WORK_REPO_STORE) {
+            repo_store_chunk(pool, cctx, job);
+        } else if (pool->mode == IMAGE_WORK_REPO_LOAD) {
+            repo_load_chunk(pool, dctx, job);
+        } else if (pool->mode == IMAGE_WORK_HASH) {
+            hash_chunk_job(pool, dctx, job);
+        } else if (pool->mode == IMAGE_WORK_DECOMPRESS) {
+            decode_chunk_job(dctx, job);
+        } else if (is_zero_block(job->raw, e->raw_length)) {
+            e->flags |= DAIMG_CHUNK_ZERO;
+            e->stored_length = 0;
+            e->crc = 0;
+        } else {
+            e->crc = crc32c(0, job->raw, e->raw_length);
+            image_chunk_digest(job->raw, e->raw_length, job->digest);
+            if (job->has_base && memcmp(job->digest, job->base_digest, DAIMG_DIGEST_SIZE) == 0) {
+                /* Unchanged since the base image: only the index entry is written. */
+                e->flags |= DAIMG_CHUNK_BASE;
+                e->stored_length = 0;
+                g_async_queue_push(pool->done, job);
+                continue;
+            }
+            size_t bound = ZSTD_compressBound(e->raw_length);
+            job->stored = g_malloc(bound);
+            size_t n = ZSTD_compressCCtx(cctx, job->stored, bound, job->raw, e->raw_length, pool->level);
+            if (ZSTD_isError(n) || n >= e->raw_length) {
+                /* Incompressible data is kept as is, so a chunk never grows. */
+                g_free(job->stored);
+                job->stored = NULL;
+                e->flags |= DAIMG_CHUNK_STORED;
+                e->stored_length = e->raw_length;
+            } else {
+                e->stored_length = (guint32)n;
+            }
         }
+        g_async_queue_push(pool->done, job);
     }
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+    return NULL;
+}
 
-    g_string_append_printf(script,
-        "udevadm settle && partprobe %s || blockdev --rereadpt %s\\n"
-        "after_start=$(parted -m %s unit s print | grep '^%s:' | cut -d: -f2 | tr -d 's')\n"
-        "after_end=$(parted -m %s unit s print | grep '^%s:' | cut -d: -f3 | tr -d 's')\n"
-        "after_size=$((after_end - after_start + 1))\n"
-        "after_mib=$((after_size*%lld/1024/1024))\n"
-        "after_gib=$((after_mib/1024))\n\n"
-        "echo \"======================================\"\n"
-        "echo \" AFTER\"\n"
-        "echo \" Start sector : $after_start\"\n"
-        "echo \" End sector   : $after_end\"\n"
-        "echo \" Size (sect)  : $after_size  ($after_mib MiB / ~$after_gib GiB)\"\n"
-        "echo \"======================================\"\n"
-        "echo \"Operation completed.\"\n"
-        "rm -f \"$0\"\n",
-        disk_path, disk_path, part_num, disk_path, part_num, sector_size
-    );
+static ImageWorkerPool *image_worker_pool_new(guint thread_count, int level, ImageWorkMode mode, const gchar *chunk_dir) {
+    ImageWorkerPool *pool = g_new0(ImageWorkerPool, 1);
+    crc32c_init();
+    pool->jobs = g_async_queue_new();
+    pool->done = g_async_queue_new();
+    pool->level = level;
+    pool->mode = mode;
+    pool->chunk_dir = g_strdup(chunk_dir);
+    pool->thread_count = MAX(thread_count, 1);
+    pool->threads = g_new0(GThread *, pool->thread_count);
+    for (guint i = 0; i < pool->thread_count; i++)
+        pool->threads[i] = g_thread_new("image-worker", image_worker_thread, pool);
+    return pool;
+}
 
-    gchar *tmp_path = g_strdup_printf("/tmp/driveassistify_resize_%ld.sh", (long)getpid());
-    g_file_set_contents(tmp_path, script->str, -1, NULL);
-    chmod(tmp_path, 0755);
+static void image_worker_pool_free(ImageWorkerPool *pool) {
+    for (guint i = 0; i < pool->thread_count; i++) g_async_queue_push(pool->jobs, &image_worker_stop);
+    for (guint i = 0; i < pool->thread_count; i++) g_thread_join(pool->threads[i]);
+    g_async_queue_unref(pool->jobs);
+    g_async_queue_unref(pool->done);
+    g_free(pool->chunk_dir);
+    g_free(pool->threads);
+    g_free(pool);
+}
 
-    run_command_in_terminal(tree_view, tmp_path);
+static void free_image_chunk_job(ImageChunkJob *job) {
+    if (job->stored != job->raw) g_free(job->stored);
+    g_free(job->raw);
+    g_free(job);
+}
 
-    g_string_free(script, TRUE);
-    g_free(tmp_path);
-    g_free(part_path);
-    g_free(part_num);
-    g_free(disk_name);
-    g_free(disk_path);
+#define IMAGE_HASHES_MAGIC "# DriveAssistify chunk hashes 1"
+
+/* Writes "<image>.hashes": the tree hash and the SHA-256 of every chunk of a packed used-blocks image. */
+static gboolean write_image_hashes(const gchar *image_path, GArray *chunks, const guchar *digests, const gchar *tree) {
+    gchar *path = g_strdup_printf("%s.hashes", image_path);
+    FILE *f = fopen(path, "w");
+    gboolean ok = f != NULL;
+    if (f) {
+        fprintf(f, "%s\ntree %s\nchunks %u\n", IMAGE_HASHES_MAGIC, tree, chunks->len);
+        for (guint i = 0; i < chunks->len; i++) {
+            ImageIndexEntry *c = &g_array_index(chunks, ImageIndexEntry, i);
+            const guchar *d = digests + (gsize)i * DAIMG_DIGEST_SIZE;
+            fprintf(f, "%" G_GUINT64_FORMAT " %u ", c->device_offset, c->raw_length);
+            if (c->flags & DAIMG_CHUNK_ZERO) fputs("zero", f);
+            else
+                for (int k = 0; k < DAIMG_DIGEST_SIZE; k++) fprintf(f, "%02x", d[k]);
+            fputc('\n', f);
+        }
+        ok = fclose(f) == 0;
+    }
+    if (!ok) g_printerr("Cannot create %s: %s\n", path, g_strerror(errno));
+    g_free(path);
+    return ok;
+}
 
-cleanup_and_close_dialog:
-    gtk_widget_destroy(GTK_WIDGET(dialog));
+/* Copies only the used extents of src into a packed image and writes the block map to "<image>.map". Chunks are
+ * hashed on a worker pool while they stream through; the hashes go to "<image>.hashes". */
+static int image_used_blocks(const gchar *src_path, const gchar *image_path, gboolean resume) {
+    int src = open(src_path, O_RDONLY);
+    if (src < 0) {
+        g_printerr("Cannot open %s: %s\n", src_path, g_strerror(errno));
+        return 1;
+    }
+    crc32c_init();
+    guint64 device_size = (guint64)lseek(src, 0, SEEK_END);
+    const gchar *fs_name = NULL;
+    guint32 unit = 0;
+    guint64 used = 0;
+    GArray *extents = get_used_extents(src, device_size, &fs_name, &unit);
+    GArray *chunks = split_extents_into_chunks(extents, DAIMG_DEFAULT_CHUNK, &used);
+    g_printerr("%s: %s file system, %" G_GUINT64_FORMAT " MiB of %" G_GUINT64_FORMAT " MiB in use, %u extents\n",
+               src_path, fs_name, used >> 20, device_size >> 20, extents->len);
+
+    gboolean failed = FALSE;
+    ImageJournal *journal = image_journal_open("image-used", src_path, image_path, "-", device_size, chunks, 0, resume, &failed);
+    int out = failed ? -1 : open(image_path, O_RDWR | O_CREAT | (resume ? 0 : O_TRUNC), 0644);
+    if (out < 0) {
+        if (!failed) g_printerr("Cannot create %s: %s\n", image_path, g_strerror(errno));
+        image_journal_close(journal, FALSE);
+        g_array_free(chunks, TRUE);
+        g_array_free(extents, TRUE);
+        close(src);
+        return 1;
+    }
+
+    guint start = image_journal_committed(journal);
+    guint64 packed = 0;
+    guchar *digests = g_malloc0((gsize)chunks->len * DAIMG_DIGEST_SIZE + 1);
+    guchar *buf = g_malloc(DAIMG_DEFAULT_CHUNK);
+    gboolean ok = TRUE;
+    for (guint i = 0; i < start; i++) {
+        ImageIndexEntry *c = &g_array_index(chunks, ImageIndexEntry, i);
+        ImageIndexEntry *j = &g_array_index(journal->units, ImageIndexEntry, i);
+        c->crc = j->crc;
+        c->flags = j->flags;
+        /* Chunk hashes are not journaled: committed chunks are read back from the image to recover them. */
+        if (ok && !(c->flags & DAIMG_CHUNK_ZERO)) {
+            ok = read_exact_at(out, buf, c->raw_length, packed) && crc32c(0, buf, c->raw_length) == c->crc;
+            if (ok) image_chunk_digest(buf, c->raw_length, digests + (gsize)i * DAIMG_DIGEST_SIZE);
+        }
+        packed += c->raw_length;
+    }
+    if (ok && start > 0) {
+        ImageIndexEntry *last = &g_array_index(chunks, ImageIndexEntry, start - 1);
+        ok = range_matches_unit(src, last->device_offset, last) && range_matches_unit(out, packed - last->raw_length, last);
+    }
+    if (!ok) g_printerr("The last committed chunk no longer matches the source or the image; start a new job instead\n");
+    else report_resume(start, chunks->len);
+    ok = ok && ftruncate(out, (off_t)packed) == 0 && lseek(out, (off_t)packed, SEEK_SET) >= 0;
+    g_free(buf);
+
+    ImageWorkerPool *pool = image_worker_pool_new(g_get_num_processors(), 0, IMAGE_WORK_HASH, NULL);
+    guint window = pool->thread_count * 2 + 2;
+    ImageChunkJob **reorder = g_new0(ImageChunkJob *, window);
+    guint64 next_read = start, next_write = start, pending = 0, done = packed;
+    gint64 started = g_get_monotonic_time(), last_report = 0;
+    while (ok && next_write < chunks->len) {
+        if (next_read < chunks->len && next_read - next_write < window) {
+            ImageChunkJob *job = g_new0(ImageChunkJob, 1);
+            job->seq = next_read;
+            job->entry = g_array_index(chunks, ImageIndexEntry, next_read);
+            io_pace(job->entry.raw_length);
+            job->raw = g_malloc(job->entry.raw_length);
+            if (!read_exact_at(src, job->raw, job->entry.raw_length, job->entry.device_offset)) {
+                g_printerr("\nRead error at byte %" G_GUINT64_FORMAT ": %s\n", job->entry.device_offset, g_strerror(errno));
+                free_image_chunk_job(job);
+                ok = FALSE;
+                break;
+            }
+            g_async_queue_push(pool->jobs, job);
+            next_read++;
+            pending++;
+            continue;
+        }
+        ImageChunkJob *job = g_async_queue_pop(pool->done);
+        pending--;
+        reorder[job->seq % window] = job;
+        while (ok && reorder[next_write % window] && reorder[next_write % window]->seq == next_write) {
+            ImageChunkJob *ready = reorder[next_write % window];
+            ImageIndexEntry *c = &g_array_index(chunks, ImageIndexEntry, next_write);
+            reorder[next_write % window] = NULL;
+            *c = ready->entry;
+            memcpy(digests + (gsize)next_write * DAIMG_DIGEST_SIZE, ready->digest, DAIMG_DIGEST_SIZE);
+            /* Zero blocks become holes in the image file. */
+            if (c->flags & DAIMG_CHUNK_ZERO) ok = lseek(out, (off_t)c->raw_length, SEEK_CUR) >= 0;
+            else ok = write_all(out, ready->raw, c->raw_length);
+            if (!ok) g_printerr("\nWrite error at byte %" G_GUINT64_FORMAT ": %s\n", c->device_offset, g_strerror(errno));
+            done += c->raw_length;
+            if (ok) image_journal_add(journal, c);
+            free_image_chunk_job(ready);
+            next_write++;
+        }
+        if (ok && image_journal_due(journal)) ok = ftruncate(out, (off_t)done) == 0 && image_journal_commit(journal, out);
+        if (g_get_monotonic_time() - last_report > G_USEC_PER_SEC) {
+            print_transfer_progress("Imaged", done, used, started, FALSE);
+            last_report = g_get_monotonic_time();
+        }
+    }
+    for (; pending > 0; pending--) free_image_chunk_job(g_async_queue_pop(pool->done));
+    for (guint i = 0; i < window; i++)
+        if (reorder[i]) free_image_chunk_job(reorder[i]);
+    g_free(reorder);
+    image_worker_pool_free(pool);
+    if (ok) print_transfer_progress("Imaged", done, used, started, TRUE);
+    if (ok && (ftruncate(out, (off_t)used) != 0 || fsync(out) != 0)) ok = FALSE;
+    close(out);
+    close(src);
+
+    gchar *tree = ok ? image_tree_hash(chunks, digests) : NULL;
+    if (ok) ok = write_image_hashes(image_path, chunks, digests, tree);
+    gchar *map_path = g_strdup_printf("%s.map", image_path);
+    FILE *map = ok ? fopen(map_path, "w") : NULL;
+    if (map) {
+        fprintf(map, "# DriveAssistify block map 1\nsource %s\nfilesystem %s\ndevice_size %" G_GUINT64_FORMAT "\n"
+                "unit %u\nused_bytes %" G_GUINT64_FORMAT "\nextents %u\n", src_path, fs_name, device_size, unit, used, extents->len);
+        for (guint i = 0; i < extents->len; i++) {
+            ImageExtent e = g_array_index(extents, ImageExtent, i);
+            fprintf(map, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT "\n", e.offset, e.length);
+        }
+        ok = fclose(map) == 0;
+    } else if (ok) {
+        g_printerr("Cannot create %s: %s\n", map_path, g_strerror(errno));
+        ok = FALSE;
+    }
+    if (ok) g_printerr("Image: %s\nBlock map: %s\nTree hash: %s\n", image_path, map_path, tree);
+    image_journal_close(journal, ok);
+    g_free(tree);
+    g_free(map_path);
+    g_free(digests);
+    g_array_free(chunks, TRUE);
+    g_array_free(extents, TRUE);
+    return ok ? 0 : 1;
 }
 
-static void on_resize_dialog_destroy(GtkWidget *dialog, gpointer user_data) {
-    ResizeWidgets *widgets = g_object_get_data(G_OBJECT(dialog), "widgets");
-    gchar *partition_name = g_object_get_data(G_OBJECT(dialog), "partition_name");
-    gchar *fstype = g_object_get_data(G_OBJECT(dialog), "fstype");
-    gchar *size = g_object_get_data(G_OBJECT(dialog), "size");
-    gchar *device_path = g_object_get_data(G_OBJECT(dialog), "device_path");
-    if (widgets) g_free(widgets);
-    if (partition_name) g_free(partition_name);
-    if (fstype) g_free(fstype);
-    if (size) g_free(size);
-    if (device_path) g_free(device_path);
+/* Reads "<image>.map"; the extents are returned in image order, which is also device order. */
+static GArray *load_block_map(const gchar *map_path, guint64 *device_size, gchar **fs_name) {
+    gchar *contents = NULL;
+    if (!g_file_get_contents(map_path, &contents, NULL, NULL)) return NULL;
+    GArray *extents = g_array_new(FALSE, FALSE, sizeof(ImageExtent));
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    gboolean valid = g_str_has_prefix(contents, "# DriveAssistify block map 1");
+    *device_size = 0;
+    for (int i = 0; valid && lines[i]; i++) {
+        if (lines[i][0] == '#' || lines[i][0] == '\0') continue;
+        if (g_str_has_prefix(lines[i], "device_size ")) *device_size = g_ascii_strtoull(lines[i] + 12, NULL, 10);
+        else if (g_str_has_prefix(lines[i], "filesystem ") && fs_name) *fs_name = g_strdup(lines[i] + 11);
+        else if (g_ascii_isdigit(lines[i][0])) {
+            gchar *end = NULL;
+            ImageExtent e;
+            e.offset = g_ascii_strtoull(lines[i], &end, 10);
+            e.length = g_ascii_strtoull(end, NULL, 10);
+            g_array_append_val(extents, e);
+        }
+    }
+    g_strfreev(lines);
+    g_free(contents);
+    if (!valid || *device_size == 0) {
+        g_array_free(extents, TRUE);
+        return NULL;
+    }
+    return extents;
 }
 
-static void on_grub_terminal_exited(VteTerminal *terminal, gint status, gpointer user_data) {
-    GtkWidget *window = GTK_WIDGET(user_data);
-    gtk_window_set_title(GTK_WINDOW(window), "Command Finished - You can close this window");
+/* Writes the extents of a packed image back to their offsets on dst; unused areas of dst are left untouched. */
+static int restore_used_blocks(const gchar *image_path, const gchar *dst_path, gboolean target_zeroed, gboolean resume) {
+    gchar *map_path = g_strdup_printf("%s.map", image_path);
+    guint64 device_size = 0;
+    gchar *fs_name = NULL;
+    GArray *extents = load_block_map(map_path, &device_size, &fs_name);
+    if (!extents) {
+        g_printerr("%s is missing or not a DriveAssistify block map\n", map_path);
+        g_free(map_path);
+        return 1;
+    }
+    crc32c_init();
+    guint64 used = 0;
+    GArray *chunks = split_extents_into_chunks(extents, DAIMG_DEFAULT_CHUNK, &used);
+    int in = open(image_path, O_RDONLY);
+    int dst = open(dst_path, O_RDWR);
+    guint64 image_size = in >= 0 ? (guint64)lseek(in, 0, SEEK_END) : 0;
+    guint64 dst_size = dst >= 0 ? (guint64)lseek(dst, 0, SEEK_END) : 0;
+    ImageJournal *journal = NULL;
+    int rc = 1;
+
+    if (in < 0 || dst < 0) {
+        g_printerr("Cannot open %s: %s\n", in < 0 ? image_path : dst_path, g_strerror(errno));
+    } else if (dst_size < device_size) {
+        g_printerr("%s is %" G_GUINT64_FORMAT " bytes, but the image needs %" G_GUINT64_FORMAT " bytes\n",
+                   dst_path, dst_size, device_size);
+    } else {
+        gboolean failed = FALSE;
+        journal = image_journal_open("restore-used", image_path, dst_path, target_zeroed ? "zeroed" : "-", image_size,
+                                     chunks, 0, resume, &failed);
+        guint start = image_journal_committed(journal);
+        guint64 image_pos = 0;
+        for (guint i = 0; i < start; i++) image_pos += g_array_index(chunks, ImageIndexEntry, i).raw_length;
+        gboolean ok = !failed;
+        if (ok && start > 0) {
+            ImageIndexEntry last = g_array_index(journal->units, ImageIndexEntry, start - 1);
+            ImageIndexEntry *chunk = &g_array_index(chunks, ImageIndexEntry, start - 1);
+            last.raw_length = chunk->raw_length;
+            ok = range_matches_unit(in, image_pos - last.raw_length, &last) && range_matches_unit(dst, chunk->device_offset, &last);
+            if (!ok) g_printerr("The last committed chunk no longer matches the image or the target; start a new job instead\n");
+            else report_resume(start, chunks->len);
+        }
+        if (ok) g_printerr("Restoring %s image: %" G_GUINT64_FORMAT " MiB in %u extents\n", fs_name ? fs_name : "?", used >> 20, extents->len);
+        guchar *buf = g_malloc(DAIMG_DEFAULT_CHUNK);
+        guint64 done = image_pos;
+        gint64 started = g_get_monotonic_time(), last_report = 0;
+        ZeroAwareTarget target;
+        zero_aware_target_init(&target, dst, target_zeroed);
+        for (guint i = start; ok && i < chunks->len; i++) {
+            ImageIndexEntry *c = &g_array_index(chunks, ImageIndexEntry, i);
+            io_pace(c->raw_length);
+            ok = read_exact_at(in, buf, c->raw_length, image_pos) && zero_aware_write(&target, buf, c->raw_length, c->device_offset);
+            if (!ok) g_printerr("\nI/O error at byte %" G_GUINT64_FORMAT ": %s\n", c->device_offset, g_strerror(errno));
+            c->crc = crc32c(0, buf, c->raw_length);
+            image_pos += c->raw_length;
+            done += c->raw_length;
+            if (ok) image_journal_add(journal, c);
+            if (ok && image_journal_due(journal)) ok = flush_zero_range(&target) && image_journal_commit(journal, dst);
+            if (g_get_monotonic_time() - last_report > G_USEC_PER_SEC) {
+                print_transfer_progress("Restored", done, used, started, FALSE);
+                last_report = g_get_monotonic_time();
+            }
+        }
+        if (ok && zero_aware_finish(&target)) {
+            print_transfer_progress("Restored", done, used, started, TRUE);
+            rc = 0;
+        }
+        g_free(buf);
+    }
+
+    image_journal_close(journal, rc == 0);
+    if (in >= 0) close(in);
+    if (dst >= 0) close(dst);
+    g_free(fs_name);
+    g_array_free(chunks, TRUE);
+    g_array_free(extents, TRUE);
+    g_free(map_path);
+    return rc;
 }
 
-void on_grub_uefi_install_activate(GtkWidget *menuitem, gpointer user_data) {
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-    GtkTreeModel *model;
-    GtkTreeIter iter;
-    gchar *partition_name = NULL, *mountpoint = NULL;
+/* Restores a raw image in 4 MiB chunks. Chunks inside holes of the image file (SEEK_DATA) are not read at all, and
+ * zero chunks are not written; both become BLKZEROOUT or punched holes unless the target is already zeroed. */
+static int restore_raw_image(const gchar *image_path, const gchar *dst_path, gboolean target_zeroed, gboolean resume) {
+    int in = open(image_path, O_RDONLY);
+    int dst = open(dst_path, O_RDWR);
+    if (in < 0 || dst < 0) {
+        g_printerr("Cannot open %s: %s\n", in < 0 ? image_path : dst_path, g_strerror(errno));
+        if (in >= 0) close(in);
+        if (dst >= 0) close(dst);
+        return 1;
+    }
+    crc32c_init();
+    guint64 size = (guint64)lseek(in, 0, SEEK_END);
+    guint64 dst_size = (guint64)lseek(dst, 0, SEEK_END);
+    if (dst_size < size) {
+        g_printerr("%s is %" G_GUINT64_FORMAT " bytes, but the image needs %" G_GUINT64_FORMAT " bytes\n", dst_path, dst_size, size);
+        close(in);
+        close(dst);
+        return 1;
+    }
 
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+    guint chunk_count = (guint)((size + DAIMG_DEFAULT_CHUNK - 1) / DAIMG_DEFAULT_CHUNK);
+    gboolean failed = FALSE;
+    ImageJournal *journal = image_journal_open("restore-raw", image_path, dst_path, target_zeroed ? "zeroed" : "-", size,
+                                               NULL, chunk_count, resume, &failed);
+    guint start = image_journal_committed(journal);
+    gboolean ok = !failed;
+    if (ok && start > 0) {
+        ImageIndexEntry last = g_array_index(journal->units, ImageIndexEntry, start - 1);
+        guint64 offset = (guint64)(start - 1) * DAIMG_DEFAULT_CHUNK;
+        last.raw_length = (guint32)MIN((guint64)DAIMG_DEFAULT_CHUNK, size - offset);
+        ok = range_matches_unit(in, offset, &last) && range_matches_unit(dst, offset, &last);
+        if (!ok) g_printerr("The last committed chunk no longer matches the image or the target; start a new job instead\n");
+        else report_resume(start, chunk_count);
+    }
 
-        gtk_tree_model_get(model, &iter,
-                           COL_NAME, &partition_name,
-                           COL_MOUNTPOINT, &mountpoint,
-                           -1);
+    ZeroAwareTarget target;
+    zero_aware_target_init(&target, dst, target_zeroed);
+    guchar *buf = g_malloc(DAIMG_DEFAULT_CHUNK);
+    guint32 zero_crc = 0;
+    guint64 pos = (guint64)start * DAIMG_DEFAULT_CHUNK;
+    gint64 started = g_get_monotonic_time(), last_report = 0;
+    for (guint i = start; ok && i < chunk_count; i++, pos += DAIMG_DEFAULT_CHUNK) {
+        ImageIndexEntry c = {0};
+        c.device_offset = pos;
+        c.raw_length = (guint32)MIN((guint64)DAIMG_DEFAULT_CHUNK, size - pos);
+        off_t data = lseek(in, (off_t)pos, SEEK_DATA);
+        if (data < 0 || (guint64)data >= pos + c.raw_length) {
+            if (c.raw_length == DAIMG_DEFAULT_CHUNK && zero_crc == 0) {
+                memset(buf, 0, DAIMG_DEFAULT_CHUNK);
+                zero_crc = crc32c(0, buf, DAIMG_DEFAULT_CHUNK);
+            }
+            if (c.raw_length == DAIMG_DEFAULT_CHUNK) {
+                c.crc = zero_crc;
+            } else {
+                memset(buf, 0, c.raw_length);
+                c.crc = crc32c(0, buf, c.raw_length);
+            }
+            ok = zero_aware_zero(&target, pos, c.raw_length);
+        } else {
+            io_pace(c.raw_length);
+            ok = read_exact_at(in, buf, c.raw_length, pos) && zero_aware_write(&target, buf, c.raw_length, pos);
+            c.crc = crc32c(0, buf, c.raw_length);
+        }
+        if (!ok) g_printerr("\nI/O error at byte %" G_GUINT64_FORMAT ": %s\n", pos, g_strerror(errno));
+        if (ok) image_journal_add(journal, &c);
+        if (ok && image_journal_due(journal)) ok = flush_zero_range(&target) && image_journal_commit(journal, dst);
+        if (g_get_monotonic_time() - last_report > G_USEC_PER_SEC) {
+            print_transfer_progress("Restored", pos + c.raw_length, size, started, FALSE);
+            last_report = g_get_monotonic_time();
+        }
+    }
+    ok = ok && zero_aware_finish(&target);
+    if (ok) {
+        print_transfer_progress("Restored", size, size, started, TRUE);
+        g_printerr("%" G_GUINT64_FORMAT " MiB were zero ranges (%s)\n", target.zeroed_bytes >> 20,
+                   target_zeroed ? "skipped" : (target.is_block ? "BLKZEROOUT" : "punched holes"));
+    }
+    image_journal_close(journal, ok);
+    g_free(buf);
+    close(in);
+    close(dst);
+    return ok ? 0 : 1;
+}
 
-        gchar *device_path        = g_strdup_printf("/dev/%s", partition_name);
-        gchar *mount_dir          = g_strdup("/mnt/driveassistify_grub");
-        gchar *quoted_device_path = g_shell_quote(device_path);
-        gchar *quoted_mountpoint  = mountpoint ? g_shell_quote(mountpoint) : g_strdup("''");
+/* Path of the running binary, so terminal commands can call its headless modes through sudo. */
+static gchar *get_self_executable(void) {
+    gchar *self = g_file_read_link("/proc/self/exe", NULL);
+    return self ? self : g_strdup("DriveAssistify");
+}
 
-        GtkWidget *warn = gtk_message_dialog_new(
-            NULL,
-            GTK_DIALOG_MODAL,
-            GTK_MESSAGE_WARNING,
-            GTK_BUTTONS_OK_CANCEL,
-            "WARNING: This is a potentially destructive operation!\n\n"
-            "Installing GRUB2 to a UEFI partition.\n"
-            "If you select the wrong partition, your system may become unbootable.\n\n"
-            "Target partition: %s\n\n"
-            "Are you sure you want to continue?",
-            device_path
-        );
+/* "sudo <self> <mode> 'first' 'second' <extra>" for the imaging helper modes handled in main(). */
+static gchar *build_image_helper_command(const gchar *mode, const gchar *first, const gchar *second, const gchar *extra) {
+    gchar *self = get_self_executable();
+    gchar *quoted_self = g_shell_quote(self);
+    gchar *quoted_first = g_shell_quote(first);
+    gchar *quoted_second = g_shell_quote(second);
+    gchar *cmd = g_strdup_printf(IO_HELPER_SUDO " %s %s %s %s%s%s", quoted_self, mode, quoted_first, quoted_second,
+                                 extra && *extra ? " " : "", extra ? extra : "");
+    g_free(quoted_second);
+    g_free(quoted_first);
+    g_free(quoted_self);
+    g_free(self);
+    return cmd;
+}
 
-        gint response = gtk_dialog_run(GTK_DIALOG(warn));
-        gtk_widget_destroy(warn);
+/* Images the used extents of src into a compressed .daimg file. Chunks are hashed and compressed on a worker pool
+ * and written in order through a reorder window, so the reader never waits for a single slow chunk. With a base
+ * image, chunks whose SHA-256 matches the base chunk at the same offset are only referenced (differential image). */
+static int image_compressed(const gchar *src_path, const gchar *image_path, int level, guint threads, const gchar *base_path,
+                            gboolean resume) {
+    int src = open(src_path, O_RDONLY);
+    if (src < 0) {
+        g_printerr("Cannot open %s: %s\n", src_path, g_strerror(errno));
+        return 1;
+    }
+    crc32c_init();
+    ImageHeader h = {0};
+    h.codec = DAIMG_CODEC_ZSTD;
+    h.chunk_size = DAIMG_DEFAULT_CHUNK;
+    h.level = (guint32)level;
+    h.flags = DAIMG_IMAGE_HASHES;
+    h.device_size = (guint64)lseek(src, 0, SEEK_END);
+
+    /* A differential image only needs the index and chunk hashes of its base; the base chunk data is never read. */
+    ImageHeader base_h = {0};
+    GArray *base_index = NULL;
+    guchar *base_digests = NULL;
+    char *base_abs = NULL;
+    if (base_path) {
+        int base_fd = open(base_path, O_RDONLY);
+        base_index = base_fd >= 0 ? load_image_index(base_fd, &base_h) : NULL;
+        base_digests = base_index ? load_image_digests(base_fd, &base_h) : NULL;
+        base_abs = realpath(base_path, NULL);
+        if (base_fd >= 0) close(base_fd);
+        if (!base_digests || !base_abs || strlen(base_abs) > 4096 || base_h.device_size != h.device_size ||
+            base_h.chunk_size != h.chunk_size) {
+            if (!base_digests) g_printerr("%s cannot be used as a base: it is not a .daimg image with chunk hashes\n", base_path);
+            else g_printerr("%s cannot be used as a base: it is an image of a %" G_GUINT64_FORMAT " MiB partition, %s is %" G_GUINT64_FORMAT " MiB\n",
+                            base_path, base_h.device_size >> 20, src_path, h.device_size >> 20);
+            if (base_index) g_array_free(base_index, TRUE);
+            g_free(base_digests);
+            free(base_abs);
+            close(src);
+            return 1;
+        }
+        h.flags |= DAIMG_IMAGE_DIFF;
+    }
 
-        if (response == GTK_RESPONSE_OK) {
+    const gchar *fs_name = NULL;
+    guint64 used = 0;
+    GArray *extents = get_used_extents(src, h.device_size, &fs_name, &h.unit);
+    g_strlcpy(h.fs_name, fs_name, sizeof(h.fs_name));
+    GArray *chunks = split_extents_into_chunks(extents, h.chunk_size, &used);
+    g_array_free(extents, TRUE);
+    h.chunk_count = chunks->len;
+    g_printerr("%s: %s file system, %" G_GUINT64_FORMAT " MiB in use, %u chunks, zstd level %d, %u threads\n",
+               src_path, fs_name, used >> 20, chunks->len, level, threads);
+    if (base_abs) g_printerr("Differential image against %s\n", base_abs);
+
+    gboolean failed = FALSE;
+    gchar *params = base_abs ? g_strdup_printf("%d %s", level, base_abs) : g_strdup_printf("%d", level);
+    ImageJournal *journal = image_journal_open(base_abs ? "image-diff" : "image-compressed", src_path, image_path, params,
+                                               h.device_size, chunks, 0, resume, &failed);
+    g_free(params);
+    int out = failed ? -1 : open(image_path, O_RDWR | O_CREAT | (resume ? 0 : O_TRUNC), 0644);
+    if (out < 0) {
+        if (!failed) g_printerr("Cannot create %s: %s\n", image_path, g_strerror(errno));
+        image_journal_close(journal, FALSE);
+        g_array_free(chunks, TRUE);
+        if (base_index) g_array_free(base_index, TRUE);
+        g_free(base_digests);
+        free(base_abs);
+        close(src);
+        return 1;
+    }
 
-            gchar *command = g_strdup_printf(
-                "echo '========================================='; "
-                "echo 'Starting UEFI GRUB installation'; "
-                "echo 'Target device: %s'; "
-                "echo 'Mount directory: %s'; "
-                "echo '-----------------------------------------'; "
+    /* Chunks committed by an earlier run keep the stored offsets, lengths and checksums from the journal. */
+    guint start = image_journal_committed(journal);
+    guint64 stored_offset = DAIMG_HEADER_SIZE, stored_total = 0, done = 0, changed = 0;
+    guchar *digests = g_malloc0((gsize)chunks->len * DAIMG_DIGEST_SIZE + 1);
+    for (guint i = 0; i < start; i++) {
+        ImageIndexEntry *c = &g_array_index(chunks, ImageIndexEntry, i);
+        ImageIndexEntry *j = &g_array_index(journal->units, ImageIndexEntry, i);
+        c->stored_offset = j->stored_offset;
+        c->stored_length = j->stored_length;
+        c->flags = j->flags;
+        c->crc = j->crc;
+        stored_offset = c->stored_offset + c->stored_length;
+        stored_total += c->stored_length;
+        done += c->raw_length;
+        if (!(c->flags & DAIMG_CHUNK_BASE)) changed += c->raw_length;
+    }
+    gboolean ok = TRUE;
+    if (start > 0) {
+        /* The chunk hashes are not journaled: committed chunks are decoded again to recover them, which also checks them. */
+        ImageIndexEntry *last = &g_array_index(chunks, ImageIndexEntry, start - 1);
+        guchar *raw = g_malloc(h.chunk_size + 1);
+        ZSTD_DCtx *dctx = ZSTD_createDCtx();
+        ok = range_matches_unit(src, last->device_offset, last);
+        for (guint i = 0; ok && i < start; i++) {
+            ImageIndexEntry *c = &g_array_index(chunks, ImageIndexEntry, i);
+            guchar *digest = digests + (gsize)i * DAIMG_DIGEST_SIZE;
+            if (c->flags & DAIMG_CHUNK_BASE) {
+                gint b = base_index ? find_image_chunk(base_index, c->device_offset, c->raw_length) : -1;
+                ok = b >= 0;
+                if (ok) memcpy(digest, base_digests + (gsize)b * DAIMG_DIGEST_SIZE, DAIMG_DIGEST_SIZE);
+            } else if (!(c->flags & DAIMG_CHUNK_ZERO)) {
+                ok = c->raw_length <= h.chunk_size && decode_image_chunk(dctx, out, c, raw);
+                if (ok) image_chunk_digest(raw, c->raw_length, digest);
+            }
+        }
+        ZSTD_freeDCtx(dctx);
+        g_free(raw);
+        if (!ok) g_printerr("The committed chunks no longer match the source or the image; start a new job instead\n");
+        else report_resume(start, chunks->len);
+    }
+    guchar header_buf[DAIMG_HEADER_SIZE];
+    encode_image_header(&h, header_buf);
+    if (ok && start == 0) ok = ftruncate(out, 0) == 0 && write_all(out, header_buf, sizeof(header_buf));
+    else if (ok) ok = ftruncate(out, (off_t)stored_offset) == 0 && lseek(out, (off_t)stored_offset, SEEK_SET) >= 0;
+
+    ImageWorkerPool *pool = image_worker_pool_new(threads, level, IMAGE_WORK_COMPRESS, NULL);
+    guint window = pool->thread_count * 2 + 2;
+    ImageChunkJob **reorder = g_new0(ImageChunkJob *, window);
+    guint64 next_read = start, next_write = start, in_flight = 0, pending = 0;
+    gint64 started = g_get_monotonic_time(), last_report = 0;
+
+    while (ok && next_write < chunks->len) {
+        if (next_read < chunks->len && in_flight < window) {
+            ImageChunkJob *job = g_new0(ImageChunkJob, 1);
+            job->seq = next_read;
+            job->entry = g_array_index(chunks, ImageIndexEntry, next_read);
+            gint b = base_index ? find_image_chunk(base_index, job->entry.device_offset, job->entry.raw_length) : -1;
+            if (b >= 0 && !(g_array_index(base_index, ImageIndexEntry, b).flags & DAIMG_CHUNK_ZERO)) {
+                job->has_base = TRUE;
+                memcpy(job->base_digest, base_digests + (gsize)b * DAIMG_DIGEST_SIZE, DAIMG_DIGEST_SIZE);
+            }
+            io_pace(job->entry.raw_length);
+            job->raw = g_malloc(job->entry.raw_length);
+            if (!read_exact_at(src, job->raw, job->entry.raw_length, job->entry.device_offset)) {
+                g_printerr("\nRead error at byte %" G_GUINT64_FORMAT ": %s\n", job->entry.device_offset, g_strerror(errno));
+                free_image_chunk_job(job);
+                ok = FALSE;
+                break;
+            }
+            g_async_queue_push(pool->jobs, job);
+            next_read++;
+            in_flight++;
+            pending++;
+            continue;
+        }
+        ImageChunkJob *job = g_async_queue_pop(pool->done);
+        pending--;
+        reorder[job->seq % window] = job;
+        while (ok && reorder[next_write % window] && reorder[next_write % window]->seq == next_write) {
+            ImageChunkJob *ready = reorder[next_write % window];
+            reorder[next_write % window] = NULL;
+            ready->entry.stored_offset = stored_offset;
+            ok = write_all(out, ready->stored ? ready->stored : ready->raw, ready->entry.stored_length);
+            if (!ok) g_printerr("\nWrite error: %s\n", g_strerror(errno));
+            stored_offset += ready->entry.stored_length;
+            stored_total += ready->entry.stored_length;
+            done += ready->entry.raw_length;
+            if (!(ready->entry.flags & DAIMG_CHUNK_BASE)) changed += ready->entry.raw_length;
+            g_array_index(chunks, ImageIndexEntry, next_write) = ready->entry;
+            memcpy(digests + (gsize)next_write * DAIMG_DIGEST_SIZE, ready->digest, DAIMG_DIGEST_SIZE);
+            if (ok) image_journal_add(journal, &ready->entry);
+            free_image_chunk_job(ready);
+            next_write++;
+            in_flight--;
+        }
+        if (ok && image_journal_due(journal)) ok = image_journal_commit(journal, out);
+        if (g_get_monotonic_time() - last_report > G_USEC_PER_SEC) {
+            print_transfer_progress("Imaged", done, used, started, FALSE);
+            last_report = g_get_monotonic_time();
+        }
+    }
+    /* After an error, wait for the chunks still being compressed before the pool goes away. */
+    for (; pending > 0; pending--) free_image_chunk_job(g_async_queue_pop(pool->done));
+    for (guint i = 0; i < window; i++)
+        if (reorder[i]) free_image_chunk_job(reorder[i]);
+    g_free(reorder);
+    image_worker_pool_free(pool);
+
+    if (ok) {
+        gsize index_bytes = (gsize)chunks->len * DAIMG_ENTRY_SIZE, digest_bytes = (gsize)chunks->len * DAIMG_DIGEST_SIZE;
+        gsize base_length = base_abs ? strlen(base_abs) : 0, trailer_bytes = digest_bytes + (base_abs ? 8 + base_length : 0);
+        guchar *index = g_malloc0(index_bytes + trailer_bytes + 1);
+        for (guint i = 0; i < chunks->len; i++) {
+            ImageIndexEntry e = g_array_index(chunks, ImageIndexEntry, i);
+            guchar *p = index + (gsize)i * DAIMG_ENTRY_SIZE;
+            put_le64(p, e.device_offset);
+            put_le64(p + 8, e.stored_offset);
+            put_le32(p + 16, e.stored_length);
+            put_le32(p + 20, e.raw_length);
+            put_le32(p + 24, e.flags);
+            put_le32(p + 28, e.crc);
+        }
+        memcpy(index + index_bytes, digests, digest_bytes);
+        if (base_abs) {
+            guchar *p = index + index_bytes + digest_bytes;
+            put_le32(p, base_h.index_crc);
+            put_le32(p + 4, (guint32)base_length);
+            memcpy(p + 8, base_abs, base_length);
+        }
+        h.index_offset = stored_offset;
+        h.index_crc = crc32c(0, index, index_bytes + trailer_bytes);
+        encode_image_header(&h, header_buf);
+        ok = write_all(out, index, index_bytes + trailer_bytes) && pwrite(out, header_buf, sizeof(header_buf), 0) == sizeof(header_buf) &&
+             fsync(out) == 0;
+        g_free(index);
+    }
+    if (ok) {
+        gchar *tree = image_tree_hash(chunks, digests);
+        print_transfer_progress("Imaged", done, used, started, TRUE);
+        g_printerr("Tree hash: %s\n", tree);
+        g_free(tree);
+        if (base_abs)
+            g_printerr("Image: %s (%" G_GUINT64_FORMAT " MiB); %" G_GUINT64_FORMAT " MiB of %" G_GUINT64_FORMAT
+                       " MiB changed since the base image\n", image_path, stored_total >> 20, changed >> 20, used >> 20);
+        else
+            g_printerr("Image: %s (%" G_GUINT64_FORMAT " MiB, %.1f%% of the used data)\n", image_path, stored_total >> 20,
+                       used ? 100.0 * stored_total / used : 0.0);
+    }
+    image_journal_close(journal, ok);
+    close(out);
+    close(src);
+    g_free(digests);
+    if (base_index) g_array_free(base_index, TRUE);
+    g_free(base_digests);
+    free(base_abs);
+    g_array_free(chunks, TRUE);
+    return ok ? 0 : 1;
+}
 
-                "echo 'Unmounting previous mount (if any)...'; "
+/* Restores a .daimg file to dst. Chunks are decompressed and checked on the worker pool and written at their
+ * device offsets as they complete; the journal only advances over the contiguous run of finished chunks.
+ * Unchanged chunks of a differential image are read from its base chain. */
+static int restore_compressed(const gchar *image_path, const gchar *dst_path, guint threads, gboolean target_zeroed, gboolean resume) {
+    ImageChain chain;
+    if (!image_chain_open(&chain, image_path)) return 1;
+    int in = chain.fds[0];
+    ImageHeader h = chain.headers[0];
+    GArray *index = chain.indexes[0];
+    if (chain.depth > 1) g_printerr("Differential image on top of %u base image(s)\n", chain.depth - 1);
+    int dst = open(dst_path, O_RDWR);
+    guint64 image_size = (guint64)lseek(in, 0, SEEK_END);
+    guint64 dst_size = dst >= 0 ? (guint64)lseek(dst, 0, SEEK_END) : 0;
+    guint64 used = 0;
+    for (guint i = 0; i < index->len; i++) used += g_array_index(index, ImageIndexEntry, i).raw_length;
+    ImageJournal *journal = NULL;
+    int rc = 1;
+
+    if (dst < 0) {
+        g_printerr("Cannot open %s: %s\n", dst_path, g_strerror(errno));
+    } else if (dst_size < h.device_size) {
+        g_printerr("%s is %" G_GUINT64_FORMAT " bytes, but the image needs %" G_GUINT64_FORMAT " bytes\n",
+                   dst_path, dst_size, h.device_size);
+    } else {
+        gboolean failed = FALSE;
+        journal = image_journal_open("restore-image", image_path, dst_path, target_zeroed ? "zeroed" : "-", image_size,
+                                     index, 0, resume, &failed);
+        guint start = image_journal_committed(journal);
+        gboolean ok = !failed;
+        if (ok && start > 0) {
+            ImageIndexEntry *last = &g_array_index(index, ImageIndexEntry, start - 1);
+            guint last_level = 0;
+            const ImageIndexEntry *data = image_chain_resolve(&chain, last, &last_level);
+            guchar *raw = g_malloc(last->raw_length + 1);
+            ZSTD_DCtx *dctx = ZSTD_createDCtx();
+            ok = data && decode_image_chunk(dctx, chain.fds[last_level], data, raw) && range_matches_unit(dst, last->device_offset, last);
+            ZSTD_freeDCtx(dctx);
+            g_free(raw);
+            if (!ok) g_printerr("The last committed chunk no longer matches the image or the target; start a new job instead\n");
+            else report_resume(start, index->len);
+        }
+        if (ok) g_printerr("Restoring %s image: %" G_GUINT64_FORMAT " MiB in %u chunks, %u threads\n", h.fs_name, used >> 20, index->len, threads);
+        ImageWorkerPool *pool = image_worker_pool_new(threads, 0, IMAGE_WORK_DECOMPRESS, NULL);
+        ZeroAwareTarget target;
+        zero_aware_target_init(&target, dst, target_zeroed);
+        guint window = pool->thread_count * 2 + 2;
+        guint8 *finished = g_new0(guint8, index->len + 1);
+        guint64 next_read = start, next_journal = start, in_flight = 0, done = 0;
+        for (guint i = 0; i < start; i++) done += g_array_index(index, ImageIndexEntry, i).raw_length;
+        gint64 started = g_get_monotonic_time(), last_report = 0;
+        while (!failed && (next_read < index->len || in_flight > 0)) {
+            if (ok && next_read < index->len && in_flight < window) {
+                ImageChunkJob *job = g_new0(ImageChunkJob, 1);
+                guint data_level = 0;
+                const ImageIndexEntry *data = image_chain_resolve(&chain, &g_array_index(index, ImageIndexEntry, next_read), &data_level);
+                job->seq = next_read++;
+                if (data) job->entry = *data;
+                io_pace(job->entry.raw_length);
+                job->stored = g_malloc(job->entry.stored_length + 1);
+                if (!data || !read_exact_at(chain.fds[data_level], job->stored, job->entry.stored_length, job->entry.stored_offset)) {
+                    g_printerr("\nCannot read chunk %" G_GUINT64_FORMAT " of the image\n", job->seq);
+                    free_image_chunk_job(job);
+                    ok = FALSE;
+                    continue;
+                }
+                g_async_queue_push(pool->jobs, job);
+                in_flight++;
+                continue;
+            }
+            if (!ok && in_flight == 0) break;
+            ImageChunkJob *job = g_async_queue_pop(pool->done);
+            in_flight--;
+            if (ok && job->failed) {
+                g_printerr("\nChunk %" G_GUINT64_FORMAT " (device offset %" G_GUINT64_FORMAT ") failed its checksum\n",
+                           job->seq, job->entry.device_offset);
+                ok = FALSE;
+            } else if (ok && !(job->raw ? zero_aware_write(&target, job->raw, job->entry.raw_length, job->entry.device_offset)
+                                        : zero_aware_zero(&target, job->entry.device_offset, job->entry.raw_length))) {
+                g_printerr("\nWrite error at byte %" G_GUINT64_FORMAT ": %s\n", job->entry.device_offset, g_strerror(errno));
+                ok = FALSE;
+            } else if (ok) {
+                finished[job->seq] = 1;
+            }
+            done += job->entry.raw_length;
+            free_image_chunk_job(job);
+            for (; ok && next_journal < index->len && finished[next_journal]; next_journal++)
+                image_journal_add(journal, &g_array_index(index, ImageIndexEntry, next_journal));
+            if (ok && image_journal_due(journal)) ok = flush_zero_range(&target) && image_journal_commit(journal, dst);
+            if (g_get_monotonic_time() - last_report > G_USEC_PER_SEC) {
+                print_transfer_progress("Restored", done, used, started, FALSE);
+                last_report = g_get_monotonic_time();
+            }
+        }
+        image_worker_pool_free(pool);
+        g_free(finished);
+        if (ok && zero_aware_finish(&target)) {
+            print_transfer_progress("Restored", done, used, started, TRUE);
+            rc = 0;
+        }
+    }
+    image_journal_close(journal, rc == 0);
+    if (dst >= 0) close(dst);
+    image_chain_close(&chain);
+    return rc;
+}
 
-                "if mount | grep -q '%s '; then "
-                "  echo 'Trying normal umount with timeout...'; "
-                "  for i in 1 2; do "
-                "    timeout 15 umount %s && break || { "
-                "      echo 'Attempt $i failed, retrying in 2s...'; "
-                "      sleep 2; "
-                "    }; "
-                "  done; "
-                "  if mount | grep -q '%s '; then "
-                "    echo 'ERROR: Could not unmount the device.'; "
-                "    echo 'You may need to unmount manually using:'; "
-                "    echo '   umount %s'; "
-                "    echo '   umount -l %s   (lazy)'; "
-                "    echo '   umount -f %s   (force)'; "
-                "    echo 'Aborting.'; "
-                "    echo; "
-                "    echo 'This window can now be closed.'; "
-                "    read -p 'Press Enter to close...'; "
-                "    exit 1; "
-                "  fi; "
-                "else "
-                "  echo 'Device not mounted — OK'; "
-                "fi; "
+/* Random access: decompresses only the chunks that overlap [offset, offset + length); unused areas read as zeros. */
+static gboolean read_image_range(ImageChain *chain, guint64 offset, guchar *buf, gsize length) {
+    GArray *index = chain->indexes[0];
+    memset(buf, 0, length);
+    guint lo = 0, hi = index->len;
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        ImageIndexEntry *e = &g_array_index(index, ImageIndexEntry, mid);
+        if (e->device_offset + e->raw_length <= offset) lo = mid + 1;
+        else hi = mid;
+    }
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+    guchar *raw = g_malloc(chain->headers[0].chunk_size + 1);
+    gboolean ok = TRUE;
+    for (guint i = lo; ok && i < index->len; i++) {
+        ImageIndexEntry *e = &g_array_index(index, ImageIndexEntry, i);
+        if (e->device_offset >= offset + length) break;
+        guint level = 0;
+        const ImageIndexEntry *data = image_chain_resolve(chain, e, &level);
+        if (data && (data->flags & DAIMG_CHUNK_ZERO)) continue;
+        ok = data && e->raw_length <= chain->headers[0].chunk_size && decode_image_chunk(dctx, chain->fds[level], data, raw);
+        if (ok) {
+            guint64 from = MAX(offset, e->device_offset), to = MIN(offset + length, e->device_offset + e->raw_length);
+            memcpy(buf + (from - offset), raw + (from - e->device_offset), to - from);
+        }
+    }
+    g_free(raw);
+    ZSTD_freeDCtx(dctx);
+    return ok;
+}
 
-                "echo 'Creating temporary mount directory...'; "
-                "mkdir -p %s; "
+/* Writes length bytes of the imaged device, starting at offset, to stdout. */
+static int read_image_to_stdout(const gchar *image_path, guint64 offset, guint64 length) {
+    ImageChain chain;
+    if (!image_chain_open(&chain, image_path)) return 1;
+    guint64 device_size = chain.headers[0].device_size;
+    if (offset > device_size) offset = device_size;
+    length = MIN(length, device_size - offset);
+    guchar *buf = g_malloc(1 << 20);
+    gboolean ok = TRUE;
+    for (guint64 pos = 0; ok && pos < length; pos += 1 << 20) {
+        gsize n = (gsize)MIN((guint64)(1 << 20), length - pos);
+        ok = read_image_range(&chain, offset + pos, buf, n) && write_all(STDOUT_FILENO, buf, n);
+    }
+    if (!ok) g_printerr("Cannot read the requested range of %s\n", image_path);
+    g_free(buf);
+    image_chain_close(&chain);
+    return ok ? 0 : 1;
+}
 
-                "echo 'Mounting target partition (vfat)...'; "
-                "mount -t vfat %s %s || { "
-                "  echo 'ERROR: Failed to mount partition! Aborting.'; "
-                "  echo; "
-                "  echo 'This window can now be closed.'; "
-                "  read -p 'Press Enter to close...'; "
-                "  exit 1; "
-                "}; "
+static gboolean is_compressed_image(const gchar *path) {
+    gchar magic[8] = {0};
+    FILE *f = fopen(path, "rb");
+    if (!f) return FALSE;
+    gboolean match = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, DAIMG_MAGIC, 8) == 0;
+    fclose(f);
+    return match;
+}
 
-                "echo 'Ensuring boot directory exists...'; "
-                "mkdir -p %s/boot; "
+/* Deduplicating image repository. An image is a text manifest listing its chunks in device order; chunk data is
+ * stored once per content as <repository>/chunks/xx/<sha256>, prefixed with 'Z' (zstd) or 'R' (stored as is).
+ * Chunk boundaries come from a gear rolling hash over the used extents, so an insertion only moves nearby cuts. */
+#define REPO_MANIFEST_MAGIC "# DriveAssistify manifest 1"
+#define REPO_CDC_MIN (256 * 1024)
+#define REPO_CDC_AVG (1024 * 1024)
+#define REPO_CDC_MAX DAIMG_DEFAULT_CHUNK
+/* Normalized chunking: a stricter mask below the average size and a looser one above it keeps sizes close to the average. */
+#define REPO_CDC_MASK_HARD (~G_GUINT64_CONSTANT(0) << (64 - 22))
+#define REPO_CDC_MASK_EASY (~G_GUINT64_CONSTANT(0) << (64 - 18))
+
+static guint64 repo_gear[256];
+
+/* The gear table is fixed (splitmix64 from a constant seed), so the same data is cut the same way on every machine. */
+static void repo_gear_init(void) {
+    if (repo_gear[0]) return;
+    guint64 x = G_GUINT64_CONSTANT(0x4472697665417369);
+    for (int i = 0; i < 256; i++) {
+        guint64 z = (x += G_GUINT64_CONSTANT(0x9E3779B97F4A7C15));
+        z = (z ^ (z >> 30)) * G_GUINT64_CONSTANT(0xBF58476D1CE4E5B9);
+        z = (z ^ (z >> 27)) * G_GUINT64_CONSTANT(0x94D049BB133111EB);
+        repo_gear[i] = z ^ (z >> 31);
+    }
+}
 
-                "echo 'Running grub-install...'; "
-                "grub-install --target=x86_64-efi "
-                "             --efi-directory=%s "
-                "             --boot-directory=%s/boot "
-                "             --removable --no-nvram || { "
-                "    echo 'ERROR: grub-install failed! Unmounting...'; "
-                "    timeout 15 umount %s 2>/dev/null; "
-                "    echo; "
-                "    echo 'This window can now be closed.'; "
-                "    read -p 'Press Enter to close...'; "
-                "    exit 1; "
-                "}; "
+/* Returns the length of the next chunk of data; the high hash bits depend on the last 64 bytes only. */
+static gsize repo_cut_point(const guchar *data, gsize length) {
+    if (length <= REPO_CDC_MIN) return length;
+    gsize end = MIN(length, (gsize)REPO_CDC_MAX), normal = MIN(end, (gsize)REPO_CDC_AVG), i = REPO_CDC_MIN;
+    guint64 hash = 0;
+    for (; i < normal; i++) {
+        hash = (hash << 1) + repo_gear[data[i]];
+        if (!(hash & REPO_CDC_MASK_HARD)) return i + 1;
+    }
+    for (; i < end; i++) {
+        hash = (hash << 1) + repo_gear[data[i]];
+        if (!(hash & REPO_CDC_MASK_EASY)) return i + 1;
+    }
+    return end;
+}
 
-                "echo 'Unmounting...'; "
-                "timeout 15 umount %s; "
+static gchar *repo_chunk_path(const gchar *chunk_dir, const gchar *hash) {
+    gchar prefix[3] = {hash[0], hash[1], 0};
+    return g_build_filename(chunk_dir, prefix, hash, NULL);
+}
 
-                "echo 'Removing temporary directory...'; "
-                "rmdir %s; "
+static gchar *repo_chunk_dir(const gchar *manifest_path) {
+    gchar *repo_dir = g_path_get_dirname(manifest_path);
+    gchar *chunk_dir = g_build_filename(repo_dir, "chunks", NULL);
+    g_free(repo_dir);
+    return chunk_dir;
+}
 
-                "echo '-----------------------------------------'; "
-                "echo 'UEFI GRUB installation finished successfully.'; "
-                "echo '========================================='; "
-                "echo; "
-                "read -p 'Press Enter to close...';",
+/* Hashes a chunk and, unless the repository already holds that content, compresses it into a new chunk file.
+ * The file is synced under a temporary name and then renamed, so a chunk file is either complete or absent. */
+static void repo_store_chunk(ImageWorkerPool *pool, ZSTD_CCtx *cctx, ImageChunkJob *job) {
+    ImageIndexEntry *e = &job->entry;
+    e->crc = crc32c(0, job->raw, e->raw_length);
+    if (is_zero_block(job->raw, e->raw_length)) {
+        e->flags |= DAIMG_CHUNK_ZERO;
+        g_strlcpy(job->hash, "zero", sizeof(job->hash));
+        return;
+    }
+    gchar *hex = g_compute_checksum_for_data(G_CHECKSUM_SHA256, job->raw, e->raw_length);
+    g_strlcpy(job->hash, hex, sizeof(job->hash));
+    g_free(hex);
+    gchar *path = repo_chunk_path(pool->chunk_dir, job->hash);
+    if (g_file_test(path, G_FILE_TEST_EXISTS)) {
+        g_free(path);
+        return;
+    }
+    size_t bound = ZSTD_compressBound(e->raw_length);
+    job->stored = g_malloc(bound);
+    size_t n = ZSTD_compressCCtx(cctx, job->stored, bound, job->raw, e->raw_length, pool->level);
+    guchar kind = 'Z';
+    const guchar *payload = job->stored;
+    if (ZSTD_isError(n) || n >= e->raw_length) {
+        kind = 'R';
+        payload = job->raw;
+        n = e->raw_length;
+    }
+    gchar *dir = g_path_get_dirname(path);
+    /* A unique temporary name, because other imaging runs may store the same chunk into the shared folder at the same time. */
+    gchar *tmp = g_strdup_printf("%s.tmp-XXXXXX", path);
+    int fd = g_mkdir_with_parents(dir, 0755) == 0 ? g_mkstemp_full(tmp, O_WRONLY, 0644) : -1;
+    gboolean ok = fd >= 0 && write_all(fd, &kind, 1) && write_all(fd, payload, n) && fdatasync(fd) == 0;
+    if (fd >= 0 && close(fd) != 0) ok = FALSE;
+    if (ok) ok = rename(tmp, path) == 0;
+    else unlink(tmp);
+    job->failed = !ok;
+    job->is_new = ok;
+    e->stored_length = (guint32)(n + 1);
+    g_free(tmp);
+    g_free(dir);
+    g_free(path);
+}
 
-                device_path,
-                mount_dir,
+/* Loads a chunk from the repository and checks it against its hash. */
+static void repo_load_chunk(ImageWorkerPool *pool, ZSTD_DCtx *dctx, ImageChunkJob *job) {
+    ImageIndexEntry *e = &job->entry;
+    if (e->flags & DAIMG_CHUNK_ZERO) return;
+    gchar *path = repo_chunk_path(pool->chunk_dir, job->hash);
+    gchar *data = NULL;
+    gsize length = 0;
+    job->failed = TRUE;
+    if (g_file_get_contents(path, &data, &length, NULL) && length > 0) {
+        job->raw = g_malloc(e->raw_length + 1);
+        if (data[0] == 'R' && length - 1 == e->raw_length) {
+            memcpy(job->raw, data + 1, e->raw_length);
+            job->failed = FALSE;
+        } else if (data[0] == 'Z') {
+            size_t n = ZSTD_decompressDCtx(dctx, job->raw, e->raw_length, data + 1, length - 1);
+            job->failed = ZSTD_isError(n) || n != e->raw_length;
+        }
+    }
+    if (!job->failed) {
+        gchar *hex = g_compute_checksum_for_data(G_CHECKSUM_SHA256, job->raw, e->raw_length);
+        job->failed = strcmp(hex, job->hash) != 0;
+        g_free(hex);
+    }
+    g_free(data);
+    g_free(path);
+}
 
-                device_path,
-                device_path,
-                device_path,
-                device_path,
-                device_path,
-                device_path,
+typedef struct {
+    GArray *entries;
+    GPtrArray *hashes;
+    guint64 in_flight;
+    guint64 done;
+    guint64 new_bytes;
+    guint64 new_stored;
+    guint64 zero_bytes;
+    guint new_chunks;
+    gboolean failed;
+} RepoIngest;
+
+static void repo_ingest_collect(ImageWorkerPool *pool, RepoIngest *ingest) {
+    ImageChunkJob *job = g_async_queue_pop(pool->done);
+    ingest->in_flight--;
+    if (job->failed && !ingest->failed) {
+        g_printerr("\nCannot store the chunk at byte %" G_GUINT64_FORMAT " in the repository\n", job->entry.device_offset);
+        ingest->failed = TRUE;
+    }
+    g_array_index(ingest->entries, ImageIndexEntry, job->seq) = job->entry;
+    g_free(g_ptr_array_index(ingest->hashes, job->seq));
+    g_ptr_array_index(ingest->hashes, job->seq) = g_strdup(job->hash);
+    ingest->done += job->entry.raw_length;
+    if (job->entry.flags & DAIMG_CHUNK_ZERO) ingest->zero_bytes += job->entry.raw_length;
+    if (job->is_new) {
+        ingest->new_chunks++;
+        ingest->new_bytes += job->entry.raw_length;
+        ingest->new_stored += job->entry.stored_length;
+    }
+    free_image_chunk_job(job);
+}
 
-                mount_dir,
-                quoted_device_path,
-                mount_dir,
-                mount_dir,
-                mount_dir,
-                mount_dir,
-                mount_dir,
-                mount_dir,
-                mount_dir
-            );
+static gboolean write_repo_manifest(const gchar *manifest_path, const gchar *src_path, const gchar *fs_name, guint64 device_size,
+                                    guint32 unit, guint64 used, GArray *entries, GPtrArray *hashes, const gchar *tree) {
+    gchar *tmp = g_strdup_printf("%s.tmp", manifest_path);
+    FILE *f = fopen(tmp, "w");
+    gboolean ok = f != NULL;
+    if (f) {
+        fprintf(f, "%s\nsource %s\nfilesystem %s\ndevice_size %" G_GUINT64_FORMAT "\nunit %u\nused_bytes %" G_GUINT64_FORMAT
+                "\ntree %s\nchunks %u\n", REPO_MANIFEST_MAGIC, src_path, fs_name, device_size, unit, used, tree, entries->len);
+        for (guint i = 0; i < entries->len; i++) {
+            ImageIndexEntry *e = &g_array_index(entries, ImageIndexEntry, i);
+            fprintf(f, "%" G_GUINT64_FORMAT " %u %s\n", e->device_offset, e->raw_length, (gchar *)g_ptr_array_index(hashes, i));
+        }
+        ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+        if (fclose(f) != 0) ok = FALSE;
+    }
+    if (ok) ok = rename(tmp, manifest_path) == 0;
+    else unlink(tmp);
+    if (!ok) g_printerr("Cannot write %s: %s\n", manifest_path, g_strerror(errno));
+    g_free(tmp);
+    return ok;
+}
 
-            pid_t pid = fork();
-            
-            if (pid == 0) {
-                const gchar *terminals[] = {"gnome-terminal", "konsole", "xfce4-terminal", 
-                                           "mate-terminal", "lxterminal", "xterm", NULL};
-                
-                for (int i = 0; terminals[i]; i++) {
-                    gchar *term_bin = g_find_program_in_path(terminals[i]);
-                    if (term_bin) {
-                        if (g_strcmp0(terminals[i], "gnome-terminal") == 0) {
-                            execlp(term_bin, term_bin, "--", "bash", "-c", command, NULL);
-                        } else {
-                            execlp(term_bin, term_bin, "-e", "bash", "-c", command, NULL);
-                        }
-                        g_free(term_bin);
-                    }
+/* --image-repo: stores the used extents of src in the repository that holds manifest_path, then writes the manifest.
+ * The reader only cuts chunks; hashing, the existence check and compression run on the worker pool. An interrupted
+ * ingest is resumed by running it again, because chunks that already reached the repository are not stored twice. */
+static int image_to_repository(const gchar *src_path, const gchar *manifest_path, int level, guint threads) {
+    int src = open(src_path, O_RDONLY);
+    if (src < 0) {
+        g_printerr("Cannot open %s: %s\n", src_path, g_strerror(errno));
+        return 1;
+    }
+    gchar *chunk_dir = repo_chunk_dir(manifest_path);
+    if (g_mkdir_with_parents(chunk_dir, 0755) != 0) {
+        g_printerr("Cannot create %s: %s\n", chunk_dir, g_strerror(errno));
+        g_free(chunk_dir);
+        close(src);
+        return 1;
+    }
+    repo_gear_init();
+    guint64 device_size = (guint64)lseek(src, 0, SEEK_END), used = 0;
+    const gchar *fs_name = NULL;
+    guint32 unit = 0;
+    GArray *extents = get_used_extents(src, device_size, &fs_name, &unit);
+    for (guint i = 0; i < extents->len; i++) used += g_array_index(extents, ImageExtent, i).length;
+    g_printerr("%s: %s file system, %" G_GUINT64_FORMAT " MiB in use, zstd level %d, %u threads\nRepository: %s\n",
+               src_path, fs_name, used >> 20, level, threads, chunk_dir);
+
+    ImageWorkerPool *pool = image_worker_pool_new(threads, level, IMAGE_WORK_REPO_STORE, chunk_dir);
+    guint window = pool->thread_count * 4;
+    RepoIngest ingest = {0};
+    ingest.entries = g_array_new(FALSE, TRUE, sizeof(ImageIndexEntry));
+    ingest.hashes = g_ptr_array_new_with_free_func(g_free);
+    guchar *buf = g_malloc(2 * REPO_CDC_MAX);
+    gint64 started = g_get_monotonic_time(), last_report = 0;
+
+    for (guint x = 0; !ingest.failed && x < extents->len; x++) {
+        ImageExtent extent = g_array_index(extents, ImageExtent, x);
+        guint64 loaded = 0, consumed = 0;
+        gsize head = 0, have = 0;
+        while (!ingest.failed && consumed < extent.length) {
+            /* Keep at least one maximum-sized chunk buffered so cut points never depend on read sizes. */
+            if (have < REPO_CDC_MAX && loaded < extent.length) {
+                memmove(buf, buf + head, have);
+                head = 0;
+                gsize n = (gsize)MIN((guint64)(2 * REPO_CDC_MAX - have), extent.length - loaded);
+                io_pace(n);
+                if (!read_exact_at(src, buf + have, n, extent.offset + loaded)) {
+                    g_printerr("\nRead error at byte %" G_GUINT64_FORMAT ": %s\n", extent.offset + loaded, g_strerror(errno));
+                    ingest.failed = TRUE;
+                    break;
                 }
-                
-                exit(1);
-            } else if (pid > 0) {
-                g_free(command);
-            } else {
-                g_warning("Failed to fork process");
-                GtkWidget *err = gtk_message_dialog_new(
-                    GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(tree_view))),
-                    GTK_DIALOG_MODAL,
-                    GTK_MESSAGE_ERROR,
-                    GTK_BUTTONS_OK,
-                    "Failed to create new process."
-                );
-                gtk_dialog_run(GTK_DIALOG(err));
-                gtk_widget_destroy(err);
-                g_free(command);
+                have += n;
+                loaded += n;
+            }
+            while (ingest.in_flight >= window) repo_ingest_collect(pool, &ingest);
+            ImageChunkJob *job = g_new0(ImageChunkJob, 1);
+            gsize cut = repo_cut_point(buf + head, have);
+            job->seq = ingest.entries->len;
+            job->entry.device_offset = extent.offset + consumed;
+            job->entry.raw_length = (guint32)cut;
+            job->raw = g_malloc(cut);
+            memcpy(job->raw, buf + head, cut);
+            g_array_append_val(ingest.entries, job->entry);
+            g_ptr_array_add(ingest.hashes, NULL);
+            g_async_queue_push(pool->jobs, job);
+            ingest.in_flight++;
+            head += cut;
+            have -= cut;
+            consumed += cut;
+            if (g_get_monotonic_time() - last_report > G_USEC_PER_SEC) {
+                print_transfer_progress("Imaged", ingest.done, used, started, FALSE);
+                last_report = g_get_monotonic_time();
             }
         }
+    }
+    while (ingest.in_flight > 0) repo_ingest_collect(pool, &ingest);
+    image_worker_pool_free(pool);
+    g_free(buf);
+
+    gchar *tree = NULL;
+    if (!ingest.failed) {
+        guchar *digests = g_malloc0((gsize)ingest.entries->len * DAIMG_DIGEST_SIZE + 1);
+        for (guint i = 0; i < ingest.entries->len; i++)
+            digest_from_hex(g_ptr_array_index(ingest.hashes, i), digests + (gsize)i * DAIMG_DIGEST_SIZE);
+        tree = image_tree_hash(ingest.entries, digests);
+        g_free(digests);
+    }
+    gboolean ok = tree && write_repo_manifest(manifest_path, src_path, fs_name, device_size, unit, used,
+                                              ingest.entries, ingest.hashes, tree);
+    if (ok) {
+        print_transfer_progress("Imaged", ingest.done, used, started, TRUE);
+        g_printerr("Tree hash: %s\n", tree);
+        guint64 known = ingest.done - ingest.new_bytes - ingest.zero_bytes;
+        g_printerr("Manifest: %s (%u chunks)\nNew data: %" G_GUINT64_FORMAT " MiB in %u chunks, %" G_GUINT64_FORMAT
+                   " MiB after compression\nAlready in the repository: %" G_GUINT64_FORMAT " MiB, zero chunks: %" G_GUINT64_FORMAT " MiB\n",
+                   manifest_path, ingest.entries->len, ingest.new_bytes >> 20, ingest.new_chunks, ingest.new_stored >> 20,
+                   known >> 20, ingest.zero_bytes >> 20);
+    }
+    g_free(tree);
+    g_ptr_array_free(ingest.hashes, TRUE);
+    g_array_free(ingest.entries, TRUE);
+    g_array_free(extents, TRUE);
+    g_free(chunk_dir);
+    close(src);
+    return ok ? 0 : 1;
+}
 
-        g_free(quoted_device_path);
-        g_free(quoted_mountpoint);
-        g_free(mount_dir);
-        g_free(device_path);
-        g_free(partition_name);
-        g_free(mountpoint);
+/* Reads a manifest into chunk entries in device order and the matching hashes ("zero" for all-zero chunks). */
+static GArray *load_repo_manifest(const gchar *manifest_path, guint64 *device_size, gchar **fs_name, GPtrArray **hashes) {
+    gchar *contents = NULL;
+    if (!g_file_get_contents(manifest_path, &contents, NULL, NULL) || !g_str_has_prefix(contents, REPO_MANIFEST_MAGIC)) {
+        g_free(contents);
+        return NULL;
     }
+    GArray *entries = g_array_new(FALSE, TRUE, sizeof(ImageIndexEntry));
+    *hashes = g_ptr_array_new_with_free_func(g_free);
+    *device_size = 0;
+    *fs_name = NULL;
+    guint64 expected = 0, end = 0;
+    gboolean ok = TRUE;
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (int i = 1; ok && lines[i]; i++) {
+        guint64 offset = 0;
+        guint length = 0;
+        gchar hash[65] = {0};
+        if (g_str_has_prefix(lines[i], "device_size ")) {
+            *device_size = g_ascii_strtoull(lines[i] + 12, NULL, 10);
+        } else if (g_str_has_prefix(lines[i], "filesystem ")) {
+            g_free(*fs_name);
+            *fs_name = g_strdup(lines[i] + 11);
+        } else if (g_str_has_prefix(lines[i], "chunks ")) {
+            expected = g_ascii_strtoull(lines[i] + 7, NULL, 10);
+        } else if (g_ascii_isdigit(lines[i][0])) {
+            ok = sscanf(lines[i], "%" G_GUINT64_FORMAT " %u %64s", &offset, &length, hash) == 3 && offset >= end &&
+                 length > 0 && length <= REPO_CDC_MAX && offset + length <= *device_size &&
+                 (strcmp(hash, "zero") == 0 || strlen(hash) == 64);
+            ImageIndexEntry e = {0};
+            e.device_offset = offset;
+            e.raw_length = length;
+            e.flags = strcmp(hash, "zero") == 0 ? DAIMG_CHUNK_ZERO : 0;
+            g_array_append_val(entries, e);
+            g_ptr_array_add(*hashes, g_strdup(hash));
+            end = offset + length;
+        }
+    }
+    g_strfreev(lines);
+    g_free(contents);
+    if (!ok || entries->len != expected) {
+        g_array_free(entries, TRUE);
+        g_ptr_array_free(*hashes, TRUE);
+        *hashes = NULL;
+        g_free(*fs_name);
+        *fs_name = NULL;
+        return NULL;
+    }
+    return entries;
 }
 
-void on_grub_mbr_install_activate(GtkWidget *menuitem, gpointer user_data) {
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-    GtkTreeModel *model;
-    GtkTreeIter iter;
-    gchar *partition_name = NULL, *mountpoint = NULL;
+/* --restore-repo: writes the chunks listed in a manifest to dst. Chunks are loaded, decompressed and hash-checked
+ * on the worker pool and written at their device offsets as they complete. */
+static int restore_from_repository(const gchar *manifest_path, const gchar *dst_path, guint threads, gboolean target_zeroed) {
+    guint64 device_size = 0, used = 0;
+    gchar *fs_name = NULL;
+    GPtrArray *hashes = NULL;
+    GArray *entries = load_repo_manifest(manifest_path, &device_size, &fs_name, &hashes);
+    if (!entries) {
+        g_printerr("%s is not a DriveAssistify manifest or it is damaged\n", manifest_path);
+        return 1;
+    }
+    for (guint i = 0; i < entries->len; i++) used += g_array_index(entries, ImageIndexEntry, i).raw_length;
+    int dst = open(dst_path, O_RDWR);
+    guint64 dst_size = dst >= 0 ? (guint64)lseek(dst, 0, SEEK_END) : 0;
+    int rc = 1;
+    if (dst < 0) {
+        g_printerr("Cannot open %s: %s\n", dst_path, g_strerror(errno));
+    } else if (dst_size < device_size) {
+        g_printerr("%s is %" G_GUINT64_FORMAT " bytes, but the image needs %" G_GUINT64_FORMAT " bytes\n",
+                   dst_path, dst_size, device_size);
+    } else {
+        gchar *chunk_dir = repo_chunk_dir(manifest_path);
+        g_printerr("Restoring %s image: %" G_GUINT64_FORMAT " MiB in %u chunks from %s, %u threads\n",
+                   fs_name, used >> 20, entries->len, chunk_dir, threads);
+        ImageWorkerPool *pool = image_worker_pool_new(threads, 0, IMAGE_WORK_REPO_LOAD, chunk_dir);
+        ZeroAwareTarget target;
+        zero_aware_target_init(&target, dst, target_zeroed);
+        guint window = pool->thread_count * 2 + 2;
+        guint64 next_read = 0, in_flight = 0, done = 0;
+        gboolean ok = TRUE;
+        gint64 started = g_get_monotonic_time(), last_report = 0;
+        while (next_read < entries->len || in_flight > 0) {
+            if (ok && next_read < entries->len && in_flight < window) {
+                ImageChunkJob *job = g_new0(ImageChunkJob, 1);
+                job->seq = next_read;
+                job->entry = g_array_index(entries, ImageIndexEntry, next_read);
+                io_pace(job->entry.raw_length);
+                g_strlcpy(job->hash, g_ptr_array_index(hashes, next_read), sizeof(job->hash));
+                next_read++;
+                g_async_queue_push(pool->jobs, job);
+                in_flight++;
+                continue;
+            }
+            if (!ok && in_flight == 0) break;
+            ImageChunkJob *job = g_async_queue_pop(pool->done);
+            in_flight--;
+            if (ok && job->failed) {
+                g_printerr("\nChunk %s (device offset %" G_GUINT64_FORMAT ") is missing or damaged in the repository\n",
+                           job->hash, job->entry.device_offset);
+                ok = FALSE;
+            } else if (ok && !(job->raw ? zero_aware_write(&target, job->raw, job->entry.raw_length, job->entry.device_offset)
+                                        : zero_aware_zero(&target, job->entry.device_offset, job->entry.raw_length))) {
+                g_printerr("\nWrite error at byte %" G_GUINT64_FORMAT ": %s\n", job->entry.device_offset, g_strerror(errno));
+                ok = FALSE;
+            }
+            done += job->entry.raw_length;
+            free_image_chunk_job(job);
+            if (g_get_monotonic_time() - last_report > G_USEC_PER_SEC) {
+                print_transfer_progress("Restored", done, used, started, FALSE);
+                last_report = g_get_monotonic_time();
+            }
+        }
+        image_worker_pool_free(pool);
+        g_free(chunk_dir);
+        if (ok && zero_aware_finish(&target)) {
+            print_transfer_progress("Restored", done, used, started, TRUE);
+            rc = 0;
+        }
+    }
+    if (dst >= 0) close(dst);
+    g_array_free(entries, TRUE);
+    g_ptr_array_free(hashes, TRUE);
+    g_free(fs_name);
+    return rc;
+}
 
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, COL_MOUNTPOINT, &mountpoint, -1);
+static gboolean is_repository_manifest(const gchar *path) {
+    gchar magic[sizeof(REPO_MANIFEST_MAGIC)] = {0};
+    FILE *f = fopen(path, "rb");
+    if (!f) return FALSE;
+    gboolean match = fread(magic, 1, sizeof(magic) - 1, f) == sizeof(magic) - 1 && strcmp(magic, REPO_MANIFEST_MAGIC) == 0;
+    fclose(f);
+    return match;
+}
 
-        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+/* Reads "<image>.hashes" of a packed used-blocks image into chunk entries in device order and their hashes. */
+static GArray *load_image_hashes(const gchar *image_path, guchar **digests) {
+    gchar *path = g_strdup_printf("%s.hashes", image_path);
+    gchar *contents = NULL;
+    gboolean found = g_file_get_contents(path, &contents, NULL, NULL) && g_str_has_prefix(contents, IMAGE_HASHES_MAGIC);
+    g_free(path);
+    if (!found) {
+        g_free(contents);
+        return NULL;
+    }
+    GArray *entries = g_array_new(FALSE, TRUE, sizeof(ImageIndexEntry));
+    GArray *hashes = g_array_new(FALSE, TRUE, DAIMG_DIGEST_SIZE);
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    gboolean ok = TRUE;
+    for (int i = 1; ok && lines[i]; i++) {
+        ImageIndexEntry e = {0};
+        gchar hex[65] = {0};
+        guchar digest[DAIMG_DIGEST_SIZE];
+        if (!g_ascii_isdigit(lines[i][0])) continue;
+        ok = sscanf(lines[i], "%" G_GUINT64_FORMAT " %u %64s", &e.device_offset, &e.raw_length, hex) == 3 &&
+             e.raw_length <= DAIMG_DEFAULT_CHUNK && (digest_from_hex(hex, digest) || strcmp(hex, "zero") == 0);
+        if (strcmp(hex, "zero") == 0) e.flags = DAIMG_CHUNK_ZERO;
+        g_array_append_val(entries, e);
+        g_array_append_vals(hashes, digest, 1);
+    }
+    g_strfreev(lines);
+    g_free(contents);
+    if (!ok) {
+        g_array_free(hashes, TRUE);
+        g_array_free(entries, TRUE);
+        return NULL;
+    }
+    *digests = (guchar *)g_array_free(hashes, FALSE);
+    return entries;
+}
 
-        gchar *disk_path = NULL;
-        if (g_str_has_prefix(partition_name, "nvme") && strchr(partition_name, 'p')) {
-            char *p = strrchr(device_path, 'p');
-            if (p) {
-                disk_path = g_strndup(device_path, p - device_path);
+/* --verify-image: hashes every chunk on the worker pool and compares it with the chunk hashes recorded while imaging.
+ * Without a device the image itself is checked (.daimg chunks are decoded, repository chunks loaded); with a device,
+ * the device ranges the image covers are compared with it. Mismatching ranges are listed. */
+static int verify_image(const gchar *image_path, const gchar *device_path, guint threads) {
+    ImageChain chain = {0};
+    GArray *entries = NULL;
+    GPtrArray *hashes = NULL;
+    guchar *expected = NULL;
+    gchar *chunk_dir = NULL;
+    gboolean packed = FALSE;
+
+    if (is_compressed_image(image_path)) {
+        if (image_chain_open(&chain, image_path)) {
+            entries = chain.indexes[0];
+            expected = load_image_digests(chain.fds[0], &chain.headers[0]);
+        }
+    } else if (is_repository_manifest(image_path)) {
+        guint64 device_size = 0;
+        gchar *fs_name = NULL;
+        entries = load_repo_manifest(image_path, &device_size, &fs_name, &hashes);
+        if (entries) {
+            expected = g_malloc0((gsize)entries->len * DAIMG_DIGEST_SIZE + 1);
+            for (guint i = 0; i < entries->len; i++)
+                digest_from_hex(g_ptr_array_index(hashes, i), expected + (gsize)i * DAIMG_DIGEST_SIZE);
+            chunk_dir = repo_chunk_dir(image_path);
+        } else {
+            g_printerr("%s is not a DriveAssistify manifest or it is damaged\n", image_path);
+        }
+        g_free(fs_name);
+    } else {
+        entries = load_image_hashes(image_path, &expected);
+        packed = TRUE;
+    }
+    if (!entries || !expected) {
+        if (entries || packed)
+            g_printerr("%s has no chunk hashes. Only used-blocks, .daimg and repository images taken with chunk hashes can be verified\n",
+                       image_path);
+        g_free(expected);
+        if (chain.depth > 0) image_chain_close(&chain);
+        else if (entries) g_array_free(entries, TRUE);
+        if (hashes) g_ptr_array_free(hashes, TRUE);
+        g_free(chunk_dir);
+        return 1;
+    }
+
+    guint64 total = 0, end = 0;
+    for (guint i = 0; i < entries->len; i++) {
+        ImageIndexEntry *e = &g_array_index(entries, ImageIndexEntry, i);
+        total += e->raw_length;
+        end = e->device_offset + e->raw_length;
+    }
+    int fd = -1;
+    if (device_path) fd = open(device_path, O_RDONLY);
+    else if (packed) fd = open(image_path, O_RDONLY);
+    gboolean ok = TRUE;
+    if ((device_path || packed) && fd < 0) {
+        g_printerr("Cannot open %s: %s\n", device_path ? device_path : image_path, g_strerror(errno));
+        ok = FALSE;
+    } else if (device_path && (guint64)lseek(fd, 0, SEEK_END) < end) {
+        g_printerr("%s is smaller than the partition in %s\n", device_path, image_path);
+        ok = FALSE;
+    }
+
+    guint8 *bad = g_new0(guint8, entries->len + 1);
+    guint bad_count = 0;
+    guint64 bad_bytes = 0, done = 0;
+    if (ok) {
+        g_printerr("Verifying %s%s%s: %" G_GUINT64_FORMAT " MiB in %u chunks, %u threads\n", device_path ? device_path : image_path,
+                   device_path ? " against " : "", device_path ? image_path : "", total >> 20, entries->len, threads);
+        ImageWorkerPool *pool = image_worker_pool_new(threads, 0, IMAGE_WORK_HASH, device_path ? NULL : chunk_dir);
+        guint window = pool->thread_count * 2 + 2;
+        guint64 next_read = 0, in_flight = 0, packed_offset = 0;
+        gint64 started = g_get_monotonic_time(), last_report = 0;
+        while (next_read < entries->len || in_flight > 0) {
+            if (next_read < entries->len && in_flight < window) {
+                ImageChunkJob *job = g_new0(ImageChunkJob, 1);
+                job->seq = next_read;
+                job->entry = g_array_index(entries, ImageIndexEntry, next_read);
+                gboolean readable = TRUE;
+                if (fd >= 0) {
+                    /* Raw data from the device, or from the packed image, where chunks follow each other. */
+                    job->entry.flags = 0;
+                    job->raw = g_malloc(job->entry.raw_length + 1);
+                    io_pace(job->entry.raw_length);
+                    readable = read_exact_at(fd, job->raw, job->entry.raw_length, device_path ? job->entry.device_offset : packed_offset);
+                    packed_offset += job->entry.raw_length;
+                } else if (hashes) {
+                    g_strlcpy(job->hash, g_ptr_array_index(hashes, next_read), sizeof(job->hash));
+                } else {
+                    guint level = 0;
+                    const ImageIndexEntry *data = image_chain_resolve(&chain, &job->entry, &level);
+                    readable = data != NULL;
+                    if (data) job->entry = *data;
+                    if (data && !(data->flags & DAIMG_CHUNK_ZERO)) {
+                        job->stored = g_malloc(data->stored_length + 1);
+                        readable = read_exact_at(chain.fds[level], job->stored, data->stored_length, data->stored_offset);
+                    }
+                }
+                next_read++;
+                if (!readable) {
+                    bad[job->seq] = 1;
+                    done += job->entry.raw_length;
+                    free_image_chunk_job(job);
+                } else {
+                    g_async_queue_push(pool->jobs, job);
+                    in_flight++;
+                }
+                continue;
+            }
+            ImageChunkJob *job = g_async_queue_pop(pool->done);
+            in_flight--;
+            if (job->failed || memcmp(job->digest, expected + job->seq * DAIMG_DIGEST_SIZE, DAIMG_DIGEST_SIZE) != 0)
+                bad[job->seq] = 1;
+            done += job->entry.raw_length;
+            free_image_chunk_job(job);
+            if (g_get_monotonic_time() - last_report > G_USEC_PER_SEC) {
+                print_transfer_progress("Verified", done, total, started, FALSE);
+                last_report = g_get_monotonic_time();
             }
+        }
+        image_worker_pool_free(pool);
+        print_transfer_progress("Verified", done, total, started, TRUE);
+
+        GArray *ranges = g_array_new(FALSE, FALSE, sizeof(ImageExtent));
+        for (guint i = 0; i < entries->len; i++) {
+            if (!bad[i]) continue;
+            ImageIndexEntry *e = &g_array_index(entries, ImageIndexEntry, i);
+            add_used_extent(ranges, e->device_offset, e->raw_length);
+            bad_count++;
+            bad_bytes += e->raw_length;
+        }
+        gchar *recorded = image_tree_hash(entries, expected);
+        if (bad_count == 0) {
+            g_printerr("All %u chunks match.\nTree hash: %s\n", entries->len, recorded);
         } else {
-            char *p = device_path + strlen(device_path) - 1;
-            while (p > device_path && g_ascii_isdigit(*p)) p--;
-            p++;
-            disk_path = g_strndup(device_path, p - device_path);
+            g_printerr("%u of %u chunks (%" G_GUINT64_FORMAT " MiB) do not match%s:\n", bad_count, entries->len, bad_bytes >> 20,
+                       device_path ? " the device" : " their recorded hashes or cannot be read");
+            for (guint i = 0; i < ranges->len && i < 50; i++) {
+                ImageExtent r = g_array_index(ranges, ImageExtent, i);
+                g_printerr("  bytes %" G_GUINT64_FORMAT " - %" G_GUINT64_FORMAT " (%" G_GUINT64_FORMAT " KiB)\n",
+                           r.offset, r.offset + r.length - 1, r.length >> 10);
+            }
+            if (ranges->len > 50) g_printerr("  ... and %u more ranges\n", ranges->len - 50);
+            g_printerr("Recorded tree hash: %s\n", recorded);
         }
+        g_free(recorded);
+        g_array_free(ranges, TRUE);
+    }
+    if (fd >= 0) close(fd);
+    g_free(bad);
+    g_free(expected);
+    if (chain.depth > 0) image_chain_close(&chain);
+    else g_array_free(entries, TRUE);
+    if (hashes) g_ptr_array_free(hashes, TRUE);
+    g_free(chunk_dir);
+    return ok && bad_count == 0 ? 0 : 1;
+}
 
-        gchar *mount_dir = g_strdup("/mnt/driveassistify_grub");
-        gchar *quoted_mount_dir = g_shell_quote(mount_dir);
-        gchar *quoted_device_path = g_shell_quote(device_path);
-        gchar *quoted_disk_path = g_shell_quote(disk_path);
-        gchar *quoted_mountpoint = mountpoint ? g_shell_quote(mountpoint) : g_strdup("''");
 
-        GtkWidget *warn = gtk_message_dialog_new(
-            NULL,
-            GTK_DIALOG_MODAL,
-            GTK_MESSAGE_WARNING,
-            GTK_BUTTONS_OK_CANCEL,
-            "WARNING: This is a potentially destructive operation!\n\n"
-            "Installing GRUB2 to the MBR rewrites boot code on the disk.\n"
-            "If you select the wrong partition or disk, the system may become unbootable.\n\n"
-            "Target partition: %s\n\n"
-            "Are you sure you want to continue?",
-            device_path
-        );
-        gint response = gtk_dialog_run(GTK_DIALOG(warn));
-        gtk_widget_destroy(warn);
+/* --resume-job: continues the job described by a journal from its last committed chunk. */
+static int resume_image_job(const gchar *journal_path, guint threads) {
+    gchar *contents = NULL;
+    if (!g_file_get_contents(journal_path, &contents, NULL, NULL) || !g_str_has_prefix(contents, IMAGE_JOURNAL_MAGIC)) {
+        g_printerr("%s is not a DriveAssistify journal\n", journal_path);
+        g_free(contents);
+        return 1;
+    }
+    gchar *op = NULL, *source = NULL, *destination = NULL, *params = NULL;
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (int i = 0; lines[i] && !g_str_has_prefix(lines[i], "u ") && !g_str_has_prefix(lines[i], "commit "); i++) {
+        if (g_str_has_prefix(lines[i], "op ")) op = g_strdup(lines[i] + 3);
+        else if (g_str_has_prefix(lines[i], "source ")) source = g_strdup(lines[i] + 7);
+        else if (g_str_has_prefix(lines[i], "destination ")) destination = g_strdup(lines[i] + 12);
+        else if (g_str_has_prefix(lines[i], "params ")) params = g_strdup(lines[i] + 7);
+    }
+    g_strfreev(lines);
+    g_free(contents);
+
+    int rc = 1;
+    gboolean zeroed = g_strcmp0(params, "zeroed") == 0;
+    if (!op || !source || !destination || !params) g_printerr("%s is incomplete\n", journal_path);
+    else if (strcmp(op, "image-used") == 0) rc = image_used_blocks(source, destination, TRUE);
+    else if (strcmp(op, "image-compressed") == 0) rc = image_compressed(source, destination, atoi(params), threads, NULL, TRUE);
+    else if (strcmp(op, "image-diff") == 0 && strchr(params, ' '))
+        rc = image_compressed(source, destination, atoi(params), threads, strchr(params, ' ') + 1, TRUE);
+    else if (strcmp(op, "restore-used") == 0) rc = restore_used_blocks(source, destination, zeroed, TRUE);
+    else if (strcmp(op, "restore-raw") == 0) rc = restore_raw_image(source, destination, zeroed, TRUE);
+    else if (strcmp(op, "restore-image") == 0) rc = restore_compressed(source, destination, threads, zeroed, TRUE);
+    else g_printerr("Unknown job type %s in %s\n", op, journal_path);
+    g_free(op);
+    g_free(source);
+    g_free(destination);
+    g_free(params);
+    return rc;
+}
+
+/*
+ * Direct clone: reader threads fill a fixed set of aligned buffers and writer threads drain them, so reads and writes
+ * of different chunks overlap with up to CLONE_IN_FLIGHT buffers in flight and a slow side never idles the other.
+ * Sector-aligned chunks go through O_DIRECT descriptors; the rest (and files that refuse O_DIRECT) use buffered I/O.
+ */
+#define CLONE_BUFFER_SIZE (4 << 20)
+#define CLONE_IN_FLIGHT 16
 
-        if (response == GTK_RESPONSE_OK) {
+typedef struct {
+    guchar *data;
+    ImageIndexEntry chunk;
+} CloneBuffer;
 
-            gchar *command = g_strdup_printf(
-                "echo '========================================='; "
-                "echo 'Starting GRUB2 MBR installation'; "
-                "echo 'Target partition: %s'; "
-                "echo 'Target disk: %s'; "
-                "echo 'Mount directory: %s'; "
-                "echo '-----------------------------------------'; "
+typedef struct {
+    GArray *chunks;
+    int src;
+    int src_direct;
+    int dst;
+    int dst_direct;
+    guint sector;
+    GAsyncQueue *free_buffers;
+    GAsyncQueue *filled;
+    gint next;
+    gint finished;
+    gint failed;
+    GMutex lock;
+    guint64 copied;
+    guint64 zeroed;
+} CloneJob;
+
+static CloneBuffer clone_stop;
+
+static int clone_fd(const CloneJob *job, const ImageIndexEntry *c, gboolean source) {
+    int direct = source ? job->src_direct : job->dst_direct;
+    if (direct < 0 || (c->device_offset | c->raw_length) % job->sector != 0) return source ? job->src : job->dst;
+    return direct;
+}
 
-                "echo 'Unmounting previous mount (if any)...'; "
+static gpointer clone_reader_thread(gpointer data) {
+    CloneJob *job = data;
+    for (;;) {
+        guint i = (guint)g_atomic_int_add(&job->next, 1);
+        if (i >= job->chunks->len || g_atomic_int_get(&job->failed)) break;
+        CloneBuffer *b = g_async_queue_pop(job->free_buffers);
+        b->chunk = g_array_index(job->chunks, ImageIndexEntry, i);
+        io_pace(b->chunk.raw_length);
+        if (!read_exact_at(clone_fd(job, &b->chunk, TRUE), b->data, b->chunk.raw_length, b->chunk.device_offset)) {
+            g_printerr("\nRead error at byte %" G_GUINT64_FORMAT ": %s\n", b->chunk.device_offset, g_strerror(errno));
+            g_atomic_int_set(&job->failed, 1);
+            g_async_queue_push(job->free_buffers, b);
+            break;
+        }
+        g_async_queue_push(job->filled, b);
+    }
+    return NULL;
+}
 
-                "if mount | grep -q '%s '; then "
-                "  echo 'Trying normal umount with timeout...'; "
-                "  for i in 1 2; do "
-                "    timeout 15 umount %s && break || { "
-                "      echo 'Attempt $i failed, retrying in 2s...'; "
-                "      sleep 2; "
-                "    }; "
-                "  done; "
-                "  if mount | grep -q '%s '; then "
-                "    echo 'ERROR: Could not unmount the device.'; "
-                "    echo 'You may need to unmount manually using:'; "
-                "    echo '   umount %s'; "
-                "    echo '   umount -l %s   (lazy)'; "
-                "    echo '   umount -f %s   (force)'; "
-                "    echo 'Aborting.'; "
-                "    echo; "
-                "    echo 'This window can now be closed.'; "
-                "    read -p 'Press Enter to close...'; "
-                "    exit 1; "
-                "  fi; "
-                "else "
-                "  echo 'Device not mounted — OK'; "
-                "fi; "
+/* Each writer merges its own zero chunks into BLKZEROOUT ranges instead of writing them. */
+static gpointer clone_writer_thread(gpointer data) {
+    CloneJob *job = data;
+    ZeroAwareTarget target;
+    zero_aware_target_init(&target, job->dst, FALSE);
+    for (;;) {
+        CloneBuffer *b = g_async_queue_pop(job->filled);
+        if (b == &clone_stop) break;
+        ImageIndexEntry *c = &b->chunk;
+        if (!g_atomic_int_get(&job->failed)) {
+            gboolean ok;
+            if (is_zero_block(b->data, c->raw_length))
+                ok = zero_aware_zero(&target, c->device_offset, c->raw_length);
+            else
+                ok = flush_zero_range(&target) &&
+                     pwrite(clone_fd(job, c, FALSE), b->data, c->raw_length, (off_t)c->device_offset) == (ssize_t)c->raw_length;
+            if (!ok) {
+                g_printerr("\nWrite error at byte %" G_GUINT64_FORMAT ": %s\n", c->device_offset, g_strerror(errno));
+                g_atomic_int_set(&job->failed, 1);
+            } else {
+                g_mutex_lock(&job->lock);
+                job->copied += c->raw_length;
+                g_mutex_unlock(&job->lock);
+            }
+        }
+        g_atomic_int_inc(&job->finished);
+        g_async_queue_push(job->free_buffers, b);
+    }
+    if (!flush_zero_range(&target)) g_atomic_int_set(&job->failed, 1);
+    g_mutex_lock(&job->lock);
+    job->zeroed += target.zeroed_bytes;
+    g_mutex_unlock(&job->lock);
+    return NULL;
+}
 
-                "echo 'Creating temporary mount directory...'; "
-                "mkdir -p %s; "
+/* Used extents of a clone source. A whole disk is mapped partition by partition from sysfs: each partition adds the
+ * allocated clusters of its file system, and everything outside the partitions (partition tables, boot loader gaps,
+ * the backup GPT) is copied raw. */
+static GArray *get_clone_extents(const gchar *src_path, int src_fd, guint64 size, GString *layout) {
+    GArray *extents = g_array_new(FALSE, FALSE, sizeof(ImageExtent));
+    GArray *parts = g_array_new(FALSE, FALSE, sizeof(ImageExtent));
+    char *real = realpath(src_path, NULL);
+    gchar *name = g_path_get_basename(real ? real : src_path);
+    gchar *sys_dir = g_build_filename("/sys/class/block", name, NULL);
+    GDir *dir = g_dir_open(sys_dir, 0, NULL);
+    const gchar *entry;
+    while (dir && (entry = g_dir_read_name(dir)) != NULL) {
+        gchar *start_path = g_build_filename(sys_dir, entry, "start", NULL);
+        gchar *size_path = g_build_filename(sys_dir, entry, "size", NULL);
+        gchar *start_text = NULL, *size_text = NULL;
+        if (g_file_get_contents(start_path, &start_text, NULL, NULL) && g_file_get_contents(size_path, &size_text, NULL, NULL)) {
+            /* sysfs counts in 512-byte sectors whatever the logical block size. */
+            ImageExtent part = {g_ascii_strtoull(start_text, NULL, 10) * 512, g_ascii_strtoull(size_text, NULL, 10) * 512};
+            gchar *part_path = g_strdup_printf("/dev/%s", entry);
+            int fd = open(part_path, O_RDONLY);
+            const gchar *fs_name = "raw";
+            guint32 unit = 0;
+            guint64 used = part.length;
+            if (fd >= 0 && part.offset + part.length <= size) {
+                GArray *used_extents = get_used_extents(fd, part.length, &fs_name, &unit);
+                used = 0;
+                for (guint i = 0; i < used_extents->len; i++) {
+                    ImageExtent e = g_array_index(used_extents, ImageExtent, i);
+                    g_array_append_val(extents, ((ImageExtent){part.offset + e.offset, e.length}));
+                    used += e.length;
+                }
+                g_array_free(used_extents, TRUE);
+                g_array_append_val(parts, part);
+            }
+            if (fd >= 0) close(fd);
+            g_string_append_printf(layout, "%s%s: %s, %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " MiB", layout->len ? "; " : "",
+                                   entry, fs_name, used >> 20, part.length >> 20);
+            g_free(part_path);
+        }
+        g_free(start_text);
+        g_free(size_text);
+        g_free(start_path);
+        g_free(size_path);
+    }
+    if (dir) g_dir_close(dir);
+
+    if (parts->len > 0) {
+        g_array_sort(parts, compare_image_extents);
+        guint64 pos = 0;
+        for (guint i = 0; i < parts->len; i++) {
+            ImageExtent p = g_array_index(parts, ImageExtent, i);
+            if (p.offset > pos) g_array_append_val(extents, ((ImageExtent){pos, p.offset - pos}));
+            pos = MAX(pos, p.offset + p.length);
+        }
+        if (pos < size) g_array_append_val(extents, ((ImageExtent){pos, size - pos}));
+        normalize_extents(extents, size);
+    } else {
+        const gchar *fs_name;
+        guint32 unit;
+        g_array_free(extents, TRUE);
+        extents = get_used_extents(src_fd, size, &fs_name, &unit);
+        g_string_append(layout, fs_name);
+    }
+    g_array_free(parts, TRUE);
+    g_free(sys_dir);
+    g_free(name);
+    free(real);
+    return extents;
+}
 
-                "echo 'Mounting target partition...'; "
-                "mount %s %s || { "
-                "  echo 'ERROR: Failed to mount partition! Aborting.'; "
-                "  echo; "
-                "  echo 'This window can now be closed.'; "
-                "  read -p 'Press Enter to close...'; "
-                "  exit 1; "
-                "}; "
+/* Clones the used extents of src (a partition or a whole disk) onto dst with `streams` readers and as many writers. */
+static int clone_device(const gchar *src_path, const gchar *dst_path, guint streams) {
+    CloneJob job = {0};
+    job.src = open(src_path, O_RDONLY);
+    job.dst = open(dst_path, O_RDWR);
+    if (job.src < 0 || job.dst < 0) {
+        g_printerr("Cannot open %s: %s\n", job.src < 0 ? src_path : dst_path, g_strerror(errno));
+        if (job.src >= 0) close(job.src);
+        if (job.dst >= 0) close(job.dst);
+        return 1;
+    }
+    guint64 size = (guint64)lseek(job.src, 0, SEEK_END);
+    guint64 dst_size = (guint64)lseek(job.dst, 0, SEEK_END);
+    if (dst_size < size) {
+        g_printerr("%s is %" G_GUINT64_FORMAT " bytes, but the source needs %" G_GUINT64_FORMAT " bytes\n", dst_path, dst_size, size);
+        close(job.src);
+        close(job.dst);
+        return 1;
+    }
+    job.src_direct = open(src_path, O_RDONLY | O_DIRECT);
+    job.dst_direct = open(dst_path, O_RDWR | O_DIRECT);
+    int sector = 0;
+    job.sector = ioctl(job.dst, BLKSSZGET, &sector) == 0 && sector > 4096 ? (guint)sector : 4096;
+
+    GString *layout = g_string_new(NULL);
+    GArray *extents = get_clone_extents(src_path, job.src, size, layout);
+    guint64 used = 0;
+    job.chunks = split_extents_into_chunks(extents, CLONE_BUFFER_SIZE, &used);
+    g_array_free(extents, TRUE);
+    g_printerr("Cloning %s to %s (%s)\n%" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " MiB to copy, %u readers and %u writers, "
+               "%d buffers of %d MiB%s\n", src_path, dst_path, layout->str, used >> 20, size >> 20, MAX(streams, 1), MAX(streams, 1),
+               CLONE_IN_FLIGHT, CLONE_BUFFER_SIZE >> 20, job.src_direct >= 0 && job.dst_direct >= 0 ? ", O_DIRECT" : "");
+    g_string_free(layout, TRUE);
+
+    g_mutex_init(&job.lock);
+    job.free_buffers = g_async_queue_new();
+    job.filled = g_async_queue_new();
+    CloneBuffer buffers[CLONE_IN_FLIGHT];
+    for (int i = 0; i < CLONE_IN_FLIGHT; i++) {
+        void *data = NULL;
+        if (posix_memalign(&data, 4096, CLONE_BUFFER_SIZE) != 0) data = NULL;
+        buffers[i].data = data;
+        if (data) g_async_queue_push(job.free_buffers, &buffers[i]);
+    }
+    guint thread_count = MAX(streams, 1);
+    GThread **readers = g_new0(GThread *, thread_count);
+    GThread **writers = g_new0(GThread *, thread_count);
+    gint64 started = g_get_monotonic_time(), last_report = 0;
+    for (guint i = 0; i < thread_count; i++) {
+        readers[i] = g_thread_new("clone-reader", clone_reader_thread, &job);
+        writers[i] = g_thread_new("clone-writer", clone_writer_thread, &job);
+    }
+    while ((guint)g_atomic_int_get(&job.finished) < job.chunks->len && !g_atomic_int_get(&job.failed)) {
+        g_usleep(G_USEC_PER_SEC / 4);
+        if (g_get_monotonic_time() - last_report > G_USEC_PER_SEC) {
+            g_mutex_lock(&job.lock);
+            guint64 copied = job.copied;
+            g_mutex_unlock(&job.lock);
+            print_transfer_progress("Cloned", copied, used, started, FALSE);
+            last_report = g_get_monotonic_time();
+        }
+    }
+    for (guint i = 0; i < thread_count; i++) g_thread_join(readers[i]);
+    for (guint i = 0; i < thread_count; i++) g_async_queue_push(job.filled, &clone_stop);
+    for (guint i = 0; i < thread_count; i++) g_thread_join(writers[i]);
+
+    gboolean ok = !job.failed && fsync(job.dst) == 0;
+    if (ok) {
+        struct stat st;
+        gboolean is_block = fstat(job.dst, &st) == 0 && S_ISBLK(st.st_mode);
+        double seconds = (g_get_monotonic_time() - started) / 1e6;
+        print_transfer_progress("Cloned", used, used, started, TRUE);
+        g_printerr("Sustained %.1f MiB/s over %.1f s; %" G_GUINT64_FORMAT " MiB were zero ranges (%s), "
+                   "%" G_GUINT64_FORMAT " MiB of free space was not copied\n", seconds > 0 ? (used / 1048576.0) / seconds : 0.0,
+                   seconds, job.zeroed >> 20, is_block ? "BLKZEROOUT" : "punched holes", (size - used) >> 20);
+        if (dst_size > size)
+            g_printerr("The target is %" G_GUINT64_FORMAT " MiB larger than the source\n", (dst_size - size) >> 20);
+    }
+    g_free(readers);
+    g_free(writers);
+    for (int i = 0; i < CLONE_IN_FLIGHT; i++) free(buffers[i].data);
+    g_async_queue_unref(job.free_buffers);
+    g_async_queue_unref(job.filled);
+    g_mutex_clear(&job.lock);
+    g_array_free(job.chunks, TRUE);
+    if (job.src_direct >= 0) close(job.src_direct);
+    if (job.dst_direct >= 0) close(job.dst_direct);
+    close(job.src);
+    close(job.dst);
+    return ok ? 0 : 1;
+}
 
-                "echo 'Running grub-install (i386-pc)...'; "
-                "grub-install --target=i386-pc --boot-directory=%s/boot %s || { "
-                "    echo 'ERROR: grub-install failed! Unmounting...'; "
-                "    timeout 15 umount %s; "
-                "    echo; "
-                "    echo 'This window can now be closed.'; "
-                "    read -p 'Press Enter to close...'; "
-                "    exit 1; "
-                "}; "
+/*
+ * One-to-many restore: the image is read and decoded once, and every decoded chunk is handed to all targets. Each
+ * target has its own queue and writer thread; a chunk is freed when the last target has written it. A target may fall
+ * behind the decoder by at most FANOUT_TARGET_BUDGET bytes, after which decoding waits for it (backpressure). A target
+ * that fails is dropped and the others carry on.
+ */
+#define FANOUT_TARGET_BUDGET (256 << 20)
 
-                "echo 'Unmounting...'; "
-                "timeout 15 umount %s; "
+typedef struct {
+    ImageChunkJob *job;
+    gint refs;
+} FanoutBuffer;
 
-                "echo 'Removing temporary directory...'; "
-                "rmdir %s; "
+typedef struct FanoutRestore FanoutRestore;
 
-                "echo '-----------------------------------------'; "
-                "echo 'GRUB2 MBR installation finished successfully.'; "
-                "echo '========================================='; "
-                "echo; "
-                "read -p 'Press Enter to close...';",
-                
-                device_path,
-                disk_path,
-                mount_dir,
+typedef struct {
+    const gchar *path;
+    int fd;
+    ZeroAwareTarget zero;
+    GAsyncQueue *queue;
+    GThread *thread;
+    guint64 queued;
+    guint64 written;
+    gboolean failed;
+    gchar *error;
+    gint64 finished_at;
+    FanoutRestore *fan;
+} FanoutTarget;
+
+struct FanoutRestore {
+    GMutex lock;
+    GCond drained;
+    FanoutTarget *targets;
+    guint count;
+};
 
-                device_path,
-                device_path,
-                device_path,
-                device_path,
-                device_path,
-                device_path,
+static FanoutBuffer fanout_stop;
 
-                quoted_mount_dir,
-                quoted_device_path,
-                quoted_mount_dir,
-                mount_dir,
-                quoted_disk_path,
-                quoted_mount_dir,
-                quoted_mount_dir,
-                quoted_mount_dir
-            );
+static void fanout_buffer_unref(FanoutBuffer *b) {
+    if (g_atomic_int_dec_and_test(&b->refs)) {
+        free_image_chunk_job(b->job);
+        g_free(b);
+    }
+}
 
-            pid_t pid = fork();
-            
-            if (pid == 0) {
-                const gchar *terminals[] = {"gnome-terminal", "konsole", "xfce4-terminal", 
-                                           "mate-terminal", "lxterminal", "xterm", NULL};
-                
-                for (int i = 0; terminals[i]; i++) {
-                    gchar *term_bin = g_find_program_in_path(terminals[i]);
-                    if (term_bin) {
-                        if (g_strcmp0(terminals[i], "gnome-terminal") == 0) {
-                            execlp(term_bin, term_bin, "--", "bash", "-c", command, NULL);
-                        } else {
-                            execlp(term_bin, term_bin, "-e", "bash", "-c", command, NULL);
-                        }
-                        g_free(term_bin);
-                    }
-                }
-                
-                exit(1);
-            } else if (pid > 0) {
-                g_free(command);
+static gpointer fanout_writer_thread(gpointer data) {
+    FanoutTarget *t = data;
+    FanoutRestore *fan = t->fan;
+    for (;;) {
+        FanoutBuffer *b = g_async_queue_pop(t->queue);
+        if (b == &fanout_stop) break;
+        ImageChunkJob *job = b->job;
+        ImageIndexEntry *e = &job->entry;
+        gboolean ok = t->failed || (job->raw ? flush_zero_range(&t->zero) &&
+                                                   pwrite(t->fd, job->raw, e->raw_length, (off_t)e->device_offset) == (ssize_t)e->raw_length
+                                             : zero_aware_zero(&t->zero, e->device_offset, e->raw_length));
+        g_mutex_lock(&fan->lock);
+        if (!ok) {
+            t->error = g_strdup_printf("write error at byte %" G_GUINT64_FORMAT ": %s", e->device_offset, g_strerror(errno));
+            t->failed = TRUE;
+        } else if (!t->failed) {
+            t->written += e->raw_length;
+        }
+        t->queued -= e->raw_length;
+        g_cond_broadcast(&fan->drained);
+        g_mutex_unlock(&fan->lock);
+        fanout_buffer_unref(b);
+    }
+    if (!t->failed && !zero_aware_finish(&t->zero)) {
+        t->error = g_strdup_printf("cannot flush: %s", g_strerror(errno));
+        t->failed = TRUE;
+    }
+    t->finished_at = g_get_monotonic_time();
+    return NULL;
+}
+
+/* Queues a decoded chunk on every live target, waiting while a target's backlog would exceed its budget.
+ * Takes ownership of the job; returns FALSE once no target is left. */
+static gboolean fanout_dispatch(FanoutRestore *fan, ImageChunkJob *job) {
+    guint32 length = job->entry.raw_length;
+    if (job->raw && is_zero_block(job->raw, length)) {
+        /* Checked once here instead of once per target. */
+        if (job->stored == job->raw) job->stored = NULL;
+        g_free(job->raw);
+        job->raw = NULL;
+    }
+    FanoutBuffer *b = g_new0(FanoutBuffer, 1);
+    b->job = job;
+    b->refs = 1;
+    guint live = 0;
+    g_mutex_lock(&fan->lock);
+    for (guint i = 0; i < fan->count; i++) {
+        FanoutTarget *t = &fan->targets[i];
+        while (!t->failed && t->queued > 0 && t->queued + length > FANOUT_TARGET_BUDGET) g_cond_wait(&fan->drained, &fan->lock);
+        if (t->failed) continue;
+        t->queued += length;
+        g_atomic_int_inc(&b->refs);
+        g_async_queue_push(t->queue, b);
+        live++;
+    }
+    g_mutex_unlock(&fan->lock);
+    fanout_buffer_unref(b);
+    return live > 0;
+}
+
+/* Restores one image (manifest, .daimg, used-blocks or raw) onto every target at once. */
+static int restore_fanout(const gchar *image_path, gchar **target_paths, guint count, guint threads, gboolean target_zeroed) {
+    enum { FANOUT_REPO, FANOUT_DAIMG, FANOUT_USED, FANOUT_RAW } kind;
+    ImageChain chain = {0};
+    GPtrArray *hashes = NULL;
+    gchar *fs_name = NULL, *chunk_dir = NULL;
+    GArray *entries = NULL;
+    guint64 device_size = 0, used = 0;
+    int in = -1;
+    crc32c_init();
+
+    gchar *map_path = g_strdup_printf("%s.map", image_path);
+    if (is_repository_manifest(image_path)) {
+        kind = FANOUT_REPO;
+        entries = load_repo_manifest(image_path, &device_size, &fs_name, &hashes);
+        chunk_dir = repo_chunk_dir(image_path);
+    } else if (is_compressed_image(image_path)) {
+        kind = FANOUT_DAIMG;
+        if (image_chain_open(&chain, image_path)) {
+            entries = g_array_new(FALSE, FALSE, sizeof(ImageIndexEntry));
+            g_array_append_vals(entries, chain.indexes[0]->data, chain.indexes[0]->len);
+            device_size = chain.headers[0].device_size;
+            fs_name = g_strdup(chain.headers[0].fs_name);
+        }
+    } else if (g_file_test(map_path, G_FILE_TEST_EXISTS)) {
+        kind = FANOUT_USED;
+        GArray *extents = load_block_map(map_path, &device_size, &fs_name);
+        if (extents) {
+            entries = split_extents_into_chunks(extents, DAIMG_DEFAULT_CHUNK, &used);
+            g_array_free(extents, TRUE);
+            in = open(image_path, O_RDONLY);
+        }
+    } else {
+        kind = FANOUT_RAW;
+        in = open(image_path, O_RDONLY);
+        if (in >= 0) {
+            device_size = (guint64)lseek(in, 0, SEEK_END);
+            ImageExtent whole = {0, device_size};
+            GArray *extents = g_array_new(FALSE, FALSE, sizeof(ImageExtent));
+            g_array_append_val(extents, whole);
+            entries = split_extents_into_chunks(extents, DAIMG_DEFAULT_CHUNK, &used);
+            g_array_free(extents, TRUE);
+            fs_name = g_strdup("raw");
+        }
+    }
+    g_free(map_path);
+    if (!entries || ((kind == FANOUT_USED || kind == FANOUT_RAW) && in < 0)) {
+        g_printerr("Cannot read the image %s\n", image_path);
+        if (entries) g_array_free(entries, TRUE);
+        if (hashes) g_ptr_array_free(hashes, TRUE);
+        if (in >= 0) close(in);
+        image_chain_close(&chain);
+        g_free(chunk_dir);
+        g_free(fs_name);
+        return 1;
+    }
+    used = 0;
+    for (guint i = 0; i < entries->len; i++) used += g_array_index(entries, ImageIndexEntry, i).raw_length;
+
+    FanoutRestore fan = {0};
+    g_mutex_init(&fan.lock);
+    g_cond_init(&fan.drained);
+    fan.targets = g_new0(FanoutTarget, count);
+    fan.count = count;
+    guint live = 0;
+    for (guint i = 0; i < count; i++) {
+        FanoutTarget *t = &fan.targets[i];
+        t->path = target_paths[i];
+        t->fan = &fan;
+        t->fd = open(t->path, O_RDWR);
+        guint64 size = t->fd >= 0 ? (guint64)lseek(t->fd, 0, SEEK_END) : 0;
+        if (t->fd < 0) {
+            t->error = g_strdup_printf("cannot open: %s", g_strerror(errno));
+            t->failed = TRUE;
+        } else if (size < device_size) {
+            t->error = g_strdup_printf("%" G_GUINT64_FORMAT " bytes, but the image needs %" G_GUINT64_FORMAT, size, device_size);
+            t->failed = TRUE;
+        } else {
+            zero_aware_target_init(&t->zero, t->fd, target_zeroed);
+            t->queue = g_async_queue_new();
+            t->thread = g_thread_new("fanout-writer", fanout_writer_thread, t);
+            live++;
+        }
+        if (t->failed) g_printerr("Skipping %s: %s\n", t->path, t->error);
+    }
+    g_printerr("Restoring %s image: %" G_GUINT64_FORMAT " MiB in %u chunks to %u targets, %u threads, %d MiB budget per target\n",
+               fs_name ? fs_name : "?", used >> 20, entries->len, live, threads, FANOUT_TARGET_BUDGET >> 20);
+
+    ImageWorkerPool *pool = NULL;
+    if (kind == FANOUT_DAIMG) pool = image_worker_pool_new(threads, 0, IMAGE_WORK_DECOMPRESS, NULL);
+    else if (kind == FANOUT_REPO) pool = image_worker_pool_new(threads, 0, IMAGE_WORK_REPO_LOAD, chunk_dir);
+    guint window = pool ? pool->thread_count * 2 + 2 : 0;
+    guint64 next_read = 0, in_flight = 0, done = 0, image_pos = 0;
+    gboolean ok = live > 0;
+    gint64 started = g_get_monotonic_time(), last_report = 0;
+    while (ok || in_flight > 0) {
+        ImageChunkJob *job = NULL;
+        if (ok && next_read < entries->len && (!pool || in_flight < window)) {
+            job = g_new0(ImageChunkJob, 1);
+            job->seq = next_read;
+            job->entry = g_array_index(entries, ImageIndexEntry, next_read++);
+            io_pace(job->entry.raw_length);
+            gboolean read_ok = TRUE;
+            if (kind == FANOUT_DAIMG) {
+                guint data_level = 0;
+                const ImageIndexEntry *data = image_chain_resolve(&chain, &job->entry, &data_level);
+                if (data) job->entry = *data;
+                job->stored = g_malloc(job->entry.stored_length + 1);
+                read_ok = data && read_exact_at(chain.fds[data_level], job->stored, job->entry.stored_length, job->entry.stored_offset);
+            } else if (kind == FANOUT_REPO) {
+                g_strlcpy(job->hash, g_ptr_array_index(hashes, job->seq), sizeof(job->hash));
+            } else if (kind == FANOUT_USED) {
+                job->raw = g_malloc(job->entry.raw_length);
+                read_ok = read_exact_at(in, job->raw, job->entry.raw_length, image_pos);
+                image_pos += job->entry.raw_length;
             } else {
-                g_warning("Failed to fork process");
-                GtkWidget *err = gtk_message_dialog_new(
-                    GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(tree_view))),
-                    GTK_DIALOG_MODAL,
-                    GTK_MESSAGE_ERROR,
-                    GTK_BUTTONS_OK,
-                    "Failed to create new process."
-                );
-                gtk_dialog_run(GTK_DIALOG(err));
-                gtk_widget_destroy(err);
-                g_free(command);
+                /* Holes in a raw image file are zero chunks without reading them. */
+                off_t data = lseek(in, (off_t)job->entry.device_offset, SEEK_DATA);
+                if (data >= 0 && (guint64)data < job->entry.device_offset + job->entry.raw_length) {
+                    job->raw = g_malloc(job->entry.raw_length);
+                    read_ok = read_exact_at(in, job->raw, job->entry.raw_length, job->entry.device_offset);
+                }
+            }
+            if (!read_ok) {
+                g_printerr("\nCannot read chunk %" G_GUINT64_FORMAT " of the image\n", job->seq);
+                free_image_chunk_job(job);
+                ok = FALSE;
+                continue;
             }
+            if (pool) {
+                g_async_queue_push(pool->jobs, job);
+                in_flight++;
+                continue;
+            }
+        } else if (in_flight > 0) {
+            job = g_async_queue_pop(pool->done);
+            in_flight--;
+            if (ok && job->failed) {
+                g_printerr("\nChunk %" G_GUINT64_FORMAT " (device offset %" G_GUINT64_FORMAT ") is damaged or missing\n",
+                           job->seq, job->entry.device_offset);
+                ok = FALSE;
+            }
+        } else {
+            break;
         }
-
-        g_free(quoted_device_path);
-        g_free(quoted_disk_path);
-        g_free(quoted_mountpoint);
-        g_free(mount_dir);
-        g_free(quoted_mount_dir);
-        g_free(device_path);
-        g_free(disk_path);
-        g_free(partition_name);
-        g_free(mountpoint);
+        if (!ok) {
+            free_image_chunk_job(job);
+            continue;
+        }
+        done += job->entry.raw_length;
+        if (!fanout_dispatch(&fan, job)) {
+            g_printerr("\nEvery target has failed\n");
+            ok = FALSE;
+        }
+        if (g_get_monotonic_time() - last_report > G_USEC_PER_SEC) {
+            guint64 slowest = done;
+            g_mutex_lock(&fan.lock);
+            for (guint i = 0; i < count; i++)
+                if (!fan.targets[i].failed) slowest = MIN(slowest, fan.targets[i].written);
+            g_mutex_unlock(&fan.lock);
+            print_transfer_progress("Decoded", done, used, started, FALSE);
+            g_printerr("slowest target %" G_GUINT64_FORMAT " MiB behind   ", (done - slowest) >> 20);
+            last_report = g_get_monotonic_time();
+        }
+    }
+    if (pool) image_worker_pool_free(pool);
+    for (guint i = 0; i < count; i++)
+        if (fan.targets[i].thread) g_async_queue_push(fan.targets[i].queue, &fanout_stop);
+    for (guint i = 0; i < count; i++)
+        if (fan.targets[i].thread) g_thread_join(fan.targets[i].thread);
+    if (ok) print_transfer_progress("Decoded", done, used, started, TRUE);
+    else g_printerr("\n");
+
+    guint succeeded = 0;
+    for (guint i = 0; i < count; i++) {
+        FanoutTarget *t = &fan.targets[i];
+        gboolean complete = ok && !t->failed;
+        double seconds = t->finished_at > started ? (t->finished_at - started) / 1e6 : 0;
+        if (complete) {
+            succeeded++;
+            g_printerr("  OK      %s: %" G_GUINT64_FORMAT " MiB in %.1f s (%.1f MiB/s)\n", t->path, t->written >> 20, seconds,
+                       seconds > 0 ? (t->written / 1048576.0) / seconds : 0.0);
+        } else {
+            g_printerr("  FAILED  %s: %s\n", t->path, t->error ? t->error : "the image could not be read to the end");
+        }
+        if (t->queue) g_async_queue_unref(t->queue);
+        if (t->fd >= 0) close(t->fd);
+        g_free(t->error);
     }
+    g_printerr("%u of %u targets restored\n", succeeded, count);
+
+    g_free(fan.targets);
+    g_mutex_clear(&fan.lock);
+    g_cond_clear(&fan.drained);
+    g_array_free(entries, TRUE);
+    if (hashes) g_ptr_array_free(hashes, TRUE);
+    if (in >= 0) close(in);
+    image_chain_close(&chain);
+    g_free(chunk_dir);
+    g_free(fs_name);
+    return succeeded == count ? 0 : 1;
 }
 
-void on_toggle_boot_flag_activate(GtkWidget *menuitem, gpointer user_data) {
-    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
-    GtkTreeModel *model;
-    GtkTreeIter iter;
-    gchar *partition_name = NULL;
 
-    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
-        gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
+/*
+ * Rescue imaging for failing drives. The source is read in passes: large blocks first, skipping ahead past read errors
+ * and slow areas, then the remaining areas in smaller blocks, then single sectors, then optional retries of the bad
+ * sectors. Readable data goes to the same offset in IMAGE (unread areas stay holes). IMAGE.rescue-map records every
+ * range as untried (?), rescued (+), skipped (*) or bad (-); it is saved every few seconds after the image has been
+ * flushed, and running the same job again continues from it.
+ */
+#define RESCUE_MAP_MAGIC "# DriveAssistify rescue map 1"
+#define RESCUE_LARGE_BLOCK (1 << 20)
+#define RESCUE_SMALL_BLOCK (64 << 10)
+#define RESCUE_MAX_SKIP (64 << 20)
+#define RESCUE_SLOW_USEC (2 * G_USEC_PER_SEC)
+#define RESCUE_SAVE_INTERVAL 5
+#define RESCUE_STATUSES "+?*-"
 
-        gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+typedef struct {
+    guint64 offset;
+    guint64 length;
+    gchar status;
+} RescueRange;
 
-        gchar *disk_path = NULL;
-        gchar *part_num = NULL;
-        if (g_str_has_prefix(partition_name, "nvme") && strchr(partition_name, 'p')) {
-            char *p = strrchr(device_path, 'p');
-            if (p) {
-                disk_path = g_strndup(device_path, p - device_path);
-                part_num = g_strdup(p + 1);
-            }
+typedef struct {
+    int src;
+    ZeroAwareTarget target;
+    GArray *map;
+    guint64 size;
+    guint sector;
+    guchar *buf;
+    const gchar *src_path;
+    gchar *map_path;
+    gint64 started;
+    gint64 last_save;
+    gint64 last_report;
+} RescueJob;
+
+typedef struct {
+    const gchar *name;
+    const gchar *statuses;
+    guint block;
+    gboolean skip_ahead;
+    gchar fail_status;
+} RescuePass;
+
+/*
+ * Sets [offset, offset + length), which lies inside range i, to status. The map is changed in place: the common case
+ * of a block at the edge of a range only moves one boundary, and at most two ranges are inserted or removed.
+ * Returns the index of the range that now holds offset.
+ */
+static guint rescue_map_set(GArray *map, guint i, guint64 offset, guint64 length, gchar status) {
+    RescueRange *r = &g_array_index(map, RescueRange, i);
+    RescueRange *prev = i > 0 ? r - 1 : NULL;
+    RescueRange *next = i + 1 < map->len ? r + 1 : NULL;
+    guint64 end = offset + length, r_end = r->offset + r->length;
+    if (r->status == status) return i;
+
+    if (offset == r->offset && end == r_end) {
+        r->status = status;
+        if (next && next->status == status) {
+            r->length += next->length;
+            g_array_remove_index(map, i + 1);
+        }
+        if (prev && prev->status == status) {
+            prev->length += r->length;
+            g_array_remove_index(map, i);
+            return i - 1;
+        }
+        return i;
+    }
+    if (offset == r->offset) {
+        r->offset = end;
+        r->length = r_end - end;
+        if (prev && prev->status == status) {
+            prev->length += length;
+            return i - 1;
+        }
+        g_array_insert_val(map, i, ((RescueRange){offset, length, status}));
+        return i;
+    }
+    r->length = offset - r->offset;
+    if (end == r_end) {
+        if (next && next->status == status) {
+            next->offset = offset;
+            next->length += length;
         } else {
-            char *p = device_path + strlen(device_path) - 1;
-            while (p > device_path && g_ascii_isdigit(*p)) p--;
-            p++;
-            disk_path = g_strndup(device_path, p - device_path);
-            part_num = g_strdup(p);
+            g_array_insert_val(map, i + 1, ((RescueRange){offset, length, status}));
         }
+        return i + 1;
+    }
+    RescueRange pieces[2] = {{offset, length, status}, {end, r_end - end, r->status}};
+    g_array_insert_vals(map, i + 1, pieces, 2);
+    return i + 1;
+}
 
-        if (g_find_program_in_path("parted")) {
-            gchar *check_cmd = g_strdup_printf(
-                "parted -s %s print | grep -E '^ %s ' | grep boot",
-                disk_path, part_num
-            );
-            int has_boot = (system(check_cmd) == 0);
-            g_free(check_cmd);
+/* Index of the range holding pos; the ranges are sorted and cover the whole source. */
+static guint rescue_map_find(GArray *map, guint64 pos) {
+    guint low = 0, high = map->len;
+    while (high - low > 1) {
+        guint mid = low + (high - low) / 2;
+        if (g_array_index(map, RescueRange, mid).offset <= pos) low = mid;
+        else high = mid;
+    }
+    return low;
+}
+
+/*
+ * Finds the first part at or after pos with one of statuses. *cursor is the index where the previous search of the
+ * pass ended; positions only grow within a pass, so the search walks on from there.
+ */
+static gboolean rescue_map_next(GArray *map, guint *cursor, guint64 pos, const gchar *statuses, guint64 *offset, guint64 *length) {
+    if (map->len == 0) return FALSE;
+    guint i = *cursor < map->len ? *cursor : rescue_map_find(map, pos);
+    if (g_array_index(map, RescueRange, i).offset > pos) i = rescue_map_find(map, pos);
+    for (; i < map->len; i++) {
+        RescueRange r = g_array_index(map, RescueRange, i);
+        if (r.offset + r.length <= pos || !strchr(statuses, r.status)) continue;
+        *offset = MAX(r.offset, pos);
+        *length = r.offset + r.length - *offset;
+        *cursor = i;
+        return TRUE;
+    }
+    *cursor = map->len;
+    return FALSE;
+}
+
+/* Bytes per status, indexed like RESCUE_STATUSES. */
+static void rescue_map_totals(GArray *map, guint64 totals[4]) {
+    memset(totals, 0, 4 * sizeof(guint64));
+    for (guint i = 0; i < map->len; i++) {
+        RescueRange r = g_array_index(map, RescueRange, i);
+        totals[strchr(RESCUE_STATUSES, r.status) - RESCUE_STATUSES] += r.length;
+    }
+}
+
+static gboolean rescue_map_save(const gchar *path, const gchar *source, guint64 size, GArray *map) {
+    GString *out = g_string_new(RESCUE_MAP_MAGIC "\n");
+    g_string_append_printf(out, "source %s\nsize %" G_GUINT64_FORMAT "\n", source, size);
+    for (guint i = 0; i < map->len; i++) {
+        RescueRange r = g_array_index(map, RescueRange, i);
+        g_string_append_printf(out, "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %c\n", r.offset, r.length, r.status);
+    }
+    gboolean ok = g_file_set_contents(path, out->str, (gssize)out->len, NULL);
+    g_string_free(out, TRUE);
+    return ok;
+}
+
+/* Loads a rescue map; the ranges must cover the device without gaps. *size is 0 if the map gives no size. */
+static GArray *rescue_map_load(const gchar *path, guint64 *size) {
+    gchar *contents = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, NULL) || !g_str_has_prefix(contents, RESCUE_MAP_MAGIC)) {
+        g_free(contents);
+        return NULL;
+    }
+    GArray *map = g_array_new(FALSE, FALSE, sizeof(RescueRange));
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    gboolean valid = TRUE;
+    guint64 pos = 0;
+    *size = 0;
+    for (int i = 1; valid && lines[i]; i++) {
+        guint64 offset, length;
+        char status;
+        if (g_str_has_prefix(lines[i], "size ")) *size = g_ascii_strtoull(lines[i] + 5, NULL, 10);
+        else if (sscanf(lines[i], "%" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %c", &offset, &length, &status) == 3) {
+            valid = offset == pos && length > 0 && strchr(RESCUE_STATUSES, status) != NULL;
+            g_array_append_val(map, ((RescueRange){offset, length, status}));
+            pos += length;
+        }
+    }
+    if (!valid || map->len == 0 || pos != *size) {
+        g_array_free(map, TRUE);
+        map = NULL;
+    }
+    g_strfreev(lines);
+    g_free(contents);
+    return map;
+}
 
-            gchar *parted_cmd = NULL;
-            if (has_boot) {
-                parted_cmd = g_strdup_printf(
-                    "parted -s %s set %s boot off && echo 'Boot flag removed.' || echo 'Failed to remove boot flag.'",
-                    disk_path, part_num
-                );
-            } else {
-                parted_cmd = g_strdup_printf(
-                    "parted -s %s set %s boot on && echo 'Boot flag set.' || echo 'Failed to set boot flag.'",
-                    disk_path, part_num
-                );
-            }
+/* Text view of the map: 64 x 16 cells, each covering 1/1024 of the device. A cell shows its worst state.
+ * print is g_printerr during a job and g_print for --rescue-map. */
+static void rescue_print_map(GArray *map, guint64 size, void (*print)(const gchar *, ...)) {
+    const guint columns = 64, cells = 1024;
+    guint64 cell = MAX((size + cells - 1) / cells, 1);
+    guint count = (guint)((size + cell - 1) / cell);
+    guint i = 0;
+    GString *row = g_string_new(NULL);
+    for (guint c = 0; c < count; c++) {
+        guint64 start = (guint64)c * cell, end = MIN(size, start + cell);
+        while (i < map->len && g_array_index(map, RescueRange, i).offset + g_array_index(map, RescueRange, i).length <= start) i++;
+        gboolean seen[4] = {FALSE};
+        for (guint j = i; j < map->len && g_array_index(map, RescueRange, j).offset < end; j++)
+            seen[strchr(RESCUE_STATUSES, g_array_index(map, RescueRange, j).status) - RESCUE_STATUSES] = TRUE;
+        gchar mark = seen[3] ? 'X' : seen[2] ? '*' : (seen[1] && seen[0]) ? 'o' : seen[1] ? '.' : '#';
+        if (c % columns == 0) g_string_printf(row, "%10" G_GUINT64_FORMAT " MiB |", start >> 20);
+        g_string_append_c(row, mark);
+        if (c % columns == columns - 1 || c == count - 1) print("%s|\n", row->str);
+    }
+    g_string_free(row, TRUE);
+    guint64 totals[4];
+    rescue_map_totals(map, totals);
+    print("# rescued %" G_GUINT64_FORMAT " MiB (%.2f%%)   . untried %" G_GUINT64_FORMAT " MiB   * skipped %" G_GUINT64_FORMAT
+               " MiB   X bad %" G_GUINT64_FORMAT " KiB   o partly rescued   (one cell is %" G_GUINT64_FORMAT " KiB)\n",
+               totals[0] >> 20, size ? 100.0 * totals[0] / size : 0.0, totals[1] >> 20, totals[2] >> 20, totals[3] >> 10, cell >> 10);
+}
 
-            run_command_in_terminal(tree_view, parted_cmd);
-            g_free(parted_cmd);
-        } else {
-            gchar *boot_flag_hint = g_strdup_printf(
-                "To manually set the boot flag for a partition using fdisk:\n\n"
-                "1. Open a terminal and run:\n"
-                "   sudo fdisk %s\n\n"
-                "2. In fdisk, enter the following commands in order:\n"
-                "   a    (press 'a' and Enter)\n"
-                "   %s  (enter the partition number and press Enter)\n"
-                "   w    (press 'w' and Enter)\n\n"
-                "After this, the boot flag will be set. Check the result with:\n"
-                "   sudo fdisk -l %s\n",
-                disk_path, part_num, disk_path
-            );
+/* The image is flushed before the map is written, so the map never claims data that is not on disk yet. */
+static gboolean rescue_save(RescueJob *job) {
+    job->last_save = g_get_monotonic_time();
+    if (!flush_zero_range(&job->target) || fdatasync(job->target.fd) != 0) return FALSE;
+    return rescue_map_save(job->map_path, job->src_path, job->size, job->map);
+}
 
-            show_large_text_dialog(
-                GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(tree_view))),
-                "Manual Boot Flag Setup",
-                boot_flag_hint
-            );
-            g_free(boot_flag_hint);
+static gboolean rescue_run_pass(RescueJob *job, const RescuePass *pass, guint number) {
+    guint block = pass->block ? pass->block : job->sector;
+    guint64 pos = 0, skip = 0, offset, length;
+    guint cursor = 0;
+    g_printerr("Pass %u (%s, %u %s blocks%s)\n", number, pass->name, block >= 1024 ? block >> 10 : block, block >= 1024 ? "KiB" : "byte",
+               pass->skip_ahead ? ", skipping bad and slow areas" : "");
+    while (rescue_map_next(job->map, &cursor, pos, pass->statuses, &offset, &length)) {
+        /* Reads stay on the block grid, so later passes split failed blocks cleanly. */
+        guint64 n = MIN(length, block - offset % block);
+        io_pace((gsize)n);
+        gint64 before = g_get_monotonic_time();
+        gboolean ok = read_exact_at(job->src, job->buf, (gsize)n, offset);
+        gint64 took = g_get_monotonic_time() - before;
+        if (ok && !zero_aware_write(&job->target, job->buf, (gsize)n, offset)) {
+            g_printerr("\nCannot write the image at byte %" G_GUINT64_FORMAT ": %s\n", offset, g_strerror(errno));
+            return FALSE;
+        }
+        cursor = rescue_map_set(job->map, cursor, offset, n, ok ? '+' : pass->fail_status);
+        pos = offset + n;
+        if (pass->skip_ahead && (!ok || took > RESCUE_SLOW_USEC)) {
+            /* Skip further after each consecutive problem; the skipped area stays untried for the next pass. */
+            skip = skip ? MIN(skip * 2, (guint64)RESCUE_MAX_SKIP) : block;
+            pos += skip;
+        } else if (ok) {
+            skip = 0;
+        }
+        gint64 now = g_get_monotonic_time();
+        if (now - job->last_save > RESCUE_SAVE_INTERVAL * G_USEC_PER_SEC && !rescue_save(job)) {
+            g_printerr("\nCannot save %s: %s\n", job->map_path, g_strerror(errno));
+            return FALSE;
         }
+        if (now - job->last_report > G_USEC_PER_SEC) {
+            guint64 totals[4];
+            rescue_map_totals(job->map, totals);
+            g_printerr("\rAt %" G_GUINT64_FORMAT " MiB: rescued %" G_GUINT64_FORMAT " MiB, untried %" G_GUINT64_FORMAT
+                       " MiB, skipped %" G_GUINT64_FORMAT " MiB, bad %" G_GUINT64_FORMAT " KiB   ",
+                       pos >> 20, totals[0] >> 20, totals[1] >> 20, totals[2] >> 20, totals[3] >> 10);
+            job->last_report = now;
+        }
+    }
+    if (!rescue_save(job)) {
+        g_printerr("\nCannot save %s: %s\n", job->map_path, g_strerror(errno));
+        return FALSE;
+    }
+    g_printerr("\n");
+    rescue_print_map(job->map, job->size, g_printerr);
+    return TRUE;
+}
 
-        g_free(device_path);
-        g_free(disk_path);
-        g_free(part_num);
-        g_free(partition_name);
+/* Images src to image_path pass by pass; an existing IMAGE.rescue-map for the same source size resumes that job. */
+static int rescue_image(const gchar *src_path, const gchar *image_path, guint retries) {
+    RescueJob job = {0};
+    job.src_path = src_path;
+    /* O_DIRECT keeps readahead from touching bad areas outside the block being read. */
+    job.src = open(src_path, O_RDONLY | O_DIRECT);
+    if (job.src < 0) job.src = open(src_path, O_RDONLY);
+    int dst = open(image_path, O_RDWR | O_CREAT, 0644);
+    if (job.src < 0 || dst < 0) {
+        g_printerr("Cannot open %s: %s\n", job.src < 0 ? src_path : image_path, g_strerror(errno));
+        if (job.src >= 0) close(job.src);
+        if (dst >= 0) close(dst);
+        return 1;
     }
+    job.size = (guint64)lseek(job.src, 0, SEEK_END);
+    int sector = 0;
+    job.sector = ioctl(job.src, BLKSSZGET, &sector) == 0 && sector >= 512 ? (guint)sector : 512;
+    job.map_path = g_strdup_printf("%s.rescue-map", image_path);
+
+    int rc = 1;
+    guint64 map_size = 0;
+    struct stat st;
+    job.map = rescue_map_load(job.map_path, &map_size);
+    if (!job.map && g_file_test(job.map_path, G_FILE_TEST_EXISTS)) {
+        g_printerr("%s is damaged; move it away to start over\n", job.map_path);
+    } else if (job.map && map_size != job.size) {
+        g_printerr("%s belongs to a source of %" G_GUINT64_FORMAT " bytes, but %s has %" G_GUINT64_FORMAT " bytes\n",
+                   job.map_path, map_size, src_path, job.size);
+    } else if (fstat(dst, &st) != 0 ||
+               /* A new job empties an existing file first, so ranges it cannot read never keep bytes of an older image. */
+               (S_ISREG(st.st_mode) && !job.map && ftruncate(dst, 0) != 0) ||
+               (S_ISREG(st.st_mode) && (!job.map || (guint64)st.st_size < job.size) && ftruncate(dst, (off_t)job.size) != 0) ||
+               (guint64)lseek(dst, 0, SEEK_END) < job.size) {
+        g_printerr("%s cannot hold %" G_GUINT64_FORMAT " bytes\n", image_path, job.size);
+    } else {
+        if (job.map) {
+            guint64 totals[4];
+            rescue_map_totals(job.map, totals);
+            g_printerr("Resuming from %s: %" G_GUINT64_FORMAT " MiB already rescued\n", job.map_path, totals[0] >> 20);
+        } else {
+            job.map = g_array_new(FALSE, FALSE, sizeof(RescueRange));
+            g_array_append_val(job.map, ((RescueRange){0, job.size, '?'}));
+        }
+        g_printerr("Rescuing %s (%" G_GUINT64_FORMAT " MiB, %u-byte sectors) to %s\n", src_path, job.size >> 20, job.sector, image_path);
+
+        const RescuePass passes[] = {
+            {"copy", "?", RESCUE_LARGE_BLOCK, TRUE, '*'},
+            {"trim", "?*", RESCUE_SMALL_BLOCK, FALSE, '*'},
+            {"scrape", "*", 0, FALSE, '-'},
+        };
+        const RescuePass retry = {"retry bad sectors", "-", 0, FALSE, '-'};
+        void *buf = NULL;
+        gboolean ok = posix_memalign(&buf, 4096, RESCUE_LARGE_BLOCK) == 0;
+        job.buf = buf;
+        zero_aware_target_init(&job.target, dst, FALSE);
+        job.started = job.last_save = g_get_monotonic_time();
+        for (guint i = 0; ok && i < G_N_ELEMENTS(passes) + retries; i++)
+            ok = rescue_run_pass(&job, i < G_N_ELEMENTS(passes) ? &passes[i] : &retry, i + 1);
+        if (ok) {
+            guint64 totals[4];
+            rescue_map_totals(job.map, totals);
+            g_printerr("Finished in %.0f s: %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " MiB rescued, %" G_GUINT64_FORMAT
+                       " KiB unreadable\n", (g_get_monotonic_time() - job.started) / 1e6, totals[0] >> 20, job.size >> 20,
+                       totals[3] >> 10);
+            if (totals[3] > 0) g_printerr("The unreadable ranges are marked '-' in %s\n", job.map_path);
+            rc = 0;
+        }
+        free(buf);
+    }
+    if (job.map) g_array_free(job.map, TRUE);
+    g_free(job.map_path);
+    close(job.src);
+    close(dst);
+    return rc;
+}
+
+/* --rescue-map: prints the map of a rescue job, for example under watch(1) while the job runs. */
+static int print_rescue_map(const gchar *image_path) {
+    gchar *map_path = g_str_has_suffix(image_path, ".rescue-map") ? g_strdup(image_path) : g_strdup_printf("%s.rescue-map", image_path);
+    guint64 size = 0;
+    GArray *map = rescue_map_load(map_path, &size);
+    if (!map) {
+        g_printerr("%s is missing or not a DriveAssistify rescue map\n", map_path);
+        g_free(map_path);
+        return 1;
+    }
+    g_print("%s\n", map_path);
+    rescue_print_map(map, size, g_print);
+    g_array_free(map, TRUE);
+    g_free(map_path);
+    return 0;
 }
 
+
 void on_dd_copy_partition_activate(GtkWidget *menuitem, gpointer user_data) {
     GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
     GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
@@ -4044,9 +11584,52 @@ void on_dd_copy_partition_activate(GtkWidget *menuitem, gpointer user_data) {
         );
         gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), "partition_image.img");
 
+        GtkWidget *mode_combo = gtk_combo_box_text_new();
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(mode_combo), "used", "Used blocks only (packed image + .map, restore with DriveAssistify)");
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(mode_combo), "zstd1", "Used blocks, compressed .daimg - fast (zstd 1)");
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(mode_combo), "zstd3", "Used blocks, compressed .daimg - balanced (zstd 3)");
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(mode_combo), "zstd9", "Used blocks, compressed .daimg - small (zstd 9)");
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(mode_combo), "diff", "Used blocks, differential .daimg - only chunks changed since a base .daimg (zstd 3)");
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(mode_combo), "repo", "Used blocks, deduplicated repository (manifest + shared chunks folder)");
+        gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(mode_combo), "raw", "Full raw copy (dd)");
+        gtk_combo_box_set_active_id(GTK_COMBO_BOX(mode_combo), "used");
+        gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(dialog), mode_combo);
+
         if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
             char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
             gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
+            const gchar *mode = gtk_combo_box_get_active_id(GTK_COMBO_BOX(mode_combo));
+            gboolean used_only = g_strcmp0(mode, "used") == 0;
+            int zstd_level = mode && g_str_has_prefix(mode, "zstd") ? atoi(mode + 4) : 0;
+            gboolean repository = g_strcmp0(mode, "repo") == 0;
+            gchar *base_image = NULL;
+            if (g_strcmp0(mode, "diff") == 0) {
+                GtkWidget *base_dialog = gtk_file_chooser_dialog_new("Select the Base Image (.daimg)", NULL, GTK_FILE_CHOOSER_ACTION_OPEN,
+                                                                     "_Cancel", GTK_RESPONSE_CANCEL, "_Open", GTK_RESPONSE_ACCEPT, NULL);
+                if (gtk_dialog_run(GTK_DIALOG(base_dialog)) == GTK_RESPONSE_ACCEPT)
+                    base_image = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(base_dialog));
+                gtk_widget_destroy(base_dialog);
+                if (!base_image || !is_compressed_image(base_image) || g_strcmp0(base_image, filename) == 0) {
+                    GtkWidget *error = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                                                              "A differential image needs an existing .daimg image of this partition as its base, "
+                                                              "and it must be saved to a different file.");
+                    gtk_dialog_run(GTK_DIALOG(error));
+                    gtk_widget_destroy(error);
+                    g_free(base_image);
+                    g_free(filename);
+                    g_free(device_path);
+                    gtk_widget_destroy(dialog);
+                    g_free(partition_name);
+                    g_free(mountpoint);
+                    return;
+                }
+            }
+            if (repository && !g_str_has_suffix(filename, ".manifest")) {
+                /* The image becomes a manifest; its chunks go to a "chunks" folder shared by every manifest beside it. */
+                gchar *manifest = g_strdup_printf("%s.manifest", filename);
+                g_free(filename);
+                filename = manifest;
+            }
 
             GtkWidget *warn = gtk_message_dialog_new(
                 NULL,
@@ -4065,27 +11648,71 @@ void on_dd_copy_partition_activate(GtkWidget *menuitem, gpointer user_data) {
                 gchar *quoted_device = g_shell_quote(device_path);
                 gchar *quoted_file = g_shell_quote(filename);
 
+                gchar *tuning_key = get_transfer_tuning_key("read", device_path);
+                gchar *tuning = NULL, *size_expr = NULL, *copy = NULL;
+                if (base_image) {
+                    /* Chunks are hashed against the base image's chunk hashes; only changed chunks are compressed and stored. */
+                    gchar *args = g_strdup_printf("%s 3 %d", quoted_file, g_get_num_processors());
+                    tuning = g_strdup("echo 'Reading the file system allocation bitmap...'");
+                    size_expr = g_strdup("");
+                    copy = build_image_helper_command("--image-diff", device_path, base_image, args);
+                    g_free(args);
+                } else if (repository) {
+                    /* Chunk hashing and compression run on one worker thread per CPU; known chunks are not stored again. */
+                    gchar *args = g_strdup_printf("3 %d", g_get_num_processors());
+                    tuning = g_strdup("echo 'Reading the file system allocation bitmap...'");
+                    size_expr = g_strdup("");
+                    copy = build_image_helper_command("--image-repo", device_path, filename, args);
+                    g_free(args);
+                } else if (zstd_level > 0) {
+                    /* Compression runs on one worker thread per CPU, so reading the partition stays the bottleneck. */
+                    gchar *args = g_strdup_printf("%d %d", zstd_level, g_get_num_processors());
+                    tuning = g_strdup("echo 'Reading the file system allocation bitmap...'");
+                    size_expr = g_strdup("");
+                    copy = build_image_helper_command("--image-compressed", device_path, filename, args);
+                    g_free(args);
+                } else if (used_only) {
+                    /* Only allocated clusters are read; unknown file systems fall back to one full-size extent. */
+                    tuning = g_strdup("echo 'Reading the file system allocation bitmap...'");
+                    size_expr = g_strdup("");
+                    copy = build_image_helper_command("--image-used", device_path, filename, NULL);
+                } else {
+                    /* conv=sparse leaves holes for zero blocks; the final truncate keeps a trailing hole in the file size. */
+                    tuning = build_transfer_tuning_command(tuning_key, device_path, "/dev/null", FALSE, TRUE, FALSE, FALSE);
+                    size_expr = g_strdup_printf("$(sudo blockdev --getsize64 %s)", quoted_device);
+                    gchar *dd_copy = build_tuned_dd_command(device_path, filename, size_expr, FALSE, TRUE, FALSE, TRUE);
+                    copy = g_strdup_printf("%s && sudo truncate -s %s %s", dd_copy, size_expr, quoted_file);
+                    g_free(dd_copy);
+                }
+
                 gchar *command = NULL;
                 if (mountpoint && strlen(mountpoint) > 0 && strcmp(mountpoint, "N/A") != 0 && strcmp(mountpoint, "-") != 0) {
                     command = g_strdup_printf(
                         "umount %s 2>/dev/null; "
-                        "sudo dd if=%s of=%s bs=4M status=progress",
-                        quoted_device, quoted_device, quoted_file
+                        "%s; sudo truncate -s 0 %s 2>/dev/null; %s",
+                        quoted_device, tuning, quoted_file, copy
                     );
                 } else {
                     command = g_strdup_printf(
-                        "sudo dd if=%s of=%s bs=4M status=progress",
-                        quoted_device, quoted_file
+                        "%s; sudo truncate -s 0 %s 2>/dev/null; %s",
+                        tuning, quoted_file, copy
                     );
                 }
 
-                run_command_in_terminal(tree_view, command);
+                gchar *budgeted = build_io_budget_command("Partition image", device_path, command);
+                run_command_in_terminal(tree_view, budgeted);
 
+                g_free(budgeted);
                 g_free(command);
+                g_free(copy);
+                g_free(size_expr);
+                g_free(tuning);
+                g_free(tuning_key);
                 g_free(quoted_device);
                 g_free(quoted_file);
             }
 
+            g_free(base_image);
             g_free(device_path);
             g_free(filename);
         }
@@ -4113,8 +11740,12 @@ void on_dd_restore_partition_activate(GtkWidget *menuitem, gpointer user_data) {
             "_Open", GTK_RESPONSE_ACCEPT,
             NULL
         );
+        GtkWidget *zeroed_check = gtk_check_button_new_with_label("Target partition is already zeroed (skip zero ranges instead of zeroing them)");
+        gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(dialog), zeroed_check);
+
         if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
             char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+            gboolean target_zeroed = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(zeroed_check));
             gchar *device_path = g_strdup_printf("/dev/%s", partition_name);
 
             GtkWidget *confirm = gtk_message_dialog_new(
@@ -4139,33 +11770,61 @@ void on_dd_restore_partition_activate(GtkWidget *menuitem, gpointer user_data) {
                 gchar *disk_path = g_strdup_printf("/dev/%s", disk_name);
                 gchar *quoted_disk = g_shell_quote(disk_path);
 
+                /* Zero ranges are zeroed with BLKZEROOUT, or skipped when the target is known to be zeroed already. */
+                const gchar *zero_arg = target_zeroed ? "--target-zeroed" : NULL;
+                gchar *map_path = g_strdup_printf("%s.map", filename);
+                gchar *tuning = NULL, *restore = NULL;
+                if (is_repository_manifest(filename)) {
+                    gchar *args = g_strdup_printf("%d%s%s", g_get_num_processors(), zero_arg ? " " : "", zero_arg ? zero_arg : "");
+                    tuning = g_strdup("echo 'Restoring an image from a deduplicated repository...'");
+                    restore = build_image_helper_command("--restore-repo", filename, device_path, args);
+                    g_free(args);
+                } else if (is_compressed_image(filename)) {
+                    gchar *args = g_strdup_printf("%d%s%s", g_get_num_processors(), zero_arg ? " " : "", zero_arg ? zero_arg : "");
+                    tuning = g_strdup("echo 'Restoring a compressed DriveAssistify image...'");
+                    restore = build_image_helper_command("--restore-image", filename, device_path, args);
+                    g_free(args);
+                } else if (g_file_test(map_path, G_FILE_TEST_EXISTS)) {
+                    /* Packed used-blocks image: each extent goes back to the offset recorded in the block map. */
+                    tuning = g_strdup("echo 'Restoring a used-blocks image using its block map...'");
+                    restore = build_image_helper_command("--restore-used", filename, device_path, zero_arg);
+                } else {
+                    tuning = g_strdup("echo 'Restoring a raw image (holes and zero blocks are not written)...'");
+                    restore = build_image_helper_command("--restore-raw", filename, device_path, zero_arg);
+                }
+                g_free(map_path);
+
                 gchar *command = NULL;
                 if (mountpoint && strlen(mountpoint) > 0 && strcmp(mountpoint, "N/A") != 0 && strcmp(mountpoint, "-") != 0) {
                     command = g_strdup_printf(
                         "echo 'WARNING! Do NOT mount this partition during restore, otherwise the data may be corrupted.'; "
                         "umount %s 2>/dev/null; "
-                        "sudo dd if=%s of=%s bs=4M status=progress; "
+                        "%s; %s; "
                         "echo 'Updating partition table...'; sudo partprobe %s || sudo blockdev --rereadpt %s; "
                         "sleep 1; "
                         "echo 'Partition restored successfully!'",
-                        quoted_device, quoted_file, quoted_device,
+                        quoted_device, tuning, restore,
                         quoted_disk, quoted_disk
                     );
                 } else {
                     command = g_strdup_printf(
                         "echo 'WARNING! Do NOT mount this partition during restore, otherwise the data may be corrupted.'; "
-                        "sudo dd if=%s of=%s bs=4M status=progress; "
+                        "%s; %s; "
                         "echo 'Updating partition table...'; sudo partprobe %s || sudo blockdev --rereadpt %s; "
                         "sleep 1; "
                         "echo 'Partition restored successfully!'",
-                        quoted_file, quoted_device,
+                        tuning, restore,
                         quoted_disk, quoted_disk
                     );
                 }
 
-                run_command_in_terminal(tree_view, command);
+                gchar *budgeted = build_io_budget_command("Partition restore", device_path, command);
+                run_command_in_terminal(tree_view, budgeted);
 
+                g_free(budgeted);
                 g_free(command);
+                g_free(restore);
+                g_free(tuning);
                 g_free(quoted_device);
                 g_free(quoted_file);
                 g_free(quoted_disk);
@@ -4182,6 +11841,589 @@ void on_dd_restore_partition_activate(GtkWidget *menuitem, gpointer user_data) {
     }
 }
 
+/* One line for the resume dialog; *device receives the partition the job reads or writes. */
+static gchar *describe_image_journal(const gchar *path, gchar **device) {
+    gchar *contents = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, NULL) || !g_str_has_prefix(contents, IMAGE_JOURNAL_MAGIC)) {
+        g_free(contents);
+        return NULL;
+    }
+    const gchar *op = "?", *source = "?", *destination = "?";
+    guint64 units = 0, committed = 0;
+    gchar **lines = g_strsplit(contents, "\n", -1);
+    for (int i = 0; lines[i]; i++) {
+        if (g_str_has_prefix(lines[i], "op ")) op = lines[i] + 3;
+        else if (g_str_has_prefix(lines[i], "source ")) source = lines[i] + 7;
+        else if (g_str_has_prefix(lines[i], "destination ")) destination = lines[i] + 12;
+        else if (g_str_has_prefix(lines[i], "units ")) units = g_ascii_strtoull(lines[i] + 6, NULL, 10);
+        else if (g_str_has_prefix(lines[i], "commit ")) committed = g_ascii_strtoull(lines[i] + 7, NULL, 10);
+    }
+    struct stat st;
+    gchar *when = NULL;
+    if (stat(path, &st) == 0) {
+        GDateTime *saved = g_date_time_new_from_unix_local(st.st_mtime);
+        when = g_date_time_format(saved, "%Y-%m-%d %H:%M");
+        g_date_time_unref(saved);
+    }
+    gchar *text = g_strdup_printf("%s: %s -> %s (%" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " chunks, last saved %s)",
+                                  op, source, destination, committed, units, when ? when : "?");
+    if (device) *device = g_strdup(g_str_has_prefix(op, "image") ? source : destination);
+    g_free(when);
+    g_strfreev(lines);
+    g_free(contents);
+    return text;
+}
+
+void on_resume_image_job_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Resume Interrupted Image Job", NULL, GTK_DIALOG_MODAL,
+                                                    "_Discard", 1, "_Close", GTK_RESPONSE_CLOSE, "_Resume", GTK_RESPONSE_ACCEPT, NULL);
+    GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    gtk_container_set_border_width(GTK_CONTAINER(content), 10);
+    gtk_box_set_spacing(GTK_BOX(content), 8);
+    GtkWidget *label = gtk_label_new("Jobs that were interrupted (terminal closed, reboot, I/O error). Resuming checks that the source and\n"
+                                     "destination still hold the last committed chunk, then continues from there.");
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_box_pack_start(GTK_BOX(content), label, FALSE, FALSE, 0);
+    GtkWidget *combo = gtk_combo_box_text_new();
+    gtk_box_pack_start(GTK_BOX(content), combo, FALSE, FALSE, 0);
+
+    int count = 0;
+    GDir *dir = g_dir_open(IMAGE_JOURNAL_DIR, 0, NULL);
+    if (dir) {
+        const gchar *name;
+        while ((name = g_dir_read_name(dir)) != NULL) {
+            if (!g_str_has_suffix(name, ".journal")) continue;
+            gchar *path = g_build_filename(IMAGE_JOURNAL_DIR, name, NULL);
+            gchar *text = describe_image_journal(path, NULL);
+            if (text) {
+                gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(combo), path, text);
+                count++;
+            }
+            g_free(text);
+            g_free(path);
+        }
+        g_dir_close(dir);
+    }
+    if (count == 0) {
+        gtk_widget_destroy(dialog);
+        GtkWidget *info = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_INFO, GTK_BUTTONS_OK,
+                                                 "There are no interrupted image or restore jobs.");
+        gtk_dialog_run(GTK_DIALOG(info));
+        gtk_widget_destroy(info);
+        return;
+    }
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo), 0);
+    gtk_widget_show_all(dialog);
+
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    gchar *path = g_strdup(gtk_combo_box_get_active_id(GTK_COMBO_BOX(combo)));
+    gtk_widget_destroy(dialog);
+
+    if (path && response == GTK_RESPONSE_ACCEPT) {
+        gchar *device = NULL;
+        gchar *text = describe_image_journal(path, &device);
+        gchar *self = get_self_executable();
+        gchar *quoted_self = g_shell_quote(self);
+        gchar *quoted_path = g_shell_quote(path);
+        gchar *cmd = g_strdup_printf(IO_HELPER_SUDO " %s --resume-job %s", quoted_self, quoted_path);
+        gchar *budgeted = build_io_budget_command("Resumed image job", device ? device : "", cmd);
+        run_command_simple(budgeted, NULL, NULL, NULL, NULL);
+        g_free(budgeted);
+        g_free(cmd);
+        g_free(quoted_path);
+        g_free(quoted_self);
+        g_free(self);
+        g_free(text);
+        g_free(device);
+    } else if (path && response == 1) {
+        gchar *quoted_path = g_shell_quote(path);
+        gchar *cmd = g_strdup_printf("sudo rm -f %s && echo 'Journal discarded.'", quoted_path);
+        run_command_simple(cmd, NULL, NULL, NULL, NULL);
+        g_free(cmd);
+        g_free(quoted_path);
+    }
+    g_free(path);
+}
+
+void on_verify_image_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *partition_name = NULL;
+    if (gtk_tree_selection_get_selected(selection, &model, &iter))
+        gtk_tree_model_get(model, &iter, COL_NAME, &partition_name, -1);
+
+    GtkWidget *chooser = gtk_file_chooser_dialog_new("Select Image to Verify (used blocks, .daimg or .manifest)", NULL,
+                                                     GTK_FILE_CHOOSER_ACTION_OPEN, "_Cancel", GTK_RESPONSE_CANCEL,
+                                                     "_Open", GTK_RESPONSE_ACCEPT, NULL);
+    gchar *filename = NULL;
+    if (gtk_dialog_run(GTK_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT)
+        filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+    gtk_widget_destroy(chooser);
+    if (!filename) {
+        g_free(partition_name);
+        return;
+    }
+
+    /* Checking the image re-hashes its chunks; comparing reads the partition and hashes it against the image. */
+    gchar *device_path = partition_name ? g_strdup_printf("/dev/%s", partition_name) : NULL;
+    GtkWidget *dialog = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_QUESTION, GTK_BUTTONS_NONE,
+                                               "Verify %s\n\nCheck the image file against the chunk hashes recorded while imaging, "
+                                               "or compare the selected partition with the image (for example after a restore).",
+                                               filename);
+    gtk_dialog_add_button(GTK_DIALOG(dialog), "_Cancel", GTK_RESPONSE_CANCEL);
+    gtk_dialog_add_button(GTK_DIALOG(dialog), "Check _Image File", 1);
+    if (device_path) {
+        gchar *label = g_strdup_printf("_Compare With %s", device_path);
+        gtk_dialog_add_button(GTK_DIALOG(dialog), label, 2);
+        g_free(label);
+    }
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+
+    if (response == 1 || response == 2) {
+        gchar *threads = g_strdup_printf("%d", g_get_num_processors());
+        gchar *cmd = NULL;
+        if (response == 2) {
+            gchar *self = get_self_executable();
+            gchar *quoted_self = g_shell_quote(self);
+            gchar *quoted_file = g_shell_quote(filename);
+            gchar *quoted_device = g_shell_quote(device_path);
+            cmd = g_strdup_printf(IO_HELPER_SUDO " %s --verify-device %s %s %s", quoted_self, quoted_file, quoted_device, threads);
+            g_free(quoted_device);
+            g_free(quoted_file);
+            g_free(quoted_self);
+            g_free(self);
+        } else {
+            cmd = build_image_helper_command("--verify-image", filename, threads, NULL);
+        }
+        /* Checking only the image file has no device for io.max, so the helper paces itself through IO_PACE_FILE. */
+        gchar *budgeted = build_io_budget_command("Image verification", response == 2 ? device_path : "", cmd);
+        run_command_simple(budgeted, NULL, NULL, NULL, NULL);
+        g_free(budgeted);
+        g_free(cmd);
+        g_free(threads);
+    }
+    g_free(device_path);
+    g_free(filename);
+    g_free(partition_name);
+}
+
+void on_clone_device_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *source_name = NULL, *source_type = NULL;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    gtk_tree_model_get(model, &iter, COL_NAME, &source_name, COL_TYPE, &source_type, -1);
+    gchar *source_path = g_strdup_printf("/dev/%s", source_name);
+    gboolean whole_disk = g_strcmp0(source_type, "disk") == 0;
+
+    /* Targets are devices of the same kind (disk to disk, partition to partition) that can hold the whole source. */
+    guint64 source_size = 0;
+    int source_fd = open(source_path, O_RDONLY);
+    if (source_fd >= 0) {
+        off_t end = lseek(source_fd, 0, SEEK_END);
+        source_size = end > 0 ? (guint64)end : 0;
+        close(source_fd);
+    }
+    gchar *source_disk = whole_disk ? g_strdup(source_name) : get_disk_from_partition(source_name);
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons(whole_disk ? "Clone Disk" : "Clone Partition", NULL, GTK_DIALOG_MODAL,
+                                                    "_Cancel", GTK_RESPONSE_CANCEL, "_Clone", GTK_RESPONSE_ACCEPT, NULL);
+    GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    gtk_container_set_border_width(GTK_CONTAINER(content), 10);
+    gtk_box_set_spacing(GTK_BOX(content), 8);
+    gchar *intro = g_strdup_printf("Copy %s (%" G_GUINT64_FORMAT " MiB) directly onto another %s. Only allocated clusters of\n"
+                                   "ext2/3/4, NTFS, FAT and exFAT are read; other file systems are copied in full.",
+                                   source_path, source_size >> 20, whole_disk ? "disk" : "partition");
+    GtkWidget *label = gtk_label_new(intro);
+    g_free(intro);
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_box_pack_start(GTK_BOX(content), label, FALSE, FALSE, 0);
+    GtkWidget *combo = gtk_combo_box_text_new();
+    gtk_box_pack_start(GTK_BOX(content), combo, FALSE, FALSE, 0);
+    GtkWidget *grow_check = gtk_check_button_new_with_label(whole_disk
+        ? "If the target disk is larger, move the backup GPT header to its end (sgdisk -e)"
+        : "If the target partition is larger, grow the file system to fill it (resize2fs, ntfsresize, xfs_growfs, btrfs)");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(grow_check), TRUE);
+    gtk_box_pack_start(GTK_BOX(content), grow_check, FALSE, FALSE, 0);
+
+    int count = 0;
+    FILE *fp = popen("lsblk -bnlpo NAME,SIZE,TYPE,MOUNTPOINT 2>/dev/null", "r");
+    if (fp) {
+        char line[512];
+        while (fgets(line, sizeof(line), fp)) {
+            char name[256], type[32], mountpoint[256] = "";
+            unsigned long long size = 0;
+            line[strcspn(line, "\n")] = '\0';
+            if (sscanf(line, "%255s %llu %31s %255s", name, &size, type, mountpoint) < 3) continue;
+            if (g_strcmp0(type, whole_disk ? "disk" : "part") != 0 || g_strcmp0(name, source_path) == 0) continue;
+            if (size < source_size) continue;
+            gchar *target_name = g_path_get_basename(name);
+            gchar *target_disk = whole_disk ? g_strdup(target_name) : get_disk_from_partition(target_name);
+            gchar *text = g_strdup_printf("%s (%llu MiB%s%s%s)", name, size >> 20,
+                                          !whole_disk && g_strcmp0(target_disk, source_disk) == 0 ? ", same disk" : "",
+                                          mountpoint[0] ? ", mounted at " : "", mountpoint);
+            gtk_combo_box_text_append(GTK_COMBO_BOX_TEXT(combo), name, text);
+            count++;
+            g_free(text);
+            g_free(target_disk);
+            g_free(target_name);
+        }
+        pclose(fp);
+    }
+    if (count == 0) {
+        gtk_widget_destroy(dialog);
+        GtkWidget *info = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_INFO, GTK_BUTTONS_OK,
+                                                 "There is no other %s with at least %" G_GUINT64_FORMAT " MiB to clone %s onto.",
+                                                 whole_disk ? "disk" : "partition", source_size >> 20, source_path);
+        gtk_dialog_run(GTK_DIALOG(info));
+        gtk_widget_destroy(info);
+        g_free(source_disk);
+        g_free(source_path);
+        g_free(source_name);
+        g_free(source_type);
+        return;
+    }
+    gtk_combo_box_set_active(GTK_COMBO_BOX(combo), 0);
+    gtk_widget_show_all(dialog);
+
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    gchar *target_path = g_strdup(gtk_combo_box_get_active_id(GTK_COMBO_BOX(combo)));
+    gboolean grow = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(grow_check));
+    gtk_widget_destroy(dialog);
+
+    if (response == GTK_RESPONSE_ACCEPT && target_path) {
+        GtkWidget *warn = gtk_message_dialog_new(
+            NULL,
+            GTK_DIALOG_MODAL,
+            GTK_MESSAGE_WARNING,
+            GTK_BUTTONS_OK_CANCEL,
+            "WARNING: This operation will overwrite the target %s!\n\n"
+            "Everything on the target is replaced by a copy of the source, including its UUIDs and labels.\n\n"
+            "Source: %s\nTarget: %s\n\n"
+            "Are you sure you want to continue?",
+            whole_disk ? "disk" : "partition", source_path, target_path
+        );
+        response = gtk_dialog_run(GTK_DIALOG(warn));
+        gtk_widget_destroy(warn);
+    }
+
+    if (response == GTK_RESPONSE_OK) {
+        gchar *quoted_source = g_shell_quote(source_path);
+        gchar *quoted_target = g_shell_quote(target_path);
+
+        /* Reader and writer counts follow the stream count the transfer probe cached for this drive model. */
+        gchar *tuning_key = get_transfer_tuning_key("read", source_path);
+        gchar *cached_bs = NULL;
+        int streams = 2;
+        lookup_transfer_tuning(tuning_key, &cached_bs, &streams);
+        gchar *streams_arg = g_strdup_printf("%d", CLAMP(streams, 1, 8));
+        gchar *clone = build_image_helper_command("--clone", source_path, target_path, streams_arg);
+
+        gchar *grow_cmd = NULL;
+        if (!grow) {
+            grow_cmd = g_strdup("true");
+        } else if (whole_disk) {
+            grow_cmd = g_strdup_printf(
+                "if [ \"$(sudo blockdev --getsize64 %s)\" -gt \"$(sudo blockdev --getsize64 %s)\" ] && "
+                "[ \"$(sudo blkid -o value -s PTTYPE %s)\" = gpt ]; then "
+                "sudo sgdisk -e %s && echo 'Moved the backup GPT header to the end of the target disk.'; fi",
+                quoted_target, quoted_source, quoted_target, quoted_target);
+        } else {
+            /* The clone carries the source file system size; grow it into the rest of the larger target partition. */
+            grow_cmd = g_strdup_printf(
+                "if [ \"$(sudo blockdev --getsize64 %s)\" -gt \"$(sudo blockdev --getsize64 %s)\" ]; then "
+                "fs=$(sudo blkid -o value -s TYPE %s); echo \"Growing the $fs file system to fill the target...\"; "
+                "case \"$fs\" in "
+                "ext2|ext3|ext4) sudo e2fsck -fy %s; sudo resize2fs %s ;; "
+                "ntfs) sudo ntfsresize -f %s ;; "
+                "xfs|btrfs) grow_dir=$(mktemp -d) && "
+                "if [ \"$fs\" = xfs ]; then sudo mount -o nouuid %s \"$grow_dir\" && sudo xfs_growfs \"$grow_dir\"; "
+                "else sudo mount %s \"$grow_dir\" && sudo btrfs filesystem resize max \"$grow_dir\"; fi; "
+                "sudo umount \"$grow_dir\"; rmdir \"$grow_dir\" ;; "
+                "*) echo \"There is no grow tool for $fs; use Resize/Move Partition instead.\" ;; "
+                "esac; fi",
+                quoted_target, quoted_source, quoted_target, quoted_target, quoted_target, quoted_target,
+                quoted_target, quoted_target);
+        }
+
+        gchar *target_name = g_path_get_basename(target_path);
+        gchar *target_disk = whole_disk ? g_strdup(target_name) : get_disk_from_partition(target_name);
+        gchar *disk_path = g_strdup_printf("/dev/%s", target_disk);
+        gchar *quoted_disk = g_shell_quote(disk_path);
+        gchar *command = g_strdup_printf(
+            "for dev in $(lsblk -lnpo NAME %s %s); do sudo umount $dev 2>/dev/null; done; "
+            "%s && %s; "
+            "echo 'Updating partition table...'; sudo partprobe %s || sudo blockdev --rereadpt %s; "
+            "sleep 1; "
+            "echo 'Clone finished. Source and target now share UUIDs and labels; do not mount both at the same time.'",
+            quoted_source, quoted_target, clone, grow_cmd, quoted_disk, quoted_disk
+        );
+        gchar *budgeted = build_io_budget_command(whole_disk ? "Disk clone" : "Partition clone", target_path, command);
+        run_command_in_terminal(tree_view, budgeted);
+
+        g_free(budgeted);
+        g_free(command);
+        g_free(quoted_disk);
+        g_free(disk_path);
+        g_free(target_disk);
+        g_free(target_name);
+        g_free(grow_cmd);
+        g_free(clone);
+        g_free(streams_arg);
+        g_free(cached_bs);
+        g_free(tuning_key);
+        g_free(quoted_target);
+        g_free(quoted_source);
+    }
+
+    g_free(target_path);
+    g_free(source_disk);
+    g_free(source_path);
+    g_free(source_name);
+    g_free(source_type);
+}
+
+void on_fanout_restore_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkWidget *chooser = gtk_file_chooser_dialog_new("Select Image to Restore onto Several Targets", NULL, GTK_FILE_CHOOSER_ACTION_OPEN,
+                                                     "_Cancel", GTK_RESPONSE_CANCEL, "_Open", GTK_RESPONSE_ACCEPT, NULL);
+    gchar *filename = NULL;
+    if (gtk_dialog_run(GTK_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT)
+        filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+    gtk_widget_destroy(chooser);
+    if (!filename) return;
+
+    GtkWidget *dialog = gtk_dialog_new_with_buttons("Fan-out Restore", NULL, GTK_DIALOG_MODAL,
+                                                    "_Cancel", GTK_RESPONSE_CANCEL, "_Restore", GTK_RESPONSE_ACCEPT, NULL);
+    gtk_window_set_default_size(GTK_WINDOW(dialog), 560, 420);
+    GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
+    gtk_container_set_border_width(GTK_CONTAINER(content), 10);
+    gtk_box_set_spacing(GTK_BOX(content), 8);
+    GtkWidget *label = gtk_label_new("The image is read and decoded once and written to every checked target at the same time.\n"
+                                     "A slow target may fall behind by up to 256 MiB, then the others wait for it; a failing target is dropped.");
+    gtk_label_set_xalign(GTK_LABEL(label), 0.0);
+    gtk_box_pack_start(GTK_BOX(content), label, FALSE, FALSE, 0);
+    GtkWidget *scrolled = gtk_scrolled_window_new(NULL, NULL);
+    gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled), GTK_POLICY_NEVER, GTK_POLICY_AUTOMATIC);
+    GtkWidget *list = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
+    gtk_container_add(GTK_CONTAINER(scrolled), list);
+    gtk_box_pack_start(GTK_BOX(content), scrolled, TRUE, TRUE, 0);
+    GtkWidget *zeroed_check = gtk_check_button_new_with_label("Targets are already zeroed (skip zero ranges instead of zeroing them)");
+    gtk_box_pack_start(GTK_BOX(content), zeroed_check, FALSE, FALSE, 0);
+
+    /* Devices with anything mounted on them are left out, so the disk of the running system cannot be checked by accident. */
+    GPtrArray *checks = g_ptr_array_new();
+    GPtrArray *paths = g_ptr_array_new_with_free_func(g_free);
+    FILE *fp = popen("lsblk -bnlpo NAME,SIZE,TYPE,MODEL 2>/dev/null", "r");
+    if (fp) {
+        char line[512];
+        while (fgets(line, sizeof(line), fp)) {
+            char name[256], type[32], rest[256] = "";
+            unsigned long long size = 0;
+            line[strcspn(line, "\n")] = '\0';
+            if (sscanf(line, "%255s %llu %31s %255[^\n]", name, &size, type, rest) < 3) continue;
+            if (g_strcmp0(type, "disk") != 0 && g_strcmp0(type, "part") != 0) continue;
+            gchar *mounted_cmd = g_strdup_printf("lsblk -nlo MOUNTPOINT %s", name);
+            gchar *mounted = NULL;
+            gboolean in_use = g_spawn_command_line_sync(mounted_cmd, &mounted, NULL, NULL, NULL) && mounted && g_strstrip(mounted)[0];
+            g_free(mounted);
+            g_free(mounted_cmd);
+            if (in_use) continue;
+            gchar *text = g_strdup_printf("%s  (%s, %llu MiB%s%s)", name, type, size >> 20, rest[0] ? ", " : "", g_strstrip(rest));
+            GtkWidget *check = gtk_check_button_new_with_label(text);
+            g_free(text);
+            gtk_box_pack_start(GTK_BOX(list), check, FALSE, FALSE, 0);
+            g_ptr_array_add(checks, check);
+            g_ptr_array_add(paths, g_strdup(name));
+        }
+        pclose(fp);
+    }
+    gtk_widget_show_all(dialog);
+
+    gint response = gtk_dialog_run(GTK_DIALOG(dialog));
+    gboolean target_zeroed = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(zeroed_check));
+    GString *targets = g_string_new(NULL);
+    GString *quoted_targets = g_string_new(NULL);
+    guint count = 0;
+    for (guint i = 0; i < checks->len; i++) {
+        if (!gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(g_ptr_array_index(checks, i)))) continue;
+        gchar *quoted = g_shell_quote(g_ptr_array_index(paths, i));
+        g_string_append_printf(targets, "%s\n", (gchar *)g_ptr_array_index(paths, i));
+        g_string_append_printf(quoted_targets, " %s", quoted);
+        g_free(quoted);
+        count++;
+    }
+    gtk_widget_destroy(dialog);
+
+    if (response == GTK_RESPONSE_ACCEPT && count == 0) {
+        GtkWidget *error = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                                                  "No target was checked.");
+        gtk_dialog_run(GTK_DIALOG(error));
+        gtk_widget_destroy(error);
+    } else if (response == GTK_RESPONSE_ACCEPT) {
+        GtkWidget *confirm = gtk_message_dialog_new(
+            NULL,
+            GTK_DIALOG_MODAL,
+            GTK_MESSAGE_WARNING,
+            GTK_BUTTONS_OK_CANCEL,
+            "WARNING: This will overwrite %u devices!\n\n"
+            "Image file: %s\nTargets:\n%s\n"
+            "Are you sure you want to continue?",
+            count, filename, targets->str
+        );
+        response = gtk_dialog_run(GTK_DIALOG(confirm));
+        gtk_widget_destroy(confirm);
+    }
+
+    if (response == GTK_RESPONSE_OK) {
+        gchar *self = get_self_executable();
+        gchar *quoted_self = g_shell_quote(self);
+        gchar *quoted_file = g_shell_quote(filename);
+        gchar *command = g_strdup_printf(
+            "for dev in%s; do for part in $(lsblk -lnpo NAME $dev); do sudo umount $part 2>/dev/null; done; done; "
+            IO_HELPER_SUDO " %s --restore-fanout %s %d%s%s; "
+            "echo 'Updating partition tables...'; "
+            "for dev in%s; do disk=$(lsblk -ndpo PKNAME $dev); sudo partprobe ${disk:-$dev} || sudo blockdev --rereadpt ${disk:-$dev}; done; "
+            "sleep 1",
+            quoted_targets->str, quoted_self, quoted_file, g_get_num_processors(), quoted_targets->str,
+            target_zeroed ? " --target-zeroed" : "", quoted_targets->str
+        );
+        /* io.max gets one line per target disk. */
+        gchar **target_list = g_strsplit(g_strstrip(targets->str), "\n", -1);
+        gchar *device_paths = g_strjoinv(" ", target_list);
+        gchar *budgeted = build_io_budget_command("Fan-out restore", device_paths, command);
+        g_free(device_paths);
+        g_strfreev(target_list);
+        run_command_simple(budgeted, NULL, NULL, NULL, NULL);
+        g_free(budgeted);
+        g_free(command);
+        g_free(quoted_file);
+        g_free(quoted_self);
+        g_free(self);
+    }
+
+    g_string_free(targets, TRUE);
+    g_string_free(quoted_targets, TRUE);
+    g_ptr_array_free(checks, TRUE);
+    g_ptr_array_free(paths, TRUE);
+    g_free(filename);
+}
+
+void on_rescue_image_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *device_name = NULL;
+
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return;
+    gtk_tree_model_get(model, &iter, COL_NAME, &device_name, -1);
+
+    GtkWidget *dialog = gtk_file_chooser_dialog_new(
+        "Save Rescue Image As...",
+        NULL,
+        GTK_FILE_CHOOSER_ACTION_SAVE,
+        "_Cancel", GTK_RESPONSE_CANCEL,
+        "_Save", GTK_RESPONSE_ACCEPT,
+        NULL
+    );
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), "rescue_image.img");
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), TRUE);
+    GtkWidget *retry_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+    gtk_box_pack_start(GTK_BOX(retry_box), gtk_label_new("Retry passes over unreadable sectors:"), FALSE, FALSE, 0);
+    GtkWidget *retry_spin = gtk_spin_button_new_with_range(0, 10, 1);
+    gtk_spin_button_set_value(GTK_SPIN_BUTTON(retry_spin), 1);
+    gtk_box_pack_start(GTK_BOX(retry_box), retry_spin, FALSE, FALSE, 0);
+    gtk_widget_show_all(retry_box);
+    gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(dialog), retry_box);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        char *filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        gint retries = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(retry_spin));
+        gchar *device_path = g_strdup_printf("/dev/%s", device_name);
+        gchar *map_path = g_strdup_printf("%s.rescue-map", filename);
+        gboolean resume = g_file_test(map_path, G_FILE_TEST_EXISTS);
+
+        GtkWidget *confirm = gtk_message_dialog_new(
+            NULL,
+            GTK_DIALOG_MODAL,
+            GTK_MESSAGE_WARNING,
+            GTK_BUTTONS_OK_CANCEL,
+            "The source is read in 1 MiB blocks first, skipping ahead past read errors and slow areas, then the skipped areas are "
+            "trimmed and scraped sector by sector. Every pass updates %s, so the job can be stopped and started again at any time.\n\n"
+            "%s"
+            "Do NOT mount the source during rescue, and save the image on a different, healthy disk.\n\n"
+            "Source: %s\nImage file: %s\n\n"
+            "Are you sure you want to continue?",
+            map_path,
+            resume ? "A rescue map already exists for this image: the job resumes where it stopped.\n\n" : "",
+            device_path, filename
+        );
+        gint response = gtk_dialog_run(GTK_DIALOG(confirm));
+        gtk_widget_destroy(confirm);
+
+        if (response == GTK_RESPONSE_OK) {
+            gchar *quoted_device = g_shell_quote(device_path);
+            gchar *retry_arg = g_strdup_printf("%d", retries);
+            gchar *rescue = build_image_helper_command("--rescue", device_path, filename, retry_arg);
+            /* Whole disks have their partitions unmounted as well. */
+            gchar *command = g_strdup_printf(
+                "for part in $(lsblk -lnpo NAME %s); do sudo umount $part 2>/dev/null; done; %s",
+                quoted_device, rescue
+            );
+            gchar *budgeted = build_io_budget_command("Rescue image", device_path, command);
+            run_command_in_terminal(tree_view, budgeted);
+            g_free(budgeted);
+            g_free(command);
+            g_free(rescue);
+            g_free(retry_arg);
+            g_free(quoted_device);
+        }
+
+        g_free(map_path);
+        g_free(device_path);
+        g_free(filename);
+    }
+    gtk_widget_destroy(dialog);
+    g_free(device_name);
+}
+
+void on_rescue_map_activate(GtkWidget *menuitem, gpointer user_data) {
+    GtkWidget *chooser = gtk_file_chooser_dialog_new("Select Rescue Image or Rescue Map", NULL, GTK_FILE_CHOOSER_ACTION_OPEN,
+                                                     "_Cancel", GTK_RESPONSE_CANCEL, "_Open", GTK_RESPONSE_ACCEPT, NULL);
+    gchar *filename = NULL;
+    if (gtk_dialog_run(GTK_DIALOG(chooser)) == GTK_RESPONSE_ACCEPT)
+        filename = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(chooser));
+    gtk_widget_destroy(chooser);
+    if (!filename) return;
+
+    gchar *map_path = g_str_has_suffix(filename, ".rescue-map") ? g_strdup(filename) : g_strdup_printf("%s.rescue-map", filename);
+    if (!g_file_test(map_path, G_FILE_TEST_EXISTS)) {
+        GtkWidget *error = gtk_message_dialog_new(NULL, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_OK,
+                                                  "No rescue map found: %s", map_path);
+        gtk_dialog_run(GTK_DIALOG(error));
+        gtk_widget_destroy(error);
+    } else {
+        /* The map is rewritten every few seconds while a rescue runs, so watch(1) shows its progress live. */
+        gchar *self = get_self_executable();
+        gchar *quoted_self = g_shell_quote(self);
+        gchar *quoted_map = g_shell_quote(map_path);
+        gchar *command = g_strdup_printf("watch -n 2 -t -x %s --rescue-map %s", quoted_self, quoted_map);
+        run_command_simple(command, NULL, NULL, NULL, NULL);
+        g_free(command);
+        g_free(quoted_map);
+        g_free(quoted_self);
+        g_free(self);
+    }
+    g_free(map_path);
+    g_free(filename);
+}
+
 void on_delete_partition_table_activate(GtkWidget *menuitem, gpointer user_data) {
     GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
     GtkTreeSelection *selection = gtk_tree_view_get_selection(tree_view);
@@ -4457,12 +12699,22 @@ void on_dd_erase_activate(GtkWidget *menuitem, gpointer user_data) {
 
         if (response == GTK_RESPONSE_OK) {
             gchar *quoted_device = g_shell_quote(device_path);
+            gchar *tuning_key = get_transfer_tuning_key("erase", device_path);
+            gchar *tuning = build_transfer_tuning_command(tuning_key, "/dev/urandom", device_path, TRUE, FALSE, TRUE, TRUE);
+            gchar *size_expr = g_strdup_printf("$(sudo blockdev --getsize64 %s)", quoted_device);
+            gchar *erase = build_tuned_dd_command("/dev/urandom", device_path, size_expr, TRUE, FALSE, TRUE, FALSE);
             gchar *command = g_strdup_printf(
-                "dd if=/dev/urandom of=%s bs=1M status=progress && sudo udevadm settle && echo 'Disk erased successfully'",
-                quoted_device
+                "%s; %s && sudo udevadm settle && echo 'Disk erased successfully'",
+                tuning, erase
             );
-            run_command_in_terminal(tree_view, command);
+            gchar *budgeted = build_io_budget_command("Erase", device_path, command);
+            run_command_in_terminal(tree_view, budgeted);
+            g_free(budgeted);
             g_free(command);
+            g_free(erase);
+            g_free(size_expr);
+            g_free(tuning);
+            g_free(tuning_key);
             g_free(quoted_device);
         }
 
@@ -4499,17 +12751,31 @@ void on_dd_multiple_erase_activate(GtkWidget *menuitem, gpointer user_data) {
 
         if (response == GTK_RESPONSE_OK) {
             gchar *quoted_device = g_shell_quote(device_path);
+            gchar *tuning_key = get_transfer_tuning_key("erase", device_path);
+            gchar *tuning = build_transfer_tuning_command(tuning_key, "/dev/urandom", device_path, TRUE, FALSE, TRUE, TRUE);
+            gchar *size_expr = g_strdup_printf("$(sudo blockdev --getsize64 %s)", quoted_device);
+            const gchar *sources[] = {"/dev/urandom", "/dev/zero", "/dev/zero", "/dev/full"};
+            gchar *passes[4];
+            for (int i = 0; i < 4; i++)
+                passes[i] = build_tuned_dd_command(sources[i], device_path, size_expr, TRUE, FALSE, TRUE, FALSE);
             gchar *command = g_strdup_printf(
-                "sudo dd if=/dev/urandom of=%s bs=1M status=progress && "
-                "sudo dd if=/dev/zero of=%s bs=1M status=progress && "
-                "sudo dd if=/dev/zero of=%s bs=1M status=progress && "
-                "sudo dd if=/dev/full of=%s bs=1M status=progress && "
+                "%s; "
+                "echo 'Pass 1/4: random data' && %s && "
+                "echo 'Pass 2/4: zeros' && %s && "
+                "echo 'Pass 3/4: zeros' && %s && "
+                "echo 'Pass 4/4: zeros from /dev/full' && %s && "
                 "sudo udevadm settle && "
                 "echo 'Disk erased successfully'",
-                quoted_device, quoted_device, quoted_device, quoted_device
+                tuning, passes[0], passes[1], passes[2], passes[3]
             );
-            run_command_in_terminal(tree_view, command);
+            gchar *budgeted = build_io_budget_command("Multiple pass erase", device_path, command);
+            run_command_in_terminal(tree_view, budgeted);
+            g_free(budgeted);
             g_free(command);
+            for (int i = 0; i < 4; i++) g_free(passes[i]);
+            g_free(size_expr);
+            g_free(tuning);
+            g_free(tuning_key);
             g_free(quoted_device);
         }
 
@@ -5095,6 +13361,30 @@ void on_row_activated(GtkTreeView *tree_view, GtkTreePath *path, GtkTreeViewColu
     g_signal_connect(raw_write_item, "activate", G_CALLBACK(on_disk_raw_write_benchmark_activate), tree_view);
     gtk_menu_shell_append(GTK_MENU_SHELL(info_menu), raw_write_item);
 
+    GtkWidget *mixed_workload_item = gtk_menu_item_new_with_label("Mixed Read/Write Workload Test on Mounted Partition (fio)");
+    g_signal_connect(mixed_workload_item, "activate", G_CALLBACK(on_mixed_workload_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(info_menu), mixed_workload_item);
+
+    GtkWidget *trace_replay_item = gtk_menu_item_new_with_label("Replay I/O Trace on File, Image or Scratch File (fio)");
+    g_signal_connect(trace_replay_item, "activate", G_CALLBACK(on_trace_replay_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(info_menu), trace_replay_item);
+
+    GtkWidget *fs_metadata_item = gtk_menu_item_new_with_label("Filesystem Metadata Benchmark on Mounted Partition (fio)");
+    g_signal_connect(fs_metadata_item, "activate", G_CALLBACK(on_fs_metadata_benchmark_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(info_menu), fs_metadata_item);
+
+    GtkWidget *commit_latency_item = gtk_menu_item_new_with_label("Commit Latency Benchmark, fsync/fdatasync (fio)");
+    g_signal_connect(commit_latency_item, "activate", G_CALLBACK(on_commit_latency_benchmark_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(info_menu), commit_latency_item);
+
+    GtkWidget *read_path_item = gtk_menu_item_new_with_label("Read Path Comparison: buffered, O_DIRECT, mmap, io_uring (fio)");
+    g_signal_connect(read_path_item, "activate", G_CALLBACK(on_read_path_comparison_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(info_menu), read_path_item);
+
+    GtkWidget *queue_tuning_item = gtk_menu_item_new_with_label("Block Queue Tuning: scheduler, read_ahead_kb, nr_requests, rq_affinity (sysfs, fio)");
+    g_signal_connect(queue_tuning_item, "activate", G_CALLBACK(on_queue_tuning_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(info_menu), queue_tuning_item);
+
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), info_root);
 
     GtkWidget *scan_menu = gtk_menu_new();
@@ -5151,6 +13441,10 @@ void on_row_activated(GtkTreeView *tree_view, GtkTreePath *path, GtkTreeViewColu
     g_signal_connect(umount_f_item, "activate", G_CALLBACK(on_umount_f_activate), tree_view);
     gtk_menu_shell_append(GTK_MENU_SHELL(mount_menu), umount_f_item);
 
+    GtkWidget *mount_compare_item = gtk_menu_item_new_with_label("Compare Mount Option Profiles on Scratch Partition (mount, fio)");
+    g_signal_connect(mount_compare_item, "activate", G_CALLBACK(on_mount_profile_compare_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(mount_menu), mount_compare_item);
+
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), mount_root);
 
     GtkWidget *fs_menu = gtk_menu_new();
@@ -5189,6 +13483,10 @@ void on_row_activated(GtkTreeView *tree_view, GtkTreePath *path, GtkTreeViewColu
     g_signal_connect(toggle_boot_flag_item, "activate", G_CALLBACK(on_toggle_boot_flag_activate), tree_view);
     gtk_menu_shell_append(GTK_MENU_SHELL(fs_menu), toggle_boot_flag_item);
 
+    GtkWidget *fstrim_item = gtk_menu_item_new_with_label("TRIM Free Space on Mounted Partition, Paced or Scheduled (fstrim)");
+    g_signal_connect(fstrim_item, "activate", G_CALLBACK(on_fstrim_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(fs_menu), fstrim_item);
+
     GtkWidget *dd_copy_partition_item = gtk_menu_item_new_with_label("Create Partition Image (dd)");
     g_signal_connect(dd_copy_partition_item, "activate", G_CALLBACK(on_dd_copy_partition_activate), tree_view);
     gtk_menu_shell_append(GTK_MENU_SHELL(fs_menu), dd_copy_partition_item);
@@ -5197,6 +13495,30 @@ void on_row_activated(GtkTreeView *tree_view, GtkTreePath *path, GtkTreeViewColu
     g_signal_connect(dd_restore_partition_item, "activate", G_CALLBACK(on_dd_restore_partition_activate), tree_view);
     gtk_menu_shell_append(GTK_MENU_SHELL(fs_menu), dd_restore_partition_item);
 
+    GtkWidget *fanout_restore_item = gtk_menu_item_new_with_label("Restore Image onto Several Devices at Once (fan-out) => DANGEROUS! Think carefully before proceeding!");
+    g_signal_connect(fanout_restore_item, "activate", G_CALLBACK(on_fanout_restore_activate), NULL);
+    gtk_menu_shell_append(GTK_MENU_SHELL(fs_menu), fanout_restore_item);
+
+    GtkWidget *resume_image_job_item = gtk_menu_item_new_with_label("Resume Interrupted Image or Restore Job");
+    g_signal_connect(resume_image_job_item, "activate", G_CALLBACK(on_resume_image_job_activate), NULL);
+    gtk_menu_shell_append(GTK_MENU_SHELL(fs_menu), resume_image_job_item);
+
+    GtkWidget *verify_image_item = gtk_menu_item_new_with_label("Verify Partition Image (check image or compare with partition)");
+    g_signal_connect(verify_image_item, "activate", G_CALLBACK(on_verify_image_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(fs_menu), verify_image_item);
+
+    GtkWidget *clone_device_item = gtk_menu_item_new_with_label("Clone Partition or Disk to Another Device (used blocks) => DANGEROUS! Think carefully before proceeding!");
+    g_signal_connect(clone_device_item, "activate", G_CALLBACK(on_clone_device_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(fs_menu), clone_device_item);
+
+    GtkWidget *rescue_image_item = gtk_menu_item_new_with_label("Rescue Image of Failing Partition or Disk (multi-pass, skips bad sectors)");
+    g_signal_connect(rescue_image_item, "activate", G_CALLBACK(on_rescue_image_activate), tree_view);
+    gtk_menu_shell_append(GTK_MENU_SHELL(fs_menu), rescue_image_item);
+
+    GtkWidget *rescue_map_item = gtk_menu_item_new_with_label("Show Rescue Map of an Image (live)");
+    g_signal_connect(rescue_map_item, "activate", G_CALLBACK(on_rescue_map_activate), NULL);
+    gtk_menu_shell_append(GTK_MENU_SHELL(fs_menu), rescue_map_item);
+
     gtk_menu_shell_append(GTK_MENU_SHELL(menu), fs_root);
 
     GtkWidget *delete_menu = gtk_menu_new();
@@ -5554,6 +13876,50 @@ int main(int argc, char *argv[]) {
     GtkWidget *terms_item;
     GtkWidget *license_item;
 
+    /* Headless mode for cron or a systemd timer: run the trims that are due and exit without opening a window. */
+    if (argc > 1 && strcmp(argv[1], "--run-scheduled-trims") == 0)
+        return run_due_trims(TRUE);
+
+    /* Imaging helpers; the GUI runs these through sudo in a terminal. --read-image prints a byte range of a .daimg image,
+     * --image-diff takes the base .daimg between the source and the new image, --clone copies a partition or disk onto another device.
+     * --restore-fanout IMAGE THREADS TARGET... restores one image onto several targets at once.
+     * --rescue SOURCE IMAGE RETRIES images a failing device pass by pass, --rescue-map IMAGE prints its recovery map.
+     * Restore modes accept a trailing --target-zeroed to skip zero ranges instead of zeroing them on the target. */
+    gboolean target_zeroed = argc > 2 && strcmp(argv[argc - 1], "--target-zeroed") == 0;
+    int helper_argc = target_zeroed ? argc - 1 : argc;
+    if (argc == 4 && strcmp(argv[1], "--image-used") == 0)
+        return image_used_blocks(argv[2], argv[3], FALSE);
+    if (helper_argc == 4 && strcmp(argv[1], "--restore-used") == 0)
+        return restore_used_blocks(argv[2], argv[3], target_zeroed, FALSE);
+    if (helper_argc == 4 && strcmp(argv[1], "--restore-raw") == 0)
+        return restore_raw_image(argv[2], argv[3], target_zeroed, FALSE);
+    if (argc == 6 && strcmp(argv[1], "--image-compressed") == 0)
+        return image_compressed(argv[2], argv[3], atoi(argv[4]), (guint)atoi(argv[5]), NULL, FALSE);
+    if (argc == 7 && strcmp(argv[1], "--image-diff") == 0)
+        return image_compressed(argv[2], argv[4], atoi(argv[5]), (guint)atoi(argv[6]), argv[3], FALSE);
+    if (helper_argc == 5 && strcmp(argv[1], "--restore-image") == 0)
+        return restore_compressed(argv[2], argv[3], (guint)atoi(argv[4]), target_zeroed, FALSE);
+    if (argc == 6 && strcmp(argv[1], "--image-repo") == 0)
+        return image_to_repository(argv[2], argv[3], atoi(argv[4]), (guint)atoi(argv[5]));
+    if (helper_argc == 5 && strcmp(argv[1], "--restore-repo") == 0)
+        return restore_from_repository(argv[2], argv[3], (guint)atoi(argv[4]), target_zeroed);
+    if (argc == 4 && strcmp(argv[1], "--verify-image") == 0)
+        return verify_image(argv[2], NULL, (guint)atoi(argv[3]));
+    if (argc == 5 && strcmp(argv[1], "--verify-device") == 0)
+        return verify_image(argv[2], argv[3], (guint)atoi(argv[4]));
+    if (argc == 3 && strcmp(argv[1], "--resume-job") == 0)
+        return resume_image_job(argv[2], (guint)g_get_num_processors());
+    if (helper_argc >= 5 && strcmp(argv[1], "--restore-fanout") == 0)
+        return restore_fanout(argv[2], argv + 4, (guint)(helper_argc - 4), (guint)atoi(argv[3]), target_zeroed);
+    if (argc == 5 && strcmp(argv[1], "--clone") == 0)
+        return clone_device(argv[2], argv[3], (guint)atoi(argv[4]));
+    if (argc == 5 && strcmp(argv[1], "--rescue") == 0)
+        return rescue_image(argv[2], argv[3], (guint)atoi(argv[4]));
+    if (argc == 3 && strcmp(argv[1], "--rescue-map") == 0)
+        return print_rescue_map(argv[2]);
+    if (argc == 5 && strcmp(argv[1], "--read-image") == 0)
+        return read_image_to_stdout(argv[2], g_ascii_strtoull(argv[3], NULL, 10), g_ascii_strtoull(argv[4], NULL, 10));
+
     gtk_init(&argc, &argv);
 
     GtkCssProvider *provider = gtk_css_provider_new();
@@ -5591,6 +13957,14 @@ int main(int argc, char *argv[]) {
     g_signal_connect(refresh_item, "activate", G_CALLBACK(on_refresh_button_clicked), NULL);
     gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), refresh_item);
 
+    GtkWidget *benchmark_results_item = gtk_menu_item_new_with_label("Benchmark Results and Comparison");
+    g_signal_connect(benchmark_results_item, "activate", G_CALLBACK(on_benchmark_results_activate), NULL);
+    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), benchmark_results_item);
+
+    GtkWidget *io_budget_item = gtk_menu_item_new_with_label("Bulk Job I/O Limits");
+    g_signal_connect(io_budget_item, "activate", G_CALLBACK(on_io_budget_activate), NULL);
+    gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), io_budget_item);
+
     exit_item = gtk_menu_item_new_with_label("Exit");
     g_signal_connect(exit_item, "activate", G_CALLBACK(on_exit_activate), NULL);
     gtk_menu_shell_append(GTK_MENU_SHELL(file_menu), exit_item);
@@ -5696,6 +14070,8 @@ int main(int argc, char *argv[]) {
     show_disk_list(NULL, tree_view);
 
     gtk_widget_show_all(window);
+    g_timeout_add_seconds(600, on_trim_schedule_timer, NULL);
+
     gtk_main();
 
     return 0;